@@ -0,0 +1,299 @@
+package main
+
+import (
+	"bufio"
+	"errors"
+	"fmt"
+	"net/url"
+	"os"
+	"path/filepath"
+	"strings"
+	"sync"
+	"time"
+)
+
+const backup_dir string = "backup"
+const backup_header string = "touchlog-backup 1"
+
+// Backup uploads a journal to an S3-compatible object store given as s3://bucket/prefix. Objects
+// are named after the sha256 of their content, and a local manifest remembers which ones the
+// target already holds, so a backup only sends days whose content has never been sent before.
+// The packs holding archived days are sent the same way. Each backup ends with a snapshot
+// manifest mapping logfile and pack names to objects.
+//
+// The endpoint and credentials come from -endpoint or TOUCHLOG_S3_ENDPOINT, AWS_ACCESS_KEY_ID,
+// AWS_SECRET_ACCESS_KEY and AWS_REGION.
+//
+// If the backup is successfully uploaded, Backup returns true.
+// Otherwise, the error is logged and Backup returns false.
+func Backup(args []string) bool {
+	fs, verbosePtr := New_FlagSet("backup")
+	outDirPtr := fs.String("outdir", "", "back up the journal in the inputted directory")
+	endpointPtr := fs.String("endpoint", os.Getenv("TOUCHLOG_S3_ENDPOINT"), "url of the object store")
+	jobsPtr := fs.Int("jobs", 8, "number of requests to keep in flight")
+	partSizePtr := fs.Int("part-size", 8, "size in MiB above which objects are uploaded in parts")
+	fs.Parse(args)
+
+	Set_Verbosity(*verbosePtr)
+
+	target, err := url.Parse(fs.Arg(0))
+	if fs.NArg() != 1 || err != nil || target.Scheme != "s3" || target.Host == "" {
+		errlog.Println("usage: touchlog backup [-verbose] [-outdir dir] [-endpoint url] [-jobs n] [-part-size MiB] s3://bucket/prefix")
+
+		return false
+	}
+
+	if *endpointPtr == "" {
+		errlog.Println("no object store endpoint, set -endpoint or TOUCHLOG_S3_ENDPOINT")
+
+		return false
+	}
+
+	if *jobsPtr < 1 || *partSizePtr < 5 {
+		errlog.Println("-jobs must be at least 1 and -part-size at least 5 MiB")
+
+		return false
+	}
+
+	if !Resolve_Outdir(outDirPtr) {
+		return false
+	}
+
+	region := os.Getenv("AWS_REGION")
+	if region == "" {
+		region = "us-east-1"
+	}
+
+	client := New_S3_Client(*endpointPtr, region, os.Getenv("AWS_ACCESS_KEY_ID"),
+		os.Getenv("AWS_SECRET_ACCESS_KEY"), target.Host, *jobsPtr)
+	prefix := strings.Trim(target.Path, "/")
+	if prefix != "" {
+		prefix += "/"
+	}
+
+	debug.Printf("Backup(%s -> %s/%s/%s)\n", *outDirPtr, client.Endpoint, client.Bucket, prefix)
+
+	idx, ok := Load_Index(*outDirPtr)
+	if !ok {
+		return false
+	}
+
+	if _, ok := Refresh_Index(idx); !ok || !Save_Index(idx) {
+		return false
+	}
+
+	manifestPath := State_Path(*outDirPtr, backup_dir, url.PathEscape(fs.Arg(0)))
+
+	sent, ok := Load_Backup_Manifest(manifestPath)
+	if !ok {
+		return false
+	}
+
+	items := make([]backup_item, 0, len(idx.Entries))
+	for _, name := range idx.Names() {
+		e := idx.Entries[name]
+		items = append(items, backup_item{name: name, hash: e.Hash, size: e.Size})
+	}
+
+	packs, ok := backup_packs(*outDirPtr)
+	if !ok {
+		return false
+	}
+
+	items = append(items, packs...)
+
+	var mu sync.Mutex
+	var errs []error
+	var wg sync.WaitGroup
+
+	// pending bounds the objects read into memory ahead of the uploads
+	pending := make(chan struct{}, 2*cap(client.slots))
+	uploaded, skipped := 0, 0
+	partSize := *partSizePtr << 20
+
+	queued := make(map[string]bool)
+	for _, item := range items {
+		hash := item.hash
+		if sent[hash] || queued[hash] {
+			continue
+		}
+
+		queued[hash] = true
+		pending <- struct{}{}
+		wg.Add(1)
+
+		go func(item backup_item, hash string) {
+			defer func() {
+				<-pending
+				wg.Done()
+			}()
+
+			name := item.name
+			key := prefix + Backup_Object_Key(hash)
+
+			exists, err := client.Exists(key)
+			if err == nil && !exists {
+				var data []byte
+
+				data, err = item.read(*outDirPtr)
+				if err == nil && Hash_Content(data) != hash {
+					err = errors.New(name + " changed during the backup")
+				}
+				if err == nil {
+					err = client.Put(key, data, partSize)
+				}
+			}
+
+			mu.Lock()
+			defer mu.Unlock()
+
+			switch {
+			case err != nil:
+				errs = append(errs, fmt.Errorf("%s: %w", name, err))
+			case exists:
+				skipped++
+				sent[hash] = true
+			default:
+				debug.Printf("uploaded %s as %s\n", name, key)
+
+				uploaded++
+				sent[hash] = true
+			}
+		}(item, hash)
+	}
+
+	wg.Wait()
+
+	// what did go up is remembered even when some uploads failed
+	if !Save_Backup_Manifest(manifestPath, sent) {
+		return false
+	}
+
+	if len(errs) > 0 {
+		for _, err := range errs {
+			errlog.Print(err)
+		}
+
+		return false
+	}
+
+	var snapshot strings.Builder
+	for _, item := range items {
+		fmt.Fprintf(&snapshot, "%s\t%s\t%d\n", item.name, Backup_Object_Key(item.hash), item.size)
+	}
+
+	snapshotKey := prefix + "manifests/" + time.Now().UTC().Format("20060102T150405Z")
+
+	err = client.Put(snapshotKey, []byte(snapshot.String()), partSize)
+	if err != nil {
+		errlog.Print(err)
+
+		return false
+	}
+
+	print.Printf("backed up %d days and %d packs to %s: %d uploaded, %d already stored, %d unchanged\n",
+		len(idx.Entries), len(packs), fs.Arg(0), uploaded, skipped, len(items)-len(queued))
+
+	return true
+}
+
+// backup_item is a logfile or, when path is set, a pack to back up. Logfiles are named as in the
+// journal and packs by their path inside it.
+type backup_item struct {
+	name string
+	path string
+	hash string
+	size int64
+}
+
+// read returns the content of the item.
+func (item backup_item) read(dir string) ([]byte, error) {
+	if item.path != "" {
+		return os.ReadFile(item.path)
+	}
+
+	return Read_Log(dir, item.name)
+}
+
+// backup_packs returns the packs of a journal with the hashes of their content.
+//
+// If a pack cannot be read, the error is logged and backup_packs returns nil, false.
+func backup_packs(dir string) ([]backup_item, bool) {
+	paths, ok := Pack_Paths(dir)
+	if !ok {
+		return nil, false
+	}
+
+	items := make([]backup_item, 0, len(paths))
+
+	for _, path := range paths {
+		data, err := os.ReadFile(path)
+		if err != nil {
+			errlog.Print(err)
+
+			return nil, false
+		}
+
+		name := filepath.ToSlash(filepath.Join(state_dir, packs_dir, filepath.Base(path)))
+		items = append(items, backup_item{name: name, path: path, hash: Hash_Content(data), size: int64(len(data))})
+	}
+
+	return items, true
+}
+
+// Backup_Object_Key returns the content-addressed name of an object relative to the backup prefix.
+func Backup_Object_Key(hash string) string {
+	return "objects/" + hash[:2] + "/" + hash
+}
+
+// Load_Backup_Manifest reads the set of content hashes a backup target is known to hold.
+//
+// If the manifest cannot be read, the error is logged and Load_Backup_Manifest returns nil, false.
+func Load_Backup_Manifest(path string) (map[string]bool, bool) {
+	sent := make(map[string]bool)
+
+	f, err := os.Open(path)
+	if os.IsNotExist(err) {
+		return sent, true
+	}
+	if err != nil {
+		errlog.Print(err)
+
+		return nil, false
+	}
+
+	defer f.Close()
+
+	scanner := bufio.NewScanner(f)
+	if !scanner.Scan() || scanner.Text() != backup_header {
+		return sent, true
+	}
+
+	for scanner.Scan() {
+		sent[scanner.Text()] = true
+	}
+
+	err = scanner.Err()
+	if err != nil {
+		errlog.Print(err)
+
+		return nil, false
+	}
+
+	return sent, true
+}
+
+// Save_Backup_Manifest atomically replaces the manifest of a backup target.
+func Save_Backup_Manifest(path string, sent map[string]bool) bool {
+	var sb strings.Builder
+
+	sb.WriteString(backup_header)
+	sb.WriteByte('\n')
+
+	for hash := range sent {
+		sb.WriteString(hash)
+		sb.WriteByte('\n')
+	}
+
+	return Write_Atomic(path, []byte(sb.String()))
+}
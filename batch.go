@@ -0,0 +1,459 @@
+package main
+
+import (
+	"bufio"
+	"bytes"
+	"encoding/json"
+	"hash/fnv"
+	"os"
+	"runtime"
+	"strings"
+	"sync"
+	"time"
+)
+
+// Batch_Command is one command of a batch, read from a line of words or from a JSON object with
+// the same fields. ID is echoed back in the result so scripts can match them up.
+type Batch_Command struct {
+	ID      json.RawMessage `json:"id,omitempty"`
+	Op      string          `json:"op"`
+	Date    string          `json:"date,omitempty"`
+	Section string          `json:"section,omitempty"`
+	Text    string          `json:"text,omitempty"`
+	From    string          `json:"from,omitempty"`
+	Until   string          `json:"until,omitempty"`
+	seq     int
+}
+
+// Batch_Result is the outcome of a batch command, written as a line of JSON.
+type Batch_Result struct {
+	Seq     int             `json:"seq"`
+	ID      json.RawMessage `json:"id,omitempty"`
+	Op      string          `json:"op"`
+	Date    string          `json:"date,omitempty"`
+	OK      bool            `json:"ok"`
+	Result  string          `json:"result,omitempty"`
+	Content *string         `json:"content,omitempty"`
+	Dates   []string        `json:"dates,omitempty"`
+	Error   string          `json:"error,omitempty"`
+}
+
+// batch_failed is the error of a command whose failure was logged.
+const batch_failed string = "failed, see standard error"
+
+// batch_runner holds what the commands of a batch share. Rendering skeletons runs plugins, which
+// are not safe to call concurrently, and the quota tracks the size of the whole journal, so both
+// are serialized; everything else about a day runs in the lane of its date.
+type batch_runner struct {
+	dir    string
+	render sync.Mutex
+	quota  sync.Mutex
+}
+
+// Batch runs the commands read from standard input in one process, one per line, given either as
+// words or as a JSON object:
+//
+//	create mmddyyyy                 {"op":"create","date":"mmddyyyy"}
+//	append mmddyyyy section text    {"op":"append","date":"mmddyyyy","section":"events","text":"..."}
+//	read mmddyyyy                   {"op":"read","date":"mmddyyyy"}
+//	gaps mmddyyyy [mmddyyyy]        {"op":"gaps","from":"mmddyyyy","until":"mmddyyyy"}
+//
+// Commands run on a pool of lanes, each date always in the same lane so the commands of a day keep
+// their order, while reading the next commands goes on. gaps waits for every command before it.
+// A result per command is written to standard output as a line of JSON, in the order of the
+// commands, as soon as it and those before it are done. Errors are logged to standard error.
+//
+// If every command succeeds, Batch returns true.
+// Otherwise, the errors are logged and Batch returns false.
+func Batch(args []string) bool {
+	fs, verbosePtr := New_FlagSet("batch")
+	outDirPtr := fs.String("outdir", "", "run the commands against the journal in the inputted directory")
+	jobsPtr := fs.Int("jobs", runtime.NumCPU(), "number of commands run at once")
+	fs.Parse(args)
+
+	Set_Verbosity(*verbosePtr)
+
+	if fs.NArg() != 0 || *jobsPtr < 1 {
+		errlog.Println("usage: touchlog batch [-verbose] [-outdir dir] [-jobs n] < commands")
+
+		return false
+	}
+
+	if !Resolve_Outdir(outDirPtr) {
+		return false
+	}
+
+	Stderr_Output()
+
+	return Create_Logs(*outDirPtr, func() bool {
+		return Run_Batch(&batch_runner{dir: *outDirPtr}, os.Stdin, *jobsPtr)
+	})
+}
+
+// Run_Batch reads commands from input and runs them on jobs lanes, writing their results in order.
+func Run_Batch(r *batch_runner, input *os.File, jobs int) bool {
+	results := make(chan Batch_Result, jobs)
+	window := make(chan struct{}, 4*jobs)
+	done := make(chan bool)
+
+	go func() {
+		done <- write_results(results, window)
+	}()
+
+	lanes := make([]chan Batch_Command, jobs)
+
+	var inflight sync.WaitGroup
+
+	for i := range lanes {
+		lanes[i] = make(chan Batch_Command, 16)
+
+		go func(lane chan Batch_Command) {
+			for c := range lane {
+				results <- r.run(c)
+				inflight.Done()
+			}
+		}(lanes[i])
+	}
+
+	scanner := bufio.NewScanner(input)
+	scanner.Buffer(nil, 1<<20)
+
+	seq := 0
+	for scanner.Scan() {
+		line := strings.TrimSpace(scanner.Text())
+		if line == "" || strings.HasPrefix(line, "#") {
+			continue
+		}
+
+		c, err := Parse_Batch_Command(line)
+		c.seq = seq
+		seq++
+
+		window <- struct{}{}
+
+		switch {
+		case err != "":
+			results <- Batch_Result{Seq: c.seq, ID: c.ID, Op: c.Op, Error: err}
+		case c.Op == "gaps":
+			inflight.Wait()
+			results <- r.run(c)
+		default:
+			h := fnv.New32a()
+			h.Write([]byte(c.Date))
+
+			inflight.Add(1)
+			lanes[int(h.Sum32()%uint32(jobs))] <- c
+		}
+	}
+
+	for _, lane := range lanes {
+		close(lane)
+	}
+
+	inflight.Wait()
+	close(results)
+
+	ok := <-done
+
+	if err := scanner.Err(); err != nil {
+		errlog.Print(err)
+
+		return false
+	}
+
+	return ok
+}
+
+// write_results writes results in the order of their commands, holding back those that finished
+// early, and reports whether every command succeeded.
+func write_results(results chan Batch_Result, window chan struct{}) bool {
+	out := bufio.NewWriter(os.Stdout)
+	defer out.Flush()
+
+	enc := json.NewEncoder(out)
+	enc.SetEscapeHTML(false)
+
+	held := make(map[int]Batch_Result)
+	next, ok := 0, true
+
+	for result := range results {
+		held[result.Seq] = result
+
+		for {
+			r, found := held[next]
+			if !found {
+				break
+			}
+
+			delete(held, next)
+			enc.Encode(r)
+			ok = ok && r.OK
+			next++
+			<-window
+		}
+
+		if len(results) == 0 {
+			out.Flush()
+		}
+	}
+
+	return ok
+}
+
+// Parse_Batch_Command reads a command from a line of words or a JSON object, and returns what is
+// wrong with it, if anything.
+func Parse_Batch_Command(line string) (Batch_Command, string) {
+	var c Batch_Command
+
+	if strings.HasPrefix(line, "{") {
+		dec := json.NewDecoder(strings.NewReader(line))
+		dec.DisallowUnknownFields()
+
+		if err := dec.Decode(&c); err != nil {
+			return c, "invalid command: " + err.Error()
+		}
+	} else {
+		words := strings.Fields(line)
+		c.Op = words[0]
+
+		switch {
+		case c.Op == "gaps" && (len(words) == 2 || len(words) == 3):
+			c.From = words[1]
+			if len(words) == 3 {
+				c.Until = words[2]
+			}
+		case c.Op == "append" && len(words) >= 4:
+			// sections are written with underscores for spaces, as in filter expressions
+			c.Date, c.Section = words[1], strings.ReplaceAll(words[2], "_", " ")
+			c.Text = strings.Join(words[3:], " ")
+		case (c.Op == "create" || c.Op == "read") && len(words) == 2:
+			c.Date = words[1]
+		default:
+			return c, "usage: create date | append date section text | read date | gaps from [until]"
+		}
+	}
+
+	switch c.Op {
+	case "create", "read", "gaps":
+	case "append":
+		if c.Section == "" || strings.ContainsAny(c.Text, "\n") {
+			return c, "append needs a section and a single line of text"
+		}
+	default:
+		return c, "unknown command " + c.Op
+	}
+
+	return c, ""
+}
+
+// run runs a command other than gaps against the journal, or gaps once every command before it
+// is done.
+func (r *batch_runner) run(c Batch_Command) Batch_Result {
+	result := Batch_Result{Seq: c.seq, ID: c.ID, Op: c.Op}
+
+	if c.Op == "gaps" {
+		dates, ok := r.gaps(c.From, c.Until)
+		result.OK, result.Dates = ok, dates
+		if !ok {
+			result.Error = batch_failed
+		}
+
+		return result
+	}
+
+	month, day, year, ok := Handle_Date(&c.Date)
+	if !ok {
+		result.Error = "invalid date " + c.Date
+
+		return result
+	}
+
+	name := Log_Name(month, day, year)
+	result.Date = strings.TrimSuffix(name, ".log")
+
+	date, ok := To_Time(month, day, year)
+	if !ok {
+		result.Error = batch_failed
+
+		return result
+	}
+
+	data, err := Read_Log(r.dir, name)
+	exists := err == nil
+	if err != nil && !os.IsNotExist(err) {
+		errlog.Print(err)
+		result.Error = batch_failed
+
+		return result
+	}
+
+	done := "appended"
+
+	switch c.Op {
+	case "read":
+		if !exists {
+			result.Error = "no logfile for " + result.Date
+
+			return result
+		}
+
+		content := string(data)
+		result.OK, result.Content = true, &content
+
+		return result
+	case "create":
+		if exists {
+			result.OK, result.Result = true, "exists"
+
+			return result
+		}
+
+		done = "created"
+	}
+
+	if !exists {
+		r.render.Lock()
+		data, ok = Render_Skeleton(date)
+		r.render.Unlock()
+
+		if !ok {
+			result.Error = batch_failed
+
+			return result
+		}
+	}
+
+	if c.Op == "append" {
+		data, ok = Append_Entry(data, c.Section, c.Text)
+		if !ok {
+			result.Error = "no section " + c.Section + " in " + result.Date
+
+			return result
+		}
+	}
+
+	if !r.save(name, data) {
+		result.Error = batch_failed
+
+		return result
+	}
+
+	result.OK, result.Result = true, done
+
+	return result
+}
+
+// save writes a logfile within the quota of the journal.
+func (r *batch_runner) save(name string, data []byte) bool {
+	if journal_quota != nil {
+		r.quota.Lock()
+		defer r.quota.Unlock()
+
+		if !journal_quota.Allow(journal_quota.idx, name, int64(len(data))) {
+			return false
+		}
+	}
+
+	if !Save_Log(r.dir, name, data) {
+		return false
+	}
+
+	return journal_quota == nil || journal_quota.Track(name, data)
+}
+
+// gaps lists the dates from from through until, today by default, that have neither a logfile
+// nor an archived day.
+func (r *batch_runner) gaps(fromArg string, untilArg string) ([]string, bool) {
+	if untilArg == "" {
+		untilArg = time.Now().Format("01022006")
+	}
+
+	from, until, ok := Parse_Range(fromArg, untilArg)
+	if !ok {
+		return nil, false
+	}
+
+	idx, ok := Load_Index(r.dir)
+	if !ok {
+		return nil, false
+	}
+
+	if _, ok := Refresh_Index(idx); !ok || !Save_Index(idx) {
+		return nil, false
+	}
+
+	packs, ok := open_packs(r.dir, from.Year(), until.Year())
+	if !ok {
+		return nil, false
+	}
+
+	archived := make(map[string]bool)
+	for _, p := range packs {
+		for _, e := range p.Entries {
+			archived[e.Name] = true
+		}
+
+		p.Close()
+	}
+
+	dates := []string{}
+	for date := from; !date.After(until); date = date.AddDate(0, 0, 1) {
+		name := Log_Name(pad(int(date.Month()), 2), pad(date.Day(), 2), pad(date.Year(), 4))
+		if _, ok := idx.Entries[name]; !ok && !archived[name] {
+			dates = append(dates, strings.TrimSuffix(name, ".log"))
+		}
+	}
+
+	return dates, true
+}
+
+// Append_Entry adds a line at the end of a section of a logfile, after its last non-blank line,
+// and reports whether the logfile has the section.
+func Append_Entry(data []byte, section string, text string) ([]byte, bool) {
+	sections := Section_Offsets(data)
+
+	for i, s := range sections {
+		if s.Name != section {
+			continue
+		}
+
+		end := len(data)
+		if i+1 < len(sections) {
+			end = int(sections[i+1].Start)
+		}
+
+		// the section line itself always ends where the body starts
+		at := int(s.Start)
+		if nl := bytes.IndexByte(data[at:end], '\n'); nl >= 0 {
+			at += nl + 1
+		} else {
+			at = end
+		}
+
+		for line := at; line < end; {
+			next := end
+			if nl := bytes.IndexByte(data[line:end], '\n'); nl >= 0 {
+				next = line + nl + 1
+			}
+
+			if len(bytes.TrimSpace(data[line:next])) > 0 {
+				at = next
+			}
+
+			line = next
+		}
+
+		out := make([]byte, 0, len(data)+len(text)+2)
+		out = append(out, data[:at]...)
+		if at > 0 && data[at-1] != '\n' {
+			out = append(out, '\n')
+		}
+
+		out = append(out, text...)
+		out = append(out, '\n')
+
+		return append(out, data[at:]...), true
+	}
+
+	return nil, false
+}
@@ -0,0 +1,268 @@
+package main
+
+import (
+	"encoding/binary"
+	"errors"
+	"io"
+)
+
+// Every chunk of a pack carries a Bloom filter of the tokens it holds, and optionally one of its
+// trigrams, so a search skips the chunks that cannot hold what it looks for without inflating
+// them. A token is a run of letters, digits and non-ASCII bytes; tokens and trigrams ignore ASCII
+// case, as search does.
+const bloom_bits_per_key int = 10
+const bloom_hashes int = 7
+
+// Bloom is a Bloom filter over 64-bit hashes, whose bits are probed by double hashing.
+type Bloom struct {
+	Hashes int
+	Bits   []byte
+}
+
+// New_Bloom returns a filter sized for the given hashes and holding them.
+func New_Bloom(keys map[uint64]struct{}) *Bloom {
+	size := max((len(keys)*bloom_bits_per_key+7)/8, 8)
+
+	b := &Bloom{Hashes: bloom_hashes, Bits: make([]byte, size)}
+	for h := range keys {
+		b.Add(h)
+	}
+
+	return b
+}
+
+// Add sets the bits of a hash.
+func (b *Bloom) Add(h uint64) {
+	n := uint64(len(b.Bits)) * 8
+	delta := h>>33 | h<<31
+
+	for i := 0; i < b.Hashes; i++ {
+		bit := h % n
+		b.Bits[bit/8] |= 1 << (bit % 8)
+		h += delta
+	}
+}
+
+// Has tells whether a hash may have been added. A nil filter may hold anything.
+func (b *Bloom) Has(h uint64) bool {
+	if b == nil {
+		return true
+	}
+
+	n := uint64(len(b.Bits)) * 8
+	delta := h>>33 | h<<31
+
+	for i := 0; i < b.Hashes; i++ {
+		bit := h % n
+		if b.Bits[bit/8]&(1<<(bit%8)) == 0 {
+			return false
+		}
+
+		h += delta
+	}
+
+	return true
+}
+
+// append_bloom appends a filter to a pack footer: the number of hashes, the size of the bits and
+// the bits. An absent filter is written with no bits.
+func append_bloom(out []byte, b *Bloom) []byte {
+	if b == nil {
+		return binary.AppendUvarint(binary.AppendUvarint(out, 0), 0)
+	}
+
+	out = binary.AppendUvarint(out, uint64(b.Hashes))
+	out = binary.AppendUvarint(out, uint64(len(b.Bits)))
+
+	return append(out, b.Bits...)
+}
+
+// read_bloom reads a filter written by append_bloom, which is nil when it is absent.
+func read_bloom(r io.ByteReader, data func(n int) ([]byte, error)) (*Bloom, error) {
+	hashes, err := binary.ReadUvarint(r)
+	if err != nil {
+		return nil, err
+	}
+
+	size, err := binary.ReadUvarint(r)
+	if err != nil {
+		return nil, err
+	}
+
+	if size == 0 {
+		return nil, nil
+	}
+
+	if hashes == 0 || hashes > 32 || size > 1<<30 {
+		return nil, errors.New("damaged filter")
+	}
+
+	bits, err := data(int(size))
+	if err != nil {
+		return nil, err
+	}
+
+	return &Bloom{Hashes: int(hashes), Bits: bits}, nil
+}
+
+// Each_Token calls fn with the hash of every token of data.
+func Each_Token(data []byte, fn func(h uint64)) {
+	h, in := uint64(fnv_offset), false
+
+	for _, c := range data {
+		if is_token_byte(c) {
+			h = (h ^ uint64(lower(c))) * fnv_prime
+			in = true
+
+			continue
+		}
+
+		if in {
+			fn(h)
+			h, in = fnv_offset, false
+		}
+	}
+
+	if in {
+		fn(h)
+	}
+}
+
+// Each_Trigram calls fn with the hash of every three consecutive bytes of data within a line.
+func Each_Trigram(data []byte, fn func(h uint64)) {
+	for i := 0; i+3 <= len(data); i++ {
+		a, b, c := data[i], data[i+1], data[i+2]
+		if a == '\n' || b == '\n' || c == '\n' {
+			continue
+		}
+
+		fn(hash_trigram(lower(a), lower(b), lower(c)))
+	}
+}
+
+const fnv_offset uint64 = 14695981039346656037
+const fnv_prime uint64 = 1099511628211
+
+func hash_trigram(a byte, b byte, c byte) uint64 {
+	h := (uint64(a)<<16 | uint64(b)<<8 | uint64(c)) * 0x9E3779B97F4A7C15
+
+	return h ^ h>>29
+}
+
+func is_token_byte(c byte) bool {
+	return c >= '0' && c <= '9' || c >= 'a' && c <= 'z' || c >= 'A' && c <= 'Z' || c >= 0x80
+}
+
+// chunk_keys collects the hashes of the tokens, and optionally of the trigrams, of the days whose
+// filters are those of one chunk.
+type chunk_keys struct {
+	tokens   map[uint64]struct{}
+	trigrams map[uint64]struct{}
+}
+
+func new_chunk_keys(trigrams bool) *chunk_keys {
+	k := &chunk_keys{tokens: make(map[uint64]struct{})}
+	if trigrams {
+		k.trigrams = make(map[uint64]struct{})
+	}
+
+	return k
+}
+
+func (k *chunk_keys) add(data []byte) {
+	Each_Token(data, func(h uint64) { k.tokens[h] = struct{}{} })
+
+	if k.trigrams != nil {
+		Each_Trigram(data, func(h uint64) { k.trigrams[h] = struct{}{} })
+	}
+}
+
+// filters builds the filters of the hashes collected so far and starts collecting anew.
+func (k *chunk_keys) filters() (*Bloom, *Bloom) {
+	tokens := New_Bloom(k.tokens)
+	clear(k.tokens)
+
+	if k.trigrams == nil {
+		return tokens, nil
+	}
+
+	trigrams := New_Bloom(k.trigrams)
+	clear(k.trigrams)
+
+	return tokens, trigrams
+}
+
+// Search_Probe holds the hashes a chunk must hold for a text to be found in it: the tokens the
+// text contains whole, all of them when only whole words match, and the trigrams of the text.
+type Search_Probe struct {
+	tokens   []uint64
+	trigrams []uint64
+}
+
+// New_Search_Probe returns the probe of a lower case text. Matching anywhere, the tokens at either
+// end of the text may be parts of longer tokens and are left out.
+func New_Search_Probe(needle []byte, word bool) *Search_Probe {
+	probe := &Search_Probe{}
+
+	var tokens [][2]int
+	for i := 0; i < len(needle); {
+		if !is_token_byte(needle[i]) {
+			i++
+
+			continue
+		}
+
+		j := i
+		for j < len(needle) && is_token_byte(needle[j]) {
+			j++
+		}
+
+		tokens = append(tokens, [2]int{i, j})
+		i = j
+	}
+
+	for _, t := range tokens {
+		if !word && (t[0] == 0 || t[1] == len(needle)) {
+			continue
+		}
+
+		Each_Token(needle[t[0]:t[1]], func(h uint64) { probe.tokens = append(probe.tokens, h) })
+	}
+
+	Each_Trigram(needle, func(h uint64) { probe.trigrams = append(probe.trigrams, h) })
+
+	return probe
+}
+
+// New_Phrase_Probe returns the probe of the lower case words of a phrase. The words may be
+// separated by anything in the text, so only their tokens are probed.
+func New_Phrase_Probe(words []string) *Search_Probe {
+	probe := &Search_Probe{}
+
+	for _, word := range words {
+		Each_Token([]byte(word), func(h uint64) { probe.tokens = append(probe.tokens, h) })
+	}
+
+	return probe
+}
+
+// May_Match tells whether a chunk with the given filters may hold the text of the probe.
+func (probe *Search_Probe) May_Match(tokens *Bloom, trigrams *Bloom) bool {
+	for _, h := range probe.tokens {
+		if !tokens.Has(h) {
+			return false
+		}
+	}
+
+	if trigrams == nil {
+		return true
+	}
+
+	for _, h := range probe.trigrams {
+		if !trigrams.Has(h) {
+			return false
+		}
+	}
+
+	return true
+}
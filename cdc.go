@@ -0,0 +1,59 @@
+package main
+
+// Days are cut into segments by FastCDC: a gear hash rolls over the bytes of a day and a segment
+// ends where the hash has enough zero bits. Boundaries depend on the few dozen bytes before them
+// rather than on offsets, so a block repeated in other days is cut the same way there once the hash
+// has resynchronised. Below cdc_avg bytes a cut needs more zero bits than above it, which keeps
+// segment sizes close to cdc_avg, and segments are never shorter than cdc_min nor longer than
+// cdc_max.
+const cdc_min int = 256
+const cdc_avg int = 1024
+const cdc_max int = 8192
+
+// the masks select the top bits of the hash, which depend on the last 64 bytes
+const cdc_mask_small uint64 = 0xFFF0000000000000
+const cdc_mask_large uint64 = 0xFF00000000000000
+
+var cdc_gear [256]uint64
+
+func init() {
+	// splitmix64, so that the table and the boundaries never change
+	state := uint64(0x746F7563686C6F67)
+	for i := range cdc_gear {
+		state += 0x9E3779B97F4A7C15
+		z := state
+		z = (z ^ z>>30) * 0xBF58476D1CE4E5B9
+		z = (z ^ z>>27) * 0x94D049BB133111EB
+		cdc_gear[i] = z ^ z>>31
+	}
+}
+
+// CDC_Cut returns the size of the segment data starts with.
+func CDC_Cut(data []byte) int {
+	n := len(data)
+	if n <= cdc_min {
+		return n
+	}
+
+	n = min(n, cdc_max)
+	normal := min(n, cdc_avg)
+
+	var hash uint64
+
+	i := cdc_min
+	for ; i < normal; i++ {
+		hash = hash<<1 + cdc_gear[data[i]]
+		if hash&cdc_mask_small == 0 {
+			return i + 1
+		}
+	}
+
+	for ; i < n; i++ {
+		hash = hash<<1 + cdc_gear[data[i]]
+		if hash&cdc_mask_large == 0 {
+			return i + 1
+		}
+	}
+
+	return n
+}
@@ -0,0 +1,69 @@
+package main
+
+import (
+	"bufio"
+	"os"
+)
+
+// Complete prints the words of the journal that complete a prefix, the words written on the most
+// days first, one per line, for shells and editors to offer as completions. With -fuzzy, words
+// starting with something within that many typos of the prefix complete it too. The words come
+// from the dictionaries of the word index, brought up to date first, which are walked from the
+// prefix or along the Levenshtein automaton of the prefix, so only words near it are visited.
+//
+// If the completions are successfully looked up, Complete returns true.
+// Otherwise, the error is logged and Complete returns false.
+func Complete(args []string) bool {
+	fs, verbosePtr := New_FlagSet("complete")
+	outDirPtr := fs.String("outdir", "", "complete words of the journal in the inputted directory")
+	limitPtr := fs.Int("limit", 10, "number of completions printed")
+	fuzzyPtr := fs.Int("fuzzy", 0, "number of typos allowed in the prefix")
+	fs.Parse(args)
+
+	Set_Verbosity(*verbosePtr)
+
+	words := Phrase_Words(fs.Arg(0))
+
+	if fs.NArg() != 1 || len(words) != 1 || *limitPtr < 1 || *fuzzyPtr < 0 {
+		errlog.Println("usage: touchlog complete [-verbose] [-outdir dir] [-limit n] [-fuzzy n] prefix")
+
+		return false
+	}
+
+	if !Resolve_Outdir(outDirPtr) {
+		return false
+	}
+
+	idx, ok := Load_Index(*outDirPtr)
+	if !ok {
+		return false
+	}
+
+	if _, ok := Refresh_Index(idx); !ok || !Save_Index(idx) {
+		return false
+	}
+
+	w, ok := Open_Word_Index(idx.Dir)
+	if !ok {
+		return false
+	}
+
+	defer w.Close()
+
+	if !w.Update(idx) {
+		return false
+	}
+
+	completions := w.Complete(words[0], *fuzzyPtr, *limitPtr)
+
+	debug.Printf("%d completions of %s\n", len(completions), words[0])
+
+	out := bufio.NewWriter(os.Stdout)
+	defer out.Flush()
+
+	for _, c := range completions {
+		out.WriteString(c.Word + "\n")
+	}
+
+	return true
+}
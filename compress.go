@@ -0,0 +1,200 @@
+package main
+
+import (
+	"bytes"
+	"compress/gzip"
+	"encoding/binary"
+	"fmt"
+	"io"
+	"os"
+	"path/filepath"
+	"strings"
+	"sync"
+)
+
+// Logfiles may be compressed by hand or by other tools, keeping their name with a .gz or .zst
+// extension. They are read as if they were stored as is; writing a day stores it uncompressed.
+const gzip_ext string = ".gz"
+const zstd_ext string = ".zst"
+
+var log_variants = []string{gzip_ext, zstd_ext}
+
+var gzip_magic = []byte{0x1f, 0x8b}
+var zstd_magic_bytes = []byte{0x28, 0xb5, 0x2f, 0xfd}
+
+// decompressors keep their tables and windows from one logfile to the next, so reading many
+// compressed days does not allocate them again for each.
+var gzip_readers sync.Pool
+var zstd_decoders = sync.Pool{New: func() any { return new(Zstd_Decoder) }}
+
+// Split_Log_Variant splits a file name into the name of the logfile it holds and the extension of
+// its compressed variant, which is empty for a logfile stored as is.
+func Split_Log_Variant(filename string) (name string, ext string, ok bool) {
+	name = filename
+	for _, variant := range log_variants {
+		if strings.HasSuffix(filename, variant) {
+			name, ext = strings.TrimSuffix(filename, variant), variant
+
+			break
+		}
+	}
+
+	_, _, _, ok = Parse_Log_Name(name)
+
+	return name, ext, ok
+}
+
+// Read_Log reads the content of a logfile of a journal, from the file stored as is or else from
+// its compressed variant.
+func Read_Log(dir string, name string) ([]byte, error) {
+	data, _, err := read_log(dir, name)
+
+	return data, err
+}
+
+// read_log reads a logfile like Read_Log, also returning the extension of the file it was read from.
+func read_log(dir string, name string) ([]byte, string, error) {
+	path := filepath.Join(dir, name)
+
+	data, err := os.ReadFile(path)
+	ext := ""
+
+	for _, variant := range log_variants {
+		if !os.IsNotExist(err) {
+			break
+		}
+
+		data, err = os.ReadFile(path + variant)
+		ext = variant
+	}
+
+	if err != nil {
+		// a logfile missing in every variant is reported under its own name
+		if os.IsNotExist(err) {
+			err = &os.PathError{Op: "open", Path: path, Err: os.ErrNotExist}
+		}
+
+		return nil, "", err
+	}
+
+	data, err = Decode_Log(data)
+	if err != nil {
+		return nil, "", fmt.Errorf("%s: %w", path+ext, err)
+	}
+
+	return data, ext, nil
+}
+
+// Decode_Log returns the content of a logfile, decompressing it when it starts with the magic
+// number of gzip or zstd. The name of a file is only a hint; its content decides.
+func Decode_Log(data []byte) ([]byte, error) {
+	switch {
+	case bytes.HasPrefix(data, zstd_magic_bytes):
+		d := zstd_decoders.Get().(*Zstd_Decoder)
+		defer zstd_decoders.Put(d)
+
+		return d.Decode(nil, data)
+	case bytes.HasPrefix(data, gzip_magic):
+		return decode_gzip(data)
+	}
+
+	return data, nil
+}
+
+func decode_gzip(data []byte) ([]byte, error) {
+	var zr *gzip.Reader
+	var err error
+
+	if pooled, ok := gzip_readers.Get().(*gzip.Reader); ok {
+		zr = pooled
+		err = zr.Reset(bytes.NewReader(data))
+	} else {
+		zr, err = gzip.NewReader(bytes.NewReader(data))
+	}
+
+	if err != nil {
+		return nil, err
+	}
+
+	defer gzip_readers.Put(zr)
+
+	// the trailer of the last member records the size of the content, modulo 4GiB
+	var out bytes.Buffer
+	if len(data) >= 4 {
+		out.Grow(min(int(binary.LittleEndian.Uint32(data[len(data)-4:])), 64<<20))
+	}
+
+	_, err = io.Copy(&out, zr)
+	if err != nil {
+		return nil, err
+	}
+
+	return out.Bytes(), nil
+}
+
+// Day_Reader reads logfiles on a pool of workers while they are handed out in order by Next. At
+// most twice as many logfiles as there are workers are read ahead of the one last handed out.
+type Day_Reader struct {
+	results []chan day_read
+	next    int
+	window  chan struct{}
+	stop    chan struct{}
+}
+
+type day_read struct {
+	data []byte
+	err  error
+}
+
+// Read_Ahead starts reading the logfiles of a journal with jobs workers.
+func Read_Ahead(dir string, names []string, jobs int) *Day_Reader {
+	jobs = max(jobs, 1)
+
+	r := &Day_Reader{results: make([]chan day_read, len(names)), window: make(chan struct{}, 2*jobs),
+		stop: make(chan struct{})}
+	for i := range r.results {
+		r.results[i] = make(chan day_read, 1)
+	}
+
+	queue := make(chan int)
+
+	go func() {
+		defer close(queue)
+
+		for i := range names {
+			select {
+			case r.window <- struct{}{}:
+			case <-r.stop:
+				return
+			}
+
+			queue <- i
+		}
+	}()
+
+	for w := 0; w < min(jobs, len(names)); w++ {
+		go func() {
+			for i := range queue {
+				data, err := Read_Log(dir, names[i])
+				r.results[i] <- day_read{data: data, err: err}
+			}
+		}()
+	}
+
+	return r
+}
+
+// Next returns the content of the next logfile.
+func (r *Day_Reader) Next() ([]byte, error) {
+	read := <-r.results[r.next]
+	r.results[r.next] = nil
+	r.next++
+	<-r.window
+
+	return read.data, read.err
+}
+
+// Stop lets the workers finish once the logfiles already being read are done.
+func (r *Day_Reader) Stop() {
+	close(r.stop)
+}
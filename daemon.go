@@ -0,0 +1,591 @@
+package main
+
+import (
+	"bufio"
+	"bytes"
+	"errors"
+	"fmt"
+	"net"
+	"os"
+	"os/signal"
+	"path/filepath"
+	"strconv"
+	"strings"
+	"sync"
+	"syscall"
+	"time"
+)
+
+// socket_name is the unix socket a daemon listens on inside the bookkeeping directory.
+const socket_name string = "sock"
+
+// Every subscriber gets a ring of subscriber_ring events. When a subscriber falls behind, the
+// oldest events are overwritten and it is told how many it missed, so the daemon never waits on it.
+const subscriber_ring int = 1024
+const subscriber_timeout time.Duration = 10 * time.Second
+
+// Changes arriving within daemon_settle of each other are handled together.
+const daemon_settle time.Duration = 5 * time.Millisecond
+
+// daemon_cache bounds the number of logfiles whose content the daemon keeps to diff against.
+const daemon_cache int = 512
+
+// The index is saved every daemon_save while it has changes, so a daemon that is killed rather
+// than interrupted leaves little for the next command to refresh.
+const daemon_save time.Duration = time.Minute
+
+// Change_Event is a change to one section of a logfile: the kind, the date, the section and the
+// byte range of the logfile the change covers. Changes to the lines before the first section
+// have an empty section name.
+type Change_Event struct {
+	Kind    string
+	Date    string
+	Section string
+	Start   int64
+	End     int64
+}
+
+// String formats an event as the tab separated line sent to subscribers.
+func (e Change_Event) String() string {
+	return e.Kind + "\t" + e.Date + "\t" + e.Section + "\t" + strconv.FormatInt(e.Start, 10) + "\t" +
+		strconv.FormatInt(e.End, 10)
+}
+
+// Parse_Change_Event reverses String.
+func Parse_Change_Event(line string) (Change_Event, bool) {
+	fields := strings.Split(line, "\t")
+	if len(fields) != 5 {
+		return Change_Event{}, false
+	}
+
+	start, err1 := strconv.ParseInt(fields[3], 10, 64)
+	end, err2 := strconv.ParseInt(fields[4], 10, 64)
+
+	return Change_Event{Kind: fields[0], Date: fields[1], Section: fields[2], Start: start, End: end},
+		err1 == nil && err2 == nil
+}
+
+// Subscriber is a bounded ring of events waiting to be sent to one client.
+type Subscriber struct {
+	mu      sync.Mutex
+	ring    [subscriber_ring]Change_Event
+	head    int
+	count   int
+	dropped int64
+	notify  chan struct{}
+}
+
+// Push adds an event, overwriting the oldest one when the ring is full. It never blocks.
+func (s *Subscriber) Push(event Change_Event) {
+	s.mu.Lock()
+
+	if s.count == subscriber_ring {
+		s.head = (s.head + 1) % subscriber_ring
+		s.count--
+		s.dropped++
+	}
+
+	s.ring[(s.head+s.count)%subscriber_ring] = event
+	s.count++
+
+	s.mu.Unlock()
+
+	select {
+	case s.notify <- struct{}{}:
+	default:
+	}
+}
+
+// Drain moves the waiting events into events and returns them with the number dropped since the
+// last drain.
+func (s *Subscriber) Drain(events []Change_Event) ([]Change_Event, int64) {
+	s.mu.Lock()
+	defer s.mu.Unlock()
+
+	for ; s.count > 0; s.count-- {
+		events = append(events, s.ring[s.head])
+		s.head = (s.head + 1) % subscriber_ring
+	}
+
+	dropped := s.dropped
+	s.dropped = 0
+
+	return events, dropped
+}
+
+// Daemon watches a journal, keeps today.log pointing at today and streams changes to subscribers
+// of its socket.
+type Daemon struct {
+	Dir         string
+	idx         *Index
+	cache       map[string][]byte
+	quota       *Quota
+	view        Day_View
+	dirty       bool
+	mu          sync.Mutex
+	subscribers map[*Subscriber]bool
+}
+
+// Run_Daemon runs the daemon of a journal until it is interrupted.
+//
+// If the daemon cannot start, the error is logged and Run_Daemon returns false.
+func Run_Daemon(args []string) bool {
+	fs, verbosePtr := New_FlagSet("daemon")
+	outDirPtr := fs.String("outdir", "", "watch the journal in the inputted directory")
+	fs.Parse(args)
+
+	Set_Verbosity(*verbosePtr)
+
+	if fs.NArg() != 0 {
+		errlog.Println("usage: touchlog daemon [-verbose] [-outdir dir]")
+
+		return false
+	}
+
+	if !Resolve_Outdir(outDirPtr) {
+		return false
+	}
+
+	idx, ok := Load_Index(*outDirPtr)
+	if !ok {
+		return false
+	}
+
+	if _, ok := Refresh_Index(idx); !ok || !Save_Index(idx) {
+		return false
+	}
+
+	quota, ok := Load_Quota(*outDirPtr)
+	if !ok {
+		return false
+	}
+
+	d := &Daemon{Dir: *outDirPtr, idx: idx, cache: make(map[string][]byte), quota: quota,
+		subscribers: make(map[*Subscriber]bool)}
+
+	listener, ok := Listen_Socket(*outDirPtr)
+	if !ok {
+		return false
+	}
+
+	watcher, err := Watch_Dir(*outDirPtr)
+	if err != nil {
+		listener.Close()
+		errlog.Print(err)
+
+		return false
+	}
+
+	Stream_Output()
+
+	print.Printf("touchlog daemon watching %s\n", *outDirPtr)
+
+	go d.serve(listener)
+
+	signals := make(chan os.Signal, 1)
+	signal.Notify(signals, os.Interrupt, syscall.SIGTERM)
+
+	result := d.run(watcher, signals)
+
+	listener.Close()
+	watcher.Close()
+
+	return Save_Index(d.idx) && result
+}
+
+// Listen_Socket listens on the socket of a journal. A socket left behind by a daemon that is no
+// longer running is replaced.
+//
+// If another daemon is running or the socket cannot be created, the error is logged and
+// Listen_Socket returns nil, false.
+func Listen_Socket(dir string) (net.Listener, bool) {
+	path := State_Path(dir, socket_name)
+
+	if conn, err := net.Dial("unix", path); err == nil {
+		conn.Close()
+		errlog.Printf("a daemon is already listening on %s\n", path)
+
+		return nil, false
+	}
+
+	os.Remove(path)
+
+	err := os.MkdirAll(filepath.Dir(path), 0755)
+	if err != nil {
+		errlog.Print(err)
+
+		return nil, false
+	}
+
+	listener, err := net.Listen("unix", path)
+	if err != nil {
+		errlog.Print(err)
+
+		return nil, false
+	}
+
+	return listener, true
+}
+
+// run handles changes and rollovers until a signal arrives.
+func (d *Daemon) run(watcher *Dir_Watcher, signals chan os.Signal) bool {
+	result := Update_Today_Link(d.Dir, time.Now())
+
+	rollover := time.NewTimer(until_midnight(time.Now()))
+	defer rollover.Stop()
+
+	save := time.NewTicker(daemon_save)
+	defer save.Stop()
+
+	pending := make(map[string]bool)
+	var settle <-chan time.Time
+
+	for {
+		select {
+		case <-signals:
+			return result
+		case now := <-rollover.C:
+			result = Update_Today_Link(d.Dir, now) && result
+			rollover.Reset(until_midnight(now))
+		case <-save.C:
+			if d.dirty {
+				d.dirty = !Save_Index(d.idx)
+			}
+		case name, ok := <-watcher.Names:
+			if !ok {
+				errlog.Println("stopped receiving changes")
+
+				return false
+			}
+
+			// a compressed logfile stands for the day it holds
+			if name, _, ok := Split_Log_Variant(name); ok {
+				pending[name] = true
+				settle = time.After(daemon_settle)
+			}
+		case <-settle:
+			for name := range pending {
+				d.Handle_Change(name)
+				delete(pending, name)
+			}
+
+			settle = nil
+		}
+	}
+}
+
+// until_midnight returns the time left until the next day starts.
+func until_midnight(now time.Time) time.Duration {
+	year, month, day := now.Date()
+
+	return time.Date(year, month, day+1, 0, 0, 0, 0, now.Location()).Sub(now)
+}
+
+// Handle_Change compares a logfile with what the daemon last knew of it and sends an event per
+// section the change covers. Content the daemon has kept is diffed directly; otherwise the index
+// entry tells an append, whose old content is a prefix of the new, from any other modification.
+// Changed content becomes a version in the history of the logfile before the index takes it in,
+// so a version that could not be recorded is found again by the next refresh of the index.
+func (d *Daemon) Handle_Change(name string) {
+	date := strings.TrimSuffix(name, ".log")
+
+	data, ext, err := read_log(d.Dir, name)
+	if os.IsNotExist(err) {
+		if _, ok := d.idx.Entries[name]; ok {
+			delete(d.idx.Entries, name)
+			delete(d.cache, name)
+			d.dirty = true
+			d.Publish(Change_Event{Kind: "delete", Date: date})
+		}
+
+		return
+	}
+	if err != nil {
+		errlog.Print(err)
+
+		return
+	}
+
+	kind, start, end := "", 0, len(data)
+	entry, indexed := d.idx.Entries[name]
+	old, cached := d.cache[name]
+
+	// compressed logfiles are rewritten whole by whatever compressed them, and their size on disk is
+	// not that of their content, so they are left for the quota to check on the next write
+	if d.quota != nil && ext == "" && !d.Check_Quota(name, data, old, cached) {
+		return
+	}
+
+	if cached {
+		switch {
+		case bytes.Equal(old, data):
+			return
+		case bytes.HasPrefix(data, old):
+			kind, start = "append", len(old)
+		default:
+			kind = "modify"
+			for start < len(old) && start < len(data) && old[start] == data[start] {
+				start++
+			}
+
+			oldEnd := len(old)
+			for oldEnd > start && end > start && old[oldEnd-1] == data[end-1] {
+				oldEnd--
+				end--
+			}
+		}
+	} else {
+		switch {
+		case !indexed:
+			kind = "create"
+		case entry.Length == int64(len(data)) && entry.Hash == Hash_Content(data):
+			kind = ""
+		case entry.Length < int64(len(data)) && entry.Hash == Hash_Content(data[:entry.Length]):
+			kind, start = "append", int(entry.Length)
+		default:
+			kind = "modify"
+		}
+	}
+
+	if kind != "" && !Record_History(d.Dir, name, data) {
+		return
+	}
+
+	if len(d.cache) >= daemon_cache {
+		for evicted := range d.cache {
+			delete(d.cache, evicted)
+
+			break
+		}
+	}
+
+	d.cache[name] = data
+	d.idx.Update(name, data)
+	d.dirty = true
+
+	if kind == "" {
+		return
+	}
+
+	for _, event := range Section_Events(&d.view, kind, date, data, start, end) {
+		d.Publish(event)
+	}
+}
+
+// Check_Quota holds a change to a logfile against the quota of the journal. A change taking the
+// journal over its limit is sent to subscribers as a quota event. When the quota rejects it and
+// the daemon can tell what the logfile held before, because it kept the content, the change is an
+// append or the logfile is new, the change is undone instead and sent as a reject event: the
+// rejected content is recorded in the history of the logfile, which is then put back as it was.
+//
+// Check_Quota returns false when it undid the change.
+func (d *Daemon) Check_Quota(name string, data []byte, old []byte, cached bool) bool {
+	used, over := d.quota.Over(d.idx, name, int64(len(data)))
+	if !over {
+		return true
+	}
+
+	event := Change_Event{Kind: "quota", Date: strings.TrimSuffix(name, ".log"), Start: used, End: d.quota.Limit}
+
+	entry, indexed := d.idx.Entries[name]
+	if !cached && indexed && entry.Length < int64(len(data)) && entry.Hash == Hash_Content(data[:entry.Length]) {
+		old, cached = data[:entry.Length], true
+	}
+
+	if !d.quota.Reject || indexed && !cached {
+		errlog.Printf("warning: %s takes the journal to %s, over its quota of %s\n", name, Format_Size(used),
+			Format_Size(d.quota.Limit))
+		d.Publish(event)
+
+		return true
+	}
+
+	// the rejected content stays in the history, from where it can be restored once there is room
+	path := filepath.Join(d.Dir, name)
+
+	undone := Record_History(d.Dir, name, data)
+	if undone && indexed {
+		undone = Write_Atomic(path, old)
+	} else if undone {
+		err := os.Remove(path)
+		if err != nil {
+			errlog.Print(err)
+
+			undone = false
+		}
+	}
+	if !undone {
+		d.Publish(event)
+
+		return true
+	}
+
+	errlog.Printf("rejected a change to %s taking the journal to %s, over its quota of %s\n", name,
+		Format_Size(used), Format_Size(d.quota.Limit))
+
+	event.Kind = "reject"
+	d.Publish(event)
+
+	return false
+}
+
+// Section_Events splits a changed byte range of a logfile into one event per section it covers.
+// A change that only removed bytes yields an empty range in the section where they were.
+func Section_Events(view *Day_View, kind string, date string, data []byte, start int, end int) []Change_Event {
+	view.Reset(time.Time{}, data)
+
+	var events []Change_Event
+
+	// the header runs up to the first section, and every section up to the next one
+	lo, name := 0, ""
+	for i := 0; i <= view.Sections(); i++ {
+		hi := len(data)
+		if i < view.Sections() {
+			hi = view.Section_Start(i)
+		}
+
+		if start < hi && end > lo || start == end && start >= lo && (start < hi || hi == len(data)) {
+			events = append(events, Change_Event{Kind: kind, Date: date, Section: name,
+				Start: int64(max(start, lo)), End: int64(min(end, hi))})
+		}
+
+		if i < view.Sections() {
+			sectionName, _ := view.Section(i)
+			lo, name = hi, string(sectionName)
+		}
+	}
+
+	return events
+}
+
+// Publish hands an event to every subscriber.
+func (d *Daemon) Publish(event Change_Event) {
+	debug.Println(event)
+
+	d.mu.Lock()
+	defer d.mu.Unlock()
+
+	for s := range d.subscribers {
+		s.Push(event)
+	}
+}
+
+func (d *Daemon) serve(listener net.Listener) {
+	for {
+		conn, err := listener.Accept()
+		if err != nil {
+			if !errors.Is(err, net.ErrClosed) {
+				errlog.Print(err)
+			}
+
+			return
+		}
+
+		go d.handle(conn)
+	}
+}
+
+// handle answers the requests of one client. A client sends a line naming an endpoint: ping is
+// answered with ok, and subscribe with ok followed by a line per event until the client goes
+// away, with a line reading dropped and a count whenever events had to be discarded.
+func (d *Daemon) handle(conn net.Conn) {
+	defer conn.Close()
+
+	reader := bufio.NewReader(conn)
+
+	conn.SetReadDeadline(time.Now().Add(subscriber_timeout))
+
+	request, err := reader.ReadString('\n')
+	if err != nil {
+		return
+	}
+
+	conn.SetReadDeadline(time.Time{})
+
+	switch strings.TrimSpace(request) {
+	case "ping":
+		fmt.Fprintln(conn, "ok")
+	case "subscribe":
+		d.subscribe(conn, reader)
+	default:
+		fmt.Fprintln(conn, "error unknown request")
+	}
+}
+
+func (d *Daemon) subscribe(conn net.Conn, reader *bufio.Reader) {
+	s := &Subscriber{notify: make(chan struct{}, 1)}
+
+	d.mu.Lock()
+	d.subscribers[s] = true
+	d.mu.Unlock()
+
+	defer func() {
+		d.mu.Lock()
+		delete(d.subscribers, s)
+		d.mu.Unlock()
+	}()
+
+	// the client never sends anything more, so a read returning means it is gone
+	gone := make(chan struct{})
+	go func() {
+		reader.ReadByte()
+		close(gone)
+	}()
+
+	out := bufio.NewWriter(conn)
+	out.WriteString("ok\n")
+
+	var events []Change_Event
+
+	for {
+		var dropped int64
+
+		events, dropped = s.Drain(events[:0])
+		if dropped > 0 {
+			fmt.Fprintf(out, "dropped\t%d\n", dropped)
+		}
+		for _, event := range events {
+			out.WriteString(event.String())
+			out.WriteByte('\n')
+		}
+
+		conn.SetWriteDeadline(time.Now().Add(subscriber_timeout))
+		if out.Flush() != nil {
+			return
+		}
+
+		select {
+		case <-s.notify:
+		case <-gone:
+			return
+		}
+	}
+}
+
+// Subscribe connects to the daemon of a journal and returns a reader positioned at its first
+// event.
+func Subscribe(dir string) (net.Conn, *bufio.Reader, error) {
+	conn, err := net.Dial("unix", State_Path(dir, socket_name))
+	if err != nil {
+		return nil, nil, err
+	}
+
+	reader := bufio.NewReader(conn)
+
+	_, err = conn.Write([]byte("subscribe\n"))
+	if err == nil {
+		var reply string
+
+		reply, err = reader.ReadString('\n')
+		if err == nil && reply != "ok\n" {
+			err = errors.New("daemon refused to subscribe: " + strings.TrimSpace(reply))
+		}
+	}
+	if err != nil {
+		conn.Close()
+
+		return nil, nil, err
+	}
+
+	return conn, reader, nil
+}
@@ -0,0 +1,148 @@
+package main
+
+import (
+	"os"
+	"sort"
+)
+
+// du_header names the bytes of logfiles before their first section in a report by section.
+const du_header string = "(header)"
+
+type du_group struct {
+	key   string
+	days  int
+	bytes int64
+}
+
+// Du reports the disk usage of a journal grouped by year, month or section, along with the space
+// its history, packs and word index take and how much of its quota is used. Logfiles are never
+// read: the sizes come from the index, and the sizes of sections from the offsets it records.
+//
+// If the index cannot be refreshed, the error is logged and Du returns false.
+func Du(args []string) bool {
+	fs, verbosePtr := New_FlagSet("du")
+	outDirPtr := fs.String("outdir", "", "report on the journal in the inputted directory")
+	byPtr := fs.String("by", "year", "group days by year, month or section")
+	fs.Parse(args)
+
+	Set_Verbosity(*verbosePtr)
+
+	if fs.NArg() != 0 || *byPtr != "year" && *byPtr != "month" && *byPtr != "section" {
+		errlog.Println("usage: touchlog du [-verbose] [-outdir dir] [-by year|month|section]")
+
+		return false
+	}
+
+	if !Resolve_Outdir(outDirPtr) {
+		return false
+	}
+
+	idx, ok := Load_Index(*outDirPtr)
+	if !ok {
+		return false
+	}
+
+	if _, ok := Refresh_Index(idx); !ok || !Save_Index(idx) {
+		return false
+	}
+
+	quota, ok := Load_Quota(*outDirPtr)
+	if !ok {
+		return false
+	}
+
+	groups := make(map[string]*du_group)
+	add := func(key string, size int64) {
+		g := groups[key]
+		if g == nil {
+			g = &du_group{key: key}
+			groups[key] = g
+		}
+
+		g.days++
+		g.bytes += size
+	}
+
+	for name, e := range idx.Entries {
+		month, _, year, _ := Parse_Log_Name(name)
+
+		switch *byPtr {
+		case "year":
+			add(pad(year, 4), e.Size)
+		case "month":
+			add(pad(year, 4)+"-"+pad(month, 2), e.Size)
+		case "section":
+			if header := e.Section_Size(-1); header > 0 {
+				add(du_header, header)
+			}
+
+			for i, section := range e.Sections {
+				add(section.Name, e.Section_Size(i))
+			}
+		}
+	}
+
+	sorted := make([]*du_group, 0, len(groups))
+	for _, g := range groups {
+		sorted = append(sorted, g)
+	}
+
+	sort.Slice(sorted, func(i, j int) bool {
+		if *byPtr == "section" && sorted[i].bytes != sorted[j].bytes {
+			return sorted[i].bytes > sorted[j].bytes
+		}
+
+		return sorted[i].key < sorted[j].key
+	})
+
+	// sections are measured in content, which compressed logfiles take less of on disk
+	total := idx.Usage()
+	if *byPtr == "section" {
+		total = 0
+		for _, e := range idx.Entries {
+			total += e.Length
+		}
+	}
+
+	for _, g := range sorted {
+		share := 0.0
+		if total > 0 {
+			share = 100 * float64(g.bytes) / float64(total)
+		}
+
+		print.Printf("%-20s %7d days %12s %6.1f%%\n", g.key, g.days, Format_Size(g.bytes), share)
+	}
+
+	print.Printf("%-20s %7d days %12s\n", "total", len(idx.Entries), Format_Size(total))
+
+	for _, state := range []string{history_dir, packs_dir, words_name} {
+		if size, ok := dir_size(State_Path(*outDirPtr, state)); ok {
+			print.Printf("%-20s %17s\n", state, Format_Size(size))
+		}
+	}
+
+	if quota != nil {
+		print.Printf("%-20s %17s %6.1f%% used\n", "quota", Format_Size(quota.Limit),
+			100*float64(idx.Usage())/float64(max(quota.Limit, 1)))
+	}
+
+	return true
+}
+
+// dir_size returns the total size of the files in a directory from their stat alone, and false
+// when the directory does not exist or cannot be listed.
+func dir_size(dir string) (int64, bool) {
+	dirents, err := os.ReadDir(dir)
+	if err != nil {
+		return 0, false
+	}
+
+	var size int64
+	for _, dirent := range dirents {
+		if info, err := dirent.Info(); err == nil && info.Mode().IsRegular() {
+			size += info.Size()
+		}
+	}
+
+	return size, true
+}
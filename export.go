@@ -0,0 +1,387 @@
+package main
+
+import (
+	"bufio"
+	"encoding/json"
+	"os"
+	"path/filepath"
+	"runtime"
+	"sort"
+	"strconv"
+	"strings"
+	"time"
+)
+
+// Export writes the days of a journal, archived days included, to standard output in date order,
+// either as the logfiles one after another or as a JSON object per day. Days can be limited to a
+// range, to those matching a filter expression and to those the filter of a plugin keeps.
+//
+// If every day is successfully exported, Export returns true.
+// Otherwise, the error is logged and Export returns false.
+func Export(args []string) bool {
+	fs, verbosePtr := New_FlagSet("export")
+	outDirPtr := fs.String("outdir", "", "export the journal in the inputted directory")
+	fromPtr := fs.String("from", "", "export days from this mmddyyyy date on")
+	untilPtr := fs.String("until", "", "export days up to this mmddyyyy date")
+	formatPtr := fs.String("format", "text", "text or json")
+	wherePtr := fs.String("where", "", "only export days matching this filter expression")
+	pluginPtr := fs.String("plugin", "", "only export days the filter of this plugin keeps")
+	fs.Parse(args)
+
+	Set_Verbosity(*verbosePtr)
+
+	if fs.NArg() != 0 || *formatPtr != "text" && *formatPtr != "json" {
+		errlog.Println("usage: touchlog export [-verbose] [-outdir dir] [-from mmddyyyy] [-until mmddyyyy] [-format text|json] [-where expr] [-plugin name]")
+
+		return false
+	}
+
+	if !Resolve_Outdir(outDirPtr) {
+		return false
+	}
+
+	from, until, ok := Parse_Range(*fromPtr, *untilPtr)
+	if !ok {
+		return false
+	}
+
+	where, ok := Parse_Where(*wherePtr)
+	if !ok {
+		return false
+	}
+
+	idx, ok := Load_Index(*outDirPtr)
+	if !ok {
+		return false
+	}
+
+	if _, ok := Refresh_Index(idx); !ok || !Save_Index(idx) {
+		return false
+	}
+
+	var filter *Plugin
+
+	if *pluginPtr != "" {
+		plugins, ok = Load_Plugins(*outDirPtr)
+		if !ok {
+			return false
+		}
+
+		filter = Find_Plugin(*pluginPtr)
+		if filter == nil || !filter.hasFilter {
+			errlog.Printf("no plugin %s exporting %s\n", *pluginPtr, plugin_filter)
+
+			return false
+		}
+	}
+
+	out := bufio.NewWriter(os.Stdout)
+	defer out.Flush()
+
+	count := 0
+	// archived days are exported too, so every chunk of the packs is read
+	chunks := func(p *Pack, chunk int) bool {
+		return true
+	}
+
+	ok = Each_Day(idx, from, until, where, chunks, func(name string, date time.Time, data []byte) bool {
+		if filter != nil {
+			keep, err := filter.Filter(date, data)
+			if err != nil {
+				errlog.Printf("plugin %s: %v\n", filter.Name, err)
+
+				return false
+			}
+
+			if !keep {
+				return true
+			}
+		}
+
+		var err error
+
+		if *formatPtr == "json" {
+			err = Export_JSON(out, name, data)
+		} else {
+			_, err = out.WriteString("==> " + name + " <==\n")
+			if err == nil {
+				_, err = out.Write(data)
+			}
+		}
+		if err != nil {
+			errlog.Print(err)
+
+			return false
+		}
+
+		count++
+
+		return true
+	})
+
+	debug.Printf("exported %d days\n", count)
+
+	return ok
+}
+
+// Each_Day calls fn with the content of every indexed day between from and until, in date order,
+// that where matches when it is not nil, and stops at the first call returning false. Days are
+// read, and decompressed when they are stored compressed, by a pool of workers running ahead of fn.
+// When chunks is not nil, the days archived in packs are included too, except those of the chunks
+// it rejects, which are never inflated.
+//
+// If a day cannot be read, the error is logged and Each_Day returns false.
+func Each_Day(idx *Index, from time.Time, until time.Time, where *Filter_Expr,
+	chunks func(p *Pack, chunk int) bool, fn func(name string, date time.Time, data []byte) bool) bool {
+	var names []string
+	var dates []time.Time
+
+	for _, name := range idx.Days() {
+		date, _ := log_date(name)
+		if date.Before(from) || date.After(until) {
+			continue
+		}
+
+		names = append(names, name)
+		dates = append(dates, date)
+	}
+
+	var archived []archived_day
+
+	if chunks != nil {
+		packs, ok := open_packs(idx.Dir, from.Year(), until.Year())
+		if !ok {
+			return false
+		}
+
+		defer func() {
+			for _, p := range packs {
+				p.Close()
+			}
+		}()
+
+		archived = archived_days(packs, from, until, chunks)
+	}
+
+	days := Read_Ahead(idx.Dir, names, runtime.NumCPU())
+	defer days.Stop()
+
+	var view Day_View
+
+	for i, j := 0, 0; i < len(names) || j < len(archived); {
+		var name string
+		var date time.Time
+		var data []byte
+		var err error
+
+		// an archived day comes before a logfile of the same date written since
+		if j < len(archived) && (i == len(names) || !archived[j].date.After(dates[i])) {
+			a := archived[j]
+			j++
+
+			data, err = a.pack.Read(a.entry)
+			name, date = a.entry.Name, a.date
+		} else {
+			data, err = days.Next()
+			name, date = names[i], dates[i]
+			i++
+		}
+
+		if err != nil {
+			errlog.Print(err)
+
+			return false
+		}
+
+		if where != nil {
+			view.Reset(date, data)
+			if !where.Match(&view) {
+				continue
+			}
+		}
+
+		if !fn(name, date, data) {
+			return false
+		}
+	}
+
+	return true
+}
+
+// archived_day is a day archived in a pack.
+type archived_day struct {
+	pack  *Pack
+	entry *Pack_Entry
+	date  time.Time
+}
+
+// open_packs opens the packs of a journal holding the days of the years from first to last.
+//
+// If a pack cannot be opened, the error is logged and open_packs returns nil, false.
+func open_packs(dir string, first int, last int) ([]*Pack, bool) {
+	paths, ok := Pack_Paths(dir)
+	if !ok {
+		return nil, false
+	}
+
+	var packs []*Pack
+
+	for _, path := range paths {
+		year, err := strconv.Atoi(strings.TrimSuffix(filepath.Base(path), pack_ext))
+		if err != nil || year < first || year > last {
+			continue
+		}
+
+		p, err := Open_Pack(path)
+		if err != nil {
+			errlog.Print(err)
+
+			for _, p := range packs {
+				p.Close()
+			}
+
+			return nil, false
+		}
+
+		packs = append(packs, p)
+	}
+
+	return packs, true
+}
+
+// archived_days returns the days of packs between from and until, in date order, leaving out the
+// chunks rejected by chunks.
+func archived_days(packs []*Pack, from time.Time, until time.Time, chunks func(p *Pack, chunk int) bool) []archived_day {
+	var days []archived_day
+
+	skipped, total := 0, 0
+
+	for _, p := range packs {
+		accepted := make(map[int]bool)
+
+		for i := range p.Entries {
+			e := &p.Entries[i]
+
+			date, ok := log_date(e.Name)
+			if !ok || date.Before(from) || date.After(until) {
+				continue
+			}
+
+			accept, decided := accepted[e.Chunk]
+			if !decided {
+				accept = chunks(p, e.Chunk)
+				accepted[e.Chunk] = accept
+
+				total++
+				if !accept {
+					skipped++
+				}
+			}
+
+			if accept {
+				days = append(days, archived_day{pack: p, entry: e, date: date})
+			}
+		}
+	}
+
+	debug.Printf("skipping %d of %d archived chunks\n", skipped, total)
+
+	sort.SliceStable(days, func(i, j int) bool { return days[i].date.Before(days[j].date) })
+
+	return days
+}
+
+// log_date returns the date of a logfile name at midnight, local time.
+func log_date(name string) (time.Time, bool) {
+	month, day, year, ok := Parse_Log_Name(name)
+
+	return time.Date(year, time.Month(month), day, 0, 0, 0, 0, time.Local), ok
+}
+
+type export_section struct {
+	Name    string   `json:"name"`
+	Entries []string `json:"entries"`
+}
+
+type export_day struct {
+	Date     string           `json:"date"`
+	Header   []string         `json:"header"`
+	Sections []export_section `json:"sections"`
+}
+
+// Export_JSON writes a day as one line of JSON holding its date and the non-blank lines of its
+// header and of each section.
+func Export_JSON(out *bufio.Writer, name string, data []byte) error {
+	parsed := Parse_Log(data)
+	day := export_day{Date: name[:len(name)-len(".log")], Header: non_blank(parsed.Header)}
+
+	for _, section := range parsed.Sections {
+		day.Sections = append(day.Sections, export_section{Name: section.Name, Entries: non_blank(section.Body)})
+	}
+
+	enc := json.NewEncoder(out)
+	enc.SetEscapeHTML(false)
+
+	return enc.Encode(day)
+}
+
+func non_blank(lines []string) []string {
+	kept := []string{}
+	for _, line := range lines {
+		if !is_blank(line) {
+			kept = append(kept, line)
+		}
+	}
+
+	return kept
+}
+
+// Parse_Where compiles the filter expression of a -where flag, which may be empty.
+//
+// If the expression is invalid, the error is logged and Parse_Where returns nil, false.
+func Parse_Where(source string) (*Filter_Expr, bool) {
+	if source == "" {
+		return nil, true
+	}
+
+	where, err := Compile_Filter(source)
+	if err != nil {
+		errlog.Print(err)
+
+		return nil, false
+	}
+
+	return where, true
+}
+
+// Parse_Range turns optional mmddyyyy bounds into the first and last date of a range, which is
+// unbounded on a side without a date.
+//
+// If a date is invalid, the error is logged and Parse_Range returns false.
+func Parse_Range(fromArg string, untilArg string) (from time.Time, until time.Time, success bool) {
+	from = time.Date(1, 1, 1, 0, 0, 0, 0, time.Local)
+	until = time.Date(9999, 12, 31, 0, 0, 0, 0, time.Local)
+
+	for _, bound := range []struct {
+		arg  string
+		date *time.Time
+	}{{fromArg, &from}, {untilArg, &until}} {
+		if bound.arg == "" {
+			continue
+		}
+
+		arg := bound.arg
+
+		month, day, year, ok := Handle_Date(&arg)
+		if !ok {
+			return from, until, false
+		}
+
+		*bound.date, ok = To_Time(month, day, year)
+		if !ok {
+			return from, until, false
+		}
+	}
+
+	return from, until, true
+}
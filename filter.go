@@ -0,0 +1,762 @@
+package main
+
+import (
+	"bytes"
+	"fmt"
+	"strconv"
+	"strings"
+	"time"
+	"unicode"
+	"unicode/utf8"
+)
+
+// Day_View is a logfile split into sections without copying: every section refers to its name and
+// body inside Data. Reset reuses the section slice, so viewing day after day does not allocate
+// once it has grown to the largest number of sections seen.
+type Day_View struct {
+	Data     []byte
+	Year     int
+	Month    int
+	Day      int
+	Weekday  int
+	sections []view_section
+}
+
+type view_section struct {
+	start int
+	name  []byte
+	body  []byte
+}
+
+// Reset points the view at the content of another day.
+func (v *Day_View) Reset(date time.Time, data []byte) {
+	v.Data = data
+	v.Year, v.Month, v.Day, v.Weekday = date.Year(), int(date.Month()), date.Day(), int(date.Weekday())
+	v.sections = v.sections[:0]
+
+	prefix := []byte(section_prefix)
+	bodyStart := 0
+
+	for pos := 0; pos < len(data); {
+		end := bytes.IndexByte(data[pos:], '\n')
+		if end < 0 {
+			end = len(data)
+		} else {
+			end += pos
+		}
+
+		if bytes.HasPrefix(data[pos:end], prefix) {
+			if n := len(v.sections); n > 0 {
+				v.sections[n-1].body = data[bodyStart:pos]
+			}
+
+			v.sections = append(v.sections, view_section{start: pos, name: data[pos+len(prefix) : end]})
+			bodyStart = min(end+1, len(data))
+		}
+
+		pos = end + 1
+	}
+
+	if n := len(v.sections); n > 0 {
+		v.sections[n-1].body = data[bodyStart:]
+	}
+}
+
+// Sections returns the number of sections in the view.
+func (v *Day_View) Sections() int {
+	return len(v.sections)
+}
+
+// Section returns the name and body of the i-th section.
+func (v *Day_View) Section(i int) (name []byte, body []byte) {
+	return v.sections[i].name, v.sections[i].body
+}
+
+// Section_Start returns the offset of the line opening the i-th section.
+func (v *Day_View) Section_Start(i int) int {
+	return v.sections[i].start
+}
+
+// Entries counts the non-blank lines of every section with a name, or of all sections when the
+// name is nil.
+func (v *Day_View) Entries(name []byte) int64 {
+	var count int64
+
+	for _, s := range v.sections {
+		if name == nil || bytes.Equal(s.name, name) {
+			count += count_lines(s.body)
+		}
+	}
+
+	return count
+}
+
+func count_lines(body []byte) int64 {
+	var count int64
+
+	blank := true
+	for _, c := range body {
+		switch c {
+		case '\n':
+			if !blank {
+				count++
+			}
+
+			blank = true
+		case ' ', '\t', '\r':
+		default:
+			blank = false
+		}
+	}
+
+	if !blank {
+		count++
+	}
+
+	return count
+}
+
+// Filter_Expr is a compiled predicate over a day.
+type Filter_Expr struct {
+	Source string
+	eval   expr_func
+}
+
+type expr_func func(v *Day_View) int64
+
+// Match reports whether a day satisfies the expression.
+func (f *Filter_Expr) Match(v *Day_View) bool {
+	return f.eval(v) != 0
+}
+
+var weekday_names = map[string]int64{
+	"sun": 0, "mon": 1, "tue": 2, "wed": 3, "thu": 4, "fri": 5, "sat": 6,
+	"sunday": 0, "monday": 1, "tuesday": 2, "wednesday": 3, "thursday": 4, "friday": 5, "saturday": 6,
+}
+
+var month_names = map[string]int64{
+	"jan": 1, "feb": 2, "mar": 3, "apr": 4, "may": 5, "jun": 6, "jul": 7, "aug": 8, "sep": 9, "oct": 10, "nov": 11, "dec": 12,
+	"january": 1, "february": 2, "march": 3, "april": 4, "june": 6, "july": 7, "august": 8, "september": 9,
+	"october": 10, "november": 11, "december": 12,
+}
+
+// Compile_Filter compiles an expression such as `len(events) > 3 && weekday in (Mon, Fri)` into a
+// tree of closures. Every value is an integer and comparisons yield 0 or 1. The expression can use
+// the fields year, month, day, weekday, size and entries, weekday and month names, and the
+// functions len(section), has(section) and contains(section, "text"), where a section is named by
+// an identifier with underscores for spaces or by a string. contains ignores ASCII case, and the
+// section * stands for the whole day.
+func Compile_Filter(source string) (*Filter_Expr, error) {
+	p := &expr_parser{src: source}
+
+	var eval expr_func
+
+	err := p.next()
+	if err == nil {
+		eval, err = p.or()
+	}
+	if err == nil && p.kind != tok_end {
+		err = p.errorf("unexpected %q", p.tok)
+	}
+	if err != nil {
+		return nil, err
+	}
+
+	return &Filter_Expr{Source: source, eval: eval}, nil
+}
+
+type expr_parser struct {
+	src  string
+	pos  int
+	tok  string
+	at   int
+	kind byte
+}
+
+const (
+	tok_end    byte = 0
+	tok_num    byte = 'n'
+	tok_ident  byte = 'i'
+	tok_string byte = 's'
+	tok_op     byte = 'o'
+)
+
+func (p *expr_parser) errorf(format string, args ...any) error {
+	return fmt.Errorf("filter %q at %d: %s", p.src, p.at+1, fmt.Sprintf(format, args...))
+}
+
+func (p *expr_parser) next() error {
+	for p.pos < len(p.src) && unicode.IsSpace(rune(p.src[p.pos])) {
+		p.pos++
+	}
+
+	p.at = p.pos
+	if p.pos == len(p.src) {
+		p.tok, p.kind = "", tok_end
+
+		return nil
+	}
+
+	c := p.src[p.pos]
+	r, size := utf8.DecodeRuneInString(p.src[p.pos:])
+
+	switch {
+	case c >= '0' && c <= '9':
+		for p.pos < len(p.src) && p.src[p.pos] >= '0' && p.src[p.pos] <= '9' {
+			p.pos++
+		}
+
+		p.kind = tok_num
+	case c == '_' || unicode.IsLetter(r):
+		for p.pos < len(p.src) {
+			r, size = utf8.DecodeRuneInString(p.src[p.pos:])
+			if r != '_' && !unicode.IsLetter(r) && (r < '0' || r > '9') {
+				break
+			}
+
+			p.pos += size
+		}
+
+		p.kind = tok_ident
+	case c == '"':
+		value, err := strconv.QuotedPrefix(p.src[p.pos:])
+		if err != nil {
+			return p.errorf("unterminated string")
+		}
+
+		p.pos += len(value)
+		p.kind = tok_string
+	default:
+		p.kind = tok_op
+		p.pos += size
+
+		if p.pos < len(p.src) {
+			switch p.src[p.at : p.pos+1] {
+			case "&&", "||", "==", "!=", "<=", ">=":
+				p.pos++
+			}
+		}
+	}
+
+	p.tok = p.src[p.at:p.pos]
+
+	return nil
+}
+
+func (p *expr_parser) accept(tok string) (bool, error) {
+	if p.kind == tok_op && p.tok == tok || p.kind == tok_ident && p.tok == tok {
+		return true, p.next()
+	}
+
+	return false, nil
+}
+
+func (p *expr_parser) expect(tok string) error {
+	ok, err := p.accept(tok)
+	if err == nil && !ok {
+		err = p.errorf("expected %q", tok)
+	}
+
+	return err
+}
+
+func (p *expr_parser) or() (expr_func, error) {
+	left, err := p.and()
+	for err == nil {
+		var ok bool
+
+		ok, err = p.accept("||")
+		if !ok || err != nil {
+			break
+		}
+
+		var right expr_func
+
+		right, err = p.and()
+		l := left
+		left = func(v *Day_View) int64 {
+			if l(v) != 0 || right(v) != 0 {
+				return 1
+			}
+
+			return 0
+		}
+	}
+
+	return left, err
+}
+
+func (p *expr_parser) and() (expr_func, error) {
+	left, err := p.not()
+	for err == nil {
+		var ok bool
+
+		ok, err = p.accept("&&")
+		if !ok || err != nil {
+			break
+		}
+
+		var right expr_func
+
+		right, err = p.not()
+		l := left
+		left = func(v *Day_View) int64 {
+			if l(v) != 0 && right(v) != 0 {
+				return 1
+			}
+
+			return 0
+		}
+	}
+
+	return left, err
+}
+
+func (p *expr_parser) not() (expr_func, error) {
+	ok, err := p.accept("!")
+	if !ok || err != nil {
+		return p.compare()
+	}
+
+	operand, err := p.not()
+
+	return func(v *Day_View) int64 { return b2i(operand(v) == 0) }, err
+}
+
+func (p *expr_parser) compare() (expr_func, error) {
+	left, err := p.sum()
+	if err != nil {
+		return nil, err
+	}
+
+	if ok, err := p.accept("in"); ok || err != nil {
+		if err != nil {
+			return nil, err
+		}
+
+		return p.in(left)
+	}
+
+	op := p.tok
+	switch {
+	case p.kind != tok_op:
+		return left, nil
+	case op != "==" && op != "!=" && op != "<" && op != "<=" && op != ">" && op != ">=":
+		return left, nil
+	}
+
+	err = p.next()
+	if err != nil {
+		return nil, err
+	}
+
+	right, err := p.sum()
+	if err != nil {
+		return nil, err
+	}
+
+	switch op {
+	case "==":
+		return func(v *Day_View) int64 { return b2i(left(v) == right(v)) }, nil
+	case "!=":
+		return func(v *Day_View) int64 { return b2i(left(v) != right(v)) }, nil
+	case "<":
+		return func(v *Day_View) int64 { return b2i(left(v) < right(v)) }, nil
+	case "<=":
+		return func(v *Day_View) int64 { return b2i(left(v) <= right(v)) }, nil
+	case ">":
+		return func(v *Day_View) int64 { return b2i(left(v) > right(v)) }, nil
+	}
+
+	return func(v *Day_View) int64 { return b2i(left(v) >= right(v)) }, nil
+}
+
+// in compiles membership in a list of constants, as a bit set when they are all small.
+func (p *expr_parser) in(left expr_func) (expr_func, error) {
+	err := p.expect("(")
+	if err != nil {
+		return nil, err
+	}
+
+	var values []int64
+	var set uint64
+	small := true
+
+	for {
+		constant, err := p.literal()
+		if err != nil {
+			return nil, err
+		}
+
+		values = append(values, constant)
+		if constant < 0 || constant > 63 {
+			small = false
+		} else {
+			set |= 1 << constant
+		}
+
+		if ok, err := p.accept(","); !ok || err != nil {
+			if err != nil {
+				return nil, err
+			}
+
+			break
+		}
+	}
+
+	err = p.expect(")")
+	if err != nil {
+		return nil, err
+	}
+
+	if small {
+		return func(v *Day_View) int64 {
+			x := left(v)
+
+			return b2i(x >= 0 && x <= 63 && set&(1<<x) != 0)
+		}, nil
+	}
+
+	return func(v *Day_View) int64 {
+		x := left(v)
+		for _, value := range values {
+			if x == value {
+				return 1
+			}
+		}
+
+		return 0
+	}, nil
+}
+
+// literal reads a possibly negative number or a weekday or month name.
+func (p *expr_parser) literal() (int64, error) {
+	negative, err := p.accept("-")
+	if err != nil {
+		return 0, err
+	}
+
+	var value int64
+	var ok bool
+
+	switch p.kind {
+	case tok_num:
+		value, err = strconv.ParseInt(p.tok, 10, 64)
+		ok = err == nil
+	case tok_ident:
+		value, ok = weekday_names[strings.ToLower(p.tok)]
+		if !ok {
+			value, ok = month_names[strings.ToLower(p.tok)]
+		}
+	}
+
+	if !ok {
+		return 0, p.errorf("expected a number, weekday or month instead of %q", p.tok)
+	}
+
+	if negative {
+		value = -value
+	}
+
+	return value, p.next()
+}
+
+func (p *expr_parser) sum() (expr_func, error) {
+	left, err := p.product()
+	for err == nil && p.kind == tok_op && (p.tok == "+" || p.tok == "-") {
+		op := p.tok
+
+		err = p.next()
+		if err != nil {
+			break
+		}
+
+		var right expr_func
+
+		right, err = p.product()
+		l := left
+		if op == "+" {
+			left = func(v *Day_View) int64 { return l(v) + right(v) }
+		} else {
+			left = func(v *Day_View) int64 { return l(v) - right(v) }
+		}
+	}
+
+	return left, err
+}
+
+func (p *expr_parser) product() (expr_func, error) {
+	left, err := p.unary()
+	for err == nil && p.kind == tok_op && (p.tok == "*" || p.tok == "/" || p.tok == "%") {
+		op := p.tok
+
+		err = p.next()
+		if err != nil {
+			break
+		}
+
+		var right expr_func
+
+		right, err = p.unary()
+		l := left
+
+		switch op {
+		case "*":
+			left = func(v *Day_View) int64 { return l(v) * right(v) }
+		case "/":
+			left = func(v *Day_View) int64 {
+				if d := right(v); d != 0 {
+					return l(v) / d
+				}
+
+				return 0
+			}
+		default:
+			left = func(v *Day_View) int64 {
+				if d := right(v); d != 0 {
+					return l(v) % d
+				}
+
+				return 0
+			}
+		}
+	}
+
+	return left, err
+}
+
+func (p *expr_parser) unary() (expr_func, error) {
+	ok, err := p.accept("-")
+	if !ok || err != nil {
+		return p.primary()
+	}
+
+	operand, err := p.unary()
+
+	return func(v *Day_View) int64 { return -operand(v) }, err
+}
+
+func (p *expr_parser) primary() (expr_func, error) {
+	tok, kind := p.tok, p.kind
+
+	switch kind {
+	case tok_num:
+		value, err := strconv.ParseInt(tok, 10, 64)
+		if err != nil {
+			return nil, p.errorf("%v", err)
+		}
+
+		return constant(value), p.next()
+	case tok_op:
+		if tok != "(" {
+			break
+		}
+
+		err := p.next()
+		if err != nil {
+			return nil, err
+		}
+
+		inner, err := p.or()
+		if err != nil {
+			return nil, err
+		}
+
+		return inner, p.expect(")")
+	case tok_ident:
+		at := p.at
+
+		err := p.next()
+		if err != nil {
+			return nil, err
+		}
+
+		if p.kind == tok_op && p.tok == "(" {
+			return p.call(tok)
+		}
+
+		field, ok := p.field(tok)
+		if !ok {
+			p.at = at
+
+			return nil, p.errorf("unknown name %s", tok)
+		}
+
+		return field, nil
+	}
+
+	if kind == tok_end {
+		return nil, p.errorf("unexpected end of filter")
+	}
+
+	return nil, p.errorf("unexpected %q", tok)
+}
+
+func constant(value int64) expr_func {
+	return func(*Day_View) int64 { return value }
+}
+
+func (p *expr_parser) field(name string) (expr_func, bool) {
+	switch name {
+	case "year":
+		return func(v *Day_View) int64 { return int64(v.Year) }, true
+	case "month":
+		return func(v *Day_View) int64 { return int64(v.Month) }, true
+	case "day":
+		return func(v *Day_View) int64 { return int64(v.Day) }, true
+	case "weekday":
+		return func(v *Day_View) int64 { return int64(v.Weekday) }, true
+	case "size":
+		return func(v *Day_View) int64 { return int64(len(v.Data)) }, true
+	case "entries":
+		return func(v *Day_View) int64 { return v.Entries(nil) }, true
+	case "true":
+		return constant(1), true
+	case "false":
+		return constant(0), true
+	}
+
+	lower := strings.ToLower(name)
+	if value, ok := weekday_names[lower]; ok {
+		return constant(value), true
+	}
+	if value, ok := month_names[lower]; ok {
+		return constant(value), true
+	}
+
+	return nil, false
+}
+
+func (p *expr_parser) call(name string) (expr_func, error) {
+	err := p.next()
+	if err != nil {
+		return nil, err
+	}
+
+	section, err := p.section()
+	if err != nil {
+		return nil, err
+	}
+
+	var result expr_func
+
+	switch name {
+	case "len":
+		result = func(v *Day_View) int64 { return v.Entries(section) }
+	case "has":
+		result = func(v *Day_View) int64 {
+			for _, s := range v.sections {
+				if bytes.Equal(s.name, section) {
+					return 1
+				}
+			}
+
+			return 0
+		}
+	case "contains":
+		err = p.expect(",")
+		if err != nil {
+			return nil, err
+		}
+
+		if p.kind != tok_string {
+			return nil, p.errorf("contains needs a string to look for")
+		}
+
+		text, _ := strconv.Unquote(p.tok)
+		needle := fold(text)
+
+		err = p.next()
+		if err != nil {
+			return nil, err
+		}
+
+		if section == nil {
+			result = func(v *Day_View) int64 { return b2i(contains_fold(v.Data, needle)) }
+		} else {
+			result = func(v *Day_View) int64 {
+				for _, s := range v.sections {
+					if bytes.Equal(s.name, section) && contains_fold(s.body, needle) {
+						return 1
+					}
+				}
+
+				return 0
+			}
+		}
+	default:
+		return nil, p.errorf("unknown function %s", name)
+	}
+
+	return result, p.expect(")")
+}
+
+// section reads a section argument, returning nil for *.
+func (p *expr_parser) section() ([]byte, error) {
+	var name string
+
+	switch {
+	case p.kind == tok_op && p.tok == "*":
+		return nil, p.next()
+	case p.kind == tok_ident:
+		name = strings.ReplaceAll(p.tok, "_", " ")
+	case p.kind == tok_string:
+		name, _ = strconv.Unquote(p.tok)
+	default:
+		return nil, p.errorf("expected a section name")
+	}
+
+	return []byte(name), p.next()
+}
+
+// contains_fold reports whether hay holds needle, which must be lower case, ignoring ASCII case.
+func contains_fold(hay []byte, needle []byte) bool {
+	if len(needle) == 0 {
+		return true
+	}
+
+	first := needle[0]
+	for i := 0; i+len(needle) <= len(hay); i++ {
+		if lower(hay[i]) != first {
+			continue
+		}
+
+		j := 1
+		for j < len(needle) && lower(hay[i+j]) == needle[j] {
+			j++
+		}
+
+		if j == len(needle) {
+			return true
+		}
+	}
+
+	return false
+}
+
+// fold returns a text folded to lower case the way contains_fold folds the text it searches, so
+// only ASCII letters are folded.
+func fold(text string) []byte {
+	folded := make([]byte, len(text))
+	for i := 0; i < len(text); i++ {
+		folded[i] = lower(text[i])
+	}
+
+	return folded
+}
+
+func lower(c byte) byte {
+	if c >= 'A' && c <= 'Z' {
+		return c + 'a' - 'A'
+	}
+
+	return c
+}
+
+func b2i(b bool) int64 {
+	if b {
+		return 1
+	}
+
+	return 0
+}
@@ -0,0 +1,55 @@
+package main
+
+import (
+	"strings"
+	"testing"
+	"time"
+)
+
+func TestFilterContains(t *testing.T) {
+	var view Day_View
+	view.Reset(time.Date(2024, 1, 2, 0, 0, 0, 0, time.UTC),
+		[]byte("# 01/02/2024\n\n|> events\n- lunch with Émile\n\n|> todo\n- call Zoë\n\n|> événements\n- fête\n"))
+
+	tests := []struct {
+		source string
+		match  bool
+	}{
+		{`contains(events, "Émile")`, true},
+		{`contains(events, "ÉMILE")`, true},
+		{`contains(events, "LUNCH")`, true},
+		{`contains(events, "Zoë")`, false},
+		{`contains(todo, "Zoë")`, true},
+		{`contains(*, "ZOË")`, false},
+		{`contains(*, "zoë")`, true},
+		{`has(todo_Zoë)`, false},
+		{`has(événements) && len(événements) == 1`, true},
+		{`has(naïve_todo)`, false},
+	}
+
+	for _, test := range tests {
+		f, err := Compile_Filter(test.source)
+		if err != nil {
+			t.Errorf("%s: %v", test.source, err)
+
+			continue
+		}
+
+		if match := f.Match(&view); match != test.match {
+			t.Errorf("%s: got %v, want %v", test.source, match, test.match)
+		}
+	}
+}
+
+func TestFilterMalformed(t *testing.T) {
+	for _, source := range []string{`has(é`, `len(events) → 1`, `contains(events)`, `has("events"`} {
+		if _, err := Compile_Filter(source); err == nil {
+			t.Errorf("%s: compiled", source)
+		}
+	}
+
+	_, err := Compile_Filter(`len(events) → 1`)
+	if err == nil || !strings.Contains(err.Error(), "→") {
+		t.Errorf("got %v, want an error quoting →", err)
+	}
+}
@@ -0,0 +1,411 @@
+package main
+
+import (
+	"encoding/binary"
+	"unicode/utf8"
+)
+
+// Term_FST is a sorted set of terms stored as a minimal acyclic finite-state transducer: terms
+// sharing a prefix share the states spelling it and terms sharing a suffix share the states
+// spelling that, and the outputs along the transitions spelling a term add up to its ordinal,
+// its rank among the terms in byte order. A term is looked up, and terms are enumerated, in
+// place, without decoding the transducer.
+//
+// States are written children first, each as
+//
+//	transitions<<1 | final
+//	label, output, child       for every transition, in label order
+//
+// with the output and the child's address as varints, so the root, the last state written, is
+// read from where its own address points.
+type Term_FST struct {
+	data []byte
+	root int
+}
+
+// fst_edge is a transition of a state being built; target and words are set once its child is
+// frozen.
+type fst_edge struct {
+	label  byte
+	target int
+	words  int
+}
+
+type fst_state struct {
+	final bool
+	edges []fst_edge
+}
+
+type fst_frozen struct {
+	addr  int
+	words int
+}
+
+// fst_builder builds a Term_FST from terms added in order. The states past the prefix a term
+// shares with the one before it can no longer change, so they are frozen: written out, or
+// replaced by an equivalent state written before, which the register finds by its encoding.
+type fst_builder struct {
+	data     []byte
+	register map[string]fst_frozen
+	scratch  []byte
+}
+
+// Build_Term_FST returns the transducer of terms, which must be sorted and distinct.
+func Build_Term_FST(terms []string) *Term_FST {
+	b := &fst_builder{register: make(map[string]fst_frozen)}
+	path := []*fst_state{{}}
+	prev := ""
+
+	for _, term := range terms {
+		common := 0
+		for common < len(prev) && common < len(term) && prev[common] == term[common] {
+			common++
+		}
+
+		path = b.freeze(path, common)
+
+		for i := common; i < len(term); i++ {
+			last := path[len(path)-1]
+			last.edges = append(last.edges, fst_edge{label: term[i]})
+			path = append(path, &fst_state{})
+		}
+
+		path[len(path)-1].final = true
+		prev = term
+	}
+
+	path = b.freeze(path, 0)
+	root := b.write(path[0])
+
+	return &Term_FST{data: b.data, root: root.addr}
+}
+
+// freeze freezes the states of path deeper than depth, and returns what is left of it.
+func (b *fst_builder) freeze(path []*fst_state, depth int) []*fst_state {
+	for len(path)-1 > depth {
+		child := b.write(path[len(path)-1])
+		path = path[:len(path)-1]
+
+		parent := path[len(path)-1]
+		parent.edges[len(parent.edges)-1].target = child.addr
+		parent.edges[len(parent.edges)-1].words = child.words
+	}
+
+	return path
+}
+
+// write writes a state out, unless an equivalent one was, and returns its address and how many
+// terms it leads to.
+func (b *fst_builder) write(s *fst_state) fst_frozen {
+	words := 0
+	if s.final {
+		words = 1
+	}
+
+	header := uint64(len(s.edges)) << 1
+	if s.final {
+		header |= 1
+	}
+
+	b.scratch = binary.AppendUvarint(b.scratch[:0], header)
+
+	for _, e := range s.edges {
+		b.scratch = append(b.scratch, e.label)
+		b.scratch = binary.AppendUvarint(b.scratch, uint64(words))
+		b.scratch = binary.AppendUvarint(b.scratch, uint64(e.target))
+		words += e.words
+	}
+
+	if f, ok := b.register[string(b.scratch)]; ok {
+		return f
+	}
+
+	f := fst_frozen{addr: len(b.data), words: words}
+	b.register[string(b.scratch)] = f
+	b.data = append(b.data, b.scratch...)
+
+	return f
+}
+
+// Open_Term_FST returns the transducer encoded in data with its root at an address.
+func Open_Term_FST(data []byte, root int) *Term_FST {
+	return &Term_FST{data: data, root: root}
+}
+
+// Encoded returns the encoding of the transducer and the address of its root.
+func (f *Term_FST) Encoded() ([]byte, int) {
+	return f.data, f.root
+}
+
+// state reads the header of the state at an address: whether a term ends there, how many
+// transitions leave it and where they start. A damaged state has no transitions.
+func (f *Term_FST) state(addr int) (final bool, edges int, pos int) {
+	if addr < 0 || addr >= len(f.data) {
+		return false, 0, 0
+	}
+
+	header, n := binary.Uvarint(f.data[addr:])
+	if n <= 0 {
+		return false, 0, 0
+	}
+
+	return header&1 == 1, int(header >> 1), addr + n
+}
+
+// edge reads the transition at pos and returns it along with where the next one starts, or false
+// when it is damaged.
+func (f *Term_FST) edge(pos int) (label byte, output int, target int, next int, ok bool) {
+	if pos >= len(f.data) {
+		return 0, 0, 0, 0, false
+	}
+
+	out, n1 := binary.Uvarint(f.data[pos+1:])
+	if n1 <= 0 {
+		return 0, 0, 0, 0, false
+	}
+
+	to, n2 := binary.Uvarint(f.data[pos+1+n1:])
+	if n2 <= 0 || to >= uint64(len(f.data)) {
+		return 0, 0, 0, 0, false
+	}
+
+	return f.data[pos], int(out), int(to), pos + 1 + n1 + n2, true
+}
+
+// walk follows the transitions spelling a prefix, and returns the state reached and the number of
+// terms ordered before those starting with the prefix, or false when no term does.
+func (f *Term_FST) walk(prefix string) (addr int, ordinal int, found bool) {
+	if len(f.data) == 0 {
+		return 0, 0, false
+	}
+
+	addr = f.root
+
+	for i := 0; i < len(prefix); i++ {
+		_, edges, pos := f.state(addr)
+
+		found = false
+		for ; edges > 0; edges-- {
+			label, output, target, next, ok := f.edge(pos)
+			if !ok || label > prefix[i] {
+				break
+			}
+
+			if label == prefix[i] {
+				addr, ordinal, found = target, ordinal+output, true
+
+				break
+			}
+
+			pos = next
+		}
+
+		if !found {
+			return 0, 0, false
+		}
+	}
+
+	return addr, ordinal, true
+}
+
+// Lookup returns the ordinal of a term, or false when the transducer does not hold it.
+func (f *Term_FST) Lookup(term string) (int, bool) {
+	addr, ordinal, found := f.walk(term)
+	if !found {
+		return 0, false
+	}
+
+	final, _, _ := f.state(addr)
+
+	return ordinal, final
+}
+
+// Each calls fn with every term and its ordinal, in order. The term is only valid during the call.
+func (f *Term_FST) Each(fn func(term []byte, ordinal int)) {
+	if len(f.data) > 0 {
+		f.each(f.root, 0, nil, fn)
+	}
+}
+
+// Prefix calls fn with every term starting with prefix and its ordinal, in order.
+func (f *Term_FST) Prefix(prefix string, fn func(term []byte, ordinal int)) {
+	if addr, ordinal, found := f.walk(prefix); found {
+		f.each(addr, ordinal, []byte(prefix), fn)
+	}
+}
+
+func (f *Term_FST) each(addr int, ordinal int, term []byte, fn func(term []byte, ordinal int)) []byte {
+	final, edges, pos := f.state(addr)
+	if final {
+		fn(term, ordinal)
+	}
+
+	for ; edges > 0; edges-- {
+		label, output, target, next, ok := f.edge(pos)
+		if !ok {
+			break
+		}
+
+		term = f.each(target, ordinal+output, append(term, label), fn)
+		term = term[:len(term)-1]
+		pos = next
+	}
+
+	return term
+}
+
+// Fuzzy calls fn with every term within distance edits of a word, its ordinal and its distance,
+// in order. An edit inserts, deletes or replaces a letter, or swaps two neighbouring ones. With
+// prefix, fn is called instead with every term starting with something within distance edits of
+// the word, as completions of a word mistyped as it was being typed.
+//
+// The transducer is walked along with the Levenshtein automaton of the word, whose states are the
+// rows of edit distances between the word and the letters walked so far, one row per letter.
+// Transitions are only followed while some distance in the row is within bounds, so a lookup
+// visits the few states near the word rather than the whole dictionary.
+func (f *Term_FST) Fuzzy(word string, distance int, prefix bool, fn func(term []byte, ordinal int, distance int)) {
+	if len(f.data) == 0 {
+		return
+	}
+
+	l := &levenshtein{query: []rune(word), limit: distance}
+	w := &fuzzy_walk{f: f, l: l, prefix: prefix, fn: fn}
+
+	w.visit(f.root, 0, 0)
+}
+
+type fuzzy_walk struct {
+	f      *Term_FST
+	l      *levenshtein
+	prefix bool
+	term   []byte
+	fn     func(term []byte, ordinal int, distance int)
+}
+
+// visit walks the state at an address, reached by the letters of w.term, the last of them still
+// incomplete past boundary when it is a UTF-8 sequence of several bytes.
+func (w *fuzzy_walk) visit(addr int, ordinal int, boundary int) {
+	final, edges, pos := w.f.state(addr)
+
+	if boundary == len(w.term) {
+		distance := w.l.distance()
+
+		if w.prefix && distance <= w.l.limit {
+			w.f.each(addr, ordinal, w.term, func(term []byte, ordinal int) {
+				w.fn(term, ordinal, distance)
+			})
+
+			return
+		}
+
+		if final && distance <= w.l.limit {
+			w.fn(w.term, ordinal, distance)
+		}
+	}
+
+	for ; edges > 0; edges-- {
+		label, output, target, next, ok := w.f.edge(pos)
+		if !ok {
+			return
+		}
+
+		w.term = append(w.term, label)
+
+		if utf8.FullRune(w.term[boundary:]) {
+			c, _ := utf8.DecodeRune(w.term[boundary:])
+
+			if w.l.push(c) {
+				w.visit(target, ordinal+output, len(w.term))
+			}
+
+			w.l.pop()
+		} else {
+			w.visit(target, ordinal+output, boundary)
+		}
+
+		w.term = w.term[:len(w.term)-1]
+		pos = next
+	}
+}
+
+// levenshtein is the Levenshtein automaton of a query, with transpositions, run one letter at a
+// time: rows[i][j] is the number of edits between the first i letters pushed and the first j
+// letters of the query.
+type levenshtein struct {
+	query   []rune
+	limit   int
+	letters []rune
+	rows    [][]int
+}
+
+// push steps the automaton with a letter, and tells whether any word starting with the letters
+// pushed so far can still be within the limit.
+func (l *levenshtein) push(c rune) bool {
+	if len(l.rows) == 0 {
+		first := make([]int, len(l.query)+1)
+		for j := range first {
+			first[j] = j
+		}
+
+		l.rows = append(l.rows, first)
+	}
+
+	i := len(l.letters)
+	if len(l.rows) <= i+1 {
+		l.rows = append(l.rows, make([]int, len(l.query)+1))
+	}
+
+	row, next := l.rows[i], l.rows[i+1]
+	next[0] = row[0] + 1
+	least := next[0]
+
+	for j := 1; j <= len(l.query); j++ {
+		cost := 1
+		if l.query[j-1] == c {
+			cost = 0
+		}
+
+		d := min(row[j]+1, next[j-1]+1, row[j-1]+cost)
+
+		if i > 0 && j > 1 && l.query[j-1] == l.letters[i-1] && l.query[j-2] == c {
+			d = min(d, l.rows[i-1][j-2]+1)
+		}
+
+		next[j] = d
+		least = min(least, d)
+	}
+
+	l.letters = append(l.letters, c)
+
+	return least <= l.limit
+}
+
+// pop takes back the last letter pushed.
+func (l *levenshtein) pop() {
+	l.letters = l.letters[:len(l.letters)-1]
+}
+
+// distance returns the number of edits between the letters pushed and the whole query.
+func (l *levenshtein) distance() int {
+	if len(l.letters) == 0 {
+		return len(l.query)
+	}
+
+	return l.rows[len(l.letters)][len(l.query)]
+}
+
+// matches tells whether a word is within the limit of the query, as Fuzzy counts edits.
+func (l *levenshtein) matches(word []byte) bool {
+	l.letters = l.letters[:0]
+
+	for len(word) > 0 {
+		c, n := utf8.DecodeRune(word)
+		word = word[n:]
+
+		if !l.push(c) {
+			return false
+		}
+	}
+
+	return l.distance() <= l.limit
+}
@@ -0,0 +1,701 @@
+package main
+
+import (
+	"bufio"
+	"bytes"
+	"compress/zlib"
+	"crypto/sha1"
+	"encoding/binary"
+	"encoding/hex"
+	"errors"
+	"fmt"
+	"os"
+	"path/filepath"
+	"sort"
+	"strconv"
+	"strings"
+	"time"
+)
+
+// git_state_name keeps, inside the journal, when touchlog last committed and what it has staged
+// since, so that commits can be spaced out by an interval.
+const git_state_name string = "git"
+
+// git_batch collects every logfile written during a run when -git is set, and is nil otherwise.
+var git_batch *Git_Batch
+
+// Git_Batch stages logfiles into the git repository containing a journal by writing their blobs
+// as loose objects and updating the index directly, then records everything staged in a single
+// commit, without running git once per file.
+type Git_Batch struct {
+	GitDir    string
+	CommonDir string
+	WorkTree  string
+	Journal   string
+	Interval  time.Duration
+	staged    map[string][20]byte
+}
+
+type git_index_entry struct {
+	path  string
+	stage int
+	mode  uint32
+	sha   [20]byte
+	raw   []byte
+}
+
+// Open_Git_Batch finds the git repository containing a journal directory.
+//
+// If no repository is found, the error is logged and Open_Git_Batch returns nil, false.
+func Open_Git_Batch(journal string, interval time.Duration) (*Git_Batch, bool) {
+	debug.Printf("Open_Git_Batch(%s, %v)\n", journal, interval)
+
+	for dir := journal; ; dir = filepath.Dir(dir) {
+		dotgit := filepath.Join(dir, ".git")
+
+		info, err := os.Stat(dotgit)
+		if err == nil {
+			gitDir := dotgit
+			if !info.IsDir() {
+				// worktrees and submodules point at their git directory
+				data, err := os.ReadFile(dotgit)
+				if err != nil {
+					errlog.Print(err)
+
+					return nil, false
+				}
+
+				gitDir = strings.TrimSpace(strings.TrimPrefix(string(data), "gitdir:"))
+				if !filepath.IsAbs(gitDir) {
+					gitDir = filepath.Join(dir, gitDir)
+				}
+			}
+
+			commonDir := gitDir
+			if data, err := os.ReadFile(filepath.Join(gitDir, "commondir")); err == nil {
+				commonDir = strings.TrimSpace(string(data))
+				if !filepath.IsAbs(commonDir) {
+					commonDir = filepath.Join(gitDir, commonDir)
+				}
+			}
+
+			debug.Printf("git directory %s, work tree %s\n", gitDir, dir)
+
+			return &Git_Batch{
+				GitDir:    gitDir,
+				CommonDir: commonDir,
+				WorkTree:  dir,
+				Journal:   journal,
+				Interval:  interval,
+				staged:    make(map[string][20]byte),
+			}, true
+		}
+
+		if filepath.Dir(dir) == dir {
+			errlog.Printf("%s is not inside a git repository\n", journal)
+
+			return nil, false
+		}
+	}
+}
+
+// Stage writes the blob of a logfile and remembers it for the index update at Commit.
+//
+// If the blob is successfully written, Stage returns true.
+// Otherwise, the error is logged and Stage returns false.
+func (b *Git_Batch) Stage(path string, data []byte) bool {
+	rel, err := filepath.Rel(b.WorkTree, path)
+	if err != nil || strings.HasPrefix(rel, "..") {
+		errlog.Printf("%s is outside of the work tree %s\n", path, b.WorkTree)
+
+		return false
+	}
+
+	sha, err := b.write_object("blob", data)
+	if err != nil {
+		errlog.Print(err)
+
+		return false
+	}
+
+	b.staged[filepath.ToSlash(rel)] = sha
+
+	return true
+}
+
+// Commit adds everything staged during the run to the index and, unless the last touchlog commit
+// is more recent than the interval, commits the index. As with git commit, anything else already
+// staged in the index is part of the commit too.
+//
+// If the batch is successfully recorded, Commit returns true.
+// Otherwise, the error is logged and Commit returns false.
+func (b *Git_Batch) Commit() bool {
+	debug.Printf("Git_Batch.Commit() with %d staged\n", len(b.staged))
+
+	statePath := State_Path(b.Journal, git_state_name)
+	lastCommit, pending := load_git_state(statePath)
+
+	if len(b.staged) == 0 && len(pending) == 0 {
+		return true
+	}
+
+	indexPath := filepath.Join(b.GitDir, "index")
+
+	lock, err := os.OpenFile(indexPath+".lock", os.O_WRONLY|os.O_CREATE|os.O_EXCL, 0644)
+	if err != nil {
+		errlog.Print(err)
+
+		return false
+	}
+
+	committed := false
+	defer func() {
+		if !committed {
+			lock.Close()
+			os.Remove(indexPath + ".lock")
+		}
+	}()
+
+	version, entries, err := read_git_index(indexPath)
+	if err != nil {
+		errlog.Print(err)
+
+		return false
+	}
+
+	entries, err = b.merge_staged(entries)
+	if err != nil {
+		errlog.Print(err)
+
+		return false
+	}
+
+	for path := range b.staged {
+		pending[path] = true
+	}
+
+	commit := b.Interval == 0 || time.Since(lastCommit) >= b.Interval
+
+	var tree [20]byte
+	if commit {
+		tree, err = b.write_tree(entries)
+		if err != nil {
+			errlog.Print(err)
+
+			return false
+		}
+	}
+
+	_, err = lock.Write(encode_git_index(version, entries))
+	if err == nil {
+		err = lock.Close()
+	}
+	if err == nil {
+		err = os.Rename(indexPath+".lock", indexPath)
+	}
+	if err != nil {
+		errlog.Print(err)
+
+		return false
+	}
+
+	committed = true
+
+	if !commit {
+		print.Printf("staged %d logfiles, committing after %v\n", len(pending),
+			lastCommit.Add(b.Interval).Format(time.Kitchen))
+
+		return save_git_state(statePath, lastCommit, pending)
+	}
+
+	sha, err := b.commit_tree(tree, pending)
+	if err != nil {
+		errlog.Print(err)
+
+		return false
+	}
+
+	print.Printf("committed %d logfiles as %x\n", len(pending), sha[:4])
+
+	return save_git_state(statePath, time.Now(), nil)
+}
+
+// merge_staged replaces or inserts the index entries of the staged paths, with stat data taken
+// from the files just written so that git sees them as clean.
+func (b *Git_Batch) merge_staged(entries []git_index_entry) ([]git_index_entry, error) {
+	merged := entries[:0]
+	for _, entry := range entries {
+		if _, ok := b.staged[entry.path]; !ok {
+			merged = append(merged, entry)
+		}
+	}
+
+	for path, sha := range b.staged {
+		info, err := os.Stat(filepath.Join(b.WorkTree, filepath.FromSlash(path)))
+		if err != nil {
+			return nil, err
+		}
+
+		mode := uint32(0100644)
+		if info.Mode()&0111 != 0 {
+			mode = 0100755
+		}
+
+		raw := make([]byte, 62, 62+len(path))
+		mtime := info.ModTime()
+
+		// ctime, device, inode and owner are left out; git rehashes such entries once and
+		// refreshes them itself
+		binary.BigEndian.PutUint32(raw[8:], uint32(mtime.Unix()))
+		binary.BigEndian.PutUint32(raw[12:], uint32(mtime.Nanosecond()))
+		binary.BigEndian.PutUint32(raw[24:], mode)
+		binary.BigEndian.PutUint32(raw[36:], uint32(info.Size()))
+		copy(raw[40:], sha[:])
+		binary.BigEndian.PutUint16(raw[60:], uint16(min(len(path), 0xfff)))
+		raw = append(raw, path...)
+
+		merged = append(merged, git_index_entry{path: path, mode: mode, sha: sha, raw: raw})
+	}
+
+	sort.SliceStable(merged, func(i, j int) bool {
+		if merged[i].path != merged[j].path {
+			return merged[i].path < merged[j].path
+		}
+
+		return merged[i].stage < merged[j].stage
+	})
+
+	for _, entry := range merged {
+		if entry.stage != 0 {
+			return nil, errors.New("cannot commit with unmerged path " + entry.path)
+		}
+	}
+
+	return merged, nil
+}
+
+// write_tree writes the tree objects for sorted index entries, as git write-tree does.
+func (b *Git_Batch) write_tree(entries []git_index_entry) ([20]byte, error) {
+	type item struct {
+		name string
+		mode string
+		sha  [20]byte
+	}
+
+	var items []item
+
+	for i := 0; i < len(entries); {
+		path := entries[i].path
+
+		slash := strings.IndexByte(path, '/')
+		if slash < 0 {
+			items = append(items, item{name: path, mode: strconv.FormatUint(uint64(entries[i].mode), 8), sha: entries[i].sha})
+			i++
+
+			continue
+		}
+
+		dir := path[:slash+1]
+
+		j := i
+		for j < len(entries) && strings.HasPrefix(entries[j].path, dir) {
+			j++
+		}
+
+		sub := make([]git_index_entry, j-i)
+		for k := range sub {
+			sub[k] = entries[i+k]
+			sub[k].path = strings.TrimPrefix(sub[k].path, dir)
+		}
+
+		sha, err := b.write_tree(sub)
+		if err != nil {
+			return sha, err
+		}
+
+		items = append(items, item{name: path[:slash], mode: "40000", sha: sha})
+		i = j
+	}
+
+	sort.Slice(items, func(i, j int) bool {
+		ki, kj := items[i].name, items[j].name
+		if items[i].mode == "40000" {
+			ki += "/"
+		}
+		if items[j].mode == "40000" {
+			kj += "/"
+		}
+
+		return ki < kj
+	})
+
+	var tree bytes.Buffer
+	for _, it := range items {
+		tree.WriteString(it.mode + " " + it.name + "\x00")
+		tree.Write(it.sha[:])
+	}
+
+	return b.write_object("tree", tree.Bytes())
+}
+
+// commit_tree writes a commit of tree on top of HEAD and moves the current branch to it.
+func (b *Git_Batch) commit_tree(tree [20]byte, paths map[string]bool) ([20]byte, error) {
+	ref, parent, err := b.resolve_head()
+	if err != nil {
+		return [20]byte{}, err
+	}
+
+	name, email := git_identity(b.GitDir)
+	now := time.Now()
+	signature := fmt.Sprintf("%s <%s> %d %s", name, email, now.Unix(), now.Format("-0700"))
+
+	names := make([]string, 0, len(paths))
+	for path := range paths {
+		names = append(names, path)
+	}
+
+	sort.Strings(names)
+
+	subject := "touchlog: write " + names[0]
+	if len(names) > 1 {
+		subject = fmt.Sprintf("touchlog: write %d logfiles", len(names))
+	}
+
+	var commit bytes.Buffer
+
+	fmt.Fprintf(&commit, "tree %x\n", tree)
+	if parent != "" {
+		fmt.Fprintf(&commit, "parent %s\n", parent)
+	}
+	fmt.Fprintf(&commit, "author %s\ncommitter %s\n\n%s\n", signature, signature, subject)
+	if len(names) > 1 && len(names) <= 10 {
+		commit.WriteString("\n" + strings.Join(names, "\n") + "\n")
+	}
+
+	sha, err := b.write_object("commit", commit.Bytes())
+	if err != nil {
+		return sha, err
+	}
+
+	refDir := b.CommonDir
+	if ref == "HEAD" {
+		refDir = b.GitDir
+	}
+
+	refPath := filepath.Join(refDir, filepath.FromSlash(ref))
+
+	err = os.MkdirAll(filepath.Dir(refPath), 0755)
+	if err != nil {
+		return sha, err
+	}
+
+	lock, err := os.OpenFile(refPath+".lock", os.O_WRONLY|os.O_CREATE|os.O_EXCL, 0644)
+	if err != nil {
+		return sha, err
+	}
+
+	_, err = fmt.Fprintf(lock, "%x\n", sha)
+	if cerr := lock.Close(); err == nil {
+		err = cerr
+	}
+	if err == nil {
+		err = os.Rename(refPath+".lock", refPath)
+	}
+	if err != nil {
+		os.Remove(refPath + ".lock")
+
+		return sha, err
+	}
+
+	if parent == "" {
+		parent = strings.Repeat("0", 40)
+	}
+
+	entry := fmt.Sprintf("%s %x %s\tcommit: %s\n", parent, sha, signature, subject)
+	for _, log := range []string{filepath.Join(b.GitDir, "logs", "HEAD"), filepath.Join(b.CommonDir, "logs", filepath.FromSlash(ref))} {
+		append_reflog(log, entry)
+	}
+
+	return sha, nil
+}
+
+// resolve_head returns the ref HEAD points at, or HEAD itself when detached, and the commit it
+// names, which is empty on an unborn branch.
+func (b *Git_Batch) resolve_head() (ref string, sha string, err error) {
+	data, err := os.ReadFile(filepath.Join(b.GitDir, "HEAD"))
+	if err != nil {
+		return "", "", err
+	}
+
+	head := strings.TrimSpace(string(data))
+	if !strings.HasPrefix(head, "ref: ") {
+		return "HEAD", head, nil
+	}
+
+	ref = strings.TrimPrefix(head, "ref: ")
+
+	data, err = os.ReadFile(filepath.Join(b.CommonDir, filepath.FromSlash(ref)))
+	if err == nil {
+		return ref, strings.TrimSpace(string(data)), nil
+	}
+
+	packed, err := os.Open(filepath.Join(b.CommonDir, "packed-refs"))
+	if os.IsNotExist(err) {
+		return ref, "", nil
+	}
+	if err != nil {
+		return "", "", err
+	}
+
+	defer packed.Close()
+
+	scanner := bufio.NewScanner(packed)
+	for scanner.Scan() {
+		if sha, name, ok := strings.Cut(scanner.Text(), " "); ok && name == ref {
+			return ref, sha, nil
+		}
+	}
+
+	return ref, "", scanner.Err()
+}
+
+// write_object stores a loose object unless the repository already has it loose.
+func (b *Git_Batch) write_object(kind string, data []byte) ([20]byte, error) {
+	header := kind + " " + strconv.Itoa(len(data)) + "\x00"
+
+	h := sha1.New()
+	h.Write([]byte(header))
+	h.Write(data)
+
+	var sha [20]byte
+	copy(sha[:], h.Sum(nil))
+
+	name := hex.EncodeToString(sha[:])
+	dir := filepath.Join(b.CommonDir, "objects", name[:2])
+	path := filepath.Join(dir, name[2:])
+
+	if _, err := os.Stat(path); err == nil {
+		return sha, nil
+	}
+
+	var compressed bytes.Buffer
+
+	w := zlib.NewWriter(&compressed)
+	w.Write([]byte(header))
+	w.Write(data)
+	w.Close()
+
+	err := os.MkdirAll(dir, 0755)
+	if err != nil {
+		return sha, err
+	}
+
+	f, err := os.CreateTemp(dir, "tmp_obj_")
+	if err != nil {
+		return sha, err
+	}
+
+	_, err = f.Write(compressed.Bytes())
+	if cerr := f.Close(); err == nil {
+		err = cerr
+	}
+	if err == nil {
+		err = os.Chmod(f.Name(), 0444)
+	}
+	if err == nil {
+		err = os.Rename(f.Name(), path)
+	}
+	if err != nil {
+		os.Remove(f.Name())
+	}
+
+	return sha, err
+}
+
+// read_git_index parses a version 2 or 3 index. Optional extensions are dropped, since a rewritten
+// index invalidates the cached trees they hold.
+func read_git_index(path string) (version uint32, entries []git_index_entry, err error) {
+	data, err := os.ReadFile(path)
+	if os.IsNotExist(err) {
+		return 2, nil, nil
+	}
+	if err != nil {
+		return 0, nil, err
+	}
+
+	if len(data) < 32 || string(data[:4]) != "DIRC" {
+		return 0, nil, errors.New(path + " is not a git index")
+	}
+
+	body, trailer := data[:len(data)-20], data[len(data)-20:]
+	if sum := sha1.Sum(body); !bytes.Equal(sum[:], trailer) && !bytes.Equal(trailer, make([]byte, 20)) {
+		return 0, nil, errors.New(path + " has a bad checksum")
+	}
+
+	version = binary.BigEndian.Uint32(data[4:])
+	if version != 2 && version != 3 {
+		return 0, nil, fmt.Errorf("git index version %d is not supported", version)
+	}
+
+	count := int(binary.BigEndian.Uint32(data[8:]))
+	offset := 12
+
+	for i := 0; i < count; i++ {
+		if offset+62 > len(body) {
+			return 0, nil, errors.New(path + " is truncated")
+		}
+
+		flags := binary.BigEndian.Uint16(body[offset+60:])
+
+		fixed := 62
+		if version == 3 && flags&0x4000 != 0 {
+			fixed += 2
+		}
+
+		end := bytes.IndexByte(body[offset+fixed:], 0)
+		if end < 0 {
+			return 0, nil, errors.New(path + " is truncated")
+		}
+
+		raw := body[offset : offset+fixed+end]
+		entry := git_index_entry{
+			path:  string(raw[fixed:]),
+			stage: int(flags>>12) & 3,
+			mode:  binary.BigEndian.Uint32(raw[24:]),
+			raw:   raw,
+		}
+		copy(entry.sha[:], raw[40:60])
+
+		entries = append(entries, entry)
+		offset += (fixed + end + 8) &^ 7
+	}
+
+	for offset+8 <= len(body) {
+		signature := body[offset : offset+4]
+		if signature[0] < 'A' || signature[0] > 'Z' {
+			return 0, nil, fmt.Errorf("git index extension %q is not supported", signature)
+		}
+
+		offset += 8 + int(binary.BigEndian.Uint32(body[offset+4:]))
+	}
+
+	return version, entries, nil
+}
+
+func encode_git_index(version uint32, entries []git_index_entry) []byte {
+	var out bytes.Buffer
+
+	out.WriteString("DIRC")
+	binary.Write(&out, binary.BigEndian, version)
+	binary.Write(&out, binary.BigEndian, uint32(len(entries)))
+
+	for _, entry := range entries {
+		out.Write(entry.raw)
+		out.Write(make([]byte, (len(entry.raw)+8)&^7-len(entry.raw)))
+	}
+
+	sum := sha1.Sum(out.Bytes())
+	out.Write(sum[:])
+
+	return out.Bytes()
+}
+
+// git_identity returns the committer identity from the environment or the repository and user
+// configuration, falling back to touchlog itself.
+func git_identity(gitDir string) (name string, email string) {
+	name, email = os.Getenv("GIT_COMMITTER_NAME"), os.Getenv("GIT_COMMITTER_EMAIL")
+
+	configs := []string{filepath.Join(gitDir, "config")}
+	if home, err := os.UserHomeDir(); err == nil {
+		configs = append(configs, filepath.Join(home, ".gitconfig"))
+	}
+
+	for _, config := range configs {
+		f, err := os.Open(config)
+		if err != nil {
+			continue
+		}
+
+		section := ""
+		scanner := bufio.NewScanner(f)
+		for scanner.Scan() {
+			line := strings.TrimSpace(scanner.Text())
+			if strings.HasPrefix(line, "[") {
+				section = strings.ToLower(strings.Trim(line, "[] "))
+
+				continue
+			}
+
+			key, value, ok := strings.Cut(line, "=")
+			if !ok || section != "user" {
+				continue
+			}
+
+			key, value = strings.ToLower(strings.TrimSpace(key)), strings.TrimSpace(value)
+			if key == "name" && name == "" {
+				name = value
+			} else if key == "email" && email == "" {
+				email = value
+			}
+		}
+
+		f.Close()
+	}
+
+	if name == "" {
+		name = "touchlog"
+	}
+	if email == "" {
+		email = "touchlog@localhost"
+	}
+
+	return name, email
+}
+
+func append_reflog(path string, entry string) {
+	if _, err := os.Stat(filepath.Dir(path)); err != nil {
+		return
+	}
+
+	f, err := os.OpenFile(path, os.O_WRONLY|os.O_CREATE|os.O_APPEND, 0644)
+	if err != nil {
+		debug.Print(err)
+
+		return
+	}
+
+	defer f.Close()
+
+	f.WriteString(entry)
+}
+
+func load_git_state(path string) (lastCommit time.Time, pending map[string]bool) {
+	pending = make(map[string]bool)
+
+	data, err := os.ReadFile(path)
+	if err != nil {
+		return
+	}
+
+	lines := strings.Split(strings.TrimSpace(string(data)), "\n")
+	if unix, err := strconv.ParseInt(lines[0], 10, 64); err == nil {
+		lastCommit = time.Unix(unix, 0)
+	}
+
+	for _, line := range lines[1:] {
+		pending[line] = true
+	}
+
+	return
+}
+
+func save_git_state(path string, lastCommit time.Time, pending map[string]bool) bool {
+	var sb strings.Builder
+
+	sb.WriteString(strconv.FormatInt(lastCommit.Unix(), 10) + "\n")
+	for path := range pending {
+		sb.WriteString(path + "\n")
+	}
+
+	return Write_Atomic(path, []byte(sb.String()))
+}
@@ -0,0 +1,192 @@
+package main
+
+import (
+	"encoding/binary"
+	"os"
+	"os/exec"
+	"path/filepath"
+	"strings"
+	"testing"
+)
+
+// git_test_run runs git in a repository and returns its trimmed output, failing the test when git
+// does.
+func git_test_run(t *testing.T, dir string, args ...string) string {
+	t.Helper()
+
+	cmd := exec.Command("git", args...)
+	cmd.Dir = dir
+
+	out, err := cmd.CombinedOutput()
+	if err != nil {
+		t.Fatalf("git %s: %v\n%s", strings.Join(args, " "), err, out)
+	}
+
+	return strings.TrimSpace(string(out))
+}
+
+func TestGitBatch(t *testing.T) {
+	if _, err := exec.LookPath("git"); err != nil {
+		t.Skip("git is not installed")
+	}
+
+	for _, name := range []string{"GIT_AUTHOR_NAME", "GIT_COMMITTER_NAME"} {
+		t.Setenv(name, "Touchlog Test")
+	}
+	for _, name := range []string{"GIT_AUTHOR_EMAIL", "GIT_COMMITTER_EMAIL"} {
+		t.Setenv(name, "touchlog@example.com")
+	}
+	t.Setenv("GIT_CONFIG_GLOBAL", os.DevNull)
+	t.Setenv("GIT_CONFIG_NOSYSTEM", "1")
+
+	tests := []struct {
+		name    string
+		setup   []string
+		version uint32
+		fails   bool
+	}{
+		{"version 2 index", nil, 2, false},
+		{"version 3 index with extended flags", []string{"update-index --skip-worktree README"}, 3, false},
+		{"files removed from the index", []string{"rm -q --cached README notes/old.txt"}, 2, false},
+		{"version 4 index", []string{"update-index --index-version 4"}, 4, true},
+	}
+
+	for _, test := range tests {
+		t.Run(test.name, func(t *testing.T) {
+			dir := t.TempDir()
+			journal := filepath.Join(dir, "journal")
+
+			git_test_run(t, dir, "init", "-q")
+			os.MkdirAll(filepath.Join(dir, "notes"), 0755)
+			os.MkdirAll(journal, 0755)
+			os.WriteFile(filepath.Join(dir, "README"), []byte("journal\n"), 0644)
+			os.WriteFile(filepath.Join(dir, "notes", "old.txt"), []byte("old\n"), 0644)
+			git_test_run(t, dir, "add", "README", "notes/old.txt")
+			git_test_run(t, dir, "commit", "-q", "-m", "start")
+
+			for _, args := range test.setup {
+				git_test_run(t, dir, strings.Fields(args)...)
+			}
+
+			days := map[string]string{
+				"01-01-2024.log": "> month: 01\n|> events\nnew year\n",
+				"01-02-2024.log": "> month: 01\n|> events\nback to work\n",
+				"12-31-2023.log": "> month: 12\n|> events\n",
+			}
+
+			for round := 0; round < 2; round++ {
+				b, ok := Open_Git_Batch(journal, 0)
+				if !ok {
+					t.Fatal("no repository found")
+				}
+
+				for name, content := range days {
+					if round == 1 && name != "01-02-2024.log" {
+						continue
+					}
+
+					data := []byte(content + strings.Repeat("more\n", round))
+					path := filepath.Join(journal, name)
+					os.WriteFile(path, data, 0644)
+
+					if !b.Stage(path, data) {
+						t.Fatalf("staging %s failed", name)
+					}
+				}
+
+				if ok := b.Commit(); ok == test.fails {
+					t.Fatalf("round %d: Commit returned %v", round, ok)
+				}
+
+				if test.fails {
+					if _, err := os.Stat(filepath.Join(dir, ".git", "index.lock")); !os.IsNotExist(err) {
+						t.Errorf("index.lock left behind: %v", err)
+					}
+
+					return
+				}
+
+				git_test_run(t, dir, "fsck", "--strict", "--no-progress", "--no-dangling")
+
+				// the index written matches both the commit and the work tree
+				git_test_run(t, dir, "diff", "--cached", "--quiet", "HEAD")
+				git_test_run(t, dir, "diff", "--quiet")
+				if status := git_test_run(t, dir, "status", "--porcelain", "--untracked-files=no"); status != "" {
+					t.Errorf("round %d: work tree not clean:\n%s", round, status)
+				}
+
+				for name := range days {
+					path := "journal/" + name
+					want := git_test_run(t, dir, "hash-object", path)
+					if got := git_test_run(t, dir, "rev-parse", "HEAD:"+path); got != want {
+						t.Errorf("round %d: %s committed as %s, want %s", round, name, got, want)
+					}
+				}
+
+				index, err := os.ReadFile(filepath.Join(dir, ".git", "index"))
+				if err != nil {
+					t.Fatal(err)
+				}
+
+				if version := binary.BigEndian.Uint32(index[4:]); version != test.version {
+					t.Errorf("round %d: index version %d, want %d", round, version, test.version)
+				}
+			}
+
+			if got := git_test_run(t, dir, "rev-list", "--count", "HEAD"); got != "3" {
+				t.Errorf("%s commits, want 3", got)
+			}
+
+			if test.version == 3 && !strings.HasPrefix(git_test_run(t, dir, "ls-files", "-v", "README"), "S ") {
+				t.Errorf("README lost its skip-worktree flag")
+			}
+
+			tracked := git_test_run(t, dir, "ls-files")
+			if strings.Contains(test.name, "removed") == strings.Contains(tracked, "README") {
+				t.Errorf("unexpected tracked files:\n%s", tracked)
+			}
+		})
+	}
+}
+
+func TestGitIndexRoundTrip(t *testing.T) {
+	if _, err := exec.LookPath("git"); err != nil {
+		t.Skip("git is not installed")
+	}
+
+	dir := t.TempDir()
+
+	git_test_run(t, dir, "init", "-q")
+	for _, name := range []string{"a", "b/c", "b/d/e", strings.Repeat("long", 40)} {
+		os.MkdirAll(filepath.Join(dir, filepath.Dir(name)), 0755)
+		os.WriteFile(filepath.Join(dir, name), []byte(name), 0644)
+	}
+	git_test_run(t, dir, "add", ".")
+	git_test_run(t, dir, "update-index", "--skip-worktree", "b/c")
+
+	path := filepath.Join(dir, ".git", "index")
+	before := git_test_run(t, dir, "ls-files", "-s", "-v", "--debug")
+
+	version, entries, err := read_git_index(path)
+	if err != nil || version != 3 || len(entries) != 4 {
+		t.Fatalf("read_git_index: version %d, %d entries, %v", version, len(entries), err)
+	}
+
+	if err := os.WriteFile(path, encode_git_index(version, entries), 0644); err != nil {
+		t.Fatal(err)
+	}
+
+	if after := git_test_run(t, dir, "ls-files", "-s", "-v", "--debug"); after != before {
+		t.Errorf("index changed when rewritten:\n%s\nwant\n%s", after, before)
+	}
+
+	git_test_run(t, dir, "fsck", "--strict", "--no-progress", "--no-dangling")
+
+	data, _ := os.ReadFile(path)
+	data[len(data)-1] ^= 1
+	os.WriteFile(path, data, 0644)
+
+	if _, _, err := read_git_index(path); err == nil {
+		t.Errorf("an index with a bad checksum was read")
+	}
+}
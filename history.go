@@ -0,0 +1,599 @@
+package main
+
+import (
+	"bytes"
+	"crypto/sha256"
+	"encoding/binary"
+	"errors"
+	"io"
+	"os"
+	"path/filepath"
+	"strconv"
+	"strings"
+	"time"
+)
+
+// The history of a logfile is an append-only record file plus a table of record offsets, so any
+// version can be found with a single seek. Every snapshot_interval-th version is stored in full
+// and the others as a delta against the version before them, which bounds a restore to one
+// snapshot and fewer than snapshot_interval deltas however long the history grows.
+const history_dir string = "history"
+const history_ext string = ".hist"
+const history_offsets_ext string = ".hidx"
+const snapshot_interval int = 32
+
+const record_snapshot byte = 'S'
+const record_delta byte = 'D'
+
+// record_header_size is the size of a record header: kind, unix time, content size, content hash
+// and payload size.
+const record_header_size int = 1 + 8 + 4 + sha256.Size + 4
+
+// Delta operations, each followed by uvarint arguments.
+const delta_copy byte = 1
+const delta_insert byte = 2
+
+// delta_block is the length of the blocks of the previous version that a delta can copy from.
+const delta_block int = 16
+
+// History_Record describes one version of a logfile in the history store.
+type History_Record struct {
+	Version int
+	Kind    byte
+	Time    time.Time
+	Size    int
+	Hash    [sha256.Size]byte
+	offset  int64
+	payload int
+}
+
+// Save_Log atomically replaces the content of a logfile, records the new version in the history
+// store, stages it when committing to git and tells the hooks about it. Content the history has
+// not seen yet, such as hand edits made since touchlog last wrote the logfile, is recorded first,
+// so that nothing touchlog overwrites is lost. A compressed logfile is replaced by the logfile
+// stored as is.
+//
+// If the logfile is successfully written, Save_Log returns true.
+// Otherwise, the error is logged and Save_Log returns false.
+func Save_Log(dir string, name string, data []byte) bool {
+	debug.Printf("Save_Log(%s, %s)\n", dir, name)
+
+	path := filepath.Join(dir, name)
+
+	event := "modified"
+
+	old, ext, err := read_log(dir, name)
+	switch {
+	case os.IsNotExist(err):
+		event = "created"
+	case err == nil:
+		if !Record_History(dir, name, old) {
+			return false
+		}
+	default:
+		errlog.Print(err)
+
+		return false
+	}
+
+	if !Write_Atomic(path, data) {
+		return false
+	}
+
+	// a day written again is stored as is, in place of the compressed file it was read from
+	if ext != "" {
+		err = os.Remove(path + ext)
+		if err != nil {
+			errlog.Print(err)
+
+			return false
+		}
+	}
+
+	if git_batch != nil && !git_batch.Stage(path, data) {
+		return false
+	}
+
+	if !Record_History(dir, name, data) {
+		return false
+	}
+
+	Emit_Hook_Event(event, path)
+
+	return true
+}
+
+// Record_History appends content to the history of a logfile unless it is already the latest
+// version there.
+//
+// If the version is successfully recorded, Record_History returns true.
+// Otherwise, the error is logged and Record_History returns false.
+func Record_History(dir string, name string, data []byte) bool {
+	debug.Printf("Record_History(%s, %s, %d bytes)\n", dir, name, len(data))
+
+	err := os.MkdirAll(State_Path(dir, history_dir), 0755)
+	if err != nil {
+		errlog.Print(err)
+
+		return false
+	}
+
+	f, err := os.OpenFile(history_path(dir, name, history_ext), os.O_RDWR|os.O_CREATE, 0644)
+	if err != nil {
+		errlog.Print(err)
+
+		return false
+	}
+
+	defer f.Close()
+
+	offsets, err := load_history_offsets(f, history_path(dir, name, history_offsets_ext))
+	if err != nil {
+		errlog.Print(err)
+
+		return false
+	}
+
+	hash := sha256.Sum256(data)
+	kind, payload := record_snapshot, data
+
+	if len(offsets) > 0 {
+		head, err := read_history_header(f, len(offsets), offsets[len(offsets)-1])
+		if err != nil {
+			errlog.Print(err)
+
+			return false
+		}
+
+		if head.Hash == hash {
+			debug.Printf("%s is already version %d\n", name, head.Version)
+
+			return true
+		}
+
+		if len(offsets)%snapshot_interval != 0 {
+			previous, err := restore_history(f, offsets, len(offsets))
+			if err != nil {
+				errlog.Print(err)
+
+				return false
+			}
+
+			kind, payload = record_delta, Encode_Delta(previous, data)
+		}
+	}
+
+	end, err := f.Seek(0, io.SeekEnd)
+	if err != nil {
+		errlog.Print(err)
+
+		return false
+	}
+
+	record := make([]byte, record_header_size, record_header_size+len(payload))
+	record[0] = kind
+	binary.LittleEndian.PutUint64(record[1:], uint64(time.Now().Unix()))
+	binary.LittleEndian.PutUint32(record[9:], uint32(len(data)))
+	copy(record[13:], hash[:])
+	binary.LittleEndian.PutUint32(record[13+sha256.Size:], uint32(len(payload)))
+	record = append(record, payload...)
+
+	_, err = f.Write(record)
+	if err != nil {
+		errlog.Print(err)
+
+		return false
+	}
+
+	idx, err := os.OpenFile(history_path(dir, name, history_offsets_ext), os.O_WRONLY|os.O_CREATE|os.O_APPEND, 0644)
+	if err != nil {
+		errlog.Print(err)
+
+		return false
+	}
+
+	defer idx.Close()
+
+	_, err = idx.Write(binary.LittleEndian.AppendUint64(nil, uint64(end)))
+	if err != nil {
+		errlog.Print(err)
+
+		return false
+	}
+
+	debug.Printf("recorded %s version %d (%c, %d byte payload)\n", name, len(offsets)+1, kind, len(payload))
+
+	return true
+}
+
+// Load_History returns the record of every version of a logfile, oldest first.
+//
+// If the history cannot be read, the error is logged and Load_History returns nil, false.
+func Load_History(dir string, name string) ([]History_Record, bool) {
+	f, err := os.Open(history_path(dir, name, history_ext))
+	if os.IsNotExist(err) {
+		return nil, true
+	}
+	if err != nil {
+		errlog.Print(err)
+
+		return nil, false
+	}
+
+	defer f.Close()
+
+	offsets, err := load_history_offsets(f, history_path(dir, name, history_offsets_ext))
+	if err != nil {
+		errlog.Print(err)
+
+		return nil, false
+	}
+
+	records := make([]History_Record, len(offsets))
+	for i, offset := range offsets {
+		records[i], err = read_history_header(f, i+1, offset)
+		if err != nil {
+			errlog.Print(err)
+
+			return nil, false
+		}
+	}
+
+	return records, true
+}
+
+// Restore_Version reconstructs the content a logfile had at a version of its history.
+//
+// If the version cannot be reconstructed, the error is logged and Restore_Version returns nil, false.
+func Restore_Version(dir string, name string, version int) ([]byte, bool) {
+	f, err := os.Open(history_path(dir, name, history_ext))
+	if err != nil {
+		errlog.Print(err)
+
+		return nil, false
+	}
+
+	defer f.Close()
+
+	offsets, err := load_history_offsets(f, history_path(dir, name, history_offsets_ext))
+	if err != nil {
+		errlog.Print(err)
+
+		return nil, false
+	}
+
+	if version < 1 || version > len(offsets) {
+		errlog.Printf("%s has no version %d, its history has %d versions\n", name, version, len(offsets))
+
+		return nil, false
+	}
+
+	data, err := restore_history(f, offsets, version)
+	if err != nil {
+		errlog.Print(err)
+
+		return nil, false
+	}
+
+	return data, true
+}
+
+// History lists the recorded versions of the logfile for a date.
+//
+// If the history is successfully listed, History returns true.
+// Otherwise, the error is logged and History returns false.
+func History(args []string) bool {
+	fs, verbosePtr := New_FlagSet("history")
+	outDirPtr := fs.String("outdir", "", "read the journal in the inputted directory")
+	fs.Parse(args)
+
+	Set_Verbosity(*verbosePtr)
+
+	date := fs.Arg(0)
+	if fs.NArg() > 1 {
+		errlog.Println("usage: touchlog history [-verbose] [-outdir dir] [mmddyyyy]")
+
+		return false
+	}
+
+	month, day, year, ok := Handle_Date(&date)
+	if !ok || !Resolve_Outdir(outDirPtr) {
+		return false
+	}
+
+	name := Log_Name(month, day, year)
+
+	records, ok := Load_History(*outDirPtr, name)
+	if !ok {
+		return false
+	}
+
+	if len(records) == 0 {
+		print.Printf("%s has no recorded history\n", name)
+
+		return true
+	}
+
+	for _, record := range records {
+		print.Printf("%s%s%s@%d\t%s\t%d bytes\t%x\t%c\n", month, day, year, record.Version,
+			record.Time.Format(time.RFC3339), record.Size, record.Hash[:6], record.Kind)
+	}
+
+	return true
+}
+
+// Restore replaces the logfile for a date with one of its recorded versions, given as
+// mmddyyyy@version. The restore is itself recorded, so it can be undone.
+//
+// If the version is successfully restored, Restore returns true.
+// Otherwise, the error is logged and Restore returns false.
+func Restore(args []string) bool {
+	fs, verbosePtr := New_FlagSet("restore")
+	outDirPtr := fs.String("outdir", "", "restore into the journal in the inputted directory")
+	fs.Parse(args)
+
+	Set_Verbosity(*verbosePtr)
+
+	date, versionStr, found := strings.Cut(fs.Arg(0), "@")
+	version, err := strconv.Atoi(versionStr)
+	if fs.NArg() != 1 || !found || err != nil {
+		errlog.Println("usage: touchlog restore [-verbose] [-outdir dir] mmddyyyy@version")
+
+		return false
+	}
+
+	month, day, year, ok := Handle_Date(&date)
+	if !ok || !Resolve_Outdir(outDirPtr) {
+		return false
+	}
+
+	name := Log_Name(month, day, year)
+
+	data, ok := Restore_Version(*outDirPtr, name, version)
+	if !ok || !Save_Log(*outDirPtr, name, data) {
+		return false
+	}
+
+	print.Printf("restored %s to version %d\n", name, version)
+
+	return true
+}
+
+func history_path(dir string, name string, ext string) string {
+	return State_Path(dir, history_dir, name+ext)
+}
+
+// load_history_offsets reads the offset table of a history file. A table left short or long by an
+// interrupted append is rebuilt by walking the record headers.
+func load_history_offsets(f *os.File, path string) ([]int64, error) {
+	info, err := f.Stat()
+	if err != nil {
+		return nil, err
+	}
+
+	raw, err := os.ReadFile(path)
+	if err != nil && !os.IsNotExist(err) {
+		return nil, err
+	}
+
+	offsets := make([]int64, len(raw)/8)
+	for i := range offsets {
+		offsets[i] = int64(binary.LittleEndian.Uint64(raw[8*i:]))
+	}
+
+	if len(raw)%8 == 0 {
+		if len(offsets) == 0 && info.Size() == 0 {
+			return offsets, nil
+		}
+
+		if len(offsets) > 0 {
+			last, err := read_history_header(f, len(offsets), offsets[len(offsets)-1])
+			if err == nil && last.offset+int64(record_header_size+last.payload) == info.Size() {
+				return offsets, nil
+			}
+		}
+	}
+
+	debug.Printf("rebuilding history offsets %s\n", path)
+
+	offsets = offsets[:0]
+	for offset := int64(0); offset < info.Size(); {
+		record, err := read_history_header(f, len(offsets)+1, offset)
+		if err != nil || offset+int64(record_header_size+record.payload) > info.Size() {
+			// a torn record at the end of the file is dropped
+			err = f.Truncate(offset)
+			if err != nil {
+				return nil, err
+			}
+
+			break
+		}
+
+		offsets = append(offsets, offset)
+		offset += int64(record_header_size + record.payload)
+	}
+
+	raw = raw[:0]
+	for _, offset := range offsets {
+		raw = binary.LittleEndian.AppendUint64(raw, uint64(offset))
+	}
+
+	return offsets, os.WriteFile(path, raw, 0644)
+}
+
+func read_history_header(f *os.File, version int, offset int64) (History_Record, error) {
+	header := make([]byte, record_header_size)
+
+	_, err := f.ReadAt(header, offset)
+	if err != nil {
+		return History_Record{}, err
+	}
+
+	if header[0] != record_snapshot && header[0] != record_delta {
+		return History_Record{}, errors.New("corrupt history record at offset " + strconv.FormatInt(offset, 10))
+	}
+
+	record := History_Record{
+		Version: version,
+		Kind:    header[0],
+		Time:    time.Unix(int64(binary.LittleEndian.Uint64(header[1:])), 0),
+		Size:    int(binary.LittleEndian.Uint32(header[9:])),
+		offset:  offset,
+		payload: int(binary.LittleEndian.Uint32(header[13+sha256.Size:])),
+	}
+	copy(record.Hash[:], header[13:])
+
+	return record, nil
+}
+
+// restore_history rebuilds a version from the closest snapshot at or before it.
+func restore_history(f *os.File, offsets []int64, version int) ([]byte, error) {
+	first := version - (version-1)%snapshot_interval
+
+	var data []byte
+
+	for v := first; v <= version; v++ {
+		record, err := read_history_header(f, v, offsets[v-1])
+		if err != nil {
+			return nil, err
+		}
+
+		payload := make([]byte, record.payload)
+
+		_, err = f.ReadAt(payload, record.offset+int64(record_header_size))
+		if err != nil {
+			return nil, err
+		}
+
+		if record.Kind == record_snapshot {
+			data = payload
+		} else {
+			data, err = Apply_Delta(data, payload)
+			if err != nil {
+				return nil, err
+			}
+		}
+
+		if sha256.Sum256(data) != record.Hash {
+			return nil, errors.New("history of version " + strconv.Itoa(v) + " does not match its hash")
+		}
+	}
+
+	return data, nil
+}
+
+// Encode_Delta describes next as copies of ranges of previous and inserted literal bytes. The
+// common prefix and suffix are copied whole, and the rest is matched against the blocks of
+// previous, which keeps the deltas of appends and small edits to a few bytes.
+func Encode_Delta(previous []byte, next []byte) []byte {
+	var delta []byte
+
+	prefix := 0
+	for prefix < len(previous) && prefix < len(next) && previous[prefix] == next[prefix] {
+		prefix++
+	}
+
+	suffix := 0
+	for suffix < len(previous)-prefix && suffix < len(next)-prefix &&
+		previous[len(previous)-1-suffix] == next[len(next)-1-suffix] {
+		suffix++
+	}
+
+	emit_copy := func(offset int, length int) {
+		if length > 0 {
+			delta = append(delta, delta_copy)
+			delta = binary.AppendUvarint(delta, uint64(offset))
+			delta = binary.AppendUvarint(delta, uint64(length))
+		}
+	}
+
+	emit_insert := func(literal []byte) {
+		if len(literal) > 0 {
+			delta = append(delta, delta_insert)
+			delta = binary.AppendUvarint(delta, uint64(len(literal)))
+			delta = append(delta, literal...)
+		}
+	}
+
+	emit_copy(0, prefix)
+
+	blocks := make(map[uint64]int)
+	for offset := 0; offset+delta_block <= len(previous); offset += delta_block {
+		key := block_hash(previous[offset : offset+delta_block])
+		if _, ok := blocks[key]; !ok {
+			blocks[key] = offset
+		}
+	}
+
+	middle := next[prefix : len(next)-suffix]
+	literal := 0
+	for i := 0; i+delta_block <= len(middle); {
+		offset, ok := blocks[block_hash(middle[i:i+delta_block])]
+		if !ok || !bytes.Equal(previous[offset:offset+delta_block], middle[i:i+delta_block]) {
+			i++
+
+			continue
+		}
+
+		length := delta_block
+		for i+length < len(middle) && offset+length < len(previous) && previous[offset+length] == middle[i+length] {
+			length++
+		}
+
+		emit_insert(middle[literal:i])
+		emit_copy(offset, length)
+
+		i += length
+		literal = i
+	}
+
+	emit_insert(middle[literal:])
+	emit_copy(len(previous)-suffix, suffix)
+
+	return delta
+}
+
+// Apply_Delta rebuilds the content a delta from Encode_Delta describes.
+func Apply_Delta(previous []byte, delta []byte) ([]byte, error) {
+	var next []byte
+
+	r := bytes.NewReader(delta)
+	for r.Len() > 0 {
+		op, _ := r.ReadByte()
+
+		switch op {
+		case delta_copy:
+			offset, err1 := binary.ReadUvarint(r)
+			length, err2 := binary.ReadUvarint(r)
+			if err1 != nil || err2 != nil || offset+length > uint64(len(previous)) {
+				return nil, errors.New("corrupt delta copy")
+			}
+
+			next = append(next, previous[offset:offset+length]...)
+		case delta_insert:
+			length, err := binary.ReadUvarint(r)
+			if err != nil || length > uint64(r.Len()) {
+				return nil, errors.New("corrupt delta insert")
+			}
+
+			start := len(next)
+			next = append(next, make([]byte, length)...)
+			r.Read(next[start:])
+		default:
+			return nil, errors.New("unknown delta operation")
+		}
+	}
+
+	return next, nil
+}
+
+// block_hash is FNV-1a, inlined so matching a block does not allocate.
+func block_hash(block []byte) uint64 {
+	h := uint64(14695981039346656037)
+	for _, c := range block {
+		h ^= uint64(c)
+		h *= 1099511628211
+	}
+
+	return h
+}
@@ -0,0 +1,287 @@
+package main
+
+import (
+	"bufio"
+	"fmt"
+	"os"
+	"os/exec"
+	"path/filepath"
+	"runtime"
+	"strings"
+	"sync"
+	"sync/atomic"
+	"time"
+)
+
+// hooks_name lists the hook commands of a journal, one per line.
+const hooks_name string = "hooks"
+
+// Each hook command is served by hook_workers long-lived processes fed from a queue of
+// hook_queue events, delivered hook_batch at a time. A batch not acknowledged within
+// hook_timeout costs its worker process, which is restarted for the next batch.
+const hook_workers int = 2
+const hook_queue int = 1024
+const hook_batch int = 64
+const hook_timeout time.Duration = 10 * time.Second
+
+// hook_pools are the hook pools of the journal being written, and empty when it has no hooks.
+var hook_pools []*Hook_Pool
+
+// Hook_Event is something that happened to a logfile, sent to hooks as a tab separated line.
+type Hook_Event struct {
+	Kind string
+	Date string
+	Path string
+}
+
+// Hook_Pool runs one hook command as a pool of worker processes speaking a line protocol: each
+// batch is a line per event followed by an empty line, and the worker answers every batch with a
+// line reading ok. Emitting an event never waits on the workers; when the queue is full the event
+// is dropped and counted instead.
+type Hook_Pool struct {
+	Command  string
+	queue    chan Hook_Event
+	dropped  atomic.Int64
+	deadline atomic.Int64
+	wg       sync.WaitGroup
+}
+
+type hook_process struct {
+	cmd     *exec.Cmd
+	stdin   *os.File
+	replies chan string
+}
+
+// Start_Hooks starts a pool for every hook command of a journal. Worker processes are spawned on
+// the first batch, so a run that writes nothing spawns nothing.
+//
+// If the hook list cannot be read, the error is logged and Start_Hooks returns nil, false.
+func Start_Hooks(dir string) ([]*Hook_Pool, bool) {
+	data, err := os.ReadFile(State_Path(dir, hooks_name))
+	if os.IsNotExist(err) {
+		return nil, true
+	}
+	if err != nil {
+		errlog.Print(err)
+
+		return nil, false
+	}
+
+	var pools []*Hook_Pool
+
+	for _, line := range strings.Split(string(data), "\n") {
+		command := strings.TrimSpace(line)
+		if command == "" || strings.HasPrefix(command, "#") {
+			continue
+		}
+
+		debug.Printf("starting hook pool for %q\n", command)
+
+		pool := &Hook_Pool{Command: command, queue: make(chan Hook_Event, hook_queue)}
+		for i := 0; i < hook_workers; i++ {
+			pool.wg.Add(1)
+
+			go pool.work()
+		}
+
+		pools = append(pools, pool)
+	}
+
+	return pools, true
+}
+
+// Emit_Hook_Event queues an event for every hook of the journal being written.
+func Emit_Hook_Event(kind string, path string) {
+	if len(hook_pools) == 0 {
+		return
+	}
+
+	event := Hook_Event{Kind: kind, Date: strings.TrimSuffix(filepath.Base(path), ".log"), Path: path}
+	for _, pool := range hook_pools {
+		pool.Emit(event)
+	}
+}
+
+// Stop_Hooks lets every pool deliver what is queued, waiting at most hook_timeout in total, and
+// then shuts the worker processes down.
+func Stop_Hooks(pools []*Hook_Pool) {
+	for _, pool := range pools {
+		pool.Close(hook_timeout)
+	}
+
+	for _, pool := range pools {
+		pool.wg.Wait()
+
+		if n := pool.dropped.Load(); n > 0 {
+			errlog.Printf("hook %q: %d events not delivered\n", pool.Command, n)
+		}
+	}
+}
+
+// Emit queues an event without blocking.
+func (p *Hook_Pool) Emit(event Hook_Event) {
+	select {
+	case p.queue <- event:
+	default:
+		p.dropped.Add(1)
+	}
+}
+
+// Close stops the queue and gives the workers until timeout from now to deliver what it holds.
+func (p *Hook_Pool) Close(timeout time.Duration) {
+	p.deadline.Store(time.Now().Add(timeout).UnixNano())
+	close(p.queue)
+}
+
+func (p *Hook_Pool) work() {
+	defer p.wg.Done()
+
+	var proc *hook_process
+
+	for event := range p.queue {
+		batch := []Hook_Event{event}
+
+	drain:
+		for len(batch) < hook_batch {
+			select {
+			case event, ok := <-p.queue:
+				if !ok {
+					break drain
+				}
+
+				batch = append(batch, event)
+			default:
+				break drain
+			}
+		}
+
+		timeout := hook_timeout
+		if deadline := p.deadline.Load(); deadline != 0 {
+			timeout = min(timeout, time.Until(time.Unix(0, deadline)))
+		}
+
+		if timeout <= 0 {
+			p.dropped.Add(int64(len(batch)))
+
+			continue
+		}
+
+		var err error
+
+		if proc == nil {
+			proc, err = start_hook_process(p.Command)
+		}
+		if err == nil {
+			err = proc.deliver(batch, timeout)
+		}
+		if err != nil {
+			errlog.Printf("hook %q: %v\n", p.Command, err)
+
+			p.dropped.Add(int64(len(batch)))
+			if proc != nil {
+				proc.cmd.Process.Kill()
+				proc.stop()
+				proc = nil
+			}
+		}
+	}
+
+	if proc != nil {
+		proc.stop()
+	}
+}
+
+func start_hook_process(command string) (*hook_process, error) {
+	var cmd *exec.Cmd
+	if runtime.GOOS == "windows" {
+		cmd = exec.Command("cmd", "/C", command)
+	} else {
+		cmd = exec.Command("sh", "-c", command)
+	}
+
+	stdinR, stdinW, err := os.Pipe()
+	if err != nil {
+		return nil, err
+	}
+
+	stdoutR, stdoutW, err := os.Pipe()
+	if err != nil {
+		stdinR.Close()
+		stdinW.Close()
+
+		return nil, err
+	}
+
+	cmd.Stdin, cmd.Stdout, cmd.Stderr = stdinR, stdoutW, os.Stderr
+
+	err = cmd.Start()
+	stdinR.Close()
+	stdoutW.Close()
+	if err != nil {
+		stdinW.Close()
+		stdoutR.Close()
+
+		return nil, err
+	}
+
+	debug.Printf("hook %q started as pid %d\n", command, cmd.Process.Pid)
+
+	proc := &hook_process{cmd: cmd, stdin: stdinW, replies: make(chan string, 1)}
+
+	go func() {
+		defer stdoutR.Close()
+		defer close(proc.replies)
+
+		scanner := bufio.NewScanner(stdoutR)
+		for scanner.Scan() {
+			proc.replies <- scanner.Text()
+		}
+	}()
+
+	return proc, nil
+}
+
+// deliver writes a batch and waits for its acknowledgement.
+func (proc *hook_process) deliver(batch []Hook_Event, timeout time.Duration) error {
+	var sb strings.Builder
+	for _, event := range batch {
+		fmt.Fprintf(&sb, "%s\t%s\t%s\n", event.Kind, event.Date, event.Path)
+	}
+	sb.WriteByte('\n')
+
+	proc.stdin.SetWriteDeadline(time.Now().Add(timeout))
+
+	_, err := proc.stdin.WriteString(sb.String())
+	if err != nil {
+		return err
+	}
+
+	timer := time.NewTimer(timeout)
+	defer timer.Stop()
+
+	select {
+	case reply, ok := <-proc.replies:
+		switch {
+		case !ok:
+			return fmt.Errorf("worker exited")
+		case reply != "ok":
+			return fmt.Errorf("worker replied %q", reply)
+		}
+	case <-timer.C:
+		return fmt.Errorf("no reply within %v", timeout)
+	}
+
+	return nil
+}
+
+// stop closes the input of a worker process, which tells it to exit, and reaps it. A worker that
+// does not exit within hook_timeout is killed. Its output is not drained, since children of the
+// worker may hold it open long after the worker is gone.
+func (proc *hook_process) stop() {
+	proc.stdin.Close()
+
+	timer := time.AfterFunc(hook_timeout, func() { proc.cmd.Process.Kill() })
+	defer timer.Stop()
+
+	proc.cmd.Wait()
+}
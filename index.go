@@ -0,0 +1,450 @@
+package main
+
+import (
+	"bufio"
+	"bytes"
+	"crypto/sha256"
+	"encoding/hex"
+	"fmt"
+	"os"
+	"path/filepath"
+	"sort"
+	"strconv"
+	"strings"
+)
+
+// state_dir is the directory inside a journal where touchlog keeps its own bookkeeping.
+const state_dir string = ".touchlog"
+
+const index_name string = "index"
+const index_header string = "touchlog-index 2"
+
+// index_header_v1 is the header of indexes written before entries recorded their sections. Their
+// entries are read again by the next refresh.
+const index_header_v1 string = "touchlog-index 1"
+
+// Index_Entry records what touchlog last saw of one logfile. Size and Mtime let a refresh decide
+// from a stat alone whether the file has to be read and hashed again, and Sections lets the size
+// of every section be told without reading it. Ext is the extension of a compressed logfile, whose
+// Size is that of the file and Length that of its content.
+type Index_Entry struct {
+	Size     int64
+	Mtime    int64
+	Hash     string
+	Sections []Section_Offset
+	Ext      string
+	Length   int64
+	scanned  bool
+}
+
+// Section_Offset is the name of a section of a logfile and the offset of its section line. The
+// bytes before the first section are the header of the logfile.
+type Section_Offset struct {
+	Name  string
+	Start int64
+}
+
+// Index is the content index of a journal directory, keyed by logfile name.
+type Index struct {
+	Dir     string
+	Entries map[string]Index_Entry
+}
+
+// Hash_Content returns the hex encoded sha256 of a logfile's content.
+func Hash_Content(data []byte) string {
+	sum := sha256.Sum256(data)
+
+	return hex.EncodeToString(sum[:])
+}
+
+// State_Path returns the path of a file inside the bookkeeping directory of a journal.
+func State_Path(dir string, elem ...string) string {
+	return filepath.Join(append([]string{dir, state_dir}, elem...)...)
+}
+
+// Load_Index reads the content index of a journal directory. A journal without an index yields
+// an empty one.
+//
+// If the index cannot be read, the error is logged and Load_Index returns nil, false.
+func Load_Index(dir string) (*Index, bool) {
+	debug.Printf("Load_Index(%s)\n", dir)
+
+	idx := &Index{Dir: dir, Entries: make(map[string]Index_Entry)}
+
+	f, err := os.Open(State_Path(dir, index_name))
+	if os.IsNotExist(err) {
+		debug.Println("no index found, starting from an empty one")
+
+		return idx, true
+	}
+	if err != nil {
+		errlog.Print(err)
+
+		return nil, false
+	}
+
+	defer f.Close()
+
+	scanner := bufio.NewScanner(f)
+	scanner.Buffer(nil, 1<<20)
+
+	if !scanner.Scan() || scanner.Text() != index_header && scanner.Text() != index_header_v1 {
+		// an unknown or damaged index is rebuilt rather than trusted
+		debug.Println("index header mismatch, starting from an empty one")
+
+		return idx, true
+	}
+
+	for scanner.Scan() {
+		fields := strings.Split(scanner.Text(), "\t")
+		if len(fields) < 4 || len(fields) > 6 {
+			continue
+		}
+
+		name, ext, ok := Split_Log_Variant(fields[0])
+		size, err1 := strconv.ParseInt(fields[1], 10, 64)
+		mtime, err2 := strconv.ParseInt(fields[2], 10, 64)
+		if !ok || err1 != nil || err2 != nil {
+			continue
+		}
+
+		entry := Index_Entry{Size: size, Mtime: mtime, Hash: fields[3], Ext: ext, Length: size}
+		if len(fields) >= 5 {
+			entry.Sections, entry.scanned = parse_section_offsets(fields[4])
+		}
+
+		if len(fields) == 6 {
+			entry.Length, err1 = strconv.ParseInt(fields[5], 10, 64)
+			entry.scanned = entry.scanned && err1 == nil
+		}
+
+		idx.Entries[name] = entry
+	}
+
+	err = scanner.Err()
+	if err != nil {
+		errlog.Print(err)
+
+		return nil, false
+	}
+
+	debug.Printf("loaded %d index entries\n", len(idx.Entries))
+
+	return idx, true
+}
+
+// Save_Index atomically replaces the content index of the journal directory.
+//
+// If the index is successfully written, Save_Index returns true.
+// Otherwise, the error is logged and Save_Index returns false.
+func Save_Index(idx *Index) bool {
+	debug.Printf("Save_Index(%s)\n", idx.Dir)
+
+	var sb strings.Builder
+
+	sb.WriteString(index_header)
+	sb.WriteByte('\n')
+
+	for _, name := range idx.Names() {
+		e := idx.Entries[name]
+		fmt.Fprintf(&sb, "%s%s\t%d\t%d\t%s\t", name, e.Ext, e.Size, e.Mtime, e.Hash)
+
+		for i, section := range e.Sections {
+			if i > 0 {
+				sb.WriteByte(' ')
+			}
+
+			sb.WriteString(strconv.FormatInt(section.Start, 10))
+			sb.WriteByte(':')
+			sb.WriteString(strconv.Quote(section.Name))
+		}
+
+		// the length of the content only differs from the size of the file when it is compressed
+		if e.Length != e.Size {
+			sb.WriteByte('\t')
+			sb.WriteString(strconv.FormatInt(e.Length, 10))
+		}
+
+		sb.WriteByte('\n')
+	}
+
+	return Write_Atomic(State_Path(idx.Dir, index_name), []byte(sb.String()))
+}
+
+// Names returns the indexed logfile names in sorted order.
+func (idx *Index) Names() []string {
+	names := make([]string, 0, len(idx.Entries))
+	for name := range idx.Entries {
+		names = append(names, name)
+	}
+
+	sort.Strings(names)
+
+	return names
+}
+
+// Days returns the indexed logfile names in date order.
+func (idx *Index) Days() []string {
+	names := idx.Names()
+
+	sort.SliceStable(names, func(i, j int) bool {
+		mi, di, yi, _ := Parse_Log_Name(names[i])
+		mj, dj, yj, _ := Parse_Log_Name(names[j])
+
+		return yi*10000+mi*100+di < yj*10000+mj*100+dj
+	})
+
+	return names
+}
+
+// Refresh_Index brings the index up to date with the directory. Only logfiles whose size or
+// modification time differ from their entry are read and hashed again. A compressed logfile is
+// indexed under the name of its content, unless the same day is also stored as is.
+//
+// Refresh_Index returns the names of logfiles that were added, changed or removed, and true.
+// If the directory cannot be read, the error is logged and Refresh_Index returns nil, false.
+func Refresh_Index(idx *Index) (changed []string, success bool) {
+	debug.Printf("Refresh_Index(%s)\n", idx.Dir)
+
+	dirents, err := os.ReadDir(idx.Dir)
+	if err != nil {
+		errlog.Print(err)
+
+		return nil, false
+	}
+
+	variants := make(map[string]os.DirEntry, len(dirents))
+
+	for _, dirent := range dirents {
+		name, _, ok := Split_Log_Variant(dirent.Name())
+		if !ok || !dirent.Type().IsRegular() {
+			continue
+		}
+
+		// dirents are sorted, so a logfile stored as is comes before its compressed variants
+		if _, found := variants[name]; found {
+			continue
+		}
+
+		variants[name] = dirent
+	}
+
+	seen := make(map[string]bool, len(variants))
+
+	for name, dirent := range variants {
+		ext := strings.TrimPrefix(dirent.Name(), name)
+		seen[name] = true
+
+		info, err := dirent.Info()
+		if err != nil {
+			errlog.Print(err)
+
+			return nil, false
+		}
+
+		old, ok := idx.Entries[name]
+		if ok && old.scanned && old.Ext == ext && old.Size == info.Size() && old.Mtime == info.ModTime().UnixNano() {
+			continue
+		}
+
+		data, err := Read_Log(idx.Dir, name)
+		if err != nil {
+			errlog.Print(err)
+
+			return nil, false
+		}
+
+		entry := New_Index_Entry(info, data)
+		entry.Ext = ext
+		idx.Entries[name] = entry
+
+		if !ok || old.Hash != entry.Hash {
+			debug.Printf("index: %s changed\n", name)
+
+			// edits made outside of touchlog become versions in the history
+			if !Record_History(idx.Dir, name, data) {
+				return nil, false
+			}
+
+			changed = append(changed, name)
+		}
+	}
+
+	for name := range idx.Entries {
+		if !seen[name] {
+			debug.Printf("index: %s removed\n", name)
+
+			delete(idx.Entries, name)
+			changed = append(changed, name)
+		}
+	}
+
+	sort.Strings(changed)
+
+	return changed, true
+}
+
+// Update records freshly written content for a logfile without reading it back.
+//
+// If the logfile cannot be stat'd, the error is logged and Update returns false.
+func (idx *Index) Update(name string, data []byte) bool {
+	path := filepath.Join(idx.Dir, name)
+
+	info, err := os.Stat(path)
+	ext := ""
+
+	for _, variant := range log_variants {
+		if !os.IsNotExist(err) {
+			break
+		}
+
+		info, err = os.Stat(path + variant)
+		ext = variant
+	}
+
+	if err != nil {
+		if os.IsNotExist(err) {
+			err = &os.PathError{Op: "stat", Path: path, Err: os.ErrNotExist}
+		}
+
+		errlog.Print(err)
+
+		return false
+	}
+
+	entry := New_Index_Entry(info, data)
+	entry.Ext = ext
+	idx.Entries[name] = entry
+
+	return true
+}
+
+// New_Index_Entry returns the entry of a logfile with the given stat and content.
+func New_Index_Entry(info os.FileInfo, data []byte) Index_Entry {
+	return Index_Entry{Size: info.Size(), Mtime: info.ModTime().UnixNano(), Hash: Hash_Content(data),
+		Sections: Section_Offsets(data), Length: int64(len(data)), scanned: true}
+}
+
+// Section_Offsets finds the sections of a logfile the way Parse_Log does.
+func Section_Offsets(data []byte) []Section_Offset {
+	var sections []Section_Offset
+
+	for start := 0; start < len(data); {
+		line, next := data[start:], len(data)
+		if end := bytes.IndexByte(line, '\n'); end >= 0 {
+			line, next = line[:end], start+end+1
+		}
+
+		if bytes.HasPrefix(line, []byte(section_prefix)) {
+			sections = append(sections, Section_Offset{Name: string(line[len(section_prefix):]), Start: int64(start)})
+		}
+
+		start = next
+	}
+
+	return sections
+}
+
+// parse_section_offsets reads the sections field of an index line, a space separated list of
+// offset:"name" pairs.
+func parse_section_offsets(field string) ([]Section_Offset, bool) {
+	var sections []Section_Offset
+
+	for field != "" {
+		colon := strings.IndexByte(field, ':')
+		if colon < 0 {
+			return nil, false
+		}
+
+		start, err := strconv.ParseInt(field[:colon], 10, 64)
+		if err != nil {
+			return nil, false
+		}
+
+		quoted, err := strconv.QuotedPrefix(field[colon+1:])
+		if err != nil {
+			return nil, false
+		}
+
+		name, _ := strconv.Unquote(quoted)
+		sections = append(sections, Section_Offset{Name: name, Start: start})
+
+		field = strings.TrimPrefix(field[colon+1+len(quoted):], " ")
+	}
+
+	return sections, true
+}
+
+// Section_Size returns the size of the i-th section of the logfile, from its section line up to
+// the next section or the end of the logfile, or the size of its header for i = -1.
+func (e Index_Entry) Section_Size(i int) int64 {
+	end := e.Length
+	if i+1 < len(e.Sections) {
+		end = e.Sections[i+1].Start
+	}
+
+	if i < 0 {
+		return end
+	}
+
+	return end - e.Sections[i].Start
+}
+
+// Usage returns the total size of the indexed logfiles.
+func (idx *Index) Usage() int64 {
+	var used int64
+	for _, e := range idx.Entries {
+		used += e.Size
+	}
+
+	return used
+}
+
+// Write_Atomic writes data to a temporary file next to path and renames it into place, so
+// readers see either the old or the new content and never a truncated file.
+//
+// If the file is successfully replaced, Write_Atomic returns true.
+// Otherwise, the error is logged and Write_Atomic returns false.
+func Write_Atomic(path string, data []byte) bool {
+	debug.Printf("Write_Atomic(%s, %d bytes)\n", path, len(data))
+
+	dir := filepath.Dir(path)
+
+	err := os.MkdirAll(dir, 0755)
+	if err != nil {
+		errlog.Print(err)
+
+		return false
+	}
+
+	f, err := os.CreateTemp(dir, "."+filepath.Base(path)+".tmp*")
+	if err != nil {
+		errlog.Print(err)
+
+		return false
+	}
+
+	tmp := f.Name()
+
+	_, err = f.Write(data)
+	if err == nil {
+		err = f.Sync()
+	}
+	if cerr := f.Close(); err == nil {
+		err = cerr
+	}
+	if err == nil {
+		err = os.Chmod(tmp, 0644)
+	}
+	if err == nil {
+		err = os.Rename(tmp, path)
+	}
+	if err != nil {
+		os.Remove(tmp)
+		errlog.Print(err)
+
+		return false
+	}
+
+	return true
+}
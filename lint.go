@@ -0,0 +1,588 @@
+package main
+
+import (
+	"bufio"
+	"bytes"
+	"crypto/sha256"
+	"encoding/hex"
+	"encoding/json"
+	"fmt"
+	"os"
+	"runtime"
+	"sort"
+	"strings"
+	"sync"
+	"time"
+)
+
+// lint_name remembers the logfiles found sound, each with the hash of its content and of the
+// skeleton it was checked against, so that neither lint nor fix reads them again until one of the
+// two changes.
+const lint_name string = "lint"
+const lint_header string = "touchlog-lint 1"
+
+// Lint_Problem is a structural problem of a logfile, printed as a line of JSON.
+type Lint_Problem struct {
+	File    string `json:"file"`
+	Line    int    `json:"line"`
+	Kind    string `json:"problem"`
+	Message string `json:"message"`
+	Fixed   bool   `json:"fixed,omitempty"`
+}
+
+// lint_expect is the structure a logfile is checked against: the non-blank header lines and the
+// sections of the skeleton touchlog writes for its date.
+type lint_expect struct {
+	skeleton Parsed_Log
+	header   []string
+	sections []string
+	hash     string
+}
+
+type lint_result struct {
+	name     string
+	hash     string
+	problems []Lint_Problem
+	repaired []byte
+	err      error
+}
+
+// Lint checks the structure of every logfile of a journal against the skeleton touchlog writes
+// for its date and prints a line of JSON per problem found.
+//
+// If every logfile is sound, Lint returns true.
+// Otherwise, Lint returns false, and when a logfile cannot be checked the error is logged.
+func Lint(args []string) bool {
+	return lint_command("lint", args)
+}
+
+// Fix repairs the structural problems Lint finds: it restores header lines, merges duplicated
+// sections into their first occurrence, puts sections back in order and adds missing ones, leaving
+// every line that was written in place. Repaired logfiles are rewritten atomically, with their
+// previous content kept in the history, and every problem is printed as a line of JSON.
+//
+// If every logfile is sound or repaired, Fix returns true.
+// Otherwise, the error is logged and Fix returns false.
+func Fix(args []string) bool {
+	return lint_command("fix", args)
+}
+
+func lint_command(name string, args []string) bool {
+	fs, verbosePtr := New_FlagSet(name)
+	outDirPtr := fs.String("outdir", "", name+" the journal in the inputted directory")
+	jobsPtr := fs.Int("jobs", runtime.NumCPU(), "number of logfiles checked at once")
+	dryRunPtr := new(bool)
+	if name == "fix" {
+		dryRunPtr = fs.Bool("dry-run", false, "print the problems that would be repaired without repairing them")
+	}
+	fs.Parse(args)
+
+	Set_Verbosity(*verbosePtr)
+
+	if fs.NArg() != 0 || *jobsPtr < 1 {
+		if name == "fix" {
+			errlog.Println("usage: touchlog fix [-verbose] [-outdir dir] [-jobs n] [-dry-run]")
+		} else {
+			errlog.Println("usage: touchlog lint [-verbose] [-outdir dir] [-jobs n]")
+		}
+
+		return false
+	}
+
+	if !Resolve_Outdir(outDirPtr) {
+		return false
+	}
+
+	repair := name == "fix" && !*dryRunPtr
+
+	var result bool
+
+	if repair {
+		result = Create_Logs(*outDirPtr, func() bool { return Lint_Journal(*outDirPtr, *jobsPtr, true) })
+	} else {
+		plugins, result = Load_Plugins(*outDirPtr)
+		if result {
+			log_template, result = Load_Template(*outDirPtr)
+		}
+
+		result = result && Lint_Journal(*outDirPtr, *jobsPtr, false)
+	}
+
+	return result
+}
+
+// Lint_Journal checks the logfiles of a journal that are not known to be sound on jobs workers,
+// prints their problems in date order, and repairs them when repair is set.
+//
+// If every logfile is sound or repaired, Lint_Journal returns true.
+// Otherwise, Lint_Journal returns false, and when a logfile cannot be checked or repaired the
+// error is logged.
+func Lint_Journal(dir string, jobs int, repair bool) bool {
+	idx, ok := Load_Index(dir)
+	if !ok {
+		return false
+	}
+
+	if _, ok := Refresh_Index(idx); !ok {
+		return false
+	}
+
+	sound, ok := Load_Lint_State(dir)
+	if !ok {
+		return false
+	}
+
+	days := idx.Days()
+	results := make([]lint_result, len(days))
+	queue := make(chan int)
+
+	var wg sync.WaitGroup
+
+	expected := make([]*lint_expect, len(days))
+
+	for w := 0; w < jobs; w++ {
+		wg.Add(1)
+
+		go func() {
+			defer wg.Done()
+
+			var view Day_View
+
+			for i := range queue {
+				results[i] = lint_day(dir, days[i], expected[i], &view, repair)
+			}
+		}()
+	}
+
+	checked := 0
+
+	// skeletons are rendered here rather than by the workers, since plugins run one call at a time
+	for i, name := range days {
+		month, day, year, _ := Parse_Log_Name(name)
+		date := time.Date(year, time.Month(month), day, 0, 0, 0, 0, time.Local)
+
+		skeleton, ok := Render_Skeleton(date)
+		if !ok {
+			close(queue)
+			wg.Wait()
+
+			return false
+		}
+
+		expect := new_lint_expect(skeleton)
+		if sound[name] == idx.Entries[name].Hash+"\t"+expect.hash {
+			continue
+		}
+
+		expected[i] = expect
+		checked++
+		queue <- i
+	}
+
+	close(queue)
+	wg.Wait()
+
+	debug.Printf("checked %d of %d logfiles\n", checked, len(days))
+
+	out := bufio.NewWriter(os.Stdout)
+	defer out.Flush()
+
+	Flush_Output()
+
+	enc := json.NewEncoder(out)
+	enc.SetEscapeHTML(false)
+
+	result := true
+	problems := 0
+
+	for i, r := range results {
+		if expected[i] == nil {
+			continue
+		}
+
+		if r.err != nil {
+			errlog.Print(r.err)
+
+			result = false
+
+			continue
+		}
+
+		problems += len(r.problems)
+
+		if len(r.problems) == 0 {
+			sound[r.name] = r.hash + "\t" + expected[i].hash
+
+			continue
+		}
+
+		if repair {
+			if !Save_Log(dir, r.name, r.repaired) || !idx.Update(r.name, r.repaired) {
+				result = false
+
+				continue
+			}
+
+			sound[r.name] = Hash_Content(r.repaired) + "\t" + expected[i].hash
+		} else {
+			result = false
+		}
+
+		for _, problem := range r.problems {
+			problem.Fixed = repair
+
+			err := enc.Encode(problem)
+			if err != nil {
+				errlog.Print(err)
+
+				return false
+			}
+		}
+	}
+
+	debug.Printf("found %d problems\n", problems)
+
+	for name := range sound {
+		if _, ok := idx.Entries[name]; !ok {
+			delete(sound, name)
+		}
+	}
+
+	return Save_Index(idx) && Save_Lint_State(dir, sound) && result
+}
+
+func new_lint_expect(skeleton []byte) *lint_expect {
+	sum := sha256.Sum256(skeleton)
+	expect := &lint_expect{skeleton: Parse_Log(skeleton), hash: hex.EncodeToString(sum[:8])}
+
+	for _, line := range expect.skeleton.Header {
+		if line = strings.TrimSpace(line); line != "" {
+			expect.header = append(expect.header, line)
+		}
+	}
+
+	for _, section := range expect.skeleton.Sections {
+		expect.sections = append(expect.sections, section.Name)
+	}
+
+	return expect
+}
+
+// lint_day reads a logfile, checks it and, when repair is set, works out its repaired content.
+func lint_day(dir string, name string, expect *lint_expect, view *Day_View, repair bool) lint_result {
+	data, err := Read_Log(dir, name)
+	if err != nil {
+		return lint_result{name: name, err: err}
+	}
+
+	r := lint_result{name: name, hash: Hash_Content(data), problems: Lint_Log(name, data, expect, view)}
+	if repair && len(r.problems) > 0 {
+		r.repaired = Repair_Log(data, expect)
+	}
+
+	return r
+}
+
+// header_key returns what identifies a header line whose value may be wrong: the text up to its
+// first colon, or the whole line.
+func header_key(line string) string {
+	if colon := strings.IndexByte(line, ':'); colon >= 0 {
+		return line[:colon+1]
+	}
+
+	return line
+}
+
+// Lint_Log checks a logfile against the structure expected of it with a single pass of the section
+// scanner, and returns its problems.
+func Lint_Log(name string, data []byte, expect *lint_expect, view *Day_View) []Lint_Problem {
+	var problems []Lint_Problem
+
+	problem := func(offset int, kind string, format string, args ...any) {
+		problems = append(problems, Lint_Problem{File: name, Line: bytes.Count(data[:offset], []byte("\n")) + 1,
+			Kind: kind, Message: fmt.Sprintf(format, args...)})
+	}
+
+	view.Reset(time.Time{}, data)
+
+	headerEnd := len(data)
+	if view.Sections() > 0 {
+		headerEnd = view.Section_Start(0)
+	}
+
+	for _, want := range expect.header {
+		key := header_key(want)
+		found, offset := "", 0
+
+		for pos := 0; pos < headerEnd; {
+			end := bytes.IndexByte(data[pos:headerEnd], '\n')
+			if end < 0 {
+				end = headerEnd - pos
+			}
+
+			line := string(bytes.TrimSpace(data[pos : pos+end]))
+			if line == want || strings.HasPrefix(line, key) {
+				found, offset = line, pos
+
+				break
+			}
+
+			pos += end + 1
+		}
+
+		switch {
+		case found == "":
+			problem(0, "missing-header", "the header line %q is missing", want)
+		case found != want:
+			problem(offset, "wrong-header", "%q should read %q", found, want)
+		}
+	}
+
+	rank := make(map[string]int, len(expect.sections))
+	for i, section := range expect.sections {
+		rank[section] = i
+	}
+
+	seen := make(map[string]bool, view.Sections())
+	last := -1
+
+	for i := 0; i < view.Sections(); i++ {
+		sectionName, _ := view.Section(i)
+		section := string(sectionName)
+
+		if seen[section] {
+			problem(view.Section_Start(i), "duplicate-section", "section %q appears again", section)
+
+			continue
+		}
+
+		seen[section] = true
+
+		r, known := rank[section]
+		if !known {
+			continue
+		}
+
+		if r < last {
+			problem(view.Section_Start(i), "misordered-section", "section %q should come before section %q",
+				section, expect.sections[last])
+		} else {
+			last = r
+		}
+	}
+
+	for _, section := range expect.sections {
+		if !seen[section] {
+			problem(len(data), "missing-section", "section %q is missing", section)
+		}
+	}
+
+	return problems
+}
+
+// Repair_Log returns a logfile with the problems Lint_Log finds repaired. Wrong header lines are
+// corrected and missing ones inserted where the skeleton has them, later occurrences of a section
+// are merged into the first, sections are moved back into the order of the skeleton, each taking
+// along the sections it does not know that follow it, and missing sections are added from the
+// skeleton.
+func Repair_Log(data []byte, expect *lint_expect) []byte {
+	parsed := Parse_Log(data)
+
+	// the empty line after the final newline is put back once blocks stop moving
+	newline := parsed.Cut_Final_Newline()
+
+	parsed.Header = repair_header(parsed.Header, expect.header)
+
+	rank := make(map[string]int, len(expect.sections))
+	for i, section := range expect.sections {
+		rank[section] = i
+	}
+
+	type block struct {
+		section Section
+		rank    int
+	}
+
+	var blocks []*block
+
+	first := make(map[string]*block)
+	current := -1
+
+	for _, section := range parsed.Sections {
+		if b, dup := first[section.Name]; dup {
+			// the merged entries go after the last line of the first occurrence, which keeps the
+			// blank lines at both of its ends
+			content := trim_blank_lines(section.Body)
+			_, end := blank_bounds(b.section.Body)
+			body := b.section.Body
+
+			merged := append(append([]string(nil), body[:end]...), content...)
+			b.section.Body = append(merged, body[end:]...)
+
+			continue
+		}
+
+		if r, known := rank[section.Name]; known {
+			current = r
+		}
+
+		b := &block{section: section, rank: current}
+		first[section.Name] = b
+		blocks = append(blocks, b)
+	}
+
+	for _, section := range expect.skeleton.Sections {
+		if first[section.Name] == nil {
+			blocks = append(blocks, &block{section: Section{Name: section.Name, Body: trim_blank_lines(section.Body)},
+				rank: rank[section.Name]})
+		}
+	}
+
+	// blank lines ending the last section stay at the end of the file when it moves
+	tail := 0
+	if n := len(parsed.Sections); n > 0 {
+		body := parsed.Sections[n-1].Body
+		_, end := blank_bounds(body)
+		tail = len(body) - end
+	}
+
+	sort.SliceStable(blocks, func(i, j int) bool { return blocks[i].rank < blocks[j].rank })
+	if n := len(blocks); n > 0 {
+		body := blocks[n-1].section.Body
+		_, end := blank_bounds(body)
+		blocks[n-1].section.Body = append(body[:end:end], make([]string, tail)...)
+	}
+
+	parsed.Sections = parsed.Sections[:0]
+	for _, b := range blocks {
+		parsed.Sections = append(parsed.Sections, b.section)
+	}
+
+	// every section is set apart by an empty line, as in the skeleton
+	if n := len(parsed.Header); len(parsed.Sections) > 0 && (n == 0 || !is_blank(parsed.Header[n-1])) {
+		parsed.Header = append(parsed.Header, "")
+	}
+
+	for i := range parsed.Sections[:max(len(parsed.Sections)-1, 0)] {
+		body := parsed.Sections[i].Body
+		if len(body) == 0 || !is_blank(body[len(body)-1]) {
+			parsed.Sections[i].Body = append(body, "")
+		}
+	}
+
+	if newline {
+		parsed.Add_Final_Newline()
+	}
+
+	return parsed.Bytes()
+}
+
+// repair_header corrects the header lines whose value differs from the expected ones and inserts
+// the missing ones after the expected line before them.
+func repair_header(lines []string, expected []string) []string {
+	repaired := append([]string(nil), lines...)
+	pos := 0
+
+	for _, want := range expected {
+		key := header_key(want)
+		found := -1
+
+		for i, line := range repaired {
+			line = strings.TrimSpace(line)
+			if line == want || strings.HasPrefix(line, key) {
+				found = i
+
+				break
+			}
+		}
+
+		if found < 0 {
+			repaired = append(repaired[:pos], append([]string{want}, repaired[pos:]...)...)
+			pos++
+
+			continue
+		}
+
+		if strings.TrimSpace(repaired[found]) != want {
+			repaired[found] = want
+		}
+
+		pos = found + 1
+	}
+
+	return repaired
+}
+
+// trim_blank_lines drops the blank lines at both ends of a section body.
+func trim_blank_lines(lines []string) []string {
+	start, end := blank_bounds(lines)
+
+	return lines[start:end]
+}
+
+// blank_bounds returns the bounds of a section body without the blank lines at both ends: the
+// index of the first line that is not blank and the index after the last one.
+func blank_bounds(lines []string) (int, int) {
+	start := 0
+	for start < len(lines) && is_blank(lines[start]) {
+		start++
+	}
+
+	end := len(lines)
+	for end > start && is_blank(lines[end-1]) {
+		end--
+	}
+
+	return start, end
+}
+
+// Load_Lint_State reads the logfiles known to be sound, mapped to the hashes they were checked with.
+//
+// If the state cannot be read, the error is logged and Load_Lint_State returns nil, false.
+func Load_Lint_State(dir string) (map[string]string, bool) {
+	sound := make(map[string]string)
+
+	data, err := os.ReadFile(State_Path(dir, lint_name))
+	if os.IsNotExist(err) {
+		return sound, true
+	}
+	if err != nil {
+		errlog.Print(err)
+
+		return nil, false
+	}
+
+	lines := strings.Split(string(data), "\n")
+	if lines[0] != lint_header {
+		return sound, true
+	}
+
+	for _, line := range lines[1:] {
+		if name, hashes, ok := strings.Cut(line, "\t"); ok {
+			sound[name] = hashes
+		}
+	}
+
+	return sound, true
+}
+
+// Save_Lint_State atomically replaces the logfiles known to be sound.
+func Save_Lint_State(dir string, sound map[string]string) bool {
+	names := make([]string, 0, len(sound))
+	for name := range sound {
+		names = append(names, name)
+	}
+
+	sort.Strings(names)
+
+	var sb strings.Builder
+
+	sb.WriteString(lint_header)
+	sb.WriteByte('\n')
+
+	for _, name := range names {
+		sb.WriteString(name + "\t" + sound[name] + "\n")
+	}
+
+	return Write_Atomic(State_Path(dir, lint_name), []byte(sb.String()))
+}
@@ -0,0 +1,46 @@
+package main
+
+import "testing"
+
+func TestRepairLog(t *testing.T) {
+	expect := new_lint_expect([]byte("# 01/02/2024\n\n|> events\n\n|> todo\n- none\n"))
+
+	tests := []struct {
+		name string
+		data string
+		want string
+	}{
+		{"sound",
+			"# 01/02/2024\n\n|> events\n- did x\n\n|> todo\n- none\n",
+			"# 01/02/2024\n\n|> events\n- did x\n\n|> todo\n- none\n"},
+		{"duplicate section",
+			"# 01/02/2024\n\n|> events\n- did x\n\n|> todo\n- none\n\n|> events\n- did y\n",
+			"# 01/02/2024\n\n|> events\n- did x\n- did y\n\n|> todo\n- none\n"},
+		{"duplicate section starting with a blank line",
+			"# 01/02/2024\n\n|> events\n\n- did x\n\n|> todo\n- none\n\n|> events\n- did y\n",
+			"# 01/02/2024\n\n|> events\n\n- did x\n- did y\n\n|> todo\n- none\n"},
+		{"sections out of order",
+			"# 01/02/2024\n\n|> todo\n- a\n\n|> events\n- did x\n",
+			"# 01/02/2024\n\n|> events\n- did x\n\n|> todo\n- a\n"},
+		{"unknown section follows its predecessor",
+			"# 01/02/2024\n\n|> todo\n- a\n\n|> mine\n- b\n\n|> events\n- did x\n",
+			"# 01/02/2024\n\n|> events\n- did x\n\n|> todo\n- a\n\n|> mine\n- b\n"},
+		{"missing sections",
+			"# 01/02/2024\n",
+			"# 01/02/2024\n\n|> events\n\n|> todo\n- none\n"},
+		{"missing header",
+			"\n|> events\n\n|> todo\n- none\n",
+			"# 01/02/2024\n\n|> events\n\n|> todo\n- none\n"},
+	}
+
+	for _, test := range tests {
+		got := string(Repair_Log([]byte(test.data), expect))
+		if got != test.want {
+			t.Errorf("%s: got %q, want %q", test.name, got, test.want)
+		}
+
+		if problems := Lint_Log("01-02-2024.log", []byte(got), expect, new(Day_View)); len(problems) > 0 {
+			t.Errorf("%s: repaired log has problems %v", test.name, problems)
+		}
+	}
+}
@@ -0,0 +1,186 @@
+package main
+
+import (
+	"bufio"
+	"os"
+	"runtime"
+	"strings"
+)
+
+// On_This_Day prints what was logged on the month and day of a date, or of today, in each of the
+// years before it, merged section by section with every line prefixed by its year. The logfile
+// names are computed from the date, one per year, and the index tells which of them exist, so
+// the journal directory is never listed: days the index holds are read in parallel, the others
+// are looked up in the pack of their year and, failing that, tried directly in case they were
+// written since the index was last refreshed.
+//
+// If the days are successfully read, On_This_Day returns true.
+// Otherwise, the error is logged and On_This_Day returns false.
+func On_This_Day(args []string) bool {
+	fs, verbosePtr := New_FlagSet("onthisday")
+	outDirPtr := fs.String("outdir", "", "read the journal in the inputted directory")
+	datePtr := fs.String("date", "", "show the month and day of this mmddyyyy date instead of today")
+	yearsPtr := fs.Int("years", 50, "number of years to look back")
+	fs.Parse(args)
+
+	Set_Verbosity(*verbosePtr)
+
+	if fs.NArg() != 0 || *yearsPtr < 1 {
+		errlog.Println("usage: touchlog onthisday [-verbose] [-outdir dir] [-date mmddyyyy] [-years n]")
+
+		return false
+	}
+
+	if !Resolve_Outdir(outDirPtr) {
+		return false
+	}
+
+	month, day, year, ok := Handle_Date(datePtr)
+	if !ok {
+		return false
+	}
+
+	date, ok := To_Time(month, day, year)
+	if !ok {
+		return false
+	}
+
+	idx, ok := Load_Index(*outDirPtr)
+	if !ok {
+		return false
+	}
+
+	first := max(date.Year()-*yearsPtr, 1)
+
+	// existing[y-first] tells whether the index holds the day of year y
+	existing := make([]bool, date.Year()-first)
+	names := make([]string, 0, len(existing))
+
+	for y := first; y < date.Year(); y++ {
+		name := Log_Name(month, day, pad(y, 4))
+
+		_, existing[y-first] = idx.Entries[name]
+		names = append(names, name)
+	}
+
+	// the days missing from the index are looked up in the packs before any logfile is tried
+	days := make([]Pack_Day, len(names))
+	var live []int
+
+	for i, name := range names {
+		if existing[i] {
+			live = append(live, i)
+
+			continue
+		}
+
+		p, err := Open_Pack(Pack_Path(*outDirPtr, first+i))
+		if os.IsNotExist(err) {
+			live = append(live, i)
+
+			continue
+		}
+
+		if err != nil {
+			errlog.Print(err)
+
+			return false
+		}
+
+		if e := p.Find(name); e != nil {
+			days[i].Name = name
+			days[i].Data, err = p.Read(e)
+		} else {
+			live = append(live, i)
+		}
+
+		p.Close()
+
+		if err != nil {
+			errlog.Print(err)
+
+			return false
+		}
+	}
+
+	paths := make([]string, len(live))
+	for i, j := range live {
+		paths[i] = names[j]
+	}
+
+	reader := Read_Ahead(*outDirPtr, paths, runtime.NumCPU())
+	defer reader.Stop()
+
+	for _, j := range live {
+		data, err := reader.Next()
+		if os.IsNotExist(err) {
+			continue
+		}
+
+		if err != nil {
+			errlog.Print(err)
+
+			return false
+		}
+
+		days[j] = Pack_Day{Name: names[j], Data: data}
+	}
+
+	out := bufio.NewWriter(os.Stdout)
+	defer out.Flush()
+
+	Write_On_This_Day(out, month+"-"+day, days)
+
+	return true
+}
+
+// Write_On_This_Day writes the days of the same month and day in several years, in year order,
+// as one view: the years found, then every section in the order it first appears, holding the
+// non-blank lines of that section in each year prefixed with the year. Sections empty in every
+// year are left out, and days without a name were not found.
+func Write_On_This_Day(out *bufio.Writer, monthDay string, days []Pack_Day) {
+	var years []string
+	var order []string
+
+	lines := make(map[string][]string)
+
+	for _, d := range days {
+		if d.Name == "" {
+			continue
+		}
+
+		year := d.Name[6:10]
+		years = append(years, year)
+
+		for _, section := range Parse_Log(d.Data).Sections {
+			if _, seen := lines[section.Name]; !seen {
+				order = append(order, section.Name)
+				lines[section.Name] = []string{}
+			}
+
+			for _, line := range non_blank(section.Body) {
+				lines[section.Name] = append(lines[section.Name], year+": "+line)
+			}
+		}
+	}
+
+	debug.Printf("found %s in %d years\n", monthDay, len(years))
+
+	if len(years) == 0 {
+		return
+	}
+
+	out.WriteString("==> " + monthDay + " in " + strings.Join(years, ", ") + " <==\n")
+
+	for _, name := range order {
+		if len(lines[name]) == 0 {
+			continue
+		}
+
+		out.WriteString("\n" + section_prefix + name + "\n")
+
+		for _, line := range lines[name] {
+			out.WriteString(line + "\n")
+		}
+	}
+}
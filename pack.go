@@ -0,0 +1,527 @@
+package main
+
+import (
+	"bytes"
+	"compress/flate"
+	"crypto/sha256"
+	"encoding/binary"
+	"errors"
+	"fmt"
+	"io"
+	"os"
+	"path/filepath"
+	"sort"
+	"sync"
+)
+
+// A pack holds archived days of one year. Every day is cut into segments at boundaries chosen by
+// its content, so a block of text repeated across days, such as a pasted runbook, yields the same
+// segments wherever it appears, and each distinct segment is stored once. Segments are laid out in
+// the order they first appear into chunks of about pack_chunk_size bytes, each compressed on its
+// own, and a footer at the end lists the segments of every day, so reading a day inflates the few
+// chunks it was written to rather than the whole pack. The last pack_trailer_size bytes of a pack
+// hold the offset of the footer and the pack magic. The footer also holds the filters of every
+// chunk; packs of the first version lack them, and packs of the first two versions store every
+// day whole.
+const packs_dir string = "packs"
+const pack_ext string = ".pack"
+const pack_magic string = "TLPACK3\n"
+const pack_magic_v2 string = "TLPACK2\n"
+const pack_magic_v1 string = "TLPACK1\n"
+const pack_chunk_size int = 256 << 10
+const pack_trailer_size int = 8 + len(pack_magic)
+
+// pack_cached_chunks is how many inflated chunks an open pack keeps for the days read next.
+const pack_cached_chunks int = 8
+
+// Pack_Entry locates one archived day inside a pack: the segments it is made of and the chunk
+// whose filters cover its content.
+type Pack_Entry struct {
+	Name     string
+	Chunk    int
+	Size     int
+	Hash     [sha256.Size]byte
+	Segments []int
+}
+
+type pack_chunk struct {
+	offset   int64
+	length   int
+	size     int
+	tokens   *Bloom
+	trigrams *Bloom
+}
+
+type pack_segment struct {
+	chunk  int
+	offset int
+	size   int
+}
+
+// Pack is an open pack file. Trigrams tells whether its chunks have trigram filters.
+type Pack struct {
+	Path     string
+	Entries  []Pack_Entry
+	Trigrams bool
+	chunks   []pack_chunk
+	segments []pack_segment
+	cache    map[int][]byte
+	file     *os.File
+}
+
+// Pack_Day is a day to be written into a pack.
+type Pack_Day struct {
+	Name string
+	Data []byte
+}
+
+var flate_readers sync.Pool
+
+// Pack_Path returns the path of the pack holding the archived days of a year.
+func Pack_Path(dir string, year int) string {
+	return State_Path(dir, packs_dir, pad(year, 4)+pack_ext)
+}
+
+// Pack_Paths returns the paths of the packs of a journal, oldest year first.
+//
+// If the pack directory cannot be read, the error is logged and Pack_Paths returns nil, false.
+func Pack_Paths(dir string) ([]string, bool) {
+	paths, err := filepath.Glob(State_Path(dir, packs_dir, "*"+pack_ext))
+	if err != nil {
+		errlog.Print(err)
+
+		return nil, false
+	}
+
+	sort.Strings(paths)
+
+	return paths, true
+}
+
+// Open_Pack opens a pack and reads its footer.
+func Open_Pack(path string) (*Pack, error) {
+	f, err := os.Open(path)
+	if err != nil {
+		return nil, err
+	}
+
+	p := &Pack{Path: path, file: f}
+
+	err = p.read_footer()
+	if err != nil {
+		f.Close()
+
+		return nil, fmt.Errorf("%s: %w", path, err)
+	}
+
+	return p, nil
+}
+
+func (p *Pack) read_footer() error {
+	info, err := p.file.Stat()
+	if err != nil {
+		return err
+	}
+
+	size := info.Size()
+	if size < int64(len(pack_magic)+pack_trailer_size) {
+		return errors.New("not a pack")
+	}
+
+	trailer := make([]byte, pack_trailer_size)
+
+	_, err = p.file.ReadAt(trailer, size-int64(pack_trailer_size))
+	if err != nil {
+		return err
+	}
+
+	footerOffset := int64(binary.LittleEndian.Uint64(trailer))
+	magic := string(trailer[8:])
+	if magic != pack_magic && magic != pack_magic_v2 && magic != pack_magic_v1 ||
+		footerOffset < int64(len(pack_magic)) || footerOffset > size-int64(pack_trailer_size) {
+		return errors.New("not a pack")
+	}
+
+	footer := make([]byte, size-int64(pack_trailer_size)-footerOffset)
+
+	_, err = p.file.ReadAt(footer, footerOffset)
+	if err != nil {
+		return err
+	}
+
+	r := bytes.NewReader(footer)
+	damaged := errors.New("damaged pack footer")
+
+	uvarints := func(fields []uint64) bool {
+		for i := range fields {
+			fields[i], err = binary.ReadUvarint(r)
+			if err != nil {
+				return false
+			}
+		}
+
+		return true
+	}
+
+	var count [1]uint64
+	if !uvarints(count[:]) || count[0] > uint64(len(footer)) {
+		return damaged
+	}
+
+	p.chunks = make([]pack_chunk, count[0])
+	for i := range p.chunks {
+		var fields [3]uint64
+		if !uvarints(fields[:]) {
+			return damaged
+		}
+
+		c := pack_chunk{offset: int64(fields[0]), length: int(fields[1]), size: int(fields[2])}
+		if c.offset+int64(c.length) > footerOffset {
+			return damaged
+		}
+
+		if magic != pack_magic_v1 {
+			c.tokens, err = read_bloom(r, bytes_of(r))
+			if err == nil {
+				c.trigrams, err = read_bloom(r, bytes_of(r))
+			}
+			if err != nil {
+				return damaged
+			}
+
+			p.Trigrams = p.Trigrams || c.trigrams != nil
+		}
+
+		p.chunks[i] = c
+	}
+
+	// days stored whole are read as days of a single segment
+	if magic == pack_magic {
+		if !uvarints(count[:]) || count[0] > uint64(len(footer)) {
+			return damaged
+		}
+
+		p.segments = make([]pack_segment, count[0])
+		for i := range p.segments {
+			var fields [3]uint64
+			if !uvarints(fields[:]) || fields[0] >= uint64(len(p.chunks)) ||
+				fields[1]+fields[2] > uint64(p.chunks[fields[0]].size) {
+				return damaged
+			}
+
+			p.segments[i] = pack_segment{chunk: int(fields[0]), offset: int(fields[1]), size: int(fields[2])}
+		}
+	}
+
+	if !uvarints(count[:]) || count[0] > uint64(len(footer)) {
+		return damaged
+	}
+
+	p.Entries = make([]Pack_Entry, count[0])
+	for i := range p.Entries {
+		e := &p.Entries[i]
+
+		var fields [4]uint64
+		if !uvarints(fields[:]) || fields[1] >= uint64(len(p.chunks)) {
+			return damaged
+		}
+
+		e.Chunk, e.Size = int(fields[1]), int(fields[3])
+
+		if magic == pack_magic {
+			if fields[2] > uint64(len(footer)) {
+				return damaged
+			}
+
+			e.Segments = make([]int, fields[2])
+			total := 0
+
+			for j := range e.Segments {
+				var segment [1]uint64
+				if !uvarints(segment[:]) || segment[0] >= uint64(len(p.segments)) {
+					return damaged
+				}
+
+				e.Segments[j] = int(segment[0])
+				total += p.segments[segment[0]].size
+			}
+
+			if total != e.Size {
+				return damaged
+			}
+		} else {
+			if fields[2]+fields[3] > uint64(p.chunks[fields[1]].size) {
+				return damaged
+			}
+
+			e.Segments = []int{len(p.segments)}
+			p.segments = append(p.segments, pack_segment{chunk: e.Chunk, offset: int(fields[2]), size: e.Size})
+		}
+
+		name := make([]byte, fields[0])
+
+		_, err = io.ReadFull(r, name)
+		if err == nil {
+			_, err = io.ReadFull(r, e.Hash[:])
+		}
+		if err != nil {
+			return damaged
+		}
+
+		e.Name = string(name)
+	}
+
+	return nil
+}
+
+// bytes_of returns a function reading the next n bytes of r.
+func bytes_of(r *bytes.Reader) func(n int) ([]byte, error) {
+	return func(n int) ([]byte, error) {
+		if n > r.Len() {
+			return nil, io.ErrUnexpectedEOF
+		}
+
+		data := make([]byte, n)
+		r.Read(data)
+
+		return data, nil
+	}
+}
+
+// May_Match tells from the filters of a chunk whether it may hold the text of a probe. Chunks of
+// packs without filters may hold anything.
+func (p *Pack) May_Match(i int, probe *Search_Probe) bool {
+	c := &p.chunks[i]
+	if c.tokens == nil {
+		return true
+	}
+
+	return probe.May_Match(c.tokens, c.trigrams)
+}
+
+// Find returns the entry of an archived day, or nil.
+func (p *Pack) Find(name string) *Pack_Entry {
+	for i := range p.Entries {
+		if p.Entries[i].Name == name {
+			return &p.Entries[i]
+		}
+	}
+
+	return nil
+}
+
+// Read returns the content of an archived day, checked against its hash. The segments of the
+// day are copied from the chunks holding them, the last few of which the pack keeps inflated, so
+// reading days in date order inflates every chunk about once.
+func (p *Pack) Read(e *Pack_Entry) ([]byte, error) {
+	data := make([]byte, 0, e.Size)
+
+	for _, i := range e.Segments {
+		segment := p.segments[i]
+
+		chunk, ok := p.cache[segment.chunk]
+		if !ok {
+			var err error
+
+			chunk, err = p.Read_Chunk(segment.chunk)
+			if err != nil {
+				return nil, err
+			}
+
+			if p.cache == nil || len(p.cache) >= pack_cached_chunks {
+				p.cache = make(map[int][]byte, pack_cached_chunks)
+			}
+
+			p.cache[segment.chunk] = chunk
+		}
+
+		data = append(data, chunk[segment.offset:segment.offset+segment.size]...)
+	}
+
+	if sha256.Sum256(data) != e.Hash {
+		return nil, fmt.Errorf("%s: %s does not match its hash", p.Path, e.Name)
+	}
+
+	return data, nil
+}
+
+// Read_Chunk returns the inflated content of one chunk of the pack.
+func (p *Pack) Read_Chunk(i int) ([]byte, error) {
+	c := p.chunks[i]
+
+	compressed := make([]byte, c.length)
+
+	_, err := p.file.ReadAt(compressed, c.offset)
+	if err != nil {
+		return nil, err
+	}
+
+	var fr io.ReadCloser
+
+	if pooled, ok := flate_readers.Get().(io.ReadCloser); ok {
+		fr = pooled
+		fr.(flate.Resetter).Reset(bytes.NewReader(compressed), nil)
+	} else {
+		fr = flate.NewReader(bytes.NewReader(compressed))
+	}
+
+	defer flate_readers.Put(fr)
+
+	data := make([]byte, c.size)
+
+	_, err = io.ReadFull(fr, data)
+	if err != nil {
+		return nil, fmt.Errorf("%s: chunk %d: %w", p.Path, i, err)
+	}
+
+	return data, nil
+}
+
+// Read_All returns every archived day of the pack in date order.
+func (p *Pack) Read_All() ([]Pack_Day, error) {
+	days := make([]Pack_Day, 0, len(p.Entries))
+
+	for i := range p.Entries {
+		data, err := p.Read(&p.Entries[i])
+		if err != nil {
+			return nil, err
+		}
+
+		days = append(days, Pack_Day{Name: p.Entries[i].Name, Data: data})
+	}
+
+	return days, nil
+}
+
+// Close closes the pack file.
+func (p *Pack) Close() error {
+	return p.file.Close()
+}
+
+// Write_Pack atomically replaces a pack with one holding days, which it sorts into date order.
+// Segments already stored for an earlier day are referred to rather than stored again. The filters
+// of a chunk cover the whole content of the days completed in it, including segments stored in
+// earlier chunks, so that text spanning segments is never missed. The chunks get token filters,
+// and trigram filters when trigrams is set.
+//
+// If the pack is successfully written, Write_Pack returns true.
+// Otherwise, the error is logged and Write_Pack returns false.
+func Write_Pack(path string, days []Pack_Day, trigrams bool) bool {
+	debug.Printf("Write_Pack(%s, %d days)\n", path, len(days))
+
+	sort.SliceStable(days, func(i, j int) bool {
+		mi, di, yi, _ := Parse_Log_Name(days[i].Name)
+		mj, dj, yj, _ := Parse_Log_Name(days[j].Name)
+
+		return yi*10000+mi*100+di < yj*10000+mj*100+dj
+	})
+
+	var out bytes.Buffer
+
+	out.WriteString(pack_magic)
+
+	fw, err := flate.NewWriter(&out, flate.BestCompression)
+	if err != nil {
+		errlog.Print(err)
+
+		return false
+	}
+
+	var chunks []pack_chunk
+	var segments []pack_segment
+	var entries []Pack_Entry
+	var raw []byte
+
+	stored := make(map[[sha256.Size]byte]int)
+	keys := new_chunk_keys(trigrams)
+
+	flush := func() {
+		offset := int64(out.Len())
+
+		fw.Reset(&out)
+		fw.Write(raw)
+		fw.Close()
+
+		c := pack_chunk{offset: offset, length: out.Len() - int(offset), size: len(raw)}
+		c.tokens, c.trigrams = keys.filters()
+
+		chunks = append(chunks, c)
+		raw = raw[:0]
+	}
+
+	for _, day := range days {
+		e := Pack_Entry{Name: day.Name, Chunk: len(chunks), Size: len(day.Data), Hash: sha256.Sum256(day.Data)}
+
+		for data := day.Data; len(data) > 0; {
+			n := CDC_Cut(data)
+			sum := sha256.Sum256(data[:n])
+
+			segment, ok := stored[sum]
+			if !ok {
+				segment = len(segments)
+				stored[sum] = segment
+				segments = append(segments, pack_segment{chunk: len(chunks), offset: len(raw), size: n})
+				raw = append(raw, data[:n]...)
+			}
+
+			e.Segments = append(e.Segments, segment)
+			data = data[n:]
+		}
+
+		keys.add(day.Data)
+		entries = append(entries, e)
+
+		if len(raw) >= pack_chunk_size {
+			flush()
+		}
+	}
+
+	if len(entries) > 0 && entries[len(entries)-1].Chunk == len(chunks) {
+		flush()
+	}
+
+	debug.Printf("stored %d distinct segments of %d days in %d chunks\n", len(segments), len(days), len(chunks))
+
+	footerOffset := out.Len()
+
+	var scratch [binary.MaxVarintLen64]byte
+	uvarint := func(v uint64) {
+		out.Write(scratch[:binary.PutUvarint(scratch[:], v)])
+	}
+
+	uvarint(uint64(len(chunks)))
+	for _, c := range chunks {
+		uvarint(uint64(c.offset))
+		uvarint(uint64(c.length))
+		uvarint(uint64(c.size))
+		out.Write(append_bloom(append_bloom(nil, c.tokens), c.trigrams))
+	}
+
+	uvarint(uint64(len(segments)))
+	for _, segment := range segments {
+		uvarint(uint64(segment.chunk))
+		uvarint(uint64(segment.offset))
+		uvarint(uint64(segment.size))
+	}
+
+	uvarint(uint64(len(entries)))
+	for _, e := range entries {
+		uvarint(uint64(len(e.Name)))
+		uvarint(uint64(e.Chunk))
+		uvarint(uint64(len(e.Segments)))
+		uvarint(uint64(e.Size))
+
+		for _, segment := range e.Segments {
+			uvarint(uint64(segment))
+		}
+
+		out.WriteString(e.Name)
+		out.Write(e.Hash[:])
+	}
+
+	binary.LittleEndian.PutUint64(scratch[:8], uint64(footerOffset))
+	out.Write(scratch[:8])
+	out.WriteString(pack_magic)
+
+	return Write_Atomic(path, out.Bytes())
+}
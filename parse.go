@@ -0,0 +1,102 @@
+package main
+
+import (
+	"strconv"
+	"strings"
+)
+
+// section_prefix starts the line that opens a section of a logfile, as in log_format.
+const section_prefix string = "|> "
+
+// Section is one `|> name` block of a logfile. Body holds the lines that follow the section line
+// up to the next section, without their newlines.
+type Section struct {
+	Name string
+	Body []string
+}
+
+// Parsed_Log is a logfile split into the header lines before the first section and its sections.
+// Joining everything back with Bytes reproduces the original content exactly.
+type Parsed_Log struct {
+	Header   []string
+	Sections []Section
+}
+
+// Parse_Log splits the content of a logfile into its header and sections.
+func Parse_Log(data []byte) Parsed_Log {
+	var parsed Parsed_Log
+
+	lines := strings.Split(string(data), "\n")
+
+	current := &parsed.Header
+	for _, line := range lines {
+		if strings.HasPrefix(line, section_prefix) {
+			parsed.Sections = append(parsed.Sections, Section{Name: strings.TrimPrefix(line, section_prefix)})
+			current = &parsed.Sections[len(parsed.Sections)-1].Body
+
+			continue
+		}
+
+		*current = append(*current, line)
+	}
+
+	return parsed
+}
+
+// Bytes joins a parsed logfile back into its content.
+func (p Parsed_Log) Bytes() []byte {
+	lines := make([]string, 0, len(p.Header)+4*len(p.Sections))
+
+	lines = append(lines, p.Header...)
+	for _, section := range p.Sections {
+		lines = append(lines, section_prefix+section.Name)
+		lines = append(lines, section.Body...)
+	}
+
+	return []byte(strings.Join(lines, "\n"))
+}
+
+// Cut_Final_Newline drops the empty line that follows the final newline, so that sections can be
+// moved or added at the end, and tells whether there was one to put back with Add_Final_Newline.
+func (p *Parsed_Log) Cut_Final_Newline() bool {
+	lines := &p.Header
+	if n := len(p.Sections); n > 0 {
+		lines = &p.Sections[n-1].Body
+	}
+
+	n := len(*lines)
+	if n == 0 || (*lines)[n-1] != "" {
+		return false
+	}
+
+	*lines = (*lines)[:n-1]
+
+	return true
+}
+
+// Add_Final_Newline ends a parsed logfile with a newline.
+func (p *Parsed_Log) Add_Final_Newline() {
+	if n := len(p.Sections); n > 0 {
+		p.Sections[n-1].Body = append(p.Sections[n-1].Body, "")
+	} else {
+		p.Header = append(p.Header, "")
+	}
+}
+
+// Section_Keys returns a key per section made of its name and, for repeated names, the number of
+// earlier sections sharing it, so duplicated sections can still be told apart.
+func (p Parsed_Log) Section_Keys() []string {
+	keys := make([]string, len(p.Sections))
+	counts := make(map[string]int)
+
+	for i, section := range p.Sections {
+		keys[i] = section.Name
+		if n := counts[section.Name]; n > 0 {
+			keys[i] = section.Name + "#" + strconv.Itoa(n)
+		}
+
+		counts[section.Name]++
+	}
+
+	return keys
+}
@@ -0,0 +1,179 @@
+package main
+
+import (
+	"errors"
+	"fmt"
+	"os"
+	"path/filepath"
+	"sort"
+	"strings"
+	"time"
+)
+
+// plugins_dir holds the WebAssembly plugins of a journal, one .wasm module per plugin.
+const plugins_dir string = "plugins"
+
+// The exports a plugin module may provide. A plugin hands touchlog a buffer inside its memory
+// once, when it is loaded, and every call exchanges text through that buffer.
+const plugin_buffer string = "touchlog_buffer"
+const plugin_buffer_size string = "touchlog_buffer_size"
+const plugin_render string = "touchlog_render"
+const plugin_filter string = "touchlog_filter"
+
+// plugins are the plugins of the journal being written or exported, loaded once per run.
+var plugins []*Plugin
+
+// Plugin is a compiled and instantiated WebAssembly module. Plugins have no imports, so they can
+// only compute on what touchlog hands them, and every call is bounded in time and memory.
+type Plugin struct {
+	Name      string
+	inst      *Wasm_Instance
+	buffer    uint32
+	size      uint32
+	render    uint32
+	filter    uint32
+	hasRender bool
+	hasFilter bool
+}
+
+// Load_Plugins compiles and instantiates every plugin of a journal.
+//
+// If a plugin cannot be loaded, the error is logged and Load_Plugins returns nil, false.
+func Load_Plugins(dir string) ([]*Plugin, bool) {
+	paths, err := filepath.Glob(State_Path(dir, plugins_dir, "*.wasm"))
+	if err != nil {
+		errlog.Print(err)
+
+		return nil, false
+	}
+
+	sort.Strings(paths)
+
+	var loaded []*Plugin
+
+	for _, path := range paths {
+		plugin, err := Load_Plugin(path)
+		if err != nil {
+			errlog.Printf("plugin %s: %v\n", filepath.Base(path), err)
+
+			return nil, false
+		}
+
+		loaded = append(loaded, plugin)
+	}
+
+	return loaded, true
+}
+
+// Load_Plugin compiles a plugin module, instantiates it and asks it for its buffer.
+func Load_Plugin(path string) (*Plugin, error) {
+	debug.Printf("Load_Plugin(%s)\n", path)
+
+	data, err := os.ReadFile(path)
+	if err != nil {
+		return nil, err
+	}
+
+	module, err := Compile_Wasm(data)
+	if err != nil {
+		return nil, err
+	}
+
+	inst, err := module.Instantiate()
+	if err != nil {
+		return nil, err
+	}
+
+	p := &Plugin{Name: strings.TrimSuffix(filepath.Base(path), ".wasm"), inst: inst}
+	p.render, p.hasRender = inst.Export(plugin_render)
+	p.filter, p.hasFilter = inst.Export(plugin_filter)
+
+	if !p.hasRender && !p.hasFilter {
+		return nil, fmt.Errorf("exports neither %s nor %s", plugin_render, plugin_filter)
+	}
+
+	buffer, err := inst.Call(plugin_buffer)
+	if err == nil {
+		var size []uint64
+
+		size, err = inst.Call(plugin_buffer_size)
+		if err == nil && len(buffer) == 1 && len(size) == 1 {
+			p.buffer, p.size = uint32(buffer[0]), uint32(size[0])
+		}
+	}
+	if err != nil {
+		return nil, err
+	}
+
+	if p.size == 0 || uint64(p.buffer)+uint64(p.size) > uint64(len(inst.Memory())) {
+		return nil, errors.New("buffer lies outside of the plugin memory")
+	}
+
+	return p, nil
+}
+
+// Find_Plugin returns the loaded plugin with a name, or nil.
+func Find_Plugin(name string) *Plugin {
+	for _, p := range plugins {
+		if p.Name == name {
+			return p
+		}
+	}
+
+	return nil
+}
+
+// Render asks a plugin for text to add to the skeleton of a date. The plugin writes into its
+// buffer and returns the length written.
+func (p *Plugin) Render(date time.Time) ([]byte, error) {
+	results, err := p.inst.Call_Index(p.render, uint64(date.Year()), uint64(date.Month()),
+		uint64(date.Day()), uint64(date.Weekday()))
+	if err != nil {
+		return nil, err
+	}
+
+	if len(results) != 1 || uint32(results[0]) > p.size {
+		return nil, fmt.Errorf("%s must return the length it wrote to its %d byte buffer", plugin_render, p.size)
+	}
+
+	n := uint32(results[0])
+
+	return append([]byte(nil), p.inst.Memory()[p.buffer:p.buffer+n]...), nil
+}
+
+// Filter asks a plugin whether a day belongs in an export. Content beyond the plugin buffer is
+// cut off, the rest is copied into the buffer and a non-zero result keeps the day.
+func (p *Plugin) Filter(date time.Time, content []byte) (bool, error) {
+	n := copy(p.inst.Memory()[p.buffer:p.buffer+p.size], content)
+
+	results, err := p.inst.Call_Index(p.filter, uint64(date.Year()), uint64(date.Month()),
+		uint64(date.Day()), uint64(n))
+	if err != nil {
+		return false, err
+	}
+
+	return len(results) == 1 && uint32(results[0]) != 0, nil
+}
+
+// Render_Plugins appends the text of every rendering plugin the template does not place to the
+// skeleton of a date.
+//
+// If a plugin fails, the error is logged and Render_Plugins returns nil, false.
+func Render_Plugins(date time.Time, skeleton []byte) ([]byte, bool) {
+	for _, p := range plugins {
+		if !p.hasRender || log_template != nil && log_template.Placed(p.Name) {
+			continue
+		}
+
+		text, err := p.Render(date)
+		if err != nil {
+			errlog.Printf("plugin %s: %v\n", p.Name, err)
+
+			return nil, false
+		}
+
+		skeleton = append(skeleton, text...)
+	}
+
+	return skeleton, true
+}
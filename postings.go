@@ -0,0 +1,475 @@
+package main
+
+import (
+	"encoding/binary"
+	"errors"
+	"math/bits"
+	"sort"
+)
+
+// The postings of a word are stored in blocks of posting_block_size occurrences. A block holds
+// four streams, the days, sections, positions and offsets of its occurrences, each bit-packed at
+// the width of its largest value. Days are delta coded, and positions and offsets too within the
+// same section of a day, so the widths stay small; every block starts afresh from the last day of
+// the block before it, so it can be decoded on its own. The blocks are preceded by skip entries
+// holding the last day and the size of every block: a cursor looking for a day steps over the
+// blocks ending before it without decoding them, and only decodes the sections, positions and
+// offsets of a block when one of its days is wanted. Blocks end with posting_block_padding zero
+// bytes, so the kernels can always load eight bytes at once.
+//
+//	count, blocks
+//	last day delta, size        for every block
+//	width, packed days
+//	width, packed sections
+//	width, packed positions
+//	width, packed offsets
+//	padding                     for every block
+const posting_block_size int = 128
+const posting_block_padding int = 8
+
+type posting_skip struct {
+	last   int
+	offset int
+	count  int
+}
+
+// append_postings encodes the occurrences of a word, in order of day, section and position.
+func append_postings(out []byte, postings []Word_Posting) []byte {
+	blocks := (len(postings) + posting_block_size - 1) / posting_block_size
+
+	out = binary.AppendUvarint(out, uint64(len(postings)))
+	out = binary.AppendUvarint(out, uint64(blocks))
+
+	var body []byte
+	var streams [4][posting_block_size]uint32
+
+	last := 0
+	for b := 0; b < blocks; b++ {
+		block := postings[b*posting_block_size : min((b+1)*posting_block_size, len(postings))]
+		start := len(body)
+
+		prev := Word_Posting{Doc: last, Section: -1}
+		for i, p := range block {
+			streams[0][i] = uint32(p.Doc - prev.Doc)
+			streams[1][i] = uint32(p.Section)
+			streams[2][i], streams[3][i] = uint32(p.Position), uint32(p.Offset)
+
+			if p.Doc == prev.Doc && p.Section == prev.Section {
+				streams[2][i] -= uint32(prev.Position)
+				streams[3][i] -= uint32(prev.Offset)
+			}
+
+			prev = p
+		}
+
+		for _, stream := range streams {
+			body = append_packed(body, stream[:len(block)])
+		}
+
+		body = append(body, make([]byte, posting_block_padding)...)
+
+		out = binary.AppendUvarint(out, uint64(prev.Doc-last))
+		out = binary.AppendUvarint(out, uint64(len(body)-start))
+		last = prev.Doc
+	}
+
+	return append(out, body...)
+}
+
+// append_packed appends the width of the largest of values and values packed at that width,
+// least significant bits first.
+func append_packed(out []byte, values []uint32) []byte {
+	var all uint32
+	for _, v := range values {
+		all |= v
+	}
+
+	width := bits.Len32(all)
+	out = append(out, byte(width))
+
+	var acc uint64
+	filled := 0
+
+	for _, v := range values {
+		acc |= uint64(v) << filled
+		filled += width
+
+		for filled >= 8 {
+			out = append(out, byte(acc))
+			acc >>= 8
+			filled -= 8
+		}
+	}
+
+	if filled > 0 {
+		out = append(out, byte(acc))
+	}
+
+	return out
+}
+
+// packed_size is the number of bytes n values of a width are packed into.
+func packed_size(n int, width int) int {
+	return (n*width + 7) / 8
+}
+
+// unpack decodes len(dst) values packed at a width, from src holding at least eight bytes past
+// them. Eight values of any width take exactly width bytes, so every group of eight starts on a
+// byte and the kernels unroll a group into loads and shifts known from the width alone: one load
+// for the eight values when they fit in it, two for four values each up to 16 bits, and a load
+// per value beyond that. The shifts are worked out once, outside the loops.
+func unpack(dst []uint32, src []byte, width int) {
+	if width == 0 {
+		clear(dst)
+
+		return
+	}
+
+	mask := uint64(1)<<width - 1
+	w := uint(width)
+	s1, s2, s3, s4, s5, s6, s7 := w&63, 2*w&63, 3*w&63, 4*w&63, 5*w&63, 6*w&63, 7*w&63
+
+	i := 0
+	switch {
+	case width <= 8:
+		for ; i+8 <= len(dst); i += 8 {
+			s := src[i/8*width:]
+			a := binary.LittleEndian.Uint64(s)
+			d := dst[i : i+8 : i+8]
+
+			d[0] = uint32(a & mask)
+			d[1] = uint32(a >> s1 & mask)
+			d[2] = uint32(a >> s2 & mask)
+			d[3] = uint32(a >> s3 & mask)
+			d[4] = uint32(a >> s4 & mask)
+			d[5] = uint32(a >> s5 & mask)
+			d[6] = uint32(a >> s6 & mask)
+			d[7] = uint32(a >> s7 & mask)
+		}
+	case width <= 16:
+		// the second four values start in the middle of the group, on a byte or half past one
+		half, shift := w>>1, (w&1)<<2
+
+		for ; i+8 <= len(dst); i += 8 {
+			s := src[i/8*width:]
+			_ = s[half+7]
+			a := binary.LittleEndian.Uint64(s)
+			b := binary.LittleEndian.Uint64(s[half:]) >> shift
+			d := dst[i : i+8 : i+8]
+
+			d[0] = uint32(a & mask)
+			d[1] = uint32(a >> s1 & mask)
+			d[2] = uint32(a >> s2 & mask)
+			d[3] = uint32(a >> s3 & mask)
+			d[4] = uint32(b & mask)
+			d[5] = uint32(b >> s1 & mask)
+			d[6] = uint32(b >> s2 & mask)
+			d[7] = uint32(b >> s3 & mask)
+		}
+	default:
+		for ; i+8 <= len(dst); i += 8 {
+			s := src[i/8*width:]
+			_ = s[w+7]
+			d := dst[i : i+8 : i+8]
+
+			d[0] = uint32(binary.LittleEndian.Uint64(s) & mask)
+			d[1] = uint32(binary.LittleEndian.Uint64(s[w>>3:]) >> (s1 & 7) & mask)
+			d[2] = uint32(binary.LittleEndian.Uint64(s[2*w>>3:]) >> (s2 & 7) & mask)
+			d[3] = uint32(binary.LittleEndian.Uint64(s[3*w>>3:]) >> (s3 & 7) & mask)
+			d[4] = uint32(binary.LittleEndian.Uint64(s[4*w>>3:]) >> (s4 & 7) & mask)
+			d[5] = uint32(binary.LittleEndian.Uint64(s[5*w>>3:]) >> (s5 & 7) & mask)
+			d[6] = uint32(binary.LittleEndian.Uint64(s[6*w>>3:]) >> (s6 & 7) & mask)
+			d[7] = uint32(binary.LittleEndian.Uint64(s[7*w>>3:]) >> (s7 & 7) & mask)
+		}
+	}
+
+	for ; i < len(dst); i++ {
+		p := uint(i) * w
+		dst[i] = uint32(binary.LittleEndian.Uint64(src[p>>3:]) >> (p & 7) & mask)
+	}
+}
+
+// Posting_Cursor walks the occurrences of a word day by day.
+type Posting_Cursor struct {
+	data  []byte
+	skips []posting_skip
+	block int
+	next  int
+	count int
+
+	// the decoded streams of the current block; fields tells whether the last three are
+	fields  bool
+	streams [4][posting_block_size]uint32
+	docs    [posting_block_size]int
+}
+
+var errDamagedPostings = errors.New("damaged postings")
+
+// New_Posting_Cursor reads the skip entries of encoded postings and returns a cursor before the
+// first of them.
+func New_Posting_Cursor(data []byte) (*Posting_Cursor, error) {
+	count, n1 := binary.Uvarint(data)
+	blocks, n2 := binary.Uvarint(data[max(n1, 0):])
+	if n1 <= 0 || n2 <= 0 || blocks > uint64(len(data)) ||
+		blocks != (count+uint64(posting_block_size)-1)/uint64(posting_block_size) {
+		return nil, errDamagedPostings
+	}
+
+	c := &Posting_Cursor{skips: make([]posting_skip, blocks), block: -1}
+
+	pos, last, offset := n1+n2, 0, 0
+	for b := range c.skips {
+		delta, n1 := binary.Uvarint(data[pos:])
+		size, n2 := binary.Uvarint(data[pos+max(n1, 0):])
+		if n1 <= 0 || n2 <= 0 {
+			return nil, errDamagedPostings
+		}
+
+		last += int(delta)
+		c.skips[b] = posting_skip{last: last, offset: offset,
+			count: min(posting_block_size, int(count)-b*posting_block_size)}
+
+		pos += n1 + n2
+		offset += int(size)
+	}
+
+	c.data = data[pos:]
+	if offset > len(c.data) {
+		return nil, errDamagedPostings
+	}
+
+	return c, nil
+}
+
+// load decodes the days of a block.
+func (c *Posting_Cursor) load(b int) error {
+	skip := c.skips[b]
+	src := c.data[skip.offset:]
+
+	if len(src) == 0 || int(src[0]) > 32 || len(src) < 1+packed_size(skip.count, int(src[0]))+posting_block_padding {
+		return errDamagedPostings
+	}
+
+	unpack(c.streams[0][:skip.count], src[1:], int(src[0]))
+
+	prev := 0
+	if b > 0 {
+		prev = c.skips[b-1].last
+	}
+
+	for i, delta := range c.streams[0][:skip.count] {
+		prev += int(delta)
+		c.docs[i] = prev
+	}
+
+	c.block, c.next, c.count, c.fields = b, 0, skip.count, false
+
+	return nil
+}
+
+// load_fields decodes the sections, positions and offsets of the current block.
+func (c *Posting_Cursor) load_fields() error {
+	skip := c.skips[c.block]
+	src := c.data[skip.offset:]
+	pos := 1 + packed_size(skip.count, int(src[0]))
+
+	for s := 1; s < 4; s++ {
+		if pos >= len(src) || int(src[pos]) > 32 ||
+			len(src) < pos+1+packed_size(skip.count, int(src[pos]))+posting_block_padding {
+			return errDamagedPostings
+		}
+
+		width := int(src[pos])
+		unpack(c.streams[s][:skip.count], src[pos+1:], width)
+		pos += 1 + packed_size(skip.count, width)
+	}
+
+	c.fields = true
+
+	return nil
+}
+
+// Seek moves the cursor to the first occurrence in a day at or after doc, skipping the blocks
+// ending before it, and returns that day, or -1 past the last occurrence.
+func (c *Posting_Cursor) Seek(doc int) (int, error) {
+	if c.block >= 0 && c.next < c.count && c.docs[c.count-1] >= doc {
+		for c.docs[c.next] < doc {
+			c.next++
+		}
+
+		return c.docs[c.next], nil
+	}
+
+	b := c.block + 1
+	if b >= len(c.skips) {
+		c.block, c.next, c.count = len(c.skips), 0, 0
+
+		return -1, nil
+	}
+
+	b += sort.Search(len(c.skips)-b, func(i int) bool { return c.skips[b+i].last >= doc })
+	if b == len(c.skips) {
+		c.block, c.next, c.count = len(c.skips), 0, 0
+
+		return -1, nil
+	}
+
+	if err := c.load(b); err != nil {
+		return -1, err
+	}
+
+	for c.docs[c.next] < doc {
+		c.next++
+	}
+
+	return c.docs[c.next], nil
+}
+
+// Take appends the occurrences in the day the cursor is at to postings and moves past them.
+func (c *Posting_Cursor) Take(postings []Word_Posting) ([]Word_Posting, error) {
+	if c.block < 0 || c.next >= c.count {
+		return postings, nil
+	}
+
+	doc := c.docs[c.next]
+
+	for {
+		if !c.fields {
+			if err := c.load_fields(); err != nil {
+				return nil, err
+			}
+		}
+
+		for ; c.next < c.count && c.docs[c.next] == doc; c.next++ {
+			i := c.next
+
+			p := Word_Posting{Doc: doc, Section: int(c.streams[1][i]), Position: int(c.streams[2][i]),
+				Offset: int(c.streams[3][i])}
+			if i > 0 && c.docs[i-1] == doc && int(c.streams[1][i-1]) == p.Section {
+				prev := postings[len(postings)-1]
+				p.Position += prev.Position
+				p.Offset += prev.Offset
+			}
+
+			postings = append(postings, p)
+		}
+
+		// a day may go on in the next block
+		if c.next < c.count || c.block+1 == len(c.skips) || c.skips[c.block].last != doc {
+			return postings, nil
+		}
+
+		if err := c.load(c.block + 1); err != nil {
+			return nil, err
+		}
+
+		if c.docs[0] != doc {
+			return postings, nil
+		}
+	}
+}
+
+// decode_postings returns every occurrence of encoded postings.
+func decode_postings(data []byte) ([]Word_Posting, error) {
+	c, err := New_Posting_Cursor(data)
+	if err != nil {
+		return nil, err
+	}
+
+	var postings []Word_Posting
+
+	for doc := 0; ; doc++ {
+		doc, err = c.Seek(doc)
+		if doc < 0 || err != nil {
+			return postings, err
+		}
+
+		postings, err = c.Take(postings)
+		if err != nil {
+			return nil, err
+		}
+	}
+}
+
+// posting_source walks the occurrences of a word day by day, as a Posting_Cursor does.
+type posting_source interface {
+	Seek(doc int) (int, error)
+	Take(postings []Word_Posting) ([]Word_Posting, error)
+}
+
+// posting_union walks the occurrences of several words as those of one word.
+type posting_union struct {
+	cursors []*Posting_Cursor
+	at      []int
+}
+
+// new_posting_source returns a source walking the occurrences of the words of cursors as one.
+func new_posting_source(cursors []*Posting_Cursor) posting_source {
+	if len(cursors) == 1 {
+		return cursors[0]
+	}
+
+	return &posting_union{cursors: cursors, at: make([]int, len(cursors))}
+}
+
+// Seek moves every cursor to the first occurrence in a day at or after doc, and returns the first
+// of those days, or -1 past the last occurrence of every word.
+func (u *posting_union) Seek(doc int) (int, error) {
+	first := -1
+
+	for i, c := range u.cursors {
+		at, err := c.Seek(doc)
+		if err != nil {
+			return -1, err
+		}
+
+		u.at[i] = at
+		if at >= 0 && (first < 0 || at < first) {
+			first = at
+		}
+	}
+
+	return first, nil
+}
+
+// Take appends the occurrences in the first day a cursor is at to postings, in order of section
+// and position, and moves past them. It follows a Seek.
+func (u *posting_union) Take(postings []Word_Posting) ([]Word_Posting, error) {
+	first := -1
+	for _, at := range u.at {
+		if at >= 0 && (first < 0 || at < first) {
+			first = at
+		}
+	}
+
+	if first < 0 {
+		return postings, nil
+	}
+
+	start, words := len(postings), 0
+
+	for i, c := range u.cursors {
+		if u.at[i] != first {
+			continue
+		}
+
+		var err error
+
+		postings, err = c.Take(postings)
+		if err != nil {
+			return nil, err
+		}
+
+		u.at[i] = -1
+		words++
+	}
+
+	if words > 1 {
+		day := postings[start:]
+		sort.Slice(day, func(i, j int) bool {
+			return day[i].Section < day[j].Section || day[i].Section == day[j].Section && day[i].Position < day[j].Position
+		})
+	}
+
+	return postings, nil
+}
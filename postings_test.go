@@ -0,0 +1,225 @@
+package main
+
+import (
+	"math/rand"
+	"reflect"
+	"sort"
+	"testing"
+)
+
+func TestUnpack(t *testing.T) {
+	rng := rand.New(rand.NewSource(1))
+
+	for width := 0; width <= 32; width++ {
+		for _, n := range []int{0, 1, 7, 8, 9, 63, 127, posting_block_size} {
+			values := make([]uint32, n)
+			for i := range values {
+				if width > 0 {
+					values[i] = uint32(rng.Uint64() >> (64 - width))
+				}
+			}
+			if n > 0 && width > 0 {
+				values[rng.Intn(n)] = 1<<width - 1
+			}
+
+			packed := append_packed(nil, values)
+			if int(packed[0]) != width && n > 0 {
+				t.Fatalf("width %d, %d values: packed at width %d", width, n, packed[0])
+			}
+			if len(packed) != 1+packed_size(n, int(packed[0])) {
+				t.Fatalf("width %d, %d values: %d bytes", width, n, len(packed))
+			}
+
+			got := make([]uint32, n)
+			unpack(got, append(packed[1:], make([]byte, posting_block_padding)...), int(packed[0]))
+
+			if !reflect.DeepEqual(got, values) {
+				t.Fatalf("width %d, %d values: got %v, want %v", width, n, got, values)
+			}
+		}
+	}
+}
+
+// postings_test_list returns n occurrences spread over days gap apart on average, in order.
+func postings_test_list(rng *rand.Rand, n int, gap int, sections int, big bool) []Word_Posting {
+	postings := make([]Word_Posting, 0, n)
+	p := Word_Posting{}
+
+	for i := 0; i < n; i++ {
+		switch {
+		case i == 0:
+		case rng.Intn(3) == 0:
+			p.Doc += 1 + rng.Intn(gap)
+			p.Section, p.Position, p.Offset = rng.Intn(sections), rng.Intn(10), rng.Intn(100)
+		case rng.Intn(4) == 0 && p.Section+1 < sections:
+			p.Section += 1 + rng.Intn(sections-p.Section-1)
+			p.Position, p.Offset = rng.Intn(10), rng.Intn(100)
+		default:
+			p.Position += 1 + rng.Intn(20)
+			p.Offset += 1 + rng.Intn(200)
+		}
+
+		if big {
+			p.Offset += rng.Intn(1 << 20)
+		}
+
+		postings = append(postings, p)
+	}
+
+	return postings
+}
+
+func TestPostingsRoundTrip(t *testing.T) {
+	rng := rand.New(rand.NewSource(2))
+
+	oneDay := make([]Word_Posting, 3*posting_block_size+5)
+	for i := range oneDay {
+		oneDay[i] = Word_Posting{Doc: 42, Section: i / 100, Position: i, Offset: 7 * i}
+	}
+
+	tests := []struct {
+		name     string
+		postings []Word_Posting
+	}{
+		{"none", nil},
+		{"one", []Word_Posting{{Doc: 3, Section: 1, Position: 4, Offset: 30}}},
+		{"first day", []Word_Posting{{}, {Position: 1, Offset: 5}}},
+		{"one block", postings_test_list(rng, posting_block_size, 5, 3, false)},
+		{"one past a block", postings_test_list(rng, posting_block_size+1, 5, 3, false)},
+		{"many blocks", postings_test_list(rng, 5000, 3, 4, false)},
+		{"sparse days", postings_test_list(rng, 1000, 1<<20, 2, false)},
+		{"large offsets", postings_test_list(rng, 700, 2, 8, true)},
+		{"a day across blocks", oneDay},
+		{"widest values", []Word_Posting{{Doc: 1<<31 - 1, Section: 1<<31 - 1, Position: 1<<31 - 1, Offset: 1<<31 - 1}}},
+	}
+
+	for _, test := range tests {
+		data := append_postings(nil, test.postings)
+
+		got, err := decode_postings(data)
+		if err != nil || len(got) != len(test.postings) || len(got) > 0 && !reflect.DeepEqual(got, test.postings) {
+			t.Errorf("%s: got %d postings, %v, want %d", test.name, len(got), err, len(test.postings))
+
+			continue
+		}
+
+		// seeking lands on the first day at or after the one sought, as a scan would
+		c, err := New_Posting_Cursor(data)
+		if err != nil {
+			t.Fatalf("%s: %v", test.name, err)
+		}
+
+		last := 0
+		if len(test.postings) > 0 {
+			last = test.postings[len(test.postings)-1].Doc
+		}
+
+		for doc := 0; doc <= last+1; doc += 1 + rng.Intn(1+last/50) {
+			i := sort.Search(len(test.postings), func(i int) bool { return test.postings[i].Doc >= doc })
+
+			want := -1
+			if i < len(test.postings) {
+				want = test.postings[i].Doc
+			}
+
+			if got, err := c.Seek(doc); got != want || err != nil {
+				t.Fatalf("%s: Seek(%d) = %d, %v, want %d", test.name, doc, got, err, want)
+			}
+		}
+
+		for cut := 0; cut < len(data); cut += 1 + len(data)/64 {
+			decode_postings(data[:cut])
+		}
+	}
+}
+
+func TestPostingUnion(t *testing.T) {
+	rng := rand.New(rand.NewSource(3))
+
+	lists := [][]Word_Posting{
+		postings_test_list(rng, 400, 4, 3, false),
+		postings_test_list(rng, 50, 30, 3, false),
+		postings_test_list(rng, 1000, 2, 3, false),
+	}
+
+	var cursors []*Posting_Cursor
+	var want []Word_Posting
+
+	for _, list := range lists {
+		c, err := New_Posting_Cursor(append_postings(nil, list))
+		if err != nil {
+			t.Fatal(err)
+		}
+
+		cursors = append(cursors, c)
+		want = append(want, list...)
+	}
+
+	sort.SliceStable(want, func(i, j int) bool {
+		a, b := want[i], want[j]
+		if a.Doc != b.Doc {
+			return a.Doc < b.Doc
+		}
+		if a.Section != b.Section {
+			return a.Section < b.Section
+		}
+
+		return a.Position < b.Position
+	})
+
+	source := new_posting_source(cursors)
+
+	var got []Word_Posting
+
+	for doc := 0; ; doc++ {
+		var err error
+
+		doc, err = source.Seek(doc)
+		if err != nil {
+			t.Fatal(err)
+		}
+		if doc < 0 {
+			break
+		}
+
+		got, err = source.Take(got)
+		if err != nil {
+			t.Fatal(err)
+		}
+	}
+
+	if len(got) != len(want) {
+		t.Fatalf("got %d postings, want %d", len(got), len(want))
+	}
+
+	for i := range got {
+		if got[i].Doc != want[i].Doc || got[i].Section != want[i].Section || got[i].Position != want[i].Position {
+			t.Fatalf("posting %d: got %+v, want %+v", i, got[i], want[i])
+		}
+	}
+}
+
+func TestPostingsDamaged(t *testing.T) {
+	data := append_postings(nil, postings_test_list(rand.New(rand.NewSource(4)), 300, 3, 2, false))
+
+	tests := []struct {
+		name   string
+		mutate func(d []byte) []byte
+	}{
+		{"no data", func(d []byte) []byte { return nil }},
+		{"block count", func(d []byte) []byte { d[2] = 9; return d }},
+		{"truncated blocks", func(d []byte) []byte { return d[:len(d)-posting_block_padding-1] }},
+		{"width", func(d []byte) []byte {
+			c, _ := New_Posting_Cursor(d)
+			c.data[0] = 40
+			return d
+		}},
+	}
+
+	for _, test := range tests {
+		d := test.mutate(append([]byte(nil), data...))
+		if _, err := decode_postings(d); err == nil {
+			t.Errorf("%s: decoded", test.name)
+		}
+	}
+}
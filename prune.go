@@ -0,0 +1,550 @@
+package main
+
+import (
+	"os"
+	"path/filepath"
+	"regexp"
+	"runtime"
+	"sort"
+	"strconv"
+	"strings"
+	"sync"
+	"time"
+)
+
+// prune_batch is the number of files a worker removes through one directory descriptor before
+// taking the next batch.
+const prune_batch int = 64
+
+const prune_keep string = "keep"
+const prune_archive string = "archive"
+const prune_delete string = "delete"
+
+var policy_rule = regexp.MustCompile(`^(keep|archive|delete)\s+(\d+)([dwmy])(?:\s+(pristine|edited))?(?:\s+where\s+(.+))?$`)
+
+// Prune_Rule is one line of a retention policy: an action for the days older than an age, and
+// optionally only for pristine or edited days, or days matching a filter expression.
+type Prune_Rule struct {
+	Action string
+	State  string
+	Where  *Filter_Expr
+	cutoff time.Time
+}
+
+// Prune applies a retention policy to a journal. The first rule of the policy matching a day
+// decides whether it is kept, archived into the pack of its year or deleted along with its
+// history, and days matching no rule are kept. Days already archived are deleted from their pack
+// by the same rules, and a pack left empty is removed.
+//
+// Which days are affected is decided from the index. The packs are written before any logfile is
+// removed, files are removed in batches on a pool of workers, and the index is saved once at the
+// end.
+//
+// If the policy is successfully applied, Prune returns true.
+// Otherwise, the error is logged and Prune returns false.
+func Prune(args []string) bool {
+	fs, verbosePtr := New_FlagSet("prune")
+	outDirPtr := fs.String("outdir", "", "prune the journal in the inputted directory")
+	policyPtr := fs.String("policy", "", "file holding the retention rules")
+	dryRunPtr := fs.Bool("dry-run", false, "print what would be archived or deleted without doing it")
+	jobsPtr := fs.Int("jobs", runtime.NumCPU(), "number of workers removing files")
+	trigramsPtr := fs.Bool("trigrams", false, "also filter the chunks of the packs written by trigrams")
+	fs.Parse(args)
+
+	Set_Verbosity(*verbosePtr)
+
+	if fs.NArg() != 0 || *policyPtr == "" || *jobsPtr < 1 {
+		errlog.Println("usage: touchlog prune [-verbose] [-outdir dir] [-dry-run] [-jobs n] [-trigrams] -policy file")
+
+		return false
+	}
+
+	rules, ok := Load_Policy(*policyPtr, time.Now())
+	if !ok {
+		return false
+	}
+
+	if !Resolve_Outdir(outDirPtr) {
+		return false
+	}
+
+	dir := *outDirPtr
+
+	for _, rule := range rules {
+		if rule.State != "" {
+			// telling pristine days apart needs the skeleton touchlog would write for them
+			plugins, ok = Load_Plugins(dir)
+			if !ok {
+				return false
+			}
+
+			log_template, ok = Load_Template(dir)
+			if !ok {
+				return false
+			}
+
+			break
+		}
+	}
+
+	idx, ok := Load_Index(dir)
+	if !ok {
+		return false
+	}
+
+	if _, ok := Refresh_Index(idx); !ok {
+		return false
+	}
+
+	p := &pruner{rules: rules}
+
+	archive := make(map[int][]string)
+	var remove []string
+
+	for _, name := range idx.Days() {
+		month, day, year, _ := Parse_Log_Name(name)
+		date := time.Date(year, time.Month(month), day, 0, 0, 0, 0, time.Local)
+
+		action, ok := p.action(date, func() ([]byte, bool) {
+			data, err := Read_Log(dir, name)
+			if err != nil {
+				errlog.Print(err)
+
+				return nil, false
+			}
+
+			return data, true
+		})
+		if !ok {
+			return false
+		}
+
+		switch action {
+		case prune_archive:
+			archive[year] = append(archive[year], name)
+		case prune_delete:
+			remove = append(remove, name)
+		}
+
+		if action != prune_keep && *dryRunPtr {
+			print.Printf("%s %s\n", action, name)
+		}
+	}
+
+	packs, ok := p.plan_packs(dir, archive, *dryRunPtr, *trigramsPtr)
+	if !ok {
+		return false
+	}
+
+	archived := 0
+	for _, names := range archive {
+		archived += len(names)
+	}
+
+	if *dryRunPtr {
+		print.Printf("would archive %d days and delete %d days and %d archived days\n",
+			archived, len(remove), len(p.unpacked))
+
+		return Save_Index(idx)
+	}
+
+	for _, pack := range packs {
+		if len(pack.days) == 0 {
+			continue
+		}
+
+		if !Write_Pack(pack.path, pack.days, pack.trigrams) {
+			return false
+		}
+	}
+
+	// a compressed day is removed under the name of its file, and dropped from the index under its own
+	var unlink []string
+	for _, names := range archive {
+		for _, name := range names {
+			unlink = append(unlink, name+idx.Entries[name].Ext)
+		}
+	}
+
+	for _, name := range remove {
+		unlink = append(unlink, name+idx.Entries[name].Ext)
+	}
+
+	removed, ok := Unlink_All(dir, unlink, *jobsPtr)
+
+	for _, filename := range removed {
+		name, _, _ := Split_Log_Variant(filename)
+		delete(idx.Entries, name)
+	}
+
+	// the history of an archived day stays so that it can still be restored, a deleted day goes
+	// for good
+	var histories []string
+	for _, name := range append(remove, p.unpacked...) {
+		histories = append(histories, name+history_ext, name+history_offsets_ext)
+	}
+
+	if _, err := os.Stat(State_Path(dir, history_dir)); err == nil {
+		_, removedHistory := Unlink_All(State_Path(dir, history_dir), histories, *jobsPtr)
+		ok = removedHistory && ok
+	}
+
+	emptied := 0
+	for _, pack := range packs {
+		if len(pack.days) > 0 {
+			continue
+		}
+
+		err := os.Remove(pack.path)
+		if err != nil && !os.IsNotExist(err) {
+			errlog.Print(err)
+
+			ok = false
+
+			continue
+		}
+
+		emptied++
+	}
+
+	if !Save_Index(idx) {
+		return false
+	}
+
+	print.Printf("archived %d days, deleted %d days and %d archived days, removed %d packs\n",
+		archived, len(remove), len(p.unpacked), emptied)
+
+	return ok
+}
+
+type pruner struct {
+	rules    []Prune_Rule
+	view     Day_View
+	unpacked []string
+}
+
+// planned_pack is the content a pack is about to be rewritten with, empty when it is to be removed.
+type planned_pack struct {
+	path     string
+	days     []Pack_Day
+	trigrams bool
+}
+
+// action returns the action of the first rule matching a day, reading the day through read only
+// when a rule looks at its content.
+func (p *pruner) action(date time.Time, read func() ([]byte, bool)) (string, bool) {
+	var data []byte
+
+	for i := range p.rules {
+		rule := &p.rules[i]
+		if !date.Before(rule.cutoff) {
+			continue
+		}
+
+		if rule.State != "" || rule.Where != nil {
+			if data == nil {
+				var ok bool
+
+				data, ok = read()
+				if !ok {
+					return "", false
+				}
+			}
+
+			if rule.State != "" {
+				pristine, ok := Is_Pristine(date, data)
+				if !ok {
+					return "", false
+				}
+
+				if pristine != (rule.State == "pristine") {
+					continue
+				}
+			}
+
+			if rule.Where != nil {
+				p.view.Reset(date, data)
+				if !rule.Where.Match(&p.view) {
+					continue
+				}
+			}
+		}
+
+		return rule.Action, true
+	}
+
+	return prune_keep, true
+}
+
+// plan_packs works out the new content of every pack that days are archived into or deleted from.
+// A pack that has trigram filters keeps them when it is rewritten.
+//
+// If a pack cannot be read, the error is logged and plan_packs returns nil, false.
+func (p *pruner) plan_packs(dir string, archive map[int][]string, dryRun bool, trigrams bool) ([]planned_pack, bool) {
+	paths, ok := Pack_Paths(dir)
+	if !ok {
+		return nil, false
+	}
+
+	years := make(map[int]bool, len(archive))
+	for year := range archive {
+		years[year] = true
+	}
+
+	for _, path := range paths {
+		year, err := strconv.Atoi(strings.TrimSuffix(filepath.Base(path), pack_ext))
+		if err == nil {
+			years[year] = true
+		}
+	}
+
+	var planned []planned_pack
+
+	for year := range years {
+		path := Pack_Path(dir, year)
+		changed := len(archive[year]) > 0
+		withTrigrams := trigrams
+
+		var days []Pack_Day
+
+		pack, err := Open_Pack(path)
+		switch {
+		case err == nil:
+			withTrigrams = withTrigrams || pack.Trigrams
+
+			all, err := pack.Read_All()
+			pack.Close()
+			if err != nil {
+				errlog.Print(err)
+
+				return nil, false
+			}
+
+			replaced := make(map[string]bool, len(archive[year]))
+			for _, name := range archive[year] {
+				replaced[name] = true
+			}
+
+			for _, day := range all {
+				month, d, _, _ := Parse_Log_Name(day.Name)
+				date := time.Date(year, time.Month(month), d, 0, 0, 0, 0, time.Local)
+
+				action, ok := p.action(date, func() ([]byte, bool) { return day.Data, true })
+				if !ok {
+					return nil, false
+				}
+
+				if action == prune_delete {
+					if dryRun {
+						print.Printf("%s %s from %s\n", action, day.Name, path)
+					}
+
+					p.unpacked = append(p.unpacked, day.Name)
+					changed = true
+
+					continue
+				}
+
+				// a day written again since it was archived is archived anew
+				if !replaced[day.Name] {
+					days = append(days, day)
+				}
+			}
+		case !os.IsNotExist(err):
+			errlog.Print(err)
+
+			return nil, false
+		}
+
+		if !changed {
+			continue
+		}
+
+		for _, name := range archive[year] {
+			data, err := Read_Log(dir, name)
+			if err != nil {
+				errlog.Print(err)
+
+				return nil, false
+			}
+
+			days = append(days, Pack_Day{Name: name, Data: data})
+		}
+
+		planned = append(planned, planned_pack{path: path, days: days, trigrams: withTrigrams})
+	}
+
+	sort.Slice(planned, func(i, j int) bool { return planned[i].path < planned[j].path })
+
+	return planned, true
+}
+
+// Load_Policy reads the rules of a retention policy, one per line:
+//
+//	keep|archive|delete <age> [pristine|edited] [where <expression>]
+//
+// where an age such as 90d, 6w, 18m or 7y selects the days older than that on now. Empty lines and
+// lines starting with # are ignored.
+//
+// If the policy cannot be read or a rule is invalid, the error is logged and Load_Policy returns
+// nil, false.
+func Load_Policy(path string, now time.Time) ([]Prune_Rule, bool) {
+	data, err := os.ReadFile(path)
+	if err != nil {
+		errlog.Print(err)
+
+		return nil, false
+	}
+
+	today := time.Date(now.Year(), now.Month(), now.Day(), 0, 0, 0, 0, time.Local)
+
+	var rules []Prune_Rule
+
+	for i, line := range strings.Split(string(data), "\n") {
+		line = strings.TrimSpace(line)
+		if line == "" || strings.HasPrefix(line, "#") {
+			continue
+		}
+
+		m := policy_rule.FindStringSubmatch(line)
+		if m == nil {
+			errlog.Printf("%s:%d: expected keep|archive|delete <age> [pristine|edited] [where <expression>]\n", path, i+1)
+
+			return nil, false
+		}
+
+		n, err := strconv.Atoi(m[2])
+		if err != nil {
+			errlog.Printf("%s:%d: %v\n", path, i+1, err)
+
+			return nil, false
+		}
+
+		rule := Prune_Rule{Action: m[1], State: m[4]}
+
+		switch m[3] {
+		case "d":
+			rule.cutoff = today.AddDate(0, 0, -n)
+		case "w":
+			rule.cutoff = today.AddDate(0, 0, -7*n)
+		case "m":
+			rule.cutoff = today.AddDate(0, -n, 0)
+		case "y":
+			rule.cutoff = today.AddDate(-n, 0, 0)
+		}
+
+		if m[5] != "" {
+			rule.Where, err = Compile_Filter(m[5])
+			if err != nil {
+				errlog.Printf("%s:%d: %v\n", path, i+1, err)
+
+				return nil, false
+			}
+		}
+
+		rules = append(rules, rule)
+	}
+
+	return rules, true
+}
+
+// Is_Pristine tells whether a day holds nothing beyond the skeleton touchlog writes for its date,
+// ignoring blank lines and surrounding whitespace.
+//
+// If the skeleton cannot be rendered, the error is logged and Is_Pristine returns false, false.
+func Is_Pristine(date time.Time, data []byte) (bool, bool) {
+	skeleton, ok := Render_Skeleton(date)
+	if !ok {
+		return false, false
+	}
+
+	return equal_lines(significant_lines(data), significant_lines(skeleton)), true
+}
+
+func significant_lines(data []byte) []string {
+	var lines []string
+	for _, line := range strings.Split(string(data), "\n") {
+		line = strings.TrimSpace(line)
+		if line != "" {
+			lines = append(lines, line)
+		}
+	}
+
+	return lines
+}
+
+// Unlink_All removes files of a directory in batches of prune_batch taken by jobs workers, which
+// resolve every name against one shared descriptor of the directory. Files already gone count as
+// removed.
+//
+// Unlink_All returns the names it removed and true. If some files cannot be removed, the errors
+// are logged, the other files are still removed and Unlink_All returns the names removed, false.
+func Unlink_All(dir string, names []string, jobs int) ([]string, bool) {
+	debug.Printf("Unlink_All(%s, %d files, %d jobs)\n", dir, len(names), jobs)
+
+	if len(names) == 0 {
+		return nil, true
+	}
+
+	d, err := open_unlink_dir(dir)
+	if err != nil {
+		errlog.Print(err)
+
+		return nil, false
+	}
+
+	defer d.close()
+
+	batches := make(chan []string)
+
+	var mu sync.Mutex
+	var wg sync.WaitGroup
+	var errs []error
+
+	removed := make([]string, 0, len(names))
+
+	for i := 0; i < jobs; i++ {
+		wg.Add(1)
+
+		go func() {
+			defer wg.Done()
+
+			for batch := range batches {
+				done := make([]string, 0, len(batch))
+
+				var failed []error
+
+				for _, name := range batch {
+					err := d.unlink(name)
+					if err != nil && !os.IsNotExist(err) {
+						failed = append(failed, err)
+
+						continue
+					}
+
+					done = append(done, name)
+				}
+
+				mu.Lock()
+				removed = append(removed, done...)
+				errs = append(errs, failed...)
+				mu.Unlock()
+			}
+		}()
+	}
+
+	for start := 0; start < len(names); start += prune_batch {
+		batches <- names[start:min(start+prune_batch, len(names))]
+	}
+
+	close(batches)
+	wg.Wait()
+
+	for _, err := range errs {
+		errlog.Print(err)
+	}
+
+	sort.Strings(removed)
+
+	return removed, len(errs) == 0
+}
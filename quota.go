@@ -0,0 +1,162 @@
+package main
+
+import (
+	"errors"
+	"fmt"
+	"os"
+	"strconv"
+	"strings"
+)
+
+// quota_name holds the quota of a journal: a size such as 200M, optionally followed by reject.
+const quota_name string = "quota"
+
+// journal_quota is the quota of the journal being written, and nil when it has none.
+var journal_quota *Quota
+
+// Quota limits the total size of the logfiles of a journal. Growth beyond the limit is only
+// warned about unless Reject is set.
+type Quota struct {
+	Limit  int64
+	Reject bool
+	idx    *Index
+}
+
+// Load_Quota reads the quota of a journal, which is nil when it has none.
+//
+// If the quota cannot be read or is invalid, the error is logged and Load_Quota returns nil, false.
+func Load_Quota(dir string) (*Quota, bool) {
+	path := State_Path(dir, quota_name)
+
+	data, err := os.ReadFile(path)
+	if os.IsNotExist(err) {
+		return nil, true
+	}
+	if err != nil {
+		errlog.Print(err)
+
+		return nil, false
+	}
+
+	fields := strings.Fields(string(data))
+	if len(fields) == 0 || len(fields) > 2 || len(fields) == 2 && fields[1] != "reject" && fields[1] != "warn" {
+		errlog.Printf("%s: expected a size optionally followed by warn or reject\n", path)
+
+		return nil, false
+	}
+
+	limit, err := Parse_Size(fields[0])
+	if err != nil {
+		errlog.Printf("%s: %v\n", path, err)
+
+		return nil, false
+	}
+
+	return &Quota{Limit: limit, Reject: len(fields) == 2 && fields[1] == "reject"}, true
+}
+
+// Start_Quota loads the quota of a journal about to be written along with its index, which
+// tells how much of the quota is used and is kept up to date by Track.
+//
+// If the quota or the index cannot be read, the error is logged and Start_Quota returns nil, false.
+func Start_Quota(dir string) (*Quota, bool) {
+	q, ok := Load_Quota(dir)
+	if !ok || q == nil {
+		return nil, ok
+	}
+
+	q.idx, ok = Load_Index(dir)
+	if !ok {
+		return nil, false
+	}
+
+	if _, ok := Refresh_Index(q.idx); !ok {
+		return nil, false
+	}
+
+	return q, true
+}
+
+// Allow tells whether a logfile of a journal whose index is idx may grow to size bytes. Growth
+// taking the journal beyond the limit is warned about, and refused when the quota rejects it.
+//
+// If the growth is refused, the error is logged and Allow returns false.
+func (q *Quota) Allow(idx *Index, name string, size int64) bool {
+	used, over := q.Over(idx, name, size)
+	if !over {
+		return true
+	}
+
+	if q.Reject {
+		errlog.Printf("%s would take the journal to %s, over its quota of %s\n", name, Format_Size(used),
+			Format_Size(q.Limit))
+
+		return false
+	}
+
+	errlog.Printf("warning: %s takes the journal to %s, over its quota of %s\n", name, Format_Size(used),
+		Format_Size(q.Limit))
+
+	return true
+}
+
+// Over returns the size of the logfiles of a journal whose index is idx once a logfile grows to
+// size bytes, and whether that growth takes the journal over the limit.
+func (q *Quota) Over(idx *Index, name string, size int64) (int64, bool) {
+	grown := size - idx.Entries[name].Size
+	used := idx.Usage() + grown
+
+	return used, grown > 0 && used > q.Limit
+}
+
+// Track records content written to a logfile in the index of the quota.
+func (q *Quota) Track(name string, data []byte) bool {
+	return q.idx.Update(name, data)
+}
+
+// Parse_Size reads a size in bytes, optionally with a K, M, G or T suffix for binary multiples.
+func Parse_Size(s string) (int64, error) {
+	shift := 0
+
+	upper := strings.ToUpper(s)
+	upper = strings.TrimSuffix(strings.TrimSuffix(upper, "IB"), "B")
+
+	if upper != "" {
+		switch upper[len(upper)-1] {
+		case 'K':
+			shift = 10
+		case 'M':
+			shift = 20
+		case 'G':
+			shift = 30
+		case 'T':
+			shift = 40
+		}
+	}
+
+	if shift > 0 {
+		upper = upper[:len(upper)-1]
+	}
+
+	n, err := strconv.ParseInt(upper, 10, 64)
+	if err != nil || n < 0 || n > 1<<(62-shift) {
+		return 0, errors.New("invalid size " + strconv.Quote(s))
+	}
+
+	return n << shift, nil
+}
+
+// Format_Size writes a size in bytes with a binary unit.
+func Format_Size(size int64) string {
+	if size < 1024 {
+		return fmt.Sprintf("%d B", size)
+	}
+
+	value, unit := float64(size)/1024, 0
+	for value >= 1024 && unit < 3 {
+		value /= 1024
+		unit++
+	}
+
+	return fmt.Sprintf("%.1f %ciB", value, "KMGT"[unit])
+}
@@ -0,0 +1,319 @@
+package main
+
+import (
+	"bytes"
+	"crypto/hmac"
+	"crypto/sha256"
+	"encoding/hex"
+	"encoding/xml"
+	"errors"
+	"fmt"
+	"io"
+	"net/http"
+	"net/url"
+	"sort"
+	"strconv"
+	"strings"
+	"sync"
+	"time"
+)
+
+// s3_retries is how many times a request to the object store is attempted before giving up.
+const s3_retries int = 5
+const s3_backoff time.Duration = 200 * time.Millisecond
+
+// S3_Client talks to an S3-compatible object store with path-style addressing and AWS signature
+// version 4. Requests in flight are bounded by slots, which every caller shares.
+type S3_Client struct {
+	Endpoint  string
+	Region    string
+	AccessKey string
+	SecretKey string
+	Bucket    string
+	client    *http.Client
+	slots     chan struct{}
+}
+
+// s3_status is an unexpected response, kept to tell failures worth retrying from the rest.
+type s3_status struct {
+	code int
+	body string
+}
+
+func (e *s3_status) Error() string {
+	return fmt.Sprintf("object store replied %d: %s", e.code, e.body)
+}
+
+// New_S3_Client creates a client for a bucket that allows at most jobs requests in flight.
+func New_S3_Client(endpoint string, region string, accessKey string, secretKey string, bucket string, jobs int) *S3_Client {
+	return &S3_Client{
+		Endpoint:  strings.TrimSuffix(endpoint, "/"),
+		Region:    region,
+		AccessKey: accessKey,
+		SecretKey: secretKey,
+		Bucket:    bucket,
+		client:    &http.Client{Timeout: 5 * time.Minute},
+		slots:     make(chan struct{}, jobs),
+	}
+}
+
+// Exists reports whether an object is already stored under key.
+func (c *S3_Client) Exists(key string) (bool, error) {
+	resp, err := c.do(http.MethodHead, key, nil, nil, http.StatusOK, http.StatusNotFound)
+	if err != nil {
+		return false, err
+	}
+
+	return resp.StatusCode == http.StatusOK, nil
+}
+
+// Put stores body under key, splitting it into a multipart upload whose parts are sent in
+// parallel when it is larger than partSize.
+func (c *S3_Client) Put(key string, body []byte, partSize int) error {
+	if len(body) <= partSize {
+		_, err := c.do(http.MethodPut, key, nil, body, http.StatusOK)
+
+		return err
+	}
+
+	return c.put_multipart(key, body, partSize)
+}
+
+func (c *S3_Client) put_multipart(key string, body []byte, partSize int) error {
+	resp, err := c.do(http.MethodPost, key, url.Values{"uploads": {""}}, nil, http.StatusOK)
+	if err != nil {
+		return err
+	}
+
+	var initiated struct {
+		UploadId string
+	}
+
+	err = xml.Unmarshal(resp.body, &initiated)
+	if err != nil || initiated.UploadId == "" {
+		return errors.New("object store did not start a multipart upload for " + key)
+	}
+
+	debug.Printf("multipart upload %s for %s\n", initiated.UploadId, key)
+
+	parts := (len(body) + partSize - 1) / partSize
+	etags := make([]string, parts)
+	errs := make([]error, parts)
+
+	var wg sync.WaitGroup
+	for i := 0; i < parts; i++ {
+		wg.Add(1)
+
+		go func(i int) {
+			defer wg.Done()
+
+			end := min((i+1)*partSize, len(body))
+			query := url.Values{"partNumber": {strconv.Itoa(i + 1)}, "uploadId": {initiated.UploadId}}
+
+			resp, err := c.do(http.MethodPut, key, query, body[i*partSize:end], http.StatusOK)
+			if err == nil {
+				etags[i] = resp.header.Get("ETag")
+			}
+
+			errs[i] = err
+		}(i)
+	}
+
+	wg.Wait()
+
+	uploadId := url.Values{"uploadId": {initiated.UploadId}}
+
+	err = errors.Join(errs...)
+	if err != nil {
+		c.do(http.MethodDelete, key, uploadId, nil, http.StatusNoContent)
+
+		return err
+	}
+
+	var complete bytes.Buffer
+
+	complete.WriteString("<CompleteMultipartUpload>")
+	for i, etag := range etags {
+		fmt.Fprintf(&complete, "<Part><PartNumber>%d</PartNumber><ETag>%s</ETag></Part>", i+1, etag)
+	}
+	complete.WriteString("</CompleteMultipartUpload>")
+
+	resp, err = c.do(http.MethodPost, key, uploadId, complete.Bytes(), http.StatusOK)
+	if err == nil && bytes.Contains(resp.body, []byte("<Error>")) {
+		// completion failures can arrive inside a 200 reply
+		err = &s3_status{code: resp.StatusCode, body: string(resp.body)}
+	}
+	if err != nil {
+		c.do(http.MethodDelete, key, uploadId, nil, http.StatusNoContent)
+	}
+
+	return err
+}
+
+type s3_response struct {
+	StatusCode int
+	header     http.Header
+	body       []byte
+}
+
+// do sends a signed request once a slot is free, retrying with exponential backoff on network
+// errors, throttling and server errors. Any status outside expected is an error.
+func (c *S3_Client) do(method string, key string, query url.Values, body []byte, expected ...int) (*s3_response, error) {
+	c.slots <- struct{}{}
+	defer func() { <-c.slots }()
+
+	var err error
+
+	for attempt := 0; attempt < s3_retries; attempt++ {
+		if attempt > 0 {
+			debug.Printf("retrying %s %s after %v\n", method, key, err)
+
+			time.Sleep(s3_backoff << (attempt - 1))
+		}
+
+		var resp *s3_response
+
+		resp, err = c.send(method, key, query, body)
+		if err != nil {
+			continue
+		}
+
+		for _, code := range expected {
+			if resp.StatusCode == code {
+				return resp, nil
+			}
+		}
+
+		err = &s3_status{code: resp.StatusCode, body: string(resp.body)}
+		if resp.StatusCode != http.StatusTooManyRequests && resp.StatusCode < 500 {
+			break
+		}
+	}
+
+	return nil, err
+}
+
+func (c *S3_Client) send(method string, key string, query url.Values, body []byte) (*s3_response, error) {
+	target := c.Endpoint + "/" + s3_escape(c.Bucket+"/"+key)
+	if len(query) > 0 {
+		target += "?" + s3_query(query)
+	}
+
+	req, err := http.NewRequest(method, target, bytes.NewReader(body))
+	if err != nil {
+		return nil, err
+	}
+
+	req.ContentLength = int64(len(body))
+	Sign_S3_Request(req, body, c.Region, c.AccessKey, c.SecretKey, time.Now())
+
+	resp, err := c.client.Do(req)
+	if err != nil {
+		return nil, err
+	}
+
+	defer resp.Body.Close()
+
+	data, err := io.ReadAll(resp.Body)
+	if err != nil {
+		return nil, err
+	}
+
+	return &s3_response{StatusCode: resp.StatusCode, header: resp.Header, body: data}, nil
+}
+
+// Sign_S3_Request adds the AWS signature version 4 headers to a request for the s3 service,
+// signing every header already set on it along with the host.
+func Sign_S3_Request(req *http.Request, body []byte, region string, accessKey string, secretKey string, now time.Time) {
+	now = now.UTC()
+	amzDate := now.Format("20060102T150405Z")
+	day := now.Format("20060102")
+
+	sum := sha256.Sum256(body)
+	payloadHash := hex.EncodeToString(sum[:])
+
+	req.Header.Set("X-Amz-Date", amzDate)
+	req.Header.Set("X-Amz-Content-Sha256", payloadHash)
+
+	headers := map[string]string{"host": req.URL.Host}
+	for name, values := range req.Header {
+		headers[strings.ToLower(name)] = strings.TrimSpace(strings.Join(values, ","))
+	}
+
+	names := make([]string, 0, len(headers))
+	for name := range headers {
+		names = append(names, name)
+	}
+
+	sort.Strings(names)
+
+	var canonical strings.Builder
+
+	canonical.WriteString(req.Method + "\n")
+	canonical.WriteString(req.URL.EscapedPath() + "\n")
+	canonical.WriteString(s3_query(req.URL.Query()) + "\n")
+	for _, name := range names {
+		canonical.WriteString(name + ":" + headers[name] + "\n")
+	}
+	canonical.WriteString("\n" + strings.Join(names, ";") + "\n" + payloadHash)
+
+	scope := day + "/" + region + "/s3/aws4_request"
+	canonicalSum := sha256.Sum256([]byte(canonical.String()))
+	toSign := "AWS4-HMAC-SHA256\n" + amzDate + "\n" + scope + "\n" + hex.EncodeToString(canonicalSum[:])
+
+	key := hmac_sha256([]byte("AWS4"+secretKey), day)
+	key = hmac_sha256(key, region)
+	key = hmac_sha256(key, "s3")
+	key = hmac_sha256(key, "aws4_request")
+
+	req.Header.Set("Authorization", "AWS4-HMAC-SHA256 Credential="+accessKey+"/"+scope+
+		", SignedHeaders="+strings.Join(names, ";")+
+		", Signature="+hex.EncodeToString(hmac_sha256(key, toSign)))
+}
+
+func hmac_sha256(key []byte, data string) []byte {
+	mac := hmac.New(sha256.New, key)
+	mac.Write([]byte(data))
+
+	return mac.Sum(nil)
+}
+
+// s3_escape percent-encodes an object path the way signature version 4 expects, leaving only
+// unreserved characters and slashes.
+func s3_escape(path string) string {
+	var sb strings.Builder
+
+	for i := 0; i < len(path); i++ {
+		c := path[i]
+		if 'a' <= c && c <= 'z' || 'A' <= c && c <= 'Z' || '0' <= c && c <= '9' ||
+			c == '-' || c == '_' || c == '.' || c == '~' || c == '/' {
+			sb.WriteByte(c)
+		} else {
+			fmt.Fprintf(&sb, "%%%02X", c)
+		}
+	}
+
+	return sb.String()
+}
+
+func s3_query(query url.Values) string {
+	keys := make([]string, 0, len(query))
+	for key := range query {
+		keys = append(keys, key)
+	}
+
+	sort.Strings(keys)
+
+	pairs := make([]string, 0, len(keys))
+	for _, key := range keys {
+		for _, value := range query[key] {
+			pairs = append(pairs, s3_escape_query(key)+"="+s3_escape_query(value))
+		}
+	}
+
+	return strings.Join(pairs, "&")
+}
+
+func s3_escape_query(s string) string {
+	return strings.ReplaceAll(s3_escape(s), "/", "%2F")
+}
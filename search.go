@@ -0,0 +1,417 @@
+package main
+
+import (
+	"bufio"
+	"bytes"
+	"io"
+	"os"
+	"path/filepath"
+	"sort"
+	"strings"
+	"time"
+	"unicode/utf8"
+)
+
+// Search prints every line of the journal that contains a text, ignoring ASCII case, as the
+// logfile name, the section and the line. The days searched can be limited to a range, to those
+// matching a filter expression and to a single section, and the text to whole words. Archived days
+// are searched too, skipping the chunks of packs whose filters tell they cannot hold the text.
+// With -phrase, the words of the text are matched in sequence and snippets of the matches are
+// printed instead, as Search_Phrase does, and with -fuzzy as well, each word allowing for typos.
+//
+// If the journal is successfully searched, Search returns true.
+// Otherwise, the error is logged and Search returns false.
+func Search(args []string) bool {
+	fs, verbosePtr := New_FlagSet("search")
+	outDirPtr := fs.String("outdir", "", "search the journal in the inputted directory")
+	fromPtr := fs.String("from", "", "search days from this mmddyyyy date on")
+	untilPtr := fs.String("until", "", "search days up to this mmddyyyy date")
+	wherePtr := fs.String("where", "", "only search days matching this filter expression")
+	sectionPtr := fs.String("section", "", "only search this section")
+	wordPtr := fs.Bool("word", false, "only match the text as whole words")
+	phrasePtr := fs.Bool("phrase", false, "match the words of the text in sequence and print snippets of the matches")
+	fuzzyPtr := fs.Int("fuzzy", 0, "as -phrase, allowing each word up to this many typos, one per three letters")
+	fs.Parse(args)
+
+	Set_Verbosity(*verbosePtr)
+
+	if fs.NArg() != 1 || fs.Arg(0) == "" || *fuzzyPtr < 0 {
+		errlog.Println("usage: touchlog search [-verbose] [-outdir dir] [-from mmddyyyy] [-until mmddyyyy] [-where expr] [-section name] [-word] [-phrase] [-fuzzy n] text")
+
+		return false
+	}
+
+	if !Resolve_Outdir(outDirPtr) {
+		return false
+	}
+
+	from, until, ok := Parse_Range(*fromPtr, *untilPtr)
+	if !ok {
+		return false
+	}
+
+	where, ok := Parse_Where(*wherePtr)
+	if !ok {
+		return false
+	}
+
+	idx, ok := Load_Index(*outDirPtr)
+	if !ok {
+		return false
+	}
+
+	if _, ok := Refresh_Index(idx); !ok || !Save_Index(idx) {
+		return false
+	}
+
+	if *phrasePtr || *fuzzyPtr > 0 {
+		return Search_Phrase(idx, from, until, where, *sectionPtr, New_Phrase_Query(fs.Arg(0), *fuzzyPtr))
+	}
+
+	needle := fold(fs.Arg(0))
+	section := []byte(*sectionPtr)
+	probe := New_Search_Probe(needle, *wordPtr)
+
+	match := contains_fold
+	if *wordPtr {
+		match = contains_word_fold
+	}
+
+	out := bufio.NewWriter(os.Stdout)
+	defer out.Flush()
+
+	chunks := func(p *Pack, chunk int) bool {
+		return p.May_Match(chunk, probe)
+	}
+
+	var view Day_View
+
+	hits := 0
+
+	ok = Each_Day(idx, from, until, where, chunks, func(name string, date time.Time, data []byte) bool {
+		if !match(data, needle) {
+			return true
+		}
+
+		view.Reset(date, data)
+
+		for i := 0; i < view.Sections(); i++ {
+			sectionName, body := view.Section(i)
+			if len(section) > 0 && !bytes.Equal(sectionName, section) {
+				continue
+			}
+
+			for len(body) > 0 {
+				line := body
+				if end := bytes.IndexByte(body, '\n'); end >= 0 {
+					line, body = body[:end], body[end+1:]
+				} else {
+					body = nil
+				}
+
+				if !match(line, needle) {
+					continue
+				}
+
+				hits++
+				out.WriteString(name)
+				out.WriteByte(':')
+				out.Write(sectionName)
+				out.WriteByte(':')
+				out.Write(line)
+				out.WriteByte('\n')
+			}
+		}
+
+		return true
+	})
+
+	debug.Printf("%d matching lines\n", hits)
+
+	return ok
+}
+
+// search_snippet_context is how many bytes of a line around a phrase match a snippet shows.
+const search_snippet_context int = 60
+
+// phrase_line is a snippet found by a phrase search.
+type phrase_line struct {
+	date    time.Time
+	name    string
+	section string
+	snippet string
+}
+
+// Search_Phrase prints a snippet of every match of a phrase, its words in sequence within a line
+// ignoring case and, for words allowed some edits, typos within them, as the logfile name, the
+// section and the text around the match with the match between ** marks, in date order. The
+// logfiles stored as is are searched through the word index, which tells where every match is,
+// and a snippet is cut from a single read of the bytes around it. Compressed and archived days
+// are read and scanned, as are all days when a filter expression has to see them.
+//
+// If the journal is successfully searched, Search_Phrase returns true.
+// Otherwise, the error is logged and Search_Phrase returns false.
+func Search_Phrase(idx *Index, from time.Time, until time.Time, where *Filter_Expr, section string,
+	q *Phrase_Query) bool {
+	if len(q.Words) == 0 {
+		errlog.Println("a phrase needs at least one word")
+
+		return false
+	}
+
+	var lines []phrase_line
+
+	scanned := idx
+
+	if where == nil {
+		w, ok := Open_Word_Index(idx.Dir)
+		if !ok {
+			return false
+		}
+
+		defer w.Close()
+
+		if !w.Update(idx) {
+			return false
+		}
+
+		lines, ok = indexed_phrase_lines(idx, w, from, until, section, q)
+		if !ok {
+			return false
+		}
+
+		// the word index covers the logfiles stored as is
+		scanned = &Index{Dir: idx.Dir, Entries: make(map[string]Index_Entry)}
+		for name, entry := range idx.Entries {
+			if entry.Ext != "" {
+				scanned.Entries[name] = entry
+			}
+		}
+	}
+
+	indexed := len(lines)
+
+	// a word allowing for typos may be spelled any way in a chunk
+	probe := New_Phrase_Probe(q.Exact_Words())
+	chunks := func(p *Pack, chunk int) bool {
+		return p.May_Match(chunk, probe)
+	}
+
+	var view Day_View
+
+	ok := Each_Day(scanned, from, until, where, chunks, func(name string, date time.Time, data []byte) bool {
+		view.Reset(date, data)
+
+		for i := 0; i < view.Sections(); i++ {
+			sectionName, body := view.Section(i)
+			if section != "" && string(sectionName) != section {
+				continue
+			}
+
+			for len(body) > 0 {
+				line := body
+				if end := bytes.IndexByte(body, '\n'); end >= 0 {
+					line, body = body[:end], body[end+1:]
+				} else {
+					body = nil
+				}
+
+				for _, match := range find_phrase(line, q) {
+					lines = append(lines, phrase_line{date: date, name: name, section: string(sectionName),
+						snippet: cut_snippet(line, match[0], match[1])})
+				}
+			}
+		}
+
+		return true
+	})
+	if !ok {
+		return false
+	}
+
+	debug.Printf("%d snippets from the word index, %d from scanned days\n", indexed, len(lines)-indexed)
+
+	sort.SliceStable(lines, func(i, j int) bool { return lines[i].date.Before(lines[j].date) })
+
+	out := bufio.NewWriter(os.Stdout)
+	defer out.Flush()
+
+	for _, line := range lines {
+		out.WriteString(line.name + ":" + line.section + ":" + line.snippet + "\n")
+	}
+
+	return true
+}
+
+// indexed_phrase_lines returns the snippets of the matches of a phrase the word index finds in
+// days between from and until. The bytes around every match are read with one read at the offset
+// of its section recorded by the content index, and matches no longer found there are dropped.
+func indexed_phrase_lines(idx *Index, w *Word_Index, from time.Time, until time.Time, section string,
+	q *Phrase_Query) ([]phrase_line, bool) {
+	hits, err := w.Phrase(q)
+	if err != nil {
+		errlog.Print(err)
+
+		return nil, false
+	}
+
+	var lines []phrase_line
+
+	var f *os.File
+	open := ""
+
+	defer func() {
+		if f != nil {
+			f.Close()
+		}
+	}()
+
+	for _, hit := range hits {
+		name := hit.Name
+		entry := idx.Entries[name]
+
+		date, _ := log_date(name)
+		if date.Before(from) || date.After(until) || hit.Section >= len(entry.Sections) ||
+			section != "" && entry.Sections[hit.Section].Name != section {
+			continue
+		}
+
+		if name != open {
+			if f != nil {
+				f.Close()
+			}
+
+			f, err = os.Open(filepath.Join(idx.Dir, name))
+			if err != nil {
+				errlog.Print(err)
+
+				return nil, false
+			}
+
+			open = name
+		}
+
+		// a match never spans lines, so the snippet lies within the section
+		sectionStart := entry.Sections[hit.Section].Start
+		sectionEnd := entry.Length
+		if hit.Section+1 < len(entry.Sections) {
+			sectionEnd = entry.Sections[hit.Section+1].Start
+		}
+
+		// a few bytes more than the snippet shows tell whether the line goes on, and hold the start
+		// of a UTF-8 sequence the snippet would otherwise cut
+		reach := search_snippet_context + utf8.UTFMax
+		start := max(sectionStart+int64(hit.Start-reach), sectionStart)
+		end := min(sectionStart+int64(hit.End+reach), sectionEnd)
+		if start >= end {
+			continue
+		}
+
+		window := make([]byte, end-start)
+
+		n, err := f.ReadAt(window, start)
+		if err != nil && err != io.EOF {
+			errlog.Print(err)
+
+			return nil, false
+		}
+
+		window = window[:n]
+		matchStart := int(sectionStart + int64(hit.Start) - start)
+
+		// cut the window down to the line of the match
+		lineStart := bytes.LastIndexByte(window[:min(matchStart, len(window))], '\n') + 1
+		line := window[lineStart:]
+		if nl := bytes.IndexByte(line, '\n'); nl >= 0 {
+			line = line[:nl]
+		}
+
+		for _, match := range find_phrase(line, q) {
+			if match[0] == matchStart-lineStart {
+				lines = append(lines, phrase_line{date: date, name: name, section: entry.Sections[hit.Section].Name,
+					snippet: cut_snippet(line, match[0], match[1])})
+			}
+		}
+	}
+
+	return lines, true
+}
+
+// find_phrase returns the bounds of every match of the words of a phrase in a line.
+func find_phrase(line []byte, q *Phrase_Query) [][2]int {
+	var bounds [][2]int
+
+	Each_Word(line, func(start int, end int) {
+		bounds = append(bounds, [2]int{start, end})
+	})
+
+	var matches [][2]int
+
+	for i := 0; i+len(q.Words) <= len(bounds); i++ {
+		matched := true
+		for j := range q.Words {
+			b := bounds[i+j]
+			if !q.Matches(j, line[b[0]:b[1]]) {
+				matched = false
+
+				break
+			}
+		}
+
+		if matched {
+			matches = append(matches, [2]int{bounds[i][0], bounds[i+len(q.Words)-1][1]})
+		}
+	}
+
+	return matches
+}
+
+// cut_snippet returns the part of a line around a match, at most search_snippet_context bytes on
+// either side, with the match between ** marks and ... where the line was cut.
+func cut_snippet(line []byte, start int, end int) string {
+	from := max(start-search_snippet_context, 0)
+	until := min(end+search_snippet_context, len(line))
+
+	// never cut inside a UTF-8 sequence
+	for from > 0 && line[from]&0xC0 == 0x80 {
+		from--
+	}
+
+	for until < len(line) && line[until]&0xC0 == 0x80 {
+		until++
+	}
+
+	var b strings.Builder
+
+	if from > 0 {
+		b.WriteString("...")
+	}
+
+	b.Write(line[from:start])
+	b.WriteString("**")
+	b.Write(line[start:end])
+	b.WriteString("**")
+	b.Write(line[end:until])
+
+	if until < len(line) {
+		b.WriteString("...")
+	}
+
+	return b.String()
+}
+
+// contains_word_fold is contains_fold for a text that must not be preceded or followed by a letter
+// or digit.
+func contains_word_fold(hay []byte, needle []byte) bool {
+	for i := 0; i+len(needle) <= len(hay); i++ {
+		if !contains_fold(hay[i:i+len(needle)], needle) {
+			continue
+		}
+
+		if (i == 0 || !is_token_byte(hay[i-1])) && (i+len(needle) == len(hay) || !is_token_byte(hay[i+len(needle)])) {
+			return true
+		}
+	}
+
+	return false
+}
@@ -0,0 +1,37 @@
+package main
+
+import "testing"
+
+func TestSearchFold(t *testing.T) {
+	day := []byte("# 01/02/2024\n\n|> events\n- lunch with Émile at the CAFÉ\n")
+
+	tests := []struct {
+		query string
+		found bool
+	}{
+		{"Émile", true},
+		{"émile", false},
+		{"LUNCH WITH Émile", true},
+		{"mile", true},
+		{"CAFÉ", true},
+		{"café", false},
+		{"Zoë", false},
+	}
+
+	keys := new_chunk_keys(true)
+	keys.add(day)
+	tokens, trigrams := keys.filters()
+
+	for _, test := range tests {
+		needle := fold(test.query)
+
+		if found := contains_fold(day, needle); found != test.found {
+			t.Errorf("%q: found %v, want %v", test.query, found, test.found)
+		}
+
+		// the chunk filters must never rule out a chunk the text is in
+		if test.found && !New_Search_Probe(needle, false).May_Match(tokens, trigrams) {
+			t.Errorf("%q: the chunk filters rule out its chunk", test.query)
+		}
+	}
+}
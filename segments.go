@@ -0,0 +1,517 @@
+package main
+
+import (
+	"crypto/sha256"
+	"encoding/hex"
+	"errors"
+	"os"
+	"path/filepath"
+	"runtime"
+	"sort"
+	"strconv"
+	"strings"
+	"sync"
+	"time"
+)
+
+// The word index is a directory of segments, each a word index of its own over some of the days,
+// named after the generation it was written in. A day is held by the newest segment that indexed
+// the content the content index records for it; in older segments, and for days removed or no
+// longer stored as is, its postings are dead and skipped. Updating the index never rewrites it:
+// the days to index are split into runs of consecutive dates indexed by workers in parallel, each
+// into a segment of its own, and segments are merged in tiers, words_merge_factor of a size at a
+// time, in the background, which keeps their number logarithmic in the number of days.
+const words_segment_ext string = ".seg"
+
+// words_merge_factor is how many segments of a tier are merged into one of the tier above.
+const words_merge_factor int = 10
+
+// words_shard_days is the fewest days a worker indexes, below which workers are not worth starting.
+const words_shard_days int = 64
+
+// Word_Index is an open word index, its segments in the order they were written.
+type Word_Index struct {
+	Dir      string
+	segments []*word_segment
+	next     int
+
+	// what the background merge writes and supersedes, closed and removed by Close
+	merging  sync.WaitGroup
+	merged   []*word_segment
+	obsolete []string
+}
+
+// Open_Word_Index opens the segments of the word index of a journal, which is empty when the
+// journal has none.
+//
+// If the index cannot be read, the error is logged and Open_Word_Index returns nil, false.
+func Open_Word_Index(dir string) (*Word_Index, bool) {
+	debug.Printf("Open_Word_Index(%s)\n", dir)
+
+	w := &Word_Index{Dir: dir}
+	path := State_Path(dir, words_name)
+
+	// the index used to be a single file, and is built again as segments
+	if info, err := os.Stat(path); err == nil && !info.IsDir() {
+		debug.Println("word index: replacing the single file index")
+
+		if err := os.Remove(path); err != nil {
+			errlog.Print(err)
+
+			return nil, false
+		}
+	}
+
+	dirents, err := os.ReadDir(path)
+	if os.IsNotExist(err) {
+		return w, true
+	}
+
+	if err != nil {
+		errlog.Print(err)
+
+		return nil, false
+	}
+
+	// dirents are sorted, and so are the zero padded generations
+	for _, dirent := range dirents {
+		gen, err := strconv.Atoi(strings.TrimSuffix(dirent.Name(), words_segment_ext))
+		if err != nil || !strings.HasSuffix(dirent.Name(), words_segment_ext) {
+			continue
+		}
+
+		s, err := open_word_segment(filepath.Join(path, dirent.Name()), gen)
+
+		// another search may have merged it away in the meantime
+		if os.IsNotExist(err) {
+			continue
+		}
+
+		// its days are indexed again, into a segment of the current format
+		if errors.Is(err, errOutdatedSegment) {
+			w.obsolete = append(w.obsolete, filepath.Join(path, dirent.Name()))
+			w.next = gen + 1
+
+			continue
+		}
+
+		if err != nil {
+			w.Close()
+			errlog.Print(err)
+
+			return nil, false
+		}
+
+		w.segments = append(w.segments, s)
+		w.next = gen + 1
+	}
+
+	return w, true
+}
+
+// segment_path returns the path of the segment of a generation.
+func (w *Word_Index) segment_path(gen int) string {
+	return State_Path(w.Dir, words_name, pad(gen, 8)+words_segment_ext)
+}
+
+// Close waits for the background merge, closes the segments and removes those superseded.
+func (w *Word_Index) Close() {
+	w.merging.Wait()
+
+	for _, s := range w.segments {
+		s.Close()
+	}
+
+	for _, s := range w.merged {
+		s.Close()
+	}
+
+	// a segment still open elsewhere is left for a later search to remove
+	for _, path := range w.obsolete {
+		if err := os.Remove(path); err != nil && !os.IsNotExist(err) {
+			debug.Println(err)
+		}
+	}
+}
+
+// Update brings the word index up to date with the content index of the journal. The logfiles
+// stored as is that no segment holds with the content they have now are read and indexed into new
+// segments, in parallel; the postings of the other days are left where they are. Segments left
+// without any current day are removed, and the merge of a tier grown full is started in the
+// background, for Close to wait for.
+//
+// If the index is successfully updated, Update returns true.
+// Otherwise, the error is logged and Update returns false.
+func (w *Word_Index) Update(idx *Index) bool {
+	type holder struct {
+		segment *word_segment
+		doc     int
+	}
+
+	current := make(map[string]holder, len(idx.Entries))
+
+	for _, s := range w.segments {
+		for i, doc := range s.Docs {
+			s.live[i] = false
+
+			entry, ok := idx.Entries[doc.Name]
+			if ok && entry.Ext == "" && hex.EncodeToString(doc.Hash[:]) == entry.Hash {
+				current[doc.Name] = holder{segment: s, doc: i}
+			}
+		}
+	}
+
+	for _, h := range current {
+		h.segment.live[h.doc] = true
+	}
+
+	var fresh []string
+
+	for _, name := range idx.Days() {
+		if _, ok := current[name]; !ok && idx.Entries[name].Ext == "" {
+			fresh = append(fresh, name)
+		}
+	}
+
+	kept := w.segments[:0]
+	for _, s := range w.segments {
+		if s.days() > 0 {
+			kept = append(kept, s)
+
+			continue
+		}
+
+		debug.Printf("word index: segment %d superseded\n", s.gen)
+
+		s.Close()
+		w.obsolete = append(w.obsolete, s.file.Name())
+	}
+
+	w.segments = kept
+
+	debug.Printf("word index: %d days current in %d segments, indexing %d\n", len(current), len(w.segments),
+		len(fresh))
+
+	if len(fresh) > 0 && !w.build(fresh, runtime.NumCPU()) {
+		return false
+	}
+
+	if inputs := merge_candidates(w.segments); inputs != nil {
+		segments := append([]*word_segment(nil), w.segments...)
+
+		w.merging.Add(1)
+
+		go func() {
+			defer w.merging.Done()
+
+			w.merge(segments, w.next)
+		}()
+	}
+
+	return true
+}
+
+// build indexes days into new segments, splitting them into runs of consecutive dates indexed by
+// up to jobs workers at once. There are never so many runs that they fill a tier by themselves.
+func (w *Word_Index) build(names []string, jobs int) bool {
+	shards := min(jobs, words_merge_factor-1, (len(names)+words_shard_days-1)/words_shard_days)
+
+	built := make([]*word_segment, shards)
+	oks := make([]bool, shards)
+
+	var wg sync.WaitGroup
+
+	for i := range built {
+		wg.Add(1)
+
+		go func(i int) {
+			defer wg.Done()
+
+			gen := w.next + i
+			built[i], oks[i] = build_word_segment(w.Dir, names[i*len(names)/shards:(i+1)*len(names)/shards],
+				w.segment_path(gen), gen)
+		}(i)
+	}
+
+	wg.Wait()
+
+	w.next += shards
+
+	ok := true
+	for i, s := range built {
+		if oks[i] {
+			w.segments = append(w.segments, s)
+		}
+
+		ok = ok && oks[i]
+	}
+
+	return ok
+}
+
+// build_word_segment indexes the words of days, in date order, into a segment of a generation.
+//
+// If the segment is successfully written, build_word_segment returns it and true.
+// Otherwise, the error is logged and build_word_segment returns nil, false.
+func build_word_segment(dir string, names []string, path string, gen int) (*word_segment, bool) {
+	docs := make([]word_doc, len(names))
+	postings := make(map[string][]Word_Posting)
+
+	var view Day_View
+
+	for doc, name := range names {
+		data, err := os.ReadFile(filepath.Join(dir, name))
+		if err != nil {
+			errlog.Print(err)
+
+			return nil, false
+		}
+
+		// the hash recorded is that of the content indexed, whatever the content index says
+		docs[doc] = word_doc{Name: name, Hash: sha256.Sum256(data)}
+
+		view.Reset(time.Time{}, data)
+
+		Each_Section_Word(&view, func(section int, position int, offset int, word []byte) {
+			term := string(word)
+			postings[term] = append(postings[term], Word_Posting{Doc: doc, Section: section,
+				Position: position, Offset: offset})
+		})
+	}
+
+	if !write_word_segment(path, docs, postings) {
+		return nil, false
+	}
+
+	s, err := open_word_segment(path, gen)
+	if err != nil {
+		errlog.Print(err)
+
+		return nil, false
+	}
+
+	return s, true
+}
+
+// word_tier returns the tier of a segment of so many live days: each tier holds segments of up to
+// words_merge_factor times as many days as the tier below.
+func word_tier(days int) int {
+	tier := 0
+	for ; days >= words_merge_factor; days /= words_merge_factor {
+		tier++
+	}
+
+	return tier
+}
+
+// merge_candidates returns the segments of the lowest tier holding words_merge_factor of them,
+// or nil when no tier is full.
+func merge_candidates(segments []*word_segment) []*word_segment {
+	tiers := make(map[int][]*word_segment)
+	full := -1
+
+	for _, s := range segments {
+		tier := word_tier(s.days())
+		tiers[tier] = append(tiers[tier], s)
+
+		if len(tiers[tier]) >= words_merge_factor && (full < 0 || tier < full) {
+			full = tier
+		}
+	}
+
+	if full < 0 {
+		return nil
+	}
+
+	return tiers[full]
+}
+
+// merge merges the segments of full tiers, one tier after the other as merged segments fill the
+// tiers above, writing generations from next on. The segments merged are left for Close to remove,
+// and a failed merge for the next search to try again.
+func (w *Word_Index) merge(segments []*word_segment, next int) {
+	for {
+		inputs := merge_candidates(segments)
+		if inputs == nil {
+			return
+		}
+
+		merged, ok := merge_word_segments(w.segment_path(next), next, inputs)
+		if !ok {
+			return
+		}
+
+		next++
+		w.merged = append(w.merged, merged)
+
+		merging := make(map[*word_segment]bool, len(inputs))
+		for _, s := range inputs {
+			merging[s] = true
+			w.obsolete = append(w.obsolete, s.file.Name())
+		}
+
+		var rest []*word_segment
+		for _, s := range segments {
+			if !merging[s] {
+				rest = append(rest, s)
+			}
+		}
+
+		segments = append(rest, merged)
+	}
+}
+
+// merge_word_segments writes the live days of segments, in date order, into a segment of a
+// generation, and opens it.
+//
+// If the segment is successfully written, merge_word_segments returns it and true.
+// Otherwise, the error is logged and merge_word_segments returns nil, false.
+func merge_word_segments(path string, gen int, inputs []*word_segment) (*word_segment, bool) {
+	type source struct {
+		doc     word_doc
+		segment int
+		old     int
+		date    int
+	}
+
+	var sources []source
+	renumber := make([][]int, len(inputs))
+
+	for i, s := range inputs {
+		renumber[i] = make([]int, len(s.Docs))
+
+		for j, doc := range s.Docs {
+			renumber[i][j] = -1
+
+			if s.live[j] {
+				month, day, year, _ := Parse_Log_Name(doc.Name)
+				sources = append(sources, source{doc: doc, segment: i, old: j, date: year*10000 + month*100 + day})
+			}
+		}
+	}
+
+	sort.SliceStable(sources, func(i, j int) bool { return sources[i].date < sources[j].date })
+
+	docs := make([]word_doc, len(sources))
+	for n, src := range sources {
+		docs[n] = src.doc
+		renumber[src.segment][src.old] = n
+	}
+
+	debug.Printf("word index: merging %d segments holding %d days\n", len(inputs), len(docs))
+
+	postings := make(map[string][]Word_Posting)
+
+	for i, s := range inputs {
+		err := s.each_postings(func(term string, old []Word_Posting) {
+			for _, p := range old {
+				if n := renumber[i][p.Doc]; n >= 0 {
+					p.Doc = n
+					postings[term] = append(postings[term], p)
+				}
+			}
+		})
+		if err != nil {
+			errlog.Print(err)
+
+			return nil, false
+		}
+	}
+
+	// the days of the segments interleave; those of one day all come from the same segment
+	for _, p := range postings {
+		sort.SliceStable(p, func(i, j int) bool { return p[i].Doc < p[j].Doc })
+	}
+
+	if !write_word_segment(path, docs, postings) {
+		return nil, false
+	}
+
+	s, err := open_word_segment(path, gen)
+	if err != nil {
+		errlog.Print(err)
+
+		return nil, false
+	}
+
+	return s, true
+}
+
+// Phrase returns the matches of a phrase, its words in sequence within one section, in the order
+// of days and of their occurrences, looking through every segment.
+func (w *Word_Index) Phrase(q *Phrase_Query) ([]Word_Hit, error) {
+	if len(q.Words) == 0 {
+		return nil, nil
+	}
+
+	var hits []Word_Hit
+
+	for _, s := range w.segments {
+		var err error
+
+		hits, err = s.phrase(hits, q)
+		if err != nil {
+			return nil, err
+		}
+	}
+
+	// the hits of each segment are in date order, but segments cover dates in any order
+	if len(w.segments) > 1 {
+		dates := make(map[string]int)
+		date := func(name string) int {
+			if d, ok := dates[name]; ok {
+				return d
+			}
+
+			month, day, year, _ := Parse_Log_Name(name)
+			dates[name] = year*10000 + month*100 + day
+
+			return dates[name]
+		}
+
+		sort.SliceStable(hits, func(i, j int) bool { return date(hits[i].Name) < date(hits[j].Name) })
+	}
+
+	return hits, nil
+}
+
+// Word_Completion is a word of the index completing what was typed, and the number of days
+// holding it.
+type Word_Completion struct {
+	Word string
+	Days int
+}
+
+// Complete returns the words of the index starting with a prefix, or with something within
+// fuzzy edits of it, the words held by the most days first and at most limit of them. The days
+// are counted as indexed, so a day indexed again since the last merge counts twice.
+func (w *Word_Index) Complete(prefix string, fuzzy int, limit int) []Word_Completion {
+	days := make(map[string]int)
+
+	for _, s := range w.segments {
+		count := func(term []byte, n int) {
+			if n < len(s.terms) {
+				days[string(term)] += s.terms[n].docs
+			}
+		}
+
+		if fuzzy > 0 {
+			s.dict.Fuzzy(prefix, fuzzy, true, func(term []byte, n int, _ int) { count(term, n) })
+		} else {
+			s.dict.Prefix(prefix, count)
+		}
+	}
+
+	completions := make([]Word_Completion, 0, len(days))
+	for word, n := range days {
+		completions = append(completions, Word_Completion{Word: word, Days: n})
+	}
+
+	sort.Slice(completions, func(i, j int) bool {
+		a, b := completions[i], completions[j]
+
+		return a.Days > b.Days || a.Days == b.Days && a.Word < b.Word
+	})
+
+	return completions[:min(limit, len(completions))]
+}
@@ -0,0 +1,711 @@
+package main
+
+import (
+	"bufio"
+	"bytes"
+	"context"
+	"encoding/hex"
+	"encoding/json"
+	"errors"
+	"html/template"
+	"io"
+	"net"
+	"net/http"
+	"os"
+	"os/signal"
+	"path/filepath"
+	"sort"
+	"strconv"
+	"strings"
+	"sync"
+	"syscall"
+	"time"
+)
+
+// serve_refresh_interval bounds how often requests bring the index up to date with the journal.
+const serve_refresh_interval time.Duration = time.Second
+
+// Journal_Server serves a journal over HTTP, read-only. Listings come from the index and the pack
+// footers, so browsing never reads a logfile; a day is only read to be shown.
+type Journal_Server struct {
+	Dir       string
+	Host      string
+	mu        sync.Mutex
+	idx       *Index
+	refreshed time.Time
+	packs     map[int]*served_pack
+}
+
+// served_pack is the pack of a year as last opened, which is nil when the year has none.
+type served_pack struct {
+	pack  *Pack
+	size  int64
+	mtime time.Time
+}
+
+// served_day is a day found by a request. A logfile stored as is and unchanged since it was
+// indexed is served from its file; any other day is read into data when it is needed.
+type served_day struct {
+	Name     string
+	Hash     string
+	Mtime    time.Time
+	Archived bool
+	file     *os.File
+	data     []byte
+	pack     *Pack
+	entry    *Pack_Entry
+}
+
+// listed_day is a day as the listings show it.
+type listed_day struct {
+	Date     string           `json:"date"`
+	Size     int64            `json:"size"`
+	Hash     string           `json:"hash"`
+	Archived bool             `json:"archived"`
+	Sections []listed_section `json:"sections,omitempty"`
+	key      int
+}
+
+type listed_section struct {
+	Name string `json:"name"`
+	Size int64  `json:"size"`
+}
+
+// Serve serves the journal over HTTP on a loopback address until interrupted: every day as raw
+// text, as HTML and as JSON, and listings of the years and days of the journal as HTML and JSON.
+//
+// If the server runs until it is interrupted, Serve returns true.
+// Otherwise, the error is logged and Serve returns false.
+func Serve(args []string) bool {
+	fs, verbosePtr := New_FlagSet("serve")
+	outDirPtr := fs.String("outdir", "", "serve the journal in the inputted directory")
+	addrPtr := fs.String("addr", "127.0.0.1:8080", "listen on this loopback address")
+	fs.Parse(args)
+
+	Set_Verbosity(*verbosePtr)
+
+	if fs.NArg() != 0 {
+		errlog.Println("usage: touchlog serve [-verbose] [-outdir dir] [-addr host:port]")
+
+		return false
+	}
+
+	if !Is_Loopback(*addrPtr) {
+		errlog.Printf("%s is not a loopback address; the journal is only served to this host\n", *addrPtr)
+
+		return false
+	}
+
+	if !Resolve_Outdir(outDirPtr) {
+		return false
+	}
+
+	host, _, _ := net.SplitHostPort(*addrPtr)
+
+	s := &Journal_Server{Dir: *outDirPtr, Host: strings.ToLower(host), packs: make(map[int]*served_pack)}
+
+	defer s.Close()
+
+	s.mu.Lock()
+	ok := s.refresh(true)
+	s.mu.Unlock()
+
+	if !ok {
+		return false
+	}
+
+	listener, err := net.Listen("tcp", *addrPtr)
+	if err != nil {
+		errlog.Print(err)
+
+		return false
+	}
+
+	Stream_Output()
+
+	print.Printf("touchlog serving %s on http://%s/\n", *outDirPtr, listener.Addr())
+
+	server := &http.Server{Handler: s, ReadHeaderTimeout: 10 * time.Second}
+
+	failed := make(chan error, 1)
+	go func() {
+		failed <- server.Serve(listener)
+	}()
+
+	signals := make(chan os.Signal, 1)
+	signal.Notify(signals, os.Interrupt, syscall.SIGTERM)
+
+	select {
+	case <-signals:
+	case err := <-failed:
+		errlog.Print(err)
+
+		return false
+	}
+
+	ctx, cancel := context.WithTimeout(context.Background(), 5*time.Second)
+	defer cancel()
+
+	server.Shutdown(ctx)
+
+	return true
+}
+
+// Is_Loopback tells whether a listening address is bound to the loopback interface.
+func Is_Loopback(addr string) bool {
+	host, _, err := net.SplitHostPort(addr)
+	if err != nil {
+		return false
+	}
+
+	if host == "localhost" {
+		return true
+	}
+
+	ip := net.ParseIP(host)
+
+	return ip != nil && ip.IsLoopback()
+}
+
+// Allowed_Host tells whether the Host header of a request names the server by a loopback name or
+// by the host it listens on. Any other name, such as that of a site whose domain was rebound to
+// 127.0.0.1, is refused, so pages of other sites cannot read the journal through the browser.
+func (s *Journal_Server) Allowed_Host(host string) bool {
+	if h, _, err := net.SplitHostPort(host); err == nil {
+		host = h
+	}
+
+	host = strings.ToLower(strings.TrimSuffix(strings.TrimPrefix(host, "["), "]"))
+
+	return host == "localhost" || host == "127.0.0.1" || host == "::1" || host != "" && host == s.Host
+}
+
+// Close closes the packs the server opened.
+func (s *Journal_Server) Close() {
+	s.mu.Lock()
+	defer s.mu.Unlock()
+
+	for _, sp := range s.packs {
+		if sp.pack != nil {
+			sp.pack.Close()
+		}
+	}
+}
+
+// ServeHTTP routes a request:
+//
+//	/                    the years of the journal
+//	/yyyy/               the days of a year
+//	/mm-dd-yyyy          a day as HTML
+//	/mm-dd-yyyy.log      a day as raw text
+//	/mm-dd-yyyy.json     a day as JSON, as export -format json prints it
+//	/api/days            the days as JSON, optionally limited by from and until
+//
+// Requests for any host but the server itself are refused with 421 Misdirected Request.
+func (s *Journal_Server) ServeHTTP(w http.ResponseWriter, r *http.Request) {
+	debug.Printf("%s %s\n", r.Method, r.URL)
+
+	if !s.Allowed_Host(r.Host) {
+		http.Error(w, "unknown host", http.StatusMisdirectedRequest)
+
+		return
+	}
+
+	if r.Method != http.MethodGet && r.Method != http.MethodHead {
+		w.Header().Set("Allow", "GET, HEAD")
+		http.Error(w, "read-only", http.StatusMethodNotAllowed)
+
+		return
+	}
+
+	path := strings.TrimPrefix(r.URL.Path, "/")
+
+	switch {
+	case path == "":
+		s.serve_years(w)
+	case path == "api/days":
+		s.serve_listing(w, r)
+	case len(path) == len("yyyy/") && strings.HasSuffix(path, "/"):
+		year, err := strconv.Atoi(path[:4])
+		if err != nil {
+			http.NotFound(w, r)
+
+			return
+		}
+
+		s.serve_year(w, year)
+	case strings.HasSuffix(path, ".log"):
+		s.serve_day(w, r, path, "")
+	case strings.HasSuffix(path, ".json"):
+		s.serve_day(w, r, strings.TrimSuffix(path, ".json")+".log", "json")
+	default:
+		s.serve_day(w, r, path+".log", "html")
+	}
+}
+
+// refresh brings the index up to date when it was last refreshed over serve_refresh_interval
+// ago, or when forced. The caller holds s.mu.
+func (s *Journal_Server) refresh(force bool) bool {
+	if !force && time.Since(s.refreshed) < serve_refresh_interval {
+		return true
+	}
+
+	if s.idx == nil {
+		idx, ok := Load_Index(s.Dir)
+		if !ok {
+			return false
+		}
+
+		s.idx = idx
+	}
+
+	changed, ok := Refresh_Index(s.idx)
+	if !ok || len(changed) > 0 && !Save_Index(s.idx) {
+		return false
+	}
+
+	s.refreshed = time.Now()
+
+	return true
+}
+
+// pack returns the pack of a year, reopening it when it was rewritten since it was opened. The
+// caller holds s.mu.
+func (s *Journal_Server) pack(year int) (*Pack, error) {
+	path := Pack_Path(s.Dir, year)
+
+	info, err := os.Stat(path)
+	if err != nil && !os.IsNotExist(err) {
+		return nil, err
+	}
+
+	sp := s.packs[year]
+	if sp != nil && (info == nil) == (sp.pack == nil) &&
+		(info == nil || info.Size() == sp.size && info.ModTime().Equal(sp.mtime)) {
+		return sp.pack, nil
+	}
+
+	if sp != nil && sp.pack != nil {
+		sp.pack.Close()
+	}
+
+	sp = &served_pack{}
+	s.packs[year] = sp
+
+	if info == nil {
+		return nil, nil
+	}
+
+	sp.pack, err = Open_Pack(path)
+	if err != nil {
+		delete(s.packs, year)
+
+		return nil, err
+	}
+
+	sp.size, sp.mtime = info.Size(), info.ModTime()
+
+	return sp.pack, nil
+}
+
+// pack_years returns the years with packs, whose footers list their days without reading them.
+func (s *Journal_Server) pack_years() ([]int, error) {
+	paths, err := filepath.Glob(State_Path(s.Dir, packs_dir, "*"+pack_ext))
+	if err != nil {
+		return nil, err
+	}
+
+	var years []int
+	for _, path := range paths {
+		year, err := strconv.Atoi(strings.TrimSuffix(filepath.Base(path), pack_ext))
+		if err == nil {
+			years = append(years, year)
+		}
+	}
+
+	return years, nil
+}
+
+// find_day looks a day up in the index, then in the pack of its year, and returns nil when the
+// journal has no such day.
+func (s *Journal_Server) find_day(name string) (*served_day, error) {
+	_, _, year, ok := Parse_Log_Name(name)
+	if !ok {
+		return nil, nil
+	}
+
+	s.mu.Lock()
+	defer s.mu.Unlock()
+
+	if !s.refresh(false) {
+		return nil, errors.New("cannot refresh the index")
+	}
+
+	if entry, ok := s.idx.Entries[name]; ok {
+		d := &served_day{Name: name, Hash: entry.Hash, Mtime: time.Unix(0, entry.Mtime)}
+		if entry.Ext != "" {
+			return d, nil
+		}
+
+		f, err := os.Open(filepath.Join(s.Dir, name))
+		if os.IsNotExist(err) {
+			return nil, nil
+		}
+
+		if err != nil {
+			return nil, err
+		}
+
+		info, err := f.Stat()
+		if err != nil {
+			f.Close()
+
+			return nil, err
+		}
+
+		if info.Size() == entry.Size && info.ModTime().UnixNano() == entry.Mtime {
+			d.file = f
+
+			return d, nil
+		}
+
+		// the logfile changed since the index was refreshed; the next refresh records it
+		defer f.Close()
+
+		d.data, err = io.ReadAll(f)
+		if err != nil {
+			return nil, err
+		}
+
+		d.Hash, d.Mtime = Hash_Content(d.data), info.ModTime()
+
+		return d, nil
+	}
+
+	p, err := s.pack(year)
+	if p == nil || err != nil {
+		return nil, err
+	}
+
+	e := p.Find(name)
+	if e == nil {
+		return nil, nil
+	}
+
+	return &served_day{Name: name, Hash: hex.EncodeToString(e.Hash[:]), Archived: true, pack: p, entry: e}, nil
+}
+
+// content returns the content of a day that is not served from its file.
+func (s *Journal_Server) content(d *served_day) ([]byte, error) {
+	if d.data != nil {
+		return d.data, nil
+	}
+
+	if d.file != nil {
+		return io.ReadAll(d.file)
+	}
+
+	if d.pack == nil {
+		return Read_Log(s.Dir, d.Name)
+	}
+
+	s.mu.Lock()
+	defer s.mu.Unlock()
+
+	return d.pack.Read(d.entry)
+}
+
+// serve_day serves a day as raw text, or as HTML or JSON. Every representation has an ETag made
+// from the hash of the content, so a client holding it is answered before the day is read.
+func (s *Journal_Server) serve_day(w http.ResponseWriter, r *http.Request, name string, format string) {
+	d, err := s.find_day(name)
+	if err != nil {
+		serve_error(w, err)
+
+		return
+	}
+
+	if d == nil {
+		http.NotFound(w, r)
+
+		return
+	}
+
+	if d.file != nil {
+		defer d.file.Close()
+	}
+
+	etag := `"` + d.Hash + `"`
+	if format != "" {
+		etag = `"` + d.Hash + "-" + format + `"`
+	}
+
+	w.Header().Set("ETag", etag)
+	w.Header().Set("Cache-Control", "no-cache")
+
+	if format == "" && d.file != nil {
+		// a file served as is goes out through sendfile where the platform has it
+		w.Header().Set("Content-Type", "text/plain; charset=utf-8")
+		http.ServeContent(w, r, name, d.Mtime, d.file)
+
+		return
+	}
+
+	if etag_matches(r.Header.Get("If-None-Match"), etag) {
+		w.WriteHeader(http.StatusNotModified)
+
+		return
+	}
+
+	data, err := s.content(d)
+	if err != nil {
+		serve_error(w, err)
+
+		return
+	}
+
+	var body []byte
+
+	switch format {
+	case "":
+		w.Header().Set("Content-Type", "text/plain; charset=utf-8")
+		body = data
+	case "json":
+		var out bytes.Buffer
+
+		bw := bufio.NewWriter(&out)
+		Export_JSON(bw, name, data)
+		bw.Flush()
+
+		w.Header().Set("Content-Type", "application/json")
+		body = out.Bytes()
+	case "html":
+		var out bytes.Buffer
+
+		err = day_page.Execute(&out, struct {
+			Day  *served_day
+			Date string
+			Year string
+			Log  Parsed_Log
+		}{d, strings.TrimSuffix(name, ".log"), name[6:10], Parse_Log(data)})
+		if err != nil {
+			serve_error(w, err)
+
+			return
+		}
+
+		w.Header().Set("Content-Type", "text/html; charset=utf-8")
+		body = out.Bytes()
+	}
+
+	http.ServeContent(w, r, "", d.Mtime, bytes.NewReader(body))
+}
+
+// etag_matches tells whether an If-None-Match header lists an ETag.
+func etag_matches(header string, etag string) bool {
+	for _, tag := range strings.Split(header, ",") {
+		tag = strings.TrimSpace(tag)
+		if tag == "*" || strings.TrimPrefix(tag, "W/") == etag {
+			return true
+		}
+	}
+
+	return false
+}
+
+func serve_error(w http.ResponseWriter, err error) {
+	errlog.Print(err)
+	http.Error(w, "cannot read the journal", http.StatusInternalServerError)
+}
+
+// list_days returns the days of the journal from first through last year in date order, from
+// the index and the pack footers. A day both stored as a logfile and archived is listed as the
+// logfile, which is what a request finds.
+func (s *Journal_Server) list_days(first int, last int) ([]listed_day, error) {
+	s.mu.Lock()
+	defer s.mu.Unlock()
+
+	if !s.refresh(false) {
+		return nil, errors.New("cannot refresh the index")
+	}
+
+	days := []listed_day{}
+
+	for name, entry := range s.idx.Entries {
+		month, day, year, ok := Parse_Log_Name(name)
+		if !ok || year < first || year > last {
+			continue
+		}
+
+		listed := listed_day{Date: strings.TrimSuffix(name, ".log"), Size: entry.Length, Hash: entry.Hash,
+			key: year*10000 + month*100 + day}
+
+		for i, section := range entry.Sections {
+			listed.Sections = append(listed.Sections, listed_section{Name: section.Name, Size: entry.Section_Size(i)})
+		}
+
+		days = append(days, listed)
+	}
+
+	years, err := s.pack_years()
+	if err != nil {
+		return nil, err
+	}
+
+	for _, year := range years {
+		if year < first || year > last {
+			continue
+		}
+
+		p, err := s.pack(year)
+		if err != nil {
+			return nil, err
+		}
+
+		if p == nil {
+			continue
+		}
+
+		for _, e := range p.Entries {
+			month, day, year, ok := Parse_Log_Name(e.Name)
+			if _, live := s.idx.Entries[e.Name]; !ok || live {
+				continue
+			}
+
+			days = append(days, listed_day{Date: strings.TrimSuffix(e.Name, ".log"), Size: int64(e.Size),
+				Hash: hex.EncodeToString(e.Hash[:]), Archived: true, key: year*10000 + month*100 + day})
+		}
+	}
+
+	sort.Slice(days, func(i, j int) bool { return days[i].key < days[j].key })
+
+	return days, nil
+}
+
+// serve_listing serves the days between the from and until parameters, mmddyyyy dates, as JSON.
+func (s *Journal_Server) serve_listing(w http.ResponseWriter, r *http.Request) {
+	from, until, ok := Parse_Range(r.URL.Query().Get("from"), r.URL.Query().Get("until"))
+	if !ok {
+		http.Error(w, "from and until are mmddyyyy dates", http.StatusBadRequest)
+
+		return
+	}
+
+	days, err := s.list_days(from.Year(), until.Year())
+	if err != nil {
+		serve_error(w, err)
+
+		return
+	}
+
+	kept := days[:0]
+	for _, day := range days {
+		date, _ := log_date(day.Date + ".log")
+		if !date.Before(from) && !date.After(until) {
+			kept = append(kept, day)
+		}
+	}
+
+	w.Header().Set("Content-Type", "application/json")
+	w.Header().Set("Cache-Control", "no-cache")
+
+	out := bufio.NewWriter(w)
+	defer out.Flush()
+
+	enc := json.NewEncoder(out)
+	enc.SetEscapeHTML(false)
+	enc.Encode(kept)
+}
+
+// serve_years serves the years of the journal with how many days each holds.
+func (s *Journal_Server) serve_years(w http.ResponseWriter) {
+	days, err := s.list_days(0, 9999)
+	if err != nil {
+		serve_error(w, err)
+
+		return
+	}
+
+	type listed_year struct {
+		Year     string
+		Days     int
+		Archived int
+	}
+
+	var years []listed_year
+	for _, day := range days {
+		year := day.Date[6:]
+		if len(years) == 0 || years[len(years)-1].Year != year {
+			years = append(years, listed_year{Year: year})
+		}
+
+		years[len(years)-1].Days++
+		if day.Archived {
+			years[len(years)-1].Archived++
+		}
+	}
+
+	serve_page(w, years_page, struct {
+		Dir   string
+		Years []listed_year
+	}{s.Dir, years})
+}
+
+// serve_year serves the days of a year.
+func (s *Journal_Server) serve_year(w http.ResponseWriter, year int) {
+	days, err := s.list_days(year, year)
+	if err != nil {
+		serve_error(w, err)
+
+		return
+	}
+
+	serve_page(w, year_page, struct {
+		Year string
+		Days []listed_day
+	}{pad(year, 4), days})
+}
+
+func serve_page(w http.ResponseWriter, page *template.Template, data any) {
+	var out bytes.Buffer
+
+	if err := page.Execute(&out, data); err != nil {
+		serve_error(w, err)
+
+		return
+	}
+
+	w.Header().Set("Content-Type", "text/html; charset=utf-8")
+	w.Header().Set("Cache-Control", "no-cache")
+	w.Write(out.Bytes())
+}
+
+const page_head string = `<!DOCTYPE html>
+<html><head><meta charset="utf-8"><title>touchlog</title>
+<style>body{font-family:sans-serif;max-width:50em;margin:2em auto}pre{white-space:pre-wrap}td{padding:0 1em 0 0}</style>
+</head><body>
+`
+
+var years_page = template.Must(template.New("years").Parse(page_head + `<h1>{{.Dir}}</h1>
+<table>{{range .Years}}
+<tr><td><a href="/{{.Year}}/">{{.Year}}</a></td><td>{{.Days}} days</td><td>{{if .Archived}}{{.Archived}} archived{{end}}</td></tr>{{end}}
+</table>
+</body></html>
+`))
+
+var year_page = template.Must(template.New("year").Parse(page_head + `<h1><a href="/">touchlog</a> / {{.Year}}</h1>
+<table>{{range .Days}}
+<tr><td><a href="/{{.Date}}">{{.Date}}</a></td><td>{{.Size}} bytes</td><td>{{range $i, $s := .Sections}}{{if $i}}, {{end}}{{$s.Name}}{{end}}</td><td>{{if .Archived}}archived{{end}}</td></tr>{{end}}
+</table>
+</body></html>
+`))
+
+var day_page = template.Must(template.New("day").Parse(page_head + `<h1><a href="/">touchlog</a> / <a href="/{{.Year}}/">{{.Year}}</a> / {{.Date}}</h1>
+<p><a href="/{{.Date}}.log">raw</a> <a href="/{{.Date}}.json">json</a>{{if .Day.Archived}} archived{{end}}</p>
+<pre>{{range .Log.Header}}{{.}}
+{{end}}</pre>{{range .Log.Sections}}
+<h2>{{.Name}}</h2>
+<pre>{{range .Body}}{{.}}
+{{end}}</pre>{{end}}
+</body></html>
+`))
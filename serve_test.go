@@ -0,0 +1,46 @@
+package main
+
+import (
+	"net/http"
+	"net/http/httptest"
+	"testing"
+)
+
+func TestServeHost(t *testing.T) {
+	s := &Journal_Server{Dir: t.TempDir(), Host: "127.0.0.2", packs: make(map[int]*served_pack)}
+
+	tests := []struct {
+		host    string
+		allowed bool
+	}{
+		{"localhost", true},
+		{"localhost:8080", true},
+		{"LocalHost:8080", true},
+		{"127.0.0.1:8080", true},
+		{"127.0.0.1", true},
+		{"[::1]:8080", true},
+		{"[::1]", true},
+		{"127.0.0.2:9000", true},
+		{"attacker.example:8080", false},
+		{"attacker.example", false},
+		{"localhost.attacker.example", false},
+		{"127.0.0.1.nip.io:8080", false},
+		{"", false},
+	}
+
+	for _, test := range tests {
+		if got := s.Allowed_Host(test.host); got != test.allowed {
+			t.Errorf("Allowed_Host(%q) = %v, want %v", test.host, got, test.allowed)
+		}
+
+		r := httptest.NewRequest(http.MethodGet, "/api/days", nil)
+		r.Host = test.host
+		w := httptest.NewRecorder()
+
+		s.ServeHTTP(w, r)
+
+		if refused := w.Code == http.StatusMisdirectedRequest; refused == test.allowed {
+			t.Errorf("GET with Host %q: status %d", test.host, w.Code)
+		}
+	}
+}
@@ -0,0 +1,600 @@
+package main
+
+import (
+	"bufio"
+	"encoding/hex"
+	"fmt"
+	"math"
+	"os"
+	"path/filepath"
+	"sort"
+	"strings"
+)
+
+// The sync state of a pair of replicas lives in the bookkeeping directory of both of them: the
+// content each logfile had after the last sync (its base) and the hash of that content.
+const sync_dir string = "sync"
+const sync_state_name string = "state"
+const sync_base_dir string = "base"
+const sync_state_header string = "touchlog-sync 1"
+
+// Sync reconciles two replicas of a journal. Logfiles whose content index hash still matches the
+// last synced base are left alone; a day changed on one side is copied to the other, and a day
+// changed on both sides is merged section by section against the stored base. A day archived in
+// the packs of a replica still counts as held by it, with the content of its archived copy.
+//
+// If both replicas are successfully reconciled, Sync returns true.
+// Otherwise, the error is logged and Sync returns false.
+func Sync(args []string) bool {
+	fs, verbosePtr := New_FlagSet("sync")
+	fs.Parse(args)
+
+	Set_Verbosity(*verbosePtr)
+
+	if fs.NArg() != 2 {
+		errlog.Println("usage: touchlog sync [-verbose] dirA dirB")
+
+		return false
+	}
+
+	dirA, dirB := fs.Arg(0), fs.Arg(1)
+	if !Normalize(&dirA) || !Normalize(&dirB) {
+		return false
+	}
+
+	debug.Printf("Sync(%s, %s)\n", dirA, dirB)
+
+	idxA, ok := Load_Index(dirA)
+	if !ok {
+		return false
+	}
+
+	idxB, ok := Load_Index(dirB)
+	if !ok {
+		return false
+	}
+
+	if _, ok := Refresh_Index(idxA); !ok {
+		return false
+	}
+
+	if _, ok := Refresh_Index(idxB); !ok {
+		return false
+	}
+
+	base, ok := Load_Sync_State(dirA)
+	if ok && len(base) == 0 {
+		base, ok = Load_Sync_State(dirB)
+	}
+	if !ok {
+		return false
+	}
+
+	archA, ok := Load_Archive(dirA)
+	if !ok {
+		return false
+	}
+
+	defer archA.Close()
+
+	archB, ok := Load_Archive(dirB)
+	if !ok {
+		return false
+	}
+
+	defer archB.Close()
+
+	a, b := &sync_replica{idxA, archA}, &sync_replica{idxB, archB}
+
+	names := make(map[string]bool)
+	for _, r := range []*sync_replica{a, b} {
+		for name := range r.idx.Entries {
+			names[name] = true
+		}
+		for name := range r.archive.days {
+			names[name] = true
+		}
+	}
+	for name := range base {
+		names[name] = true
+	}
+
+	sorted := make([]string, 0, len(names))
+	for name := range names {
+		sorted = append(sorted, name)
+	}
+
+	sort.Strings(sorted)
+
+	touched := 0
+	for _, name := range sorted {
+		hashA, hashB, hashBase := a.hash(name), b.hash(name), base[name]
+		if hashA == hashB && hashA == hashBase {
+			continue
+		}
+
+		action, ok := sync_day(name, a, b, base)
+		if !ok {
+			return false
+		}
+
+		if action != "" {
+			print.Printf("%s: %s\n", name, action)
+		}
+
+		touched++
+	}
+
+	if touched > 0 {
+		if !Save_Index(idxA) || !Save_Index(idxB) {
+			return false
+		}
+
+		if !Save_Sync_State(dirA, base) || !Save_Sync_State(dirB, base) {
+			return false
+		}
+	}
+
+	print.Printf("synced %s and %s: %d of %d days touched\n", dirA, dirB, touched, len(sorted))
+
+	return true
+}
+
+// sync_replica is one side of a sync: its index and the days archived in its packs.
+type sync_replica struct {
+	idx     *Index
+	archive *Archive
+}
+
+// hash returns the hash of the content a replica holds for a day: that of its logfile, or of its
+// archived copy when it has no logfile, or empty when it has neither.
+func (r *sync_replica) hash(name string) string {
+	if e, ok := r.idx.Entries[name]; ok {
+		return e.Hash
+	}
+
+	if day, ok := r.archive.days[name]; ok {
+		return hex.EncodeToString(day.entry.Hash[:])
+	}
+
+	return ""
+}
+
+// read returns the content a replica holds for a day, or nil when it holds none.
+func (r *sync_replica) read(name string) ([]byte, bool) {
+	var data []byte
+	var err error
+
+	if _, ok := r.idx.Entries[name]; ok {
+		data, err = Read_Log(r.idx.Dir, name)
+	} else if day, ok := r.archive.days[name]; ok {
+		data, err = day.pack.Read(day.entry)
+	}
+
+	if err != nil {
+		errlog.Print(err)
+
+		return nil, false
+	}
+
+	return data, true
+}
+
+// sync_day reconciles a single logfile whose hashes differ between the replicas or from the base,
+// and records the reconciled content as the new base. It returns a description of what was done,
+// empty when only the base had to be recorded. Sync never rewrites packs, so a day deleted on one
+// side while archived on the other is restored rather than deleted.
+func sync_day(name string, a *sync_replica, b *sync_replica, base map[string]string) (action string, success bool) {
+	idxA, idxB := a.idx, b.idx
+	hashA, hashB, hashBase := a.hash(name), b.hash(name), base[name]
+
+	debug.Printf("sync_day(%s) A=%.8s B=%.8s base=%.8s\n", name, hashA, hashB, hashBase)
+
+	read := func(r *sync_replica, hash string) ([]byte, bool) {
+		if hash == "" {
+			return nil, true
+		}
+
+		return r.read(name)
+	}
+
+	var result []byte
+	var ok bool
+
+	changedA, changedB := hashA != hashBase, hashB != hashBase
+	switch {
+	case hashA == hashB:
+		// both sides agree already, only the base is behind
+		result, ok = read(a, hashA)
+	case !changedA || hashA == "" && changedB:
+		// keep edits over deletions
+		result, ok = read(b, hashB)
+		action = "B -> A"
+	case !changedB || hashB == "":
+		result, ok = read(a, hashA)
+		action = "A -> B"
+	default:
+		var dataA, dataB, baseData []byte
+
+		dataA, ok = read(a, hashA)
+		if ok {
+			dataB, ok = read(b, hashB)
+		}
+		if ok {
+			baseData, ok = Read_Sync_Base(idxA.Dir, idxB.Dir, name)
+		}
+
+		result = Merge_Log(baseData, dataA, dataB)
+		action = "merged"
+	}
+	if !ok {
+		return "", false
+	}
+
+	if result == nil {
+		for _, r := range []*sync_replica{a, b} {
+			if _, archived := r.archive.days[name]; archived {
+				result, ok = r.read(name)
+				action = "restored from the archive"
+
+				break
+			}
+		}
+	}
+	if !ok {
+		return "", false
+	}
+
+	deleted := result == nil
+	if deleted && action != "" {
+		action = "deleted"
+	}
+
+	hash := ""
+	if !deleted {
+		hash = Hash_Content(result)
+	}
+
+	for _, r := range []*sync_replica{a, b} {
+		if r.hash(name) == hash {
+			continue
+		}
+
+		if !apply_sync(r.idx, name, result) {
+			return "", false
+		}
+	}
+
+	for _, dir := range []string{idxA.Dir, idxB.Dir} {
+		path := State_Path(dir, sync_dir, sync_base_dir, name)
+		if deleted {
+			err := os.Remove(path)
+			if err != nil && !os.IsNotExist(err) {
+				errlog.Print(err)
+
+				return "", false
+			}
+		} else if !Write_Atomic(path, result) {
+			return "", false
+		}
+	}
+
+	if deleted {
+		delete(base, name)
+	} else {
+		base[name] = hash
+	}
+
+	return action, true
+}
+
+// Archive is the days a journal has archived in its packs, by name, read in place from the open
+// packs.
+type Archive struct {
+	packs []*Pack
+	days  map[string]archived_day
+}
+
+// Load_Archive opens the packs of a journal and lists the days they hold.
+//
+// If a pack cannot be opened, the error is logged and Load_Archive returns nil, false.
+func Load_Archive(dir string) (*Archive, bool) {
+	packs, ok := open_packs(dir, math.MinInt, math.MaxInt)
+	if !ok {
+		return nil, false
+	}
+
+	a := &Archive{packs: packs, days: make(map[string]archived_day)}
+
+	for _, p := range packs {
+		for i := range p.Entries {
+			e := &p.Entries[i]
+			a.days[e.Name] = archived_day{pack: p, entry: e}
+		}
+	}
+
+	return a, true
+}
+
+// Close closes the packs of the archive.
+func (a *Archive) Close() {
+	for _, p := range a.packs {
+		p.Close()
+	}
+}
+
+// apply_sync writes the reconciled content of a logfile into one replica, or removes the logfile
+// when the reconciled content is nil, and updates the replica's index to match.
+func apply_sync(idx *Index, name string, data []byte) bool {
+	path := filepath.Join(idx.Dir, name)
+
+	if data == nil {
+		err := os.Remove(path)
+		if err != nil && !os.IsNotExist(err) {
+			errlog.Print(err)
+
+			return false
+		}
+
+		delete(idx.Entries, name)
+
+		return true
+	}
+
+	if !Save_Log(idx.Dir, name, data) {
+		return false
+	}
+
+	return idx.Update(name, data)
+}
+
+// Read_Sync_Base returns the content a logfile had after the last sync, looking in the first
+// replica and then in the second. A logfile that has never been synced has an empty base.
+//
+// If the base cannot be read, the error is logged and Read_Sync_Base returns nil, false.
+func Read_Sync_Base(dirA string, dirB string, name string) ([]byte, bool) {
+	for _, dir := range []string{dirA, dirB} {
+		data, err := os.ReadFile(State_Path(dir, sync_dir, sync_base_dir, name))
+		if os.IsNotExist(err) {
+			continue
+		}
+		if err != nil {
+			errlog.Print(err)
+
+			return nil, false
+		}
+
+		return data, true
+	}
+
+	return nil, true
+}
+
+// Load_Sync_State reads the base hash of every synced logfile of a replica. A replica that has
+// never been synced yields an empty state.
+//
+// If the state cannot be read, the error is logged and Load_Sync_State returns nil, false.
+func Load_Sync_State(dir string) (map[string]string, bool) {
+	state := make(map[string]string)
+
+	f, err := os.Open(State_Path(dir, sync_dir, sync_state_name))
+	if os.IsNotExist(err) {
+		return state, true
+	}
+	if err != nil {
+		errlog.Print(err)
+
+		return nil, false
+	}
+
+	defer f.Close()
+
+	scanner := bufio.NewScanner(f)
+	if !scanner.Scan() || scanner.Text() != sync_state_header {
+		return state, true
+	}
+
+	for scanner.Scan() {
+		name, hash, ok := strings.Cut(scanner.Text(), "\t")
+		if ok {
+			state[name] = hash
+		}
+	}
+
+	err = scanner.Err()
+	if err != nil {
+		errlog.Print(err)
+
+		return nil, false
+	}
+
+	return state, true
+}
+
+// Save_Sync_State atomically replaces the sync state of a replica.
+func Save_Sync_State(dir string, state map[string]string) bool {
+	names := make([]string, 0, len(state))
+	for name := range state {
+		names = append(names, name)
+	}
+
+	sort.Strings(names)
+
+	var sb strings.Builder
+
+	sb.WriteString(sync_state_header)
+	sb.WriteByte('\n')
+
+	for _, name := range names {
+		fmt.Fprintf(&sb, "%s\t%s\n", name, state[name])
+	}
+
+	return Write_Atomic(State_Path(dir, sync_dir, sync_state_name), []byte(sb.String()))
+}
+
+// Merge_Log three-way merges two versions of a logfile against their common base. Sections are
+// matched by name and merged independently; a section changed on both sides is merged entry by
+// entry, keeping the additions and removals made on either side. Conflicting headers resolve to
+// the first version.
+func Merge_Log(base []byte, a []byte, b []byte) []byte {
+	parsedBase, parsedA, parsedB := Parse_Log(base), Parse_Log(a), Parse_Log(b)
+
+	// sections of B are added after the last line of A, not after its final newline
+	parsedBase.Cut_Final_Newline()
+	parsedB.Cut_Final_Newline()
+	newline := parsedA.Cut_Final_Newline()
+
+	var merged Parsed_Log
+
+	switch {
+	case equal_lines(parsedA.Header, parsedBase.Header):
+		merged.Header = parsedB.Header
+	default:
+		merged.Header = parsedA.Header
+	}
+
+	baseSections := keyed_sections(parsedBase)
+	bSections := keyed_sections(parsedB)
+
+	keysA := parsedA.Section_Keys()
+	inA := make(map[string]bool, len(keysA))
+
+	for i, section := range parsedA.Sections {
+		key := keysA[i]
+		inA[key] = true
+
+		sectionB, inB := bSections[key]
+		sectionBase, inBase := baseSections[key]
+
+		switch {
+		case inB:
+			section.Body = Merge_Lines(sectionBase.Body, section.Body, sectionB.Body)
+		case inBase && equal_lines(section.Body, sectionBase.Body):
+			// removed on B and untouched on A
+			continue
+		}
+
+		merged.Sections = append(merged.Sections, section)
+	}
+
+	for i, key := range parsedB.Section_Keys() {
+		if inA[key] {
+			continue
+		}
+
+		section := parsedB.Sections[i]
+		if sectionBase, inBase := baseSections[key]; inBase && equal_lines(section.Body, sectionBase.Body) {
+			// removed on A and untouched on B
+			continue
+		}
+
+		merged.Sections = append(merged.Sections, section)
+	}
+
+	if newline {
+		merged.Add_Final_Newline()
+	}
+
+	return merged.Bytes()
+}
+
+// Merge_Lines three-way merges the lines of a section. Blank lines are layout and follow the first
+// version; every other line is an entry, kept as many times as both sides together imply, with
+// entries only the second version added placed after the last entry of the first. An entry added
+// on both sides, or removed on both, counts once, so without a base, as on the first sync, the
+// entries of both versions are kept as many times as the version holding more of them has them.
+func Merge_Lines(base []string, a []string, b []string) []string {
+	switch {
+	case equal_lines(a, b), equal_lines(b, base):
+		return a
+	case equal_lines(a, base):
+		return b
+	}
+
+	countBase, countA, countB := count_entries(base), count_entries(a), count_entries(b)
+
+	want := make(map[string]int, len(countA)+len(countB))
+	for _, counts := range []map[string]int{countA, countB} {
+		for entry := range counts {
+			want[entry] = countBase[entry] + merge_change(countA[entry]-countBase[entry], countB[entry]-countBase[entry])
+		}
+	}
+
+	kept := make([]string, 0, len(a)+len(b))
+	for _, line := range a {
+		if is_blank(line) {
+			kept = append(kept, line)
+		} else if want[line] > 0 {
+			kept = append(kept, line)
+			want[line]--
+		}
+	}
+
+	insert := len(kept)
+	for insert > 0 && is_blank(kept[insert-1]) {
+		insert--
+	}
+
+	merged := make([]string, 0, len(a)+len(b))
+	merged = append(merged, kept[:insert]...)
+
+	for _, line := range b {
+		if !is_blank(line) && want[line] > 0 {
+			merged = append(merged, line)
+			want[line]--
+		}
+	}
+
+	return append(merged, kept[insert:]...)
+}
+
+// merge_change combines how many times each side added, or removed when negative, an entry.
+// Changes in the same direction are taken to be the same change made twice.
+func merge_change(changeA int, changeB int) int {
+	switch {
+	case changeA > 0 && changeB > 0:
+		return max(changeA, changeB)
+	case changeA < 0 && changeB < 0:
+		return min(changeA, changeB)
+	}
+
+	return changeA + changeB
+}
+
+func keyed_sections(p Parsed_Log) map[string]Section {
+	sections := make(map[string]Section, len(p.Sections))
+	for i, key := range p.Section_Keys() {
+		sections[key] = p.Sections[i]
+	}
+
+	return sections
+}
+
+func count_entries(lines []string) map[string]int {
+	counts := make(map[string]int, len(lines))
+	for _, line := range lines {
+		if !is_blank(line) {
+			counts[line]++
+		}
+	}
+
+	return counts
+}
+
+func is_blank(line string) bool {
+	return strings.TrimSpace(line) == ""
+}
+
+func equal_lines(a []string, b []string) bool {
+	if len(a) != len(b) {
+		return false
+	}
+
+	for i := range a {
+		if a[i] != b[i] {
+			return false
+		}
+	}
+
+	return true
+}
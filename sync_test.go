@@ -0,0 +1,87 @@
+package main
+
+import (
+	"strings"
+	"testing"
+)
+
+func TestMergeLines(t *testing.T) {
+	tests := []struct {
+		name string
+		base string
+		a    string
+		b    string
+		want string
+	}{
+		{"first sync", "", "shared entry", "shared entry|only on B", "shared entry|only on B"},
+		{"first sync, both sides added", "", "only on A|shared entry", "shared entry|only on B", "only on A|shared entry|only on B"},
+		{"first sync, repeated entry", "", "x|x", "x", "x|x"},
+		{"same entry added on both sides", "kept", "kept|added", "kept|added", "kept|added"},
+		{"same entry added on both sides with others", "kept", "kept|added|on A", "kept|on B|added", "kept|added|on A|on B"},
+		{"added on one side", "kept", "kept|on A", "kept", "kept|on A"},
+		{"added on each side", "kept", "kept|on A", "kept|on B", "kept|on A|on B"},
+		{"removed on one side", "x|y", "x", "x|y|z", "x|z"},
+		{"removed on both sides", "x|y|y", "x|y", "x|y", "x|y"},
+		{"removed on both sides with others", "x|y|y", "x|y|a", "x|y|b", "x|y|a|b"},
+		{"repeated once more on one side", "x", "x|x", "x|b", "x|x|b"},
+		{"blank lines follow A", "x||", "x|a||", "x|b|", "x|a|b||"},
+	}
+
+	split := func(s string) []string {
+		if s == "" {
+			return nil
+		}
+
+		return strings.Split(s, "|")
+	}
+
+	for _, test := range tests {
+		got := strings.Join(Merge_Lines(split(test.base), split(test.a), split(test.b)), "|")
+		if got != test.want {
+			t.Errorf("%s: got %q, want %q", test.name, got, test.want)
+		}
+	}
+}
+
+func TestMergeLog(t *testing.T) {
+	tests := []struct {
+		name string
+		base string
+		a    string
+		b    string
+		want string
+	}{
+		{"first sync",
+			"",
+			"# 01/02/2024\n|> notes\nshared entry\n",
+			"# 01/02/2024\n|> notes\nshared entry\nonly on B\n",
+			"# 01/02/2024\n|> notes\nshared entry\nonly on B\n"},
+		{"first sync, section on one side",
+			"",
+			"# 01/02/2024\n|> notes\nshared entry\n",
+			"# 01/02/2024\n|> notes\nshared entry\n|> todo\nonly on B\n",
+			"# 01/02/2024\n|> notes\nshared entry\n|> todo\nonly on B\n"},
+		{"same entry added on both sides",
+			"# 01/02/2024\n|> notes\nkept\n",
+			"# 01/02/2024\n|> notes\nkept\nadded\n|> todo\non A\n",
+			"# 01/02/2024\n|> notes\nkept\nadded\n",
+			"# 01/02/2024\n|> notes\nkept\nadded\n|> todo\non A\n"},
+		{"section removed on one side",
+			"# 01/02/2024\n|> notes\nkept\n|> todo\ndone\n",
+			"# 01/02/2024\n|> notes\nkept\n",
+			"# 01/02/2024\n|> notes\nkept\nmore\n|> todo\ndone\n",
+			"# 01/02/2024\n|> notes\nkept\nmore\n"},
+	}
+
+	for _, test := range tests {
+		var base []byte
+		if test.base != "" {
+			base = []byte(test.base)
+		}
+
+		got := string(Merge_Log(base, []byte(test.a), []byte(test.b)))
+		if got != test.want {
+			t.Errorf("%s: got %q, want %q", test.name, got, test.want)
+		}
+	}
+}
@@ -0,0 +1,283 @@
+package main
+
+import (
+	"bufio"
+	"bytes"
+	"os"
+	"path/filepath"
+	"sync/atomic"
+	"time"
+)
+
+// Tail prints the last lines of today's logfile in one or more journals and, with -f, follows
+// them: whenever the daemon of a journal, or a watcher when it has none, reports a change, only the
+// bytes past the last offset read are read. Lines can be limited to one section.
+//
+// If a journal cannot be read, the error is logged and Tail returns false. When following, Tail
+// runs until interrupted.
+func Tail(args []string) bool {
+	fs, verbosePtr := New_FlagSet("tail")
+	followPtr := fs.Bool("f", false, "keep printing lines as they are added")
+	linesPtr := fs.Int("n", 10, "number of lines to print first")
+	sectionPtr := fs.String("section", "", "only print lines of this section")
+	fs.Parse(args)
+
+	Set_Verbosity(*verbosePtr)
+
+	dirs := fs.Args()
+	if len(dirs) == 0 {
+		dirs = []string{""}
+	}
+
+	tails := make([]*tail_file, len(dirs))
+	for i, dir := range dirs {
+		if !Resolve_Outdir(&dir) {
+			return false
+		}
+
+		tails[i] = &tail_file{dir: dir, section: *sectionPtr, header: len(dirs) > 1}
+	}
+
+	out := bufio.NewWriter(os.Stdout)
+	defer out.Flush()
+
+	now := time.Now()
+	for _, t := range tails {
+		if !t.start(out, now, *linesPtr) {
+			return false
+		}
+	}
+
+	if !*followPtr {
+		return true
+	}
+
+	out.Flush()
+	Stream_Output()
+
+	// a first pass picks up what was added before the watchers started
+	wake := make(chan struct{}, 1)
+	wake <- struct{}{}
+	for _, t := range tails {
+		t.changed.Store(true)
+
+		go t.watch(wake)
+	}
+
+	rollover := time.NewTimer(until_midnight(now))
+
+	for {
+		select {
+		case now = <-rollover.C:
+			rollover.Reset(until_midnight(now))
+
+			for _, t := range tails {
+				t.close()
+				t.start(out, now, 0)
+			}
+		case <-wake:
+			for _, t := range tails {
+				if t.changed.Swap(false) && !t.read(out) {
+					return false
+				}
+			}
+		}
+
+		out.Flush()
+	}
+}
+
+// tail_file follows today's logfile of one journal.
+type tail_file struct {
+	dir     string
+	name    string
+	section string
+	header  bool
+	file    *os.File
+	info    os.FileInfo
+	offset  int64
+	current string
+	changed atomic.Bool
+}
+
+// start switches to the logfile for a date and prints its last lines.
+func (t *tail_file) start(out *bufio.Writer, date time.Time, lines int) bool {
+	t.name = Log_Name(pad(int(date.Month()), 2), pad(date.Day(), 2), pad(date.Year(), 4))
+	t.offset, t.current = 0, ""
+
+	data, err := os.ReadFile(filepath.Join(t.dir, t.name))
+	if os.IsNotExist(err) {
+		return true
+	}
+	if err != nil {
+		errlog.Print(err)
+
+		return false
+	}
+
+	var kept [][]byte
+
+	end := bytes.LastIndexByte(data, '\n') + 1
+	t.scan(data[:end], func(line []byte) {
+		kept = append(kept, line)
+	})
+
+	t.offset = int64(end)
+
+	if len(kept) > lines {
+		kept = kept[len(kept)-lines:]
+	}
+
+	if len(kept) > 0 {
+		t.print_header(out)
+
+		for _, line := range kept {
+			out.Write(line)
+			out.WriteByte('\n')
+		}
+	}
+
+	return true
+}
+
+// scan passes the lines of newly read bytes to fn, keeping track of the section they are in.
+func (t *tail_file) scan(data []byte, fn func(line []byte)) {
+	for len(data) > 0 {
+		end := bytes.IndexByte(data, '\n')
+		line := data[:end]
+		data = data[end+1:]
+
+		if bytes.HasPrefix(line, []byte(section_prefix)) {
+			t.current = string(line[len(section_prefix):])
+		}
+
+		if t.section == "" || t.section == t.current && !bytes.HasPrefix(line, []byte(section_prefix)) {
+			fn(line)
+		}
+	}
+}
+
+func (t *tail_file) print_header(out *bufio.Writer) {
+	if t.header {
+		out.WriteString("==> " + filepath.Join(t.dir, t.name) + " <==\n")
+	}
+}
+
+// read prints the complete lines added since the last read, with a single pread.
+func (t *tail_file) read(out *bufio.Writer) bool {
+	path := filepath.Join(t.dir, t.name)
+
+	info, err := os.Stat(path)
+	if os.IsNotExist(err) {
+		t.close()
+
+		return true
+	}
+	if err != nil {
+		errlog.Print(err)
+
+		return false
+	}
+
+	// editors that save by renaming a new file into place replace the file being read
+	if t.file == nil || !os.SameFile(t.info, info) {
+		t.close()
+
+		t.file, err = os.Open(path)
+		if err != nil {
+			errlog.Print(err)
+
+			return false
+		}
+
+		t.info = info
+	}
+
+	if info.Size() < t.offset {
+		debug.Printf("%s shrank, reading it from the start\n", path)
+
+		t.offset, t.current = 0, ""
+	}
+
+	if info.Size() == t.offset {
+		return true
+	}
+
+	data := make([]byte, info.Size()-t.offset)
+
+	n, err := t.file.ReadAt(data, t.offset)
+	if n == 0 && err != nil {
+		errlog.Print(err)
+
+		return false
+	}
+
+	end := bytes.LastIndexByte(data[:n], '\n') + 1
+	if end == 0 {
+		return true
+	}
+
+	printed := false
+	t.scan(data[:end], func(line []byte) {
+		if !printed {
+			t.print_header(out)
+			printed = true
+		}
+
+		out.Write(line)
+		out.WriteByte('\n')
+	})
+
+	t.offset += int64(end)
+
+	return true
+}
+
+func (t *tail_file) close() {
+	if t.file != nil {
+		t.file.Close()
+		t.file, t.info = nil, nil
+	}
+}
+
+// watch marks the journal changed whenever something in it changes, listening to its daemon when
+// one runs and watching the directory itself otherwise.
+func (t *tail_file) watch(wake chan struct{}) {
+	// any change is worth a stat, since events may have been dropped on the way
+	notify := func() {
+		t.changed.Store(true)
+
+		select {
+		case wake <- struct{}{}:
+		default:
+		}
+	}
+
+	conn, reader, err := Subscribe(t.dir)
+	if err == nil {
+		debug.Printf("following %s through its daemon\n", t.dir)
+
+		for {
+			_, err := reader.ReadString('\n')
+			if err != nil {
+				break
+			}
+
+			notify()
+		}
+
+		conn.Close()
+		errlog.Printf("lost the daemon of %s, watching it directly\n", t.dir)
+	}
+
+	watcher, err := Watch_Dir(t.dir)
+	if err != nil {
+		errlog.Print(err)
+
+		return
+	}
+
+	for range watcher.Names {
+		notify()
+	}
+}
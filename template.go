@@ -0,0 +1,583 @@
+package main
+
+import (
+	"fmt"
+	"os"
+	"path/filepath"
+	"regexp"
+	"strings"
+	"time"
+)
+
+// template_name is the skeleton of a journal's logfiles, and templates_dir holds the partials it
+// includes. A journal without a template uses log_format.
+const template_name string = "template"
+const templates_dir string = "templates"
+const template_max_depth int = 8
+
+// Dates fall into classes by weekday, month and whether they are the first, last or another day
+// of their month. Every condition a template can test is decided by the class alone.
+const template_classes int = 7 * 12 * 3
+
+// log_template is the compiled template of the journal being written.
+var log_template *Template
+
+// bulk_skeletons renders the skeletons of log_template while a range of dates is written, and is
+// nil otherwise.
+var bulk_skeletons *Skeleton_Patcher
+
+// Template is a compiled logfile skeleton. Its conditionals are evaluated for every class of
+// dates when it is compiled, leaving one flat list of segments per distinct variant and a table
+// from class to variant, so rendering a date is a lookup followed by appends.
+type Template struct {
+	variants [][]template_segment
+	table    [template_classes]uint8
+	placed   map[string]bool
+}
+
+type template_segment struct {
+	kind byte
+	text string
+}
+
+const (
+	segment_text    byte = 0
+	segment_month   byte = 'm'
+	segment_day     byte = 'd'
+	segment_year    byte = 'y'
+	segment_weekday byte = 'w'
+	segment_plugin  byte = 'p'
+)
+
+// template_node is a run of segments, or a conditional choosing between two lists of nodes.
+type template_node struct {
+	segments []template_segment
+	cond     func(class int) bool
+	then     []template_node
+	orElse   []template_node
+}
+
+var template_action = regexp.MustCompile(`\{\{\s*([^}]*?)\s*\}\}`)
+
+// Load_Template compiles the template of a journal, or log_format when it has none.
+//
+// If the template cannot be read or compiled, the error is logged and Load_Template returns
+// nil, false.
+func Load_Template(dir string) (*Template, bool) {
+	data, err := os.ReadFile(State_Path(dir, template_name))
+	if os.IsNotExist(err) {
+		return Default_Template(), true
+	}
+	if err != nil {
+		errlog.Print(err)
+
+		return nil, false
+	}
+
+	tmpl, err := Compile_Template(string(data), func(name string) (string, error) {
+		partial, err := os.ReadFile(State_Path(dir, templates_dir, filepath.Base(name)))
+
+		return string(partial), err
+	})
+	if err != nil {
+		errlog.Print(err)
+
+		return nil, false
+	}
+
+	return tmpl, true
+}
+
+// Default_Template returns log_format as a template.
+func Default_Template() *Template {
+	tmpl, err := Compile_Template(fmt.Sprintf(log_format, "{{month}}", "{{day}}", "{{year}}"), nil)
+	if err != nil {
+		panic(err)
+	}
+
+	return tmpl
+}
+
+// Compile_Template compiles a template, reading the partials it includes through include.
+//
+// A template is text with {{month}}, {{day}}, {{year}}, {{weekday}} and {{plugin name}} fields.
+// Lines holding only {{include name}}, {{if condition}}, {{else if condition}}, {{else}} or
+// {{end}} are directives and leave nothing in the output. A condition is a list of terms joined
+// by or, each optionally preceded by not: a weekday (mon or monday), weekend, workday, a month
+// (jan or january), first-of-month or last-of-month.
+func Compile_Template(source string, include func(name string) (string, error)) (*Template, error) {
+	lines, err := expand_includes(source, include, 0)
+	if err != nil {
+		return nil, err
+	}
+
+	tmpl := &Template{placed: make(map[string]bool)}
+
+	nodes, rest, err := tmpl.parse(lines, false)
+	if err == nil && len(rest) > 0 {
+		err = fmt.Errorf("template: %s without {{if}}", strings.TrimSpace(rest[0]))
+	}
+	if err != nil {
+		return nil, err
+	}
+
+	index := make(map[string]uint8)
+	for class := 0; class < template_classes; class++ {
+		segments := flatten(nodes, class, nil)
+
+		var key strings.Builder
+		for _, s := range segments {
+			key.WriteByte(s.kind)
+			key.WriteString(s.text)
+			key.WriteByte(0)
+		}
+
+		variant, ok := index[key.String()]
+		if !ok {
+			if len(tmpl.variants) == 256 {
+				return nil, fmt.Errorf("template has too many variants")
+			}
+
+			variant = uint8(len(tmpl.variants))
+			index[key.String()] = variant
+			tmpl.variants = append(tmpl.variants, segments)
+		}
+
+		tmpl.table[class] = variant
+	}
+
+	debug.Printf("compiled template into %d variants\n", len(tmpl.variants))
+
+	return tmpl, nil
+}
+
+// expand_includes splits a template into lines, replacing include directives by the lines of
+// the partial they name.
+func expand_includes(source string, include func(name string) (string, error), depth int) ([]string, error) {
+	if depth > template_max_depth {
+		return nil, fmt.Errorf("template includes nest deeper than %d", template_max_depth)
+	}
+
+	lines := strings.SplitAfter(source, "\n")
+	if lines[len(lines)-1] == "" {
+		lines = lines[:len(lines)-1]
+	}
+
+	var expanded []string
+
+	for _, line := range lines {
+		name, ok := directive(line, "include")
+		if !ok {
+			expanded = append(expanded, line)
+
+			continue
+		}
+
+		if include == nil || name == "" {
+			return nil, fmt.Errorf("template: cannot include %q", name)
+		}
+
+		partial, err := include(name)
+		if err != nil {
+			return nil, fmt.Errorf("template: include %s: %w", name, err)
+		}
+
+		lines, err := expand_includes(partial, include, depth+1)
+		if err != nil {
+			return nil, err
+		}
+
+		expanded = append(expanded, lines...)
+	}
+
+	return expanded, nil
+}
+
+// directive returns the argument of a line holding only the directive {{keyword argument}}.
+func directive(line string, keyword string) (string, bool) {
+	line = strings.TrimSpace(line)
+	if !strings.HasPrefix(line, "{{") || !strings.HasSuffix(line, "}}") {
+		return "", false
+	}
+
+	action := strings.Fields(line[2 : len(line)-2])
+	if len(action) == 0 || action[0] != keyword {
+		return "", false
+	}
+
+	return strings.Trim(strings.Join(action[1:], " "), `"`), true
+}
+
+// parse reads nodes up to a line closing the current block, returning the lines from that one on.
+func (t *Template) parse(lines []string, nested bool) ([]template_node, []string, error) {
+	var nodes []template_node
+
+	for len(lines) > 0 {
+		line := lines[0]
+
+		if _, ok := directive(line, "end"); ok {
+			return nodes, lines, nil
+		}
+		if _, ok := directive(line, "else"); ok {
+			return nodes, lines, nil
+		}
+
+		source, ok := directive(line, "if")
+		if !ok {
+			segments, err := t.segments(line)
+			if err != nil {
+				return nil, nil, err
+			}
+
+			nodes = append(nodes, template_node{segments: segments})
+			lines = lines[1:]
+
+			continue
+		}
+
+		node, rest, err := t.parse_if(source, lines[1:])
+		if err != nil {
+			return nil, nil, err
+		}
+
+		nodes = append(nodes, node)
+		lines = rest
+	}
+
+	if nested {
+		return nil, nil, fmt.Errorf("template: {{if}} without {{end}}")
+	}
+
+	return nodes, nil, nil
+}
+
+// parse_if reads the branches of a conditional whose {{if}} line has been consumed.
+func (t *Template) parse_if(source string, lines []string) (template_node, []string, error) {
+	cond, err := template_condition(source)
+	if err != nil {
+		return template_node{}, nil, err
+	}
+
+	node := template_node{cond: cond}
+
+	node.then, lines, err = t.parse(lines, true)
+	if err != nil {
+		return node, nil, err
+	}
+
+	if rest, ok := directive(lines[0], "else"); ok {
+		if strings.HasPrefix(rest, "if ") {
+			var inner template_node
+
+			inner, lines, err = t.parse_if(strings.TrimPrefix(rest, "if "), lines[1:])
+			node.orElse = []template_node{inner}
+
+			return node, lines, err
+		}
+
+		node.orElse, lines, err = t.parse(lines[1:], true)
+		if err != nil {
+			return node, nil, err
+		}
+
+		if _, ok := directive(lines[0], "end"); !ok {
+			return node, nil, fmt.Errorf("template: {{else}} followed by %s", strings.TrimSpace(lines[0]))
+		}
+	}
+
+	return node, lines[1:], nil
+}
+
+// segments splits a line of text into literal text and fields.
+func (t *Template) segments(line string) ([]template_segment, error) {
+	var segments []template_segment
+
+	for {
+		loc := template_action.FindStringSubmatchIndex(line)
+		if loc == nil {
+			break
+		}
+
+		if loc[0] > 0 {
+			segments = append(segments, template_segment{text: line[:loc[0]]})
+		}
+
+		action := strings.Fields(line[loc[2]:loc[3]])
+
+		switch {
+		case len(action) == 1 && action[0] == "month":
+			segments = append(segments, template_segment{kind: segment_month})
+		case len(action) == 1 && action[0] == "day":
+			segments = append(segments, template_segment{kind: segment_day})
+		case len(action) == 1 && action[0] == "year":
+			segments = append(segments, template_segment{kind: segment_year})
+		case len(action) == 1 && action[0] == "weekday":
+			segments = append(segments, template_segment{kind: segment_weekday})
+		case len(action) == 2 && action[0] == "plugin":
+			name := strings.Trim(action[1], `"`)
+			t.placed[name] = true
+			segments = append(segments, template_segment{kind: segment_plugin, text: name})
+		default:
+			return nil, fmt.Errorf("template: unknown field %s", line[loc[0]:loc[1]])
+		}
+
+		line = line[loc[1]:]
+	}
+
+	if line != "" {
+		segments = append(segments, template_segment{text: line})
+	}
+
+	return segments, nil
+}
+
+// template_condition compiles a condition into a test on date classes.
+func template_condition(source string) (func(class int) bool, error) {
+	var terms []func(class int) bool
+
+	for _, alternative := range strings.Split(source, " or ") {
+		words := strings.Fields(strings.ToLower(alternative))
+
+		negate := len(words) == 2 && words[0] == "not"
+		if negate {
+			words = words[1:]
+		}
+
+		if len(words) != 1 {
+			return nil, fmt.Errorf("template: invalid condition %q", source)
+		}
+
+		var term func(class int) bool
+
+		weekday, isWeekday := weekday_names[words[0]]
+		month, isMonth := month_names[words[0]]
+
+		switch {
+		case isWeekday:
+			term = func(class int) bool { return class/36 == int(weekday) }
+		case isMonth:
+			term = func(class int) bool { return class/3%12 == int(month)-1 }
+		case words[0] == "weekend":
+			term = func(class int) bool { return class/36 == 0 || class/36 == 6 }
+		case words[0] == "workday":
+			term = func(class int) bool { return class/36 != 0 && class/36 != 6 }
+		case words[0] == "first-of-month":
+			term = func(class int) bool { return class%3 == 1 }
+		case words[0] == "last-of-month":
+			term = func(class int) bool { return class%3 == 2 }
+		default:
+			return nil, fmt.Errorf("template: unknown condition %q", words[0])
+		}
+
+		if negate {
+			positive := term
+			term = func(class int) bool { return !positive(class) }
+		}
+
+		terms = append(terms, term)
+	}
+
+	return func(class int) bool {
+		for _, term := range terms {
+			if term(class) {
+				return true
+			}
+		}
+
+		return false
+	}, nil
+}
+
+// flatten evaluates the conditionals of a node list for a class, merging adjacent text.
+func flatten(nodes []template_node, class int, out []template_segment) []template_segment {
+	for _, node := range nodes {
+		if node.cond != nil {
+			if node.cond(class) {
+				out = flatten(node.then, class, out)
+			} else {
+				out = flatten(node.orElse, class, out)
+			}
+
+			continue
+		}
+
+		for _, s := range node.segments {
+			if n := len(out); s.kind == segment_text && n > 0 && out[n-1].kind == segment_text {
+				out[n-1].text += s.text
+			} else {
+				out = append(out, s)
+			}
+		}
+	}
+
+	return out
+}
+
+// Template_Class returns the class of a date.
+func Template_Class(date time.Time) int {
+	position := 0
+	switch {
+	case date.Day() == 1:
+		position = 1
+	case date.AddDate(0, 0, 1).Day() == 1:
+		position = 2
+	}
+
+	return (int(date.Weekday())*12+int(date.Month())-1)*3 + position
+}
+
+// Render appends the skeleton of a date to buf.
+//
+// If a plugin placed in the template fails, the error is returned along with buf as it was.
+func (t *Template) Render(buf []byte, date time.Time) ([]byte, error) {
+	start := len(buf)
+
+	for _, s := range t.variants[t.table[Template_Class(date)]] {
+		switch s.kind {
+		case segment_text:
+			buf = append(buf, s.text...)
+		case segment_month:
+			buf = append_padded(buf, int(date.Month()), 2)
+		case segment_day:
+			buf = append_padded(buf, date.Day(), 2)
+		case segment_year:
+			buf = append_padded(buf, date.Year(), 4)
+		case segment_weekday:
+			buf = append(buf, date.Weekday().String()...)
+		case segment_plugin:
+			p := Find_Plugin(s.text)
+			if p == nil || !p.hasRender {
+				return buf[:start], fmt.Errorf("template: no plugin %s exporting %s", s.text, plugin_render)
+			}
+
+			text, err := p.Render(date)
+			if err != nil {
+				return buf[:start], fmt.Errorf("plugin %s: %w", p.Name, err)
+			}
+
+			buf = append(buf, text...)
+		}
+	}
+
+	return buf, nil
+}
+
+// Placed reports whether the template says where the text of a plugin goes.
+func (t *Template) Placed(name string) bool {
+	return t.placed[name]
+}
+
+// append_padded appends a non-negative number with leading zeros up to width digits.
+func append_padded(buf []byte, value int, width int) []byte {
+	var digits [20]byte
+
+	i := len(digits)
+	for value > 0 || i > len(digits)-width {
+		i--
+		digits[i] = byte('0' + value%10)
+		value /= 10
+	}
+
+	return append(buf, digits[i:]...)
+}
+
+// Skeleton_Patcher renders the skeletons of many dates quickly. The first date of every variant
+// and weekday is rendered in full while the offsets of its month, day and year are recorded; the
+// skeletons of other dates are copies of that rendering with the digits patched in place. Fields
+// whose width varies from one date to another, the text of plugins, leave the variant to full
+// rendering.
+type Skeleton_Patcher struct {
+	t     *Template
+	bases map[int]*template_base
+}
+
+type template_base struct {
+	data      []byte
+	slots     []template_slot
+	patchable bool
+}
+
+// template_slot is the offset of a date field in a pre-rendered skeleton.
+type template_slot struct {
+	offset int
+	kind   byte
+}
+
+// New_Patcher returns a patcher rendering the skeletons of t.
+func (t *Template) New_Patcher() *Skeleton_Patcher {
+	return &Skeleton_Patcher{t: t, bases: make(map[int]*template_base)}
+}
+
+// Render appends the skeleton of a date to buf, as Template.Render does.
+func (sp *Skeleton_Patcher) Render(buf []byte, date time.Time) ([]byte, error) {
+	// years past 9999 take more than the four digits of their slot
+	if date.Year() > 9999 {
+		return sp.t.Render(buf, date)
+	}
+
+	variant := int(sp.t.table[Template_Class(date)])
+	key := variant*7 + int(date.Weekday())
+
+	base := sp.bases[key]
+	if base == nil {
+		base = sp.t.prerender(variant, date)
+		sp.bases[key] = base
+	}
+
+	if !base.patchable {
+		return sp.t.Render(buf, date)
+	}
+
+	start := len(buf)
+	buf = append(buf, base.data...)
+	out := buf[start:]
+
+	for _, slot := range base.slots {
+		switch slot.kind {
+		case segment_month:
+			patch_digits(out[slot.offset:slot.offset+2], int(date.Month()))
+		case segment_day:
+			patch_digits(out[slot.offset:slot.offset+2], date.Day())
+		case segment_year:
+			patch_digits(out[slot.offset:slot.offset+4], date.Year())
+		}
+	}
+
+	return buf, nil
+}
+
+// prerender renders a variant of the template for a date, recording where its date fields are.
+func (t *Template) prerender(variant int, date time.Time) *template_base {
+	base := &template_base{patchable: true}
+
+	for _, s := range t.variants[variant] {
+		switch s.kind {
+		case segment_text:
+			base.data = append(base.data, s.text...)
+		case segment_month:
+			base.slots = append(base.slots, template_slot{offset: len(base.data), kind: s.kind})
+			base.data = append_padded(base.data, int(date.Month()), 2)
+		case segment_day:
+			base.slots = append(base.slots, template_slot{offset: len(base.data), kind: s.kind})
+			base.data = append_padded(base.data, date.Day(), 2)
+		case segment_year:
+			base.slots = append(base.slots, template_slot{offset: len(base.data), kind: s.kind})
+			base.data = append_padded(base.data, date.Year(), 4)
+		case segment_weekday:
+			// the weekday is part of the key of the rendering
+			base.data = append(base.data, date.Weekday().String()...)
+		default:
+			return &template_base{}
+		}
+	}
+
+	return base
+}
+
+// patch_digits overwrites dst with value, padded with leading zeros.
+func patch_digits(dst []byte, value int) {
+	for i := len(dst) - 1; i >= 0; i-- {
+		dst[i] = byte('0' + value%10)
+		value /= 10
+	}
+}
@@ -0,0 +1,118 @@
+package main
+
+import (
+	"os"
+	"path/filepath"
+	"runtime"
+	"strings"
+	"time"
+)
+
+// today_name is a symlink in the journal that always points at the logfile for today.
+const today_name string = "today.log"
+
+// Update_Today_Link points today.log at the logfile for date, replacing the link atomically by
+// renaming a fresh link over it, so readers never see it missing. A link already pointing there
+// is left alone. Windows, where links need privileges, has no today.log.
+//
+// If the link cannot be replaced, the error is logged and Update_Today_Link returns false.
+func Update_Today_Link(dir string, date time.Time) bool {
+	if runtime.GOOS == "windows" {
+		return true
+	}
+
+	target := Log_Name(pad(int(date.Month()), 2), pad(date.Day(), 2), pad(date.Year(), 4))
+	link := filepath.Join(dir, today_name)
+
+	if current, err := os.Readlink(link); err == nil && current == target {
+		return true
+	}
+
+	debug.Printf("pointing %s at %s\n", link, target)
+
+	tmp := filepath.Join(dir, "."+today_name+".tmp"+pad(os.Getpid(), 1))
+	os.Remove(tmp)
+
+	err := os.Symlink(target, tmp)
+	if err == nil {
+		err = os.Rename(tmp, link)
+	}
+	if err != nil {
+		os.Remove(tmp)
+		errlog.Print(err)
+
+		return false
+	}
+
+	return true
+}
+
+// Open creates the logfile for a date if it does not exist yet, or decompresses it when it is
+// stored compressed, and replaces touchlog with the editor named by VISUAL or EDITOR, so the
+// editor starts as if run directly.
+//
+// If the logfile cannot be created or the editor cannot be started, the error is logged and Open
+// returns false. Otherwise, Open does not return.
+func Open(args []string) bool {
+	fs, verbosePtr := New_FlagSet("open")
+	outDirPtr := fs.String("outdir", "", "open the logfile in the inputted directory")
+	datePtr := fs.String("date", "", "open the logfile for the supplied mmddyyyy date")
+	fs.Parse(args)
+
+	Set_Verbosity(*verbosePtr)
+
+	if fs.NArg() != 0 {
+		errlog.Println("usage: touchlog open [-verbose] [-outdir dir] [-date mmddyyyy]")
+
+		return false
+	}
+
+	editor := os.Getenv("VISUAL")
+	if editor == "" {
+		editor = os.Getenv("EDITOR")
+	}
+	if editor == "" {
+		editor = "vi"
+	}
+
+	if !Resolve_Outdir(outDirPtr) {
+		return false
+	}
+
+	// Handle_Date fills in today's date when none is given, so tell the two apart before it does
+	noDate := *datePtr == ""
+
+	month, day, year, result := Handle_Date(datePtr)
+	if !result {
+		return false
+	}
+
+	filename := Log_Name(month, day, year)
+	path := filepath.Join(*outDirPtr, filename)
+
+	// a compressed day is stored as is again, so that any editor can edit it
+	if _, err := os.Lstat(path); os.IsNotExist(err) {
+		if data, ext, err := read_log(*outDirPtr, filename); err == nil && ext != "" {
+			if !Save_Log(*outDirPtr, filename, data) {
+				return false
+			}
+		} else if !Create_Logs(*outDirPtr, func() bool { return Write(filename, outDirPtr, month, day, year) }) {
+			return false
+		}
+	}
+
+	if noDate && !Update_Today_Link(*outDirPtr, time.Now()) {
+		return false
+	}
+
+	argv := append(strings.Fields(editor), path)
+
+	debug.Printf("starting %q\n", argv)
+
+	Flush_Output()
+
+	err := exec_editor(argv)
+	errlog.Print(err)
+
+	return false
+}
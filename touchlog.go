@@ -4,10 +4,13 @@ import (
 	"bytes"
 	"flag"
 	"fmt"
+	"io"
 	"log"
 	"os"
 	"path/filepath"
 	"strconv"
+	"strings"
+	"sync"
 	"time"
 )
 
@@ -25,28 +28,113 @@ func main() {
 }
 
 var verbosity bool
-var buf bytes.Buffer
-var nilbuf bytes.Buffer
-var debug = log.New(&nilbuf, "touchlog-verbose > ", debug_flags)
+var buf locked_buffer
+var debug = log.New(io.Discard, "touchlog-verbose > ", debug_flags)
 var errlog = log.New(&buf, "touchlog-error > ", debug_flags)
 var print = log.New(&buf, "", 0)
 
+// locked_buffer collects the output touchlog prints when it exits. Commands doing work in
+// goroutines log from all of them at once, so writes are serialized.
+type locked_buffer struct {
+	mu  sync.Mutex
+	buf bytes.Buffer
+}
+
+func (b *locked_buffer) Write(p []byte) (int, error) {
+	b.mu.Lock()
+	defer b.mu.Unlock()
+
+	return b.buf.Write(p)
+}
+
+func (b *locked_buffer) String() string {
+	b.mu.Lock()
+	defer b.mu.Unlock()
+
+	return b.buf.String()
+}
+
+// Flush_Output prints what has been collected so far, for commands that never return to print it.
+func Flush_Output() {
+	buf.mu.Lock()
+	defer buf.mu.Unlock()
+
+	os.Stdout.Write(buf.buf.Bytes())
+	buf.buf.Reset()
+}
+
+// Stream_Output prints what has been collected so far and sends everything logged from then on
+// straight to standard output, for commands that run until they are interrupted.
+func Stream_Output() {
+	Flush_Output()
+
+	errlog.SetOutput(os.Stdout)
+	print.SetOutput(os.Stdout)
+	if verbosity {
+		debug.SetOutput(os.Stdout)
+	}
+}
+
+// Stderr_Output prints what has been collected so far and sends everything logged from then on
+// straight to standard error, for commands whose standard output only carries data.
+func Stderr_Output() {
+	Flush_Output()
+
+	errlog.SetOutput(os.Stderr)
+	print.SetOutput(os.Stderr)
+	if verbosity {
+		debug.SetOutput(os.Stderr)
+	}
+}
+
+// commands maps a subcommand name to the function handling the rest of the command line. Running
+// touchlog without a subcommand creates a logfile, as it always has.
+var commands map[string]func(args []string) bool
+
+func init() {
+	commands = map[string]func(args []string) bool{
+		"backup":    Backup,
+		"batch":     Batch,
+		"complete":  Complete,
+		"daemon":    Run_Daemon,
+		"du":        Du,
+		"export":    Export,
+		"fix":       Fix,
+		"search":    Search,
+		"serve":     Serve,
+		"history":   History,
+		"lint":      Lint,
+		"onthisday": On_This_Day,
+		"open":      Open,
+		"prune":     Prune,
+		"restore":   Restore,
+		"sync":      Sync,
+		"tail":      Tail,
+	}
+}
+
 // Touchlog parses the user input from the command line and then creates a logfile for the desired
 // date.
 func Touchlog() bool {
 	defer fmt.Print(&buf)
+
+	if len(os.Args) > 1 {
+		if command, ok := commands[os.Args[1]]; ok {
+			return command(os.Args[2:])
+		}
+	}
+
 	datePtr := flag.String("date", "", "a logfile is created with the supplied date")
 	outDirPtr := flag.String("outdir", "", "write the logfile to inputted directory")
 	versionPtr := flag.Bool("version", false, "display the version information")
 	verbosePtr := flag.Bool("verbose", false, "enable verbosity mode")
+	untilPtr := flag.String("until", "", "also create logfiles for every date after -date through this date")
+	gitPtr := flag.Bool("git", false, "commit the written logfiles to the git repository holding outdir")
+	gitIntervalPtr := flag.Duration("git-interval", 0, "stage logfiles but commit at most once per interval")
 
 	flag.Parse()
 
-	// store the verbosity setting
-	verbosity = *verbosePtr
-	if verbosity {
-		debug = log.New(&buf, "touchlog-verbose > ", debug_flags)
-	}
+	Set_Verbosity(*verbosePtr)
 
 	if *versionPtr {
 		debug.Println("printing version information")
@@ -80,16 +168,186 @@ func Touchlog() bool {
 		return false
 	}
 
-	filename := *datePtr + ".log"
+	result = Create_Logs(*outDirPtr, func() bool {
+		if *gitPtr || *gitIntervalPtr > 0 {
+			git_batch, result = Open_Git_Batch(*outDirPtr, *gitIntervalPtr)
+			if !result {
+				return false
+			}
+		}
+
+		if *untilPtr != "" {
+			result = Write_Range(outDirPtr, month, day, year, untilPtr)
+		} else {
+			filename := Log_Name(month, day, year)
+
+			debug.Printf("filename to use: %s", filename)
+			debug.Printf("normalized outdir: %s", *outDirPtr)
+
+			result = Write(filename, outDirPtr, month, day, year)
+		}
+
+		if git_batch != nil {
+			result = git_batch.Commit() && result
+		}
+
+		return result
+	})
+
+	return Update_Today_Link(*outDirPtr, time.Now()) && result
+}
+
+// Create_Logs runs write with the hooks, plugins, template and quota of a journal in place, and
+// lets the hooks deliver their events before returning.
+//
+// If write succeeds, Create_Logs returns true.
+// Otherwise, the error is logged and Create_Logs returns false.
+func Create_Logs(dir string, write func() bool) bool {
+	var result bool
+
+	hook_pools, result = Start_Hooks(dir)
+	if !result {
+		return false
+	}
+
+	defer Stop_Hooks(hook_pools)
+
+	plugins, result = Load_Plugins(dir)
+	if !result {
+		return false
+	}
+
+	log_template, result = Load_Template(dir)
+	if !result {
+		return false
+	}
+
+	journal_quota, result = Start_Quota(dir)
+	if !result {
+		return false
+	}
+
+	result = write()
+
+	if journal_quota != nil {
+		result = Save_Index(journal_quota.idx) && result
+	}
+
+	return result
+}
 
-	debug.Printf("filename to use: %s", filename)
-	debug.Printf("normalized outdir: %s", *outDirPtr)
+// Write_Range writes a logfile for every date from the parsed month, day and year through the
+// mmddyyyy date untilPtr points to. The template is rendered once per variant and patched with
+// the digits of every date.
+//
+// If every logfile is successfully written, Write_Range returns true.
+// Otherwise, the error is logged and Write_Range returns false at the first failure.
+func Write_Range(outDirPtr *string, month string, day string, year string, untilPtr *string) bool {
+	debug.Printf("Write_Range(%s, %s%s%s, %s)\n", *outDirPtr, month, day, year, *untilPtr)
 
-	Write(filename, outDirPtr, month, day, year)
+	untilMonth, untilDay, untilYear, result := Handle_Date(untilPtr)
+	if !result {
+		return false
+	}
+
+	start, result := To_Time(month, day, year)
+	if !result {
+		return false
+	}
+
+	end, result := To_Time(untilMonth, untilDay, untilYear)
+	if !result {
+		return false
+	}
+
+	if end.Before(start) {
+		errlog.Printf("-until %s is before the start date\n", *untilPtr)
+
+		return false
+	}
+
+	if log_template == nil {
+		log_template = Default_Template()
+	}
+
+	bulk_skeletons = log_template.New_Patcher()
+	defer func() {
+		bulk_skeletons = nil
+	}()
+
+	count := 0
+	for date := start; !date.After(end); date = date.AddDate(0, 0, 1) {
+		month, day, year = pad(int(date.Month()), 2), pad(date.Day(), 2), pad(date.Year(), 4)
+
+		if !Write(Log_Name(month, day, year), outDirPtr, month, day, year) {
+			return false
+		}
+
+		count++
+	}
+
+	debug.Printf("wrote %d logfiles\n", count)
 
 	return true
 }
 
+// To_Time converts a padded month, day and year into a date at midnight local time.
+//
+// If the fields are not numbers, the error is logged and To_Time returns the zero time, false.
+func To_Time(month string, day string, year string) (time.Time, bool) {
+	m, err1 := strconv.Atoi(month)
+	d, err2 := strconv.Atoi(day)
+	y, err3 := strconv.Atoi(year)
+	if err1 != nil || err2 != nil || err3 != nil {
+		errlog.Printf("invalid date: %s-%s-%s\n", month, day, year)
+
+		return time.Time{}, false
+	}
+
+	return time.Date(y, time.Month(m), d, 0, 0, 0, 0, time.Local), true
+}
+
+// Set_Verbosity stores the verbosity setting and, when enabled, routes debug output to the
+// output buffer.
+func Set_Verbosity(verbose bool) {
+	verbosity = verbose
+	if verbosity {
+		debug = log.New(&buf, "touchlog-verbose > ", debug_flags)
+	}
+}
+
+// New_FlagSet creates the flag set for a subcommand with the options every subcommand shares.
+func New_FlagSet(name string) (fs *flag.FlagSet, verbosePtr *bool) {
+	fs = flag.NewFlagSet("touchlog "+name, flag.ExitOnError)
+	verbosePtr = fs.Bool("verbose", false, "enable verbosity mode")
+
+	return
+}
+
+// Log_Name returns the name of the logfile for a padded month, day and year.
+func Log_Name(month string, day string, year string) string {
+	return month + "-" + day + "-" + year + ".log"
+}
+
+// Parse_Log_Name reverses Log_Name, returning the numeric month, day and year of a logfile name.
+//
+// If the name is not a logfile name, Parse_Log_Name returns 0, 0, 0, false.
+func Parse_Log_Name(name string) (month int, day int, year int, ok bool) {
+	if len(name) != len("mm-dd-yyyy.log") || !strings.HasSuffix(name, ".log") ||
+		name[2] != '-' || name[5] != '-' {
+		return 0, 0, 0, false
+	}
+
+	month, err1 := strconv.Atoi(name[0:2])
+	day, err2 := strconv.Atoi(name[3:5])
+	year, err3 := strconv.Atoi(name[6:10])
+	if err1 != nil || err2 != nil || err3 != nil {
+		return 0, 0, 0, false
+	}
+
+	return month, day, year, true
+}
+
 func pad(val int, length int) string {
 	debug.Printf("pad(%v, %v)\n", val, length)
 
@@ -247,44 +505,78 @@ func Normalize(outDirPtr *string) bool {
 	return true
 }
 
+// Resolve_Outdir defaults an empty output directory to the current working directory and
+// normalizes it.
+func Resolve_Outdir(outDirPtr *string) bool {
+	if *outDirPtr == "" && !Set_CWD(outDirPtr) {
+		return false
+	}
+
+	return Normalize(outDirPtr)
+}
+
 // Write takes a filename, a pointer to a string representing a directory, the month, the day,
-// the year, writes a logfile to the requested directory.
+// the year, writes a logfile to the requested directory. Any previous content of the logfile is
+// kept in its history.
 //
 // If the logfile is successfully written, Write returns true.
 // Otherwise, the error is logged and Write returns false.
 func Write(filename string, outDirPtr *string, month string, day string, year string) bool {
 	debug.Printf("Write(%v, %v)\n", filename, outDirPtr)
 
-	logfile := filepath.Join(*outDirPtr, filename)
-	f, err := os.Create(logfile)
-	if err != nil {
-		errlog.Print(err)
+	date, result := To_Time(month, day, year)
+	if !result {
+		return false
+	}
 
+	log_data, result := Render_Skeleton(date)
+	if !result {
 		return false
 	}
 
-	debug.Printf("os.Create(%v) -> %v", logfile, f)
+	if journal_quota != nil && !journal_quota.Allow(journal_quota.idx, filename, int64(len(log_data))) {
+		return false
+	}
 
-	defer f.Close()
-	debug.Printf("defer %v.Close()", f)
+	if !Save_Log(*outDirPtr, filename, log_data) {
+		return false
+	}
 
-	log_data := fmt.Sprintf(log_format, month, day, year)
+	if journal_quota != nil && !journal_quota.Track(filename, log_data) {
+		return false
+	}
 
-	n, err := f.WriteString(log_data)
-	if err != nil {
-		errlog.Print(err)
+	debug.Printf("wrote %d bytes\n", len(log_data))
 
-		return false
+	return true
+}
+
+// Render_Skeleton returns what touchlog writes into a new logfile for a date: the template of the
+// journal, or the default one, followed by the text of the rendering plugins it does not place.
+//
+// If the skeleton cannot be rendered, the error is logged and Render_Skeleton returns nil, false.
+func Render_Skeleton(date time.Time) ([]byte, bool) {
+	if log_template == nil {
+		log_template = Default_Template()
 	}
 
-	debug.Printf("wrote %d bytes\n", n)
+	var data []byte
+	var err error
 
-	err = f.Sync()
+	if bulk_skeletons != nil {
+		data, err = bulk_skeletons.Render(nil, date)
+	} else {
+		data, err = log_template.Render(nil, date)
+	}
 	if err != nil {
 		errlog.Print(err)
 
-		return false
+		return nil, false
 	}
 
-	return true
+	if len(plugins) > 0 {
+		return Render_Plugins(date, data)
+	}
+
+	return data, true
 }
@@ -0,0 +1,34 @@
+package main
+
+import (
+	"os"
+	"syscall"
+)
+
+// unlink_dir removes files relative to a descriptor of their directory, so that a batch of
+// removals resolves the directory once rather than once per file.
+type unlink_dir struct {
+	fd int
+}
+
+func open_unlink_dir(dir string) (*unlink_dir, error) {
+	fd, err := syscall.Open(dir, syscall.O_RDONLY|syscall.O_DIRECTORY|syscall.O_CLOEXEC, 0)
+	if err != nil {
+		return nil, &os.PathError{Op: "open", Path: dir, Err: err}
+	}
+
+	return &unlink_dir{fd: fd}, nil
+}
+
+func (d *unlink_dir) unlink(name string) error {
+	err := syscall.Unlinkat(d.fd, name)
+	if err != nil {
+		return &os.PathError{Op: "unlinkat", Path: name, Err: err}
+	}
+
+	return nil
+}
+
+func (d *unlink_dir) close() {
+	syscall.Close(d.fd)
+}
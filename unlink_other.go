@@ -0,0 +1,23 @@
+//go:build !linux
+
+package main
+
+import (
+	"os"
+	"path/filepath"
+)
+
+// unlink_dir removes files of a directory by path where the platform offers no unlinkat.
+type unlink_dir struct {
+	dir string
+}
+
+func open_unlink_dir(dir string) (*unlink_dir, error) {
+	return &unlink_dir{dir: dir}, nil
+}
+
+func (d *unlink_dir) unlink(name string) error {
+	return os.Remove(filepath.Join(d.dir, name))
+}
+
+func (d *unlink_dir) close() {}
@@ -0,0 +1,1619 @@
+package main
+
+import (
+	"bytes"
+	"encoding/binary"
+	"errors"
+	"fmt"
+	"math"
+	"math/bits"
+)
+
+// wasm.go is a small WebAssembly interpreter for plugins. It accepts modules without imports
+// using the MVP instruction set plus sign extension, saturating truncation and bulk memory. At
+// compile time every function body is type checked and decoded once into a flat instruction array
+// with branch targets and stack heights already resolved, so calls only run the dispatch loop.
+
+const wasm_magic string = "\x00asm\x01\x00\x00\x00"
+
+// Limits that keep a plugin from taking the process down with it.
+const wasm_max_pages uint32 = 256
+const wasm_stack_slots int = 1 << 16
+const wasm_max_depth int = 512
+const wasm_fuel int64 = 50_000_000
+
+const wasm_page int = 65536
+
+const (
+	wasm_i32 byte = 0x7F
+	wasm_i64 byte = 0x7E
+	wasm_f32 byte = 0x7D
+	wasm_f64 byte = 0x7C
+)
+
+// Internal operations take numbers above the one byte opcodes they stand next to.
+const (
+	op_br uint16 = 0x100 + iota
+	op_br_if
+	op_br_table
+	op_jump
+	op_jump_if_zero
+	op_fc = 0x200
+)
+
+type wasm_type struct {
+	params  []byte
+	results []byte
+}
+
+type wasm_ins struct {
+	op  uint16
+	a   uint32
+	b   uint32
+	c   uint32
+	imm uint64
+}
+
+type wasm_branch struct {
+	target uint32
+	height uint32
+	arity  uint32
+}
+
+type wasm_func struct {
+	typ       wasm_type
+	nlocals   int
+	maxHeight int
+	code      []wasm_ins
+	tables    [][]wasm_branch
+	body      []byte
+	locals    []byte
+}
+
+type wasm_global struct {
+	typ     byte
+	mutable bool
+	value   uint64
+}
+
+type wasm_data struct {
+	offset int64
+	active bool
+	bytes  []byte
+}
+
+// Wasm_Module is a decoded and compiled module, ready to be instantiated.
+type Wasm_Module struct {
+	types    []wasm_type
+	funcs    []*wasm_func
+	table    []int32
+	minPages uint32
+	maxPages uint32
+	hasMem   bool
+	globals  []wasm_global
+	exports  map[string]uint32
+	start    int
+	data     []wasm_data
+}
+
+// Wasm_Instance is a module with its own memory, globals and stack.
+type Wasm_Instance struct {
+	module  *Wasm_Module
+	memory  []byte
+	maxMem  uint32
+	globals []uint64
+	table   []int32
+	data    [][]byte
+	stack   []uint64
+	depth   int
+	fuel    int64
+}
+
+type wasm_trap struct {
+	reason string
+}
+
+func trap(format string, args ...any) {
+	panic(wasm_trap{reason: fmt.Sprintf(format, args...)})
+}
+
+type wasm_reader struct {
+	data []byte
+	pos  int
+}
+
+func (r *wasm_reader) fail(what string) {
+	panic(wasm_trap{reason: fmt.Sprintf("malformed module: %s at byte %d", what, r.pos)})
+}
+
+func (r *wasm_reader) byte() byte {
+	if r.pos >= len(r.data) {
+		r.fail("unexpected end")
+	}
+
+	b := r.data[r.pos]
+	r.pos++
+
+	return b
+}
+
+func (r *wasm_reader) bytes(n int) []byte {
+	if n < 0 || r.pos+n > len(r.data) {
+		r.fail("unexpected end")
+	}
+
+	b := r.data[r.pos : r.pos+n]
+	r.pos += n
+
+	return b
+}
+
+func (r *wasm_reader) u32() uint32 {
+	var result uint64
+	for shift := 0; ; shift += 7 {
+		b := r.byte()
+		result |= uint64(b&0x7f) << shift
+		if b&0x80 == 0 {
+			break
+		}
+		if shift >= 28 {
+			r.fail("leb128 too long")
+		}
+	}
+
+	if result > math.MaxUint32 {
+		r.fail("leb128 out of range")
+	}
+
+	return uint32(result)
+}
+
+func (r *wasm_reader) signed(size int) int64 {
+	var result int64
+	shift := 0
+
+	for {
+		b := r.byte()
+		result |= int64(b&0x7f) << shift
+		shift += 7
+
+		if b&0x80 == 0 {
+			if shift < 64 && b&0x40 != 0 {
+				result |= -1 << shift
+			}
+
+			break
+		}
+
+		if shift >= size+7 {
+			r.fail("leb128 too long")
+		}
+	}
+
+	return result
+}
+
+// Compile_Wasm decodes a module and compiles all of its functions.
+func Compile_Wasm(data []byte) (module *Wasm_Module, err error) {
+	defer func() {
+		if r := recover(); r != nil {
+			module, err = nil, fmt.Errorf("malformed module: %v", r)
+			if t, ok := r.(wasm_trap); ok {
+				module, err = nil, errors.New(t.reason)
+			}
+		}
+	}()
+
+	if !bytes.HasPrefix(data, []byte(wasm_magic)) {
+		return nil, errors.New("not a WebAssembly 1.0 module")
+	}
+
+	m := &Wasm_Module{exports: make(map[string]uint32), start: -1}
+	r := &wasm_reader{data: data, pos: len(wasm_magic)}
+
+	var funcTypes []uint32
+
+	for r.pos < len(data) {
+		id := r.byte()
+		size := r.u32()
+		s := &wasm_reader{data: r.bytes(int(size))}
+
+		switch id {
+		case 0:
+			// custom sections carry names and debug information only
+		case 1:
+			for n := s.u32(); n > 0; n-- {
+				if s.byte() != 0x60 {
+					s.fail("function type")
+				}
+
+				var t wasm_type
+				t.params = append([]byte(nil), s.bytes(int(s.u32()))...)
+				t.results = append([]byte(nil), s.bytes(int(s.u32()))...)
+				for _, v := range append(t.params, t.results...) {
+					if !is_value_type(v) {
+						s.fail("value type")
+					}
+				}
+
+				m.types = append(m.types, t)
+			}
+		case 2:
+			if s.u32() > 0 {
+				return nil, errors.New("plugins may not import anything")
+			}
+		case 3:
+			for n := s.u32(); n > 0; n-- {
+				funcTypes = append(funcTypes, s.u32())
+			}
+		case 4:
+			for n := s.u32(); n > 0; n-- {
+				s.byte()
+				min, _ := read_limits(s)
+				m.table = make([]int32, min)
+				for i := range m.table {
+					m.table[i] = -1
+				}
+			}
+		case 5:
+			if s.u32() > 0 {
+				m.hasMem = true
+				m.minPages, m.maxPages = read_limits(s)
+			}
+		case 6:
+			for n := s.u32(); n > 0; n-- {
+				g := wasm_global{typ: s.byte(), mutable: s.byte() == 1}
+				if !is_value_type(g.typ) {
+					s.fail("global type")
+				}
+
+				g.value = uint64(m.const_expr(s))
+				m.globals = append(m.globals, g)
+			}
+		case 7:
+			for n := s.u32(); n > 0; n-- {
+				name := string(s.bytes(int(s.u32())))
+				kind := s.byte()
+				index := s.u32()
+				if kind == 0 {
+					m.exports[name] = index
+				}
+			}
+		case 8:
+			m.start = int(s.u32())
+		case 9:
+			for n := s.u32(); n > 0; n-- {
+				flags := s.u32()
+				switch flags {
+				case 0, 2:
+					if flags == 2 && s.u32() != 0 {
+						s.fail("element table")
+					}
+
+					offset := m.const_expr(s)
+					if flags == 2 && s.byte() != 0 {
+						s.fail("element kind")
+					}
+
+					for k := s.u32(); k > 0; k-- {
+						if offset < 0 || int(offset) >= len(m.table) {
+							return nil, errors.New("element segment outside of the table")
+						}
+
+						m.table[offset] = int32(s.u32())
+						offset++
+					}
+				case 1, 3:
+					// passive and declarative segments are only used by table instructions
+					s.byte()
+					for k := s.u32(); k > 0; k-- {
+						s.u32()
+					}
+				default:
+					return nil, fmt.Errorf("element segment kind %d is not supported", flags)
+				}
+			}
+		case 10:
+			count := int(s.u32())
+			if count != len(funcTypes) {
+				s.fail("code count")
+			}
+
+			for i := 0; i < count; i++ {
+				body := s.bytes(int(s.u32()))
+				if int(funcTypes[i]) >= len(m.types) {
+					s.fail("function type index")
+				}
+
+				m.funcs = append(m.funcs, &wasm_func{typ: m.types[funcTypes[i]], body: body})
+			}
+		case 11:
+			for n := s.u32(); n > 0; n-- {
+				var d wasm_data
+
+				switch s.u32() {
+				case 0:
+					d.active, d.offset = true, m.const_expr(s)
+				case 1:
+				case 2:
+					s.u32()
+					d.active, d.offset = true, m.const_expr(s)
+				default:
+					s.fail("data segment")
+				}
+
+				d.bytes = s.bytes(int(s.u32()))
+				m.data = append(m.data, d)
+			}
+		case 12:
+			s.u32()
+		default:
+			return nil, fmt.Errorf("unknown section %d", id)
+		}
+	}
+
+	for _, f := range m.funcs {
+		m.compile(f)
+	}
+
+	if m.start >= len(m.funcs) || m.start >= 0 && len(m.funcs[m.start].typ.params) > 0 {
+		return nil, errors.New("start function must exist and take no arguments")
+	}
+
+	return m, nil
+}
+
+func read_limits(r *wasm_reader) (min uint32, max uint32) {
+	flags := r.byte()
+	min, max = r.u32(), math.MaxUint32
+	if flags&1 != 0 {
+		max = r.u32()
+	}
+
+	return min, max
+}
+
+// const_expr evaluates the constant expression initializing a global or a segment offset.
+func (m *Wasm_Module) const_expr(r *wasm_reader) int64 {
+	var value int64
+
+	switch op := r.byte(); op {
+	case 0x41:
+		value = int64(uint32(r.signed(32)))
+	case 0x42:
+		value = r.signed(64)
+	case 0x43:
+		value = int64(binary.LittleEndian.Uint32(r.bytes(4)))
+	case 0x44:
+		value = int64(binary.LittleEndian.Uint64(r.bytes(8)))
+	case 0x23:
+		index := r.u32()
+		if int(index) >= len(m.globals) {
+			r.fail("global index")
+		}
+
+		value = int64(m.globals[index].value)
+	default:
+		r.fail(fmt.Sprintf("constant expression opcode 0x%x", op))
+	}
+
+	if r.byte() != 0x0B {
+		r.fail("constant expression end")
+	}
+
+	return value
+}
+
+type wasm_ctrl struct {
+	loop        bool
+	start       int
+	height      int
+	params      []byte
+	results     []byte
+	patches     []int
+	tablePatch  [][2]int
+	elseJump    int
+	unreachable bool
+}
+
+// labels returns the types of the values a branch to the block carries.
+func (c *wasm_ctrl) labels() []byte {
+	if c.loop {
+		return c.params
+	}
+
+	return c.results
+}
+
+func is_value_type(t byte) bool {
+	return t >= wasm_f64 && t <= wasm_i32
+}
+
+// Types of the values loaded by the instructions from 0x28 and stored by those from 0x36.
+var wasm_load_types = []byte{
+	wasm_i32, wasm_i64, wasm_f32, wasm_f64,
+	wasm_i32, wasm_i32, wasm_i32, wasm_i32,
+	wasm_i64, wasm_i64, wasm_i64, wasm_i64, wasm_i64, wasm_i64,
+}
+var wasm_store_types = []byte{
+	wasm_i32, wasm_i64, wasm_f32, wasm_f64,
+	wasm_i32, wasm_i32, wasm_i64, wasm_i64, wasm_i64,
+}
+
+// Operand and result types of the conversions from 0xA7 to 0xC4.
+var wasm_conversions = [][2]byte{
+	{wasm_i64, wasm_i32}, {wasm_f32, wasm_i32}, {wasm_f32, wasm_i32}, {wasm_f64, wasm_i32}, {wasm_f64, wasm_i32},
+	{wasm_i32, wasm_i64}, {wasm_i32, wasm_i64}, {wasm_f32, wasm_i64}, {wasm_f32, wasm_i64}, {wasm_f64, wasm_i64},
+	{wasm_f64, wasm_i64}, {wasm_i32, wasm_f32}, {wasm_i32, wasm_f32}, {wasm_i64, wasm_f32}, {wasm_i64, wasm_f32},
+	{wasm_f64, wasm_f32}, {wasm_i32, wasm_f64}, {wasm_i32, wasm_f64}, {wasm_i64, wasm_f64}, {wasm_i64, wasm_f64},
+	{wasm_f32, wasm_f64}, {wasm_f32, wasm_i32}, {wasm_f64, wasm_i64}, {wasm_i32, wasm_f32}, {wasm_i64, wasm_f64},
+	{wasm_i32, wasm_i32}, {wasm_i32, wasm_i32}, {wasm_i64, wasm_i64}, {wasm_i64, wasm_i64}, {wasm_i64, wasm_i64},
+}
+
+// numeric_signature returns the type of the operands of a numeric instruction between 0x45 and
+// 0xC4, how many it takes and the type of its result.
+func numeric_signature(op byte) (in byte, n int, out byte) {
+	switch {
+	case op == 0x45:
+		return wasm_i32, 1, wasm_i32
+	case op <= 0x4F:
+		return wasm_i32, 2, wasm_i32
+	case op == 0x50:
+		return wasm_i64, 1, wasm_i32
+	case op <= 0x5A:
+		return wasm_i64, 2, wasm_i32
+	case op <= 0x60:
+		return wasm_f32, 2, wasm_i32
+	case op <= 0x66:
+		return wasm_f64, 2, wasm_i32
+	case op <= 0x69:
+		return wasm_i32, 1, wasm_i32
+	case op <= 0x78:
+		return wasm_i32, 2, wasm_i32
+	case op <= 0x7B:
+		return wasm_i64, 1, wasm_i64
+	case op <= 0x8A:
+		return wasm_i64, 2, wasm_i64
+	case op <= 0x91:
+		return wasm_f32, 1, wasm_f32
+	case op <= 0x98:
+		return wasm_f32, 2, wasm_f32
+	case op <= 0x9F:
+		return wasm_f64, 1, wasm_f64
+	case op <= 0xA6:
+		return wasm_f64, 2, wasm_f64
+	}
+
+	c := wasm_conversions[op-0xA7]
+
+	return c[0], 1, c[1]
+}
+
+// compile validates a function body and translates it into its instruction array. Every value
+// on the operand stack has its type tracked, so each instruction is checked to find operands of
+// the types it takes, and each block to leave exactly the values its type declares. Branches get
+// the absolute target, the stack height to unwind to relative to the frame and the number of
+// values to keep.
+func (m *Wasm_Module) compile(f *wasm_func) {
+	r := &wasm_reader{data: f.body}
+
+	f.nlocals = len(f.typ.params)
+	f.locals = append([]byte(nil), f.typ.params...)
+	for n := r.u32(); n > 0; n-- {
+		count := r.u32()
+		if uint64(f.nlocals)+uint64(count) > 50000 {
+			r.fail("too many locals")
+		}
+
+		t := r.byte()
+		if !is_value_type(t) {
+			r.fail("local type")
+		}
+
+		for i := uint32(0); i < count; i++ {
+			f.locals = append(f.locals, t)
+		}
+
+		f.nlocals += int(count)
+	}
+
+	f.maxHeight = f.nlocals
+
+	// types holds the type of every operand, so the stack height is nlocals+len(types). Code
+	// after an unconditional branch is unreachable: it may pop operands of any type down to the
+	// start of its block, and pop gives those the type it was asked for, or 0 for any type.
+	var types []byte
+
+	ctrls := []wasm_ctrl{{height: f.nlocals, results: f.typ.results, elseJump: -1}}
+
+	emit := func(in wasm_ins) {
+		f.code = append(f.code, in)
+	}
+	push := func(ts ...byte) {
+		types = append(types, ts...)
+		if f.nlocals+len(types) > f.maxHeight {
+			f.maxHeight = f.nlocals + len(types)
+		}
+	}
+	pop := func(want byte) byte {
+		c := &ctrls[len(ctrls)-1]
+		if f.nlocals+len(types) == c.height {
+			if !c.unreachable {
+				r.fail("operand stack underflow")
+			}
+
+			return want
+		}
+
+		t := types[len(types)-1]
+		types = types[:len(types)-1]
+
+		switch {
+		case t == 0:
+			return want
+		case want != 0 && t != want:
+			r.fail("operand type mismatch")
+		}
+
+		return t
+	}
+	pops := func(ts []byte) {
+		for i := len(ts) - 1; i >= 0; i-- {
+			pop(ts[i])
+		}
+	}
+	unreachable := func() {
+		c := &ctrls[len(ctrls)-1]
+		types = types[:c.height-f.nlocals]
+		c.unreachable = true
+	}
+	// leave checks that the block ends with exactly the values of its result types above the
+	// height it started at.
+	leave := func() {
+		c := &ctrls[len(ctrls)-1]
+		pops(c.results)
+		if f.nlocals+len(types) != c.height {
+			r.fail("values left at the end of a block")
+		}
+	}
+	label := func(depth uint32) *wasm_ctrl {
+		if int(depth) >= len(ctrls) {
+			r.fail("branch depth")
+		}
+
+		return &ctrls[len(ctrls)-1-int(depth)]
+	}
+	branch := func(op uint16, depth uint32) wasm_ins {
+		c := label(depth)
+		in := wasm_ins{op: op, b: uint32(c.height)}
+		if c.loop {
+			in.a, in.c = uint32(c.start), uint32(len(c.params))
+		} else {
+			in.c = uint32(len(c.results))
+			c.patches = append(c.patches, len(f.code))
+		}
+
+		return in
+	}
+	block_type := func() (params []byte, results []byte) {
+		bt := r.signed(33)
+		switch {
+		case bt == -64:
+			return nil, nil
+		case bt < 0 && bt >= -4:
+			return nil, []byte{byte(0x80 + bt)}
+		case bt >= 0 && int(bt) < len(m.types):
+			return m.types[bt].params, m.types[bt].results
+		}
+
+		r.fail("block type")
+
+		return nil, nil
+	}
+	memarg := func() uint64 {
+		r.u32()
+
+		return uint64(r.u32())
+	}
+
+	for len(ctrls) > 0 {
+		op := r.byte()
+
+		switch {
+		case op == 0x00:
+			emit(wasm_ins{op: uint16(op)})
+			unreachable()
+		case op == 0x01:
+		case op == 0x02, op == 0x03:
+			params, results := block_type()
+			pops(params)
+			ctrls = append(ctrls, wasm_ctrl{loop: op == 0x03, start: len(f.code), height: f.nlocals + len(types), params: params, results: results, elseJump: -1})
+			push(params...)
+		case op == 0x04:
+			params, results := block_type()
+			pop(wasm_i32)
+			pops(params)
+			ctrls = append(ctrls, wasm_ctrl{height: f.nlocals + len(types), params: params, results: results, elseJump: len(f.code)})
+			emit(wasm_ins{op: op_jump_if_zero})
+			push(params...)
+		case op == 0x05:
+			c := &ctrls[len(ctrls)-1]
+			if c.elseJump < 0 {
+				r.fail("else without if")
+			}
+
+			leave()
+
+			c.patches = append(c.patches, len(f.code))
+			emit(wasm_ins{op: op_jump})
+			f.code[c.elseJump].a = uint32(len(f.code))
+			c.elseJump = -1
+			c.unreachable = false
+			push(c.params...)
+		case op == 0x0B:
+			leave()
+
+			c := ctrls[len(ctrls)-1]
+			ctrls = ctrls[:len(ctrls)-1]
+
+			if c.elseJump >= 0 && !bytes.Equal(c.params, c.results) {
+				r.fail("if without else changes the operand types")
+			}
+
+			if len(ctrls) == 0 {
+				emit(wasm_ins{op: 0x0F})
+			}
+
+			end := uint32(len(f.code))
+			if c.elseJump >= 0 {
+				f.code[c.elseJump].a = end
+			}
+			for _, at := range c.patches {
+				f.code[at].a = end
+			}
+			for _, at := range c.tablePatch {
+				f.tables[at[0]][at[1]].target = end
+			}
+
+			push(c.results...)
+		case op == 0x0C:
+			depth := r.u32()
+			pops(label(depth).labels())
+			emit(branch(op_br, depth))
+			unreachable()
+		case op == 0x0D:
+			depth := r.u32()
+			pop(wasm_i32)
+			carried := label(depth).labels()
+			pops(carried)
+			push(carried...)
+			emit(branch(op_br_if, depth))
+		case op == 0x0E:
+			pop(wasm_i32)
+
+			n := r.u32()
+			if n > 1<<16 {
+				r.fail("branch table size")
+			}
+
+			table := make([]wasm_branch, n+1)
+			index := len(f.tables)
+			for i := range table {
+				c := label(r.u32())
+				table[i] = wasm_branch{height: uint32(c.height), arity: uint32(len(c.labels()))}
+				if table[i].arity != table[0].arity {
+					r.fail("branch table arity")
+				}
+
+				pops(c.labels())
+				push(c.labels()...)
+
+				if c.loop {
+					table[i].target = uint32(c.start)
+				} else {
+					c.tablePatch = append(c.tablePatch, [2]int{index, i})
+				}
+			}
+
+			f.tables = append(f.tables, table)
+			emit(wasm_ins{op: op_br_table, a: uint32(index)})
+			unreachable()
+		case op == 0x0F:
+			pops(f.typ.results)
+			emit(wasm_ins{op: uint16(op)})
+			unreachable()
+		case op == 0x10:
+			index := r.u32()
+			if int(index) >= len(m.funcs) {
+				r.fail("function index")
+			}
+
+			t := m.funcs[index].typ
+			pops(t.params)
+			push(t.results...)
+			emit(wasm_ins{op: uint16(op), a: index})
+		case op == 0x11:
+			index := r.u32()
+			r.u32()
+			if int(index) >= len(m.types) {
+				r.fail("type index")
+			}
+
+			t := m.types[index]
+			pop(wasm_i32)
+			pops(t.params)
+			push(t.results...)
+			emit(wasm_ins{op: uint16(op), a: index})
+		case op == 0x1A:
+			pop(0)
+			emit(wasm_ins{op: uint16(op)})
+		case op == 0x1B, op == 0x1C:
+			var t byte
+			if op == 0x1C {
+				if r.u32() != 1 {
+					r.fail("select type")
+				}
+
+				if t = r.byte(); !is_value_type(t) {
+					r.fail("select type")
+				}
+			}
+
+			pop(wasm_i32)
+			t = pop(t)
+			push(pop(t))
+			emit(wasm_ins{op: 0x1B})
+		case op >= 0x20 && op <= 0x22:
+			index := r.u32()
+			if int(index) >= f.nlocals {
+				r.fail("local index")
+			}
+
+			switch t := f.locals[index]; op {
+			case 0x20:
+				push(t)
+			case 0x21:
+				pop(t)
+			case 0x22:
+				push(pop(t))
+			}
+
+			emit(wasm_ins{op: uint16(op), a: index})
+		case op == 0x23, op == 0x24:
+			index := r.u32()
+			if int(index) >= len(m.globals) || op == 0x24 && !m.globals[index].mutable {
+				r.fail("global index")
+			}
+
+			if op == 0x23 {
+				push(m.globals[index].typ)
+			} else {
+				pop(m.globals[index].typ)
+			}
+
+			emit(wasm_ins{op: uint16(op), a: index})
+		case op >= 0x28 && op <= 0x35:
+			pop(wasm_i32)
+			push(wasm_load_types[op-0x28])
+			emit(wasm_ins{op: uint16(op), imm: memarg()})
+		case op >= 0x36 && op <= 0x3E:
+			pop(wasm_store_types[op-0x36])
+			pop(wasm_i32)
+			emit(wasm_ins{op: uint16(op), imm: memarg()})
+		case op == 0x3F, op == 0x40:
+			r.byte()
+			if op == 0x40 {
+				pop(wasm_i32)
+			}
+
+			push(wasm_i32)
+			emit(wasm_ins{op: uint16(op)})
+		case op == 0x41:
+			push(wasm_i32)
+			emit(wasm_ins{op: uint16(op), imm: uint64(uint32(r.signed(32)))})
+		case op == 0x42:
+			push(wasm_i64)
+			emit(wasm_ins{op: uint16(op), imm: uint64(r.signed(64))})
+		case op == 0x43:
+			push(wasm_f32)
+			emit(wasm_ins{op: 0x41, imm: uint64(binary.LittleEndian.Uint32(r.bytes(4)))})
+		case op == 0x44:
+			push(wasm_f64)
+			emit(wasm_ins{op: 0x42, imm: binary.LittleEndian.Uint64(r.bytes(8))})
+		case op >= 0x45 && op <= 0xC4:
+			in, n, out := numeric_signature(op)
+			for ; n > 0; n-- {
+				pop(in)
+			}
+
+			push(out)
+			emit(wasm_ins{op: uint16(op)})
+		case op == 0xFC:
+			sub := r.u32()
+
+			switch {
+			case sub <= 7:
+				in, out := wasm_f32, wasm_i32
+				if sub&2 != 0 {
+					in = wasm_f64
+				}
+				if sub >= 4 {
+					out = wasm_i64
+				}
+
+				pop(in)
+				push(out)
+				emit(wasm_ins{op: op_fc + uint16(sub)})
+			case sub == 8:
+				index := r.u32()
+				r.byte()
+				if int(index) >= len(m.data) {
+					r.fail("data index")
+				}
+
+				pops([]byte{wasm_i32, wasm_i32, wasm_i32})
+				emit(wasm_ins{op: op_fc + 8, a: index})
+			case sub == 9:
+				index := r.u32()
+				if int(index) >= len(m.data) {
+					r.fail("data index")
+				}
+
+				emit(wasm_ins{op: op_fc + 9, a: index})
+			case sub == 10 || sub == 11:
+				r.byte()
+				if sub == 10 {
+					r.byte()
+				}
+
+				pops([]byte{wasm_i32, wasm_i32, wasm_i32})
+				emit(wasm_ins{op: op_fc + uint16(sub)})
+			default:
+				r.fail(fmt.Sprintf("unsupported instruction 0xfc %d", sub))
+			}
+		default:
+			r.fail(fmt.Sprintf("unsupported instruction 0x%x", op))
+		}
+	}
+
+	if r.pos != len(r.data) {
+		r.fail("code after function end")
+	}
+
+	f.body = nil
+}
+
+// Instantiate creates an instance of a compiled module and runs its start function.
+func (m *Wasm_Module) Instantiate() (inst *Wasm_Instance, err error) {
+	inst = &Wasm_Instance{
+		module: m,
+		maxMem: min(m.maxPages, wasm_max_pages),
+		table:  m.table,
+		stack:  make([]uint64, wasm_stack_slots),
+	}
+
+	if m.hasMem {
+		if m.minPages > inst.maxMem {
+			return nil, fmt.Errorf("module needs %d pages of memory, plugins get at most %d", m.minPages, inst.maxMem)
+		}
+
+		inst.memory = make([]byte, int(m.minPages)*wasm_page)
+	}
+
+	for _, g := range m.globals {
+		inst.globals = append(inst.globals, g.value)
+	}
+
+	for _, d := range m.data {
+		inst.data = append(inst.data, d.bytes)
+		if d.active {
+			if d.offset < 0 || int(d.offset)+len(d.bytes) > len(inst.memory) {
+				return nil, errors.New("data segment outside of memory")
+			}
+
+			copy(inst.memory[d.offset:], d.bytes)
+		}
+	}
+
+	if m.start >= 0 {
+		_, err = inst.Call_Index(uint32(m.start))
+	}
+
+	return inst, err
+}
+
+// Memory returns the linear memory of the instance, which calls may grow and so reallocate.
+func (inst *Wasm_Instance) Memory() []byte {
+	return inst.memory
+}
+
+// Export returns the index of an exported function and whether it exists.
+func (inst *Wasm_Instance) Export(name string) (uint32, bool) {
+	index, ok := inst.module.exports[name]
+
+	return index, ok && int(index) < len(inst.module.funcs)
+}
+
+// Call runs an exported function with integer arguments and returns its results.
+func (inst *Wasm_Instance) Call(name string, args ...uint64) ([]uint64, error) {
+	index, ok := inst.Export(name)
+	if !ok {
+		return nil, fmt.Errorf("no exported function %s", name)
+	}
+
+	return inst.Call_Index(index, args...)
+}
+
+// Call_Index runs a function with arguments, trapping on faults or once it runs out of fuel.
+// Compiled bodies are validated, but should the interpreter still fault, the fault is returned
+// as an error too rather than taking the process down with the plugin.
+func (inst *Wasm_Instance) Call_Index(index uint32, args ...uint64) (results []uint64, err error) {
+	if int(index) >= len(inst.module.funcs) {
+		return nil, fmt.Errorf("no function %d", index)
+	}
+
+	f := inst.module.funcs[index]
+	if len(args) != len(f.typ.params) {
+		return nil, fmt.Errorf("function %d takes %d arguments", index, len(f.typ.params))
+	}
+
+	defer func() {
+		if r := recover(); r != nil {
+			inst.depth = 0
+			results, err = nil, fmt.Errorf("plugin failed: %v", r)
+			if t, ok := r.(wasm_trap); ok {
+				results, err = nil, errors.New("plugin trapped: "+t.reason)
+			}
+		}
+	}()
+
+	inst.fuel = wasm_fuel
+	copy(inst.stack, args)
+
+	sp := inst.invoke(f, 0)
+
+	return append([]uint64(nil), inst.stack[sp-len(f.typ.results):sp]...), nil
+}
+
+// invoke runs a function whose arguments are at fp and returns the stack pointer above its
+// results, which it leaves at fp.
+func (inst *Wasm_Instance) invoke(f *wasm_func, fp int) int {
+	if fp+f.maxHeight > len(inst.stack) || inst.depth >= wasm_max_depth {
+		trap("call stack exhausted")
+	}
+
+	inst.depth++
+	defer func() { inst.depth-- }()
+
+	s := inst.stack
+	clear(s[fp+len(f.typ.params) : fp+f.nlocals])
+
+	sp := fp + f.nlocals
+	code := f.code
+
+	for pc := 0; pc < len(code); pc++ {
+		in := &code[pc]
+
+		switch in.op {
+		case 0x00:
+			trap("unreachable executed")
+		case op_br:
+			inst.burn()
+			sp = unwind(s, fp, sp, in.b, in.c)
+			pc = int(in.a) - 1
+		case op_br_if:
+			sp--
+			if uint32(s[sp]) != 0 {
+				inst.burn()
+				sp = unwind(s, fp, sp, in.b, in.c)
+				pc = int(in.a) - 1
+			}
+		case op_br_table:
+			inst.burn()
+			table := f.tables[in.a]
+			sp--
+			i := int(uint32(s[sp]))
+			if i >= len(table) {
+				i = len(table) - 1
+			}
+
+			sp = unwind(s, fp, sp, table[i].height, table[i].arity)
+			pc = int(table[i].target) - 1
+		case op_jump:
+			pc = int(in.a) - 1
+		case op_jump_if_zero:
+			sp--
+			if uint32(s[sp]) == 0 {
+				pc = int(in.a) - 1
+			}
+		case 0x0F:
+			n := len(f.typ.results)
+			copy(s[fp:], s[sp-n:sp])
+
+			return fp + n
+		case 0x10:
+			inst.burn()
+			callee := inst.module.funcs[in.a]
+			sp = inst.invoke(callee, sp-len(callee.typ.params))
+		case 0x11:
+			inst.burn()
+			sp--
+			i := int(uint32(s[sp]))
+			if i >= len(inst.table) || inst.table[i] < 0 {
+				trap("undefined table element %d", i)
+			}
+
+			callee := inst.module.funcs[inst.table[i]]
+			want := inst.module.types[in.a]
+			if !bytes.Equal(callee.typ.params, want.params) || !bytes.Equal(callee.typ.results, want.results) {
+				trap("indirect call type mismatch")
+			}
+
+			sp = inst.invoke(callee, sp-len(callee.typ.params))
+		case 0x1A:
+			sp--
+		case 0x1B:
+			sp -= 2
+			if uint32(s[sp+1]) == 0 {
+				s[sp-1] = s[sp]
+			}
+		case 0x20:
+			s[sp] = s[fp+int(in.a)]
+			sp++
+		case 0x21:
+			sp--
+			s[fp+int(in.a)] = s[sp]
+		case 0x22:
+			s[fp+int(in.a)] = s[sp-1]
+		case 0x23:
+			s[sp] = inst.globals[in.a]
+			sp++
+		case 0x24:
+			sp--
+			inst.globals[in.a] = s[sp]
+		case 0x28, 0x2A:
+			s[sp-1] = uint64(binary.LittleEndian.Uint32(inst.addr(s[sp-1], in.imm, 4)))
+		case 0x29, 0x2B:
+			s[sp-1] = binary.LittleEndian.Uint64(inst.addr(s[sp-1], in.imm, 8))
+		case 0x2C:
+			s[sp-1] = uint64(uint32(int32(int8(inst.addr(s[sp-1], in.imm, 1)[0]))))
+		case 0x2D:
+			s[sp-1] = uint64(inst.addr(s[sp-1], in.imm, 1)[0])
+		case 0x2E:
+			s[sp-1] = uint64(uint32(int32(int16(binary.LittleEndian.Uint16(inst.addr(s[sp-1], in.imm, 2))))))
+		case 0x2F:
+			s[sp-1] = uint64(binary.LittleEndian.Uint16(inst.addr(s[sp-1], in.imm, 2)))
+		case 0x30:
+			s[sp-1] = uint64(int64(int8(inst.addr(s[sp-1], in.imm, 1)[0])))
+		case 0x31:
+			s[sp-1] = uint64(inst.addr(s[sp-1], in.imm, 1)[0])
+		case 0x32:
+			s[sp-1] = uint64(int64(int16(binary.LittleEndian.Uint16(inst.addr(s[sp-1], in.imm, 2)))))
+		case 0x33:
+			s[sp-1] = uint64(binary.LittleEndian.Uint16(inst.addr(s[sp-1], in.imm, 2)))
+		case 0x34:
+			s[sp-1] = uint64(int64(int32(binary.LittleEndian.Uint32(inst.addr(s[sp-1], in.imm, 4)))))
+		case 0x35:
+			s[sp-1] = uint64(binary.LittleEndian.Uint32(inst.addr(s[sp-1], in.imm, 4)))
+		case 0x36, 0x38, 0x3E:
+			sp -= 2
+			binary.LittleEndian.PutUint32(inst.addr(s[sp], in.imm, 4), uint32(s[sp+1]))
+		case 0x37, 0x39:
+			sp -= 2
+			binary.LittleEndian.PutUint64(inst.addr(s[sp], in.imm, 8), s[sp+1])
+		case 0x3A, 0x3C:
+			sp -= 2
+			inst.addr(s[sp], in.imm, 1)[0] = byte(s[sp+1])
+		case 0x3B, 0x3D:
+			sp -= 2
+			binary.LittleEndian.PutUint16(inst.addr(s[sp], in.imm, 2), uint16(s[sp+1]))
+		case 0x3F:
+			s[sp] = uint64(len(inst.memory) / wasm_page)
+			sp++
+		case 0x40:
+			pages := uint32(len(inst.memory) / wasm_page)
+			grow := uint32(s[sp-1])
+			if uint64(pages)+uint64(grow) > uint64(inst.maxMem) {
+				s[sp-1] = uint64(math.MaxUint32)
+			} else {
+				inst.memory = append(inst.memory, make([]byte, int(grow)*wasm_page)...)
+				s[sp-1] = uint64(pages)
+			}
+		case 0x41, 0x42:
+			s[sp] = in.imm
+			sp++
+		case op_fc + 8:
+			sp -= 3
+			data := inst.data[in.a]
+			src, n := uint64(uint32(s[sp+1])), uint64(uint32(s[sp+2]))
+			if src+n > uint64(len(data)) {
+				trap("memory.init out of bounds")
+			}
+
+			copy(inst.addr(s[sp], 0, n), data[src:src+n])
+		case op_fc + 9:
+			inst.data[in.a] = nil
+		case op_fc + 10:
+			sp -= 3
+			n := uint64(uint32(s[sp+2]))
+			copy(inst.addr(s[sp], 0, n), inst.addr(s[sp+1], 0, n))
+		case op_fc + 11:
+			sp -= 3
+			dst := inst.addr(s[sp], 0, uint64(uint32(s[sp+2])))
+			for i := range dst {
+				dst[i] = byte(s[sp+1])
+			}
+		default:
+			if in.op >= 0x45 && in.op <= 0x66 || in.op >= 0x6A && in.op <= 0x78 ||
+				in.op >= 0x7C && in.op <= 0x8A || in.op >= 0x92 && in.op <= 0x98 || in.op >= 0xA0 && in.op <= 0xA6 {
+				if in.op == 0x45 || in.op == 0x50 {
+					s[sp-1] = unary(in.op, s[sp-1])
+				} else {
+					sp--
+					s[sp-1] = binary_op(in.op, s[sp-1], s[sp])
+				}
+			} else {
+				s[sp-1] = unary(in.op, s[sp-1])
+			}
+		}
+	}
+
+	// the function end compiles to a return, so this is not reached
+	return sp
+}
+
+func (inst *Wasm_Instance) burn() {
+	inst.fuel--
+	if inst.fuel < 0 {
+		trap("out of fuel")
+	}
+}
+
+// addr returns the n bytes of memory at a dynamic address plus a static offset.
+func (inst *Wasm_Instance) addr(base uint64, offset uint64, n uint64) []byte {
+	ea := uint64(uint32(base)) + offset
+	if ea+n > uint64(len(inst.memory)) {
+		trap("memory access out of bounds at %d", ea)
+	}
+
+	return inst.memory[ea : ea+n : ea+n]
+}
+
+// unwind keeps the top arity values of the stack at height above the frame.
+func unwind(s []uint64, fp int, sp int, height uint32, arity uint32) int {
+	base := fp + int(height)
+	copy(s[base:], s[sp-int(arity):sp])
+
+	return base + int(arity)
+}
+
+func b2u(b bool) uint64 {
+	if b {
+		return 1
+	}
+
+	return 0
+}
+
+func f32(v uint64) float32 {
+	return math.Float32frombits(uint32(v))
+}
+
+func f64(v uint64) float64 {
+	return math.Float64frombits(v)
+}
+
+func uf32(f float32) uint64 {
+	return uint64(math.Float32bits(f))
+}
+
+func uf64(f float64) uint64 {
+	return math.Float64bits(f)
+}
+
+func binary_op(op uint16, x uint64, y uint64) uint64 {
+	a, b := uint32(x), uint32(y)
+
+	switch op {
+	case 0x46:
+		return b2u(a == b)
+	case 0x47:
+		return b2u(a != b)
+	case 0x48:
+		return b2u(int32(a) < int32(b))
+	case 0x49:
+		return b2u(a < b)
+	case 0x4A:
+		return b2u(int32(a) > int32(b))
+	case 0x4B:
+		return b2u(a > b)
+	case 0x4C:
+		return b2u(int32(a) <= int32(b))
+	case 0x4D:
+		return b2u(a <= b)
+	case 0x4E:
+		return b2u(int32(a) >= int32(b))
+	case 0x4F:
+		return b2u(a >= b)
+	case 0x51:
+		return b2u(x == y)
+	case 0x52:
+		return b2u(x != y)
+	case 0x53:
+		return b2u(int64(x) < int64(y))
+	case 0x54:
+		return b2u(x < y)
+	case 0x55:
+		return b2u(int64(x) > int64(y))
+	case 0x56:
+		return b2u(x > y)
+	case 0x57:
+		return b2u(int64(x) <= int64(y))
+	case 0x58:
+		return b2u(x <= y)
+	case 0x59:
+		return b2u(int64(x) >= int64(y))
+	case 0x5A:
+		return b2u(x >= y)
+	case 0x5B:
+		return b2u(f32(x) == f32(y))
+	case 0x5C:
+		return b2u(f32(x) != f32(y))
+	case 0x5D:
+		return b2u(f32(x) < f32(y))
+	case 0x5E:
+		return b2u(f32(x) > f32(y))
+	case 0x5F:
+		return b2u(f32(x) <= f32(y))
+	case 0x60:
+		return b2u(f32(x) >= f32(y))
+	case 0x61:
+		return b2u(f64(x) == f64(y))
+	case 0x62:
+		return b2u(f64(x) != f64(y))
+	case 0x63:
+		return b2u(f64(x) < f64(y))
+	case 0x64:
+		return b2u(f64(x) > f64(y))
+	case 0x65:
+		return b2u(f64(x) <= f64(y))
+	case 0x66:
+		return b2u(f64(x) >= f64(y))
+	case 0x6A:
+		return uint64(a + b)
+	case 0x6B:
+		return uint64(a - b)
+	case 0x6C:
+		return uint64(a * b)
+	case 0x6D:
+		if b == 0 {
+			trap("integer divide by zero")
+		}
+		if int32(a) == math.MinInt32 && int32(b) == -1 {
+			trap("integer overflow")
+		}
+
+		return uint64(uint32(int32(a) / int32(b)))
+	case 0x6E:
+		if b == 0 {
+			trap("integer divide by zero")
+		}
+
+		return uint64(a / b)
+	case 0x6F:
+		if b == 0 {
+			trap("integer divide by zero")
+		}
+		if int32(b) == -1 {
+			return 0
+		}
+
+		return uint64(uint32(int32(a) % int32(b)))
+	case 0x70:
+		if b == 0 {
+			trap("integer divide by zero")
+		}
+
+		return uint64(a % b)
+	case 0x71:
+		return uint64(a & b)
+	case 0x72:
+		return uint64(a | b)
+	case 0x73:
+		return uint64(a ^ b)
+	case 0x74:
+		return uint64(a << (b & 31))
+	case 0x75:
+		return uint64(uint32(int32(a) >> (b & 31)))
+	case 0x76:
+		return uint64(a >> (b & 31))
+	case 0x77:
+		return uint64(bits.RotateLeft32(a, int(b&31)))
+	case 0x78:
+		return uint64(bits.RotateLeft32(a, -int(b&31)))
+	case 0x7C:
+		return x + y
+	case 0x7D:
+		return x - y
+	case 0x7E:
+		return x * y
+	case 0x7F:
+		if y == 0 {
+			trap("integer divide by zero")
+		}
+		if int64(x) == math.MinInt64 && int64(y) == -1 {
+			trap("integer overflow")
+		}
+
+		return uint64(int64(x) / int64(y))
+	case 0x80:
+		if y == 0 {
+			trap("integer divide by zero")
+		}
+
+		return x / y
+	case 0x81:
+		if y == 0 {
+			trap("integer divide by zero")
+		}
+		if int64(y) == -1 {
+			return 0
+		}
+
+		return uint64(int64(x) % int64(y))
+	case 0x82:
+		if y == 0 {
+			trap("integer divide by zero")
+		}
+
+		return x % y
+	case 0x83:
+		return x & y
+	case 0x84:
+		return x | y
+	case 0x85:
+		return x ^ y
+	case 0x86:
+		return x << (y & 63)
+	case 0x87:
+		return uint64(int64(x) >> (y & 63))
+	case 0x88:
+		return x >> (y & 63)
+	case 0x89:
+		return bits.RotateLeft64(x, int(y&63))
+	case 0x8A:
+		return bits.RotateLeft64(x, -int(y&63))
+	case 0x92:
+		return uf32(f32(x) + f32(y))
+	case 0x93:
+		return uf32(f32(x) - f32(y))
+	case 0x94:
+		return uf32(f32(x) * f32(y))
+	case 0x95:
+		return uf32(f32(x) / f32(y))
+	case 0x96:
+		return uf32(float32(wasm_min(float64(f32(x)), float64(f32(y)))))
+	case 0x97:
+		return uf32(float32(wasm_max(float64(f32(x)), float64(f32(y)))))
+	case 0x98:
+		return x&0x7FFFFFFF | y&0x80000000
+	case 0xA0:
+		return uf64(f64(x) + f64(y))
+	case 0xA1:
+		return uf64(f64(x) - f64(y))
+	case 0xA2:
+		return uf64(f64(x) * f64(y))
+	case 0xA3:
+		return uf64(f64(x) / f64(y))
+	case 0xA4:
+		return uf64(wasm_min(f64(x), f64(y)))
+	case 0xA5:
+		return uf64(wasm_max(f64(x), f64(y)))
+	case 0xA6:
+		return x&(1<<63-1) | y&(1<<63)
+	}
+
+	trap("unsupported instruction 0x%x", op)
+
+	return 0
+}
+
+func unary(op uint16, x uint64) uint64 {
+	a := uint32(x)
+
+	switch op {
+	case 0x45:
+		return b2u(a == 0)
+	case 0x50:
+		return b2u(x == 0)
+	case 0x67:
+		return uint64(bits.LeadingZeros32(a))
+	case 0x68:
+		return uint64(bits.TrailingZeros32(a))
+	case 0x69:
+		return uint64(bits.OnesCount32(a))
+	case 0x79:
+		return uint64(bits.LeadingZeros64(x))
+	case 0x7A:
+		return uint64(bits.TrailingZeros64(x))
+	case 0x7B:
+		return uint64(bits.OnesCount64(x))
+	case 0x8B:
+		return x & 0x7FFFFFFF
+	case 0x8C:
+		return uint64(a ^ 0x80000000)
+	case 0x8D:
+		return uf32(float32(math.Ceil(float64(f32(x)))))
+	case 0x8E:
+		return uf32(float32(math.Floor(float64(f32(x)))))
+	case 0x8F:
+		return uf32(float32(math.Trunc(float64(f32(x)))))
+	case 0x90:
+		return uf32(float32(math.RoundToEven(float64(f32(x)))))
+	case 0x91:
+		return uf32(float32(math.Sqrt(float64(f32(x)))))
+	case 0x99:
+		return x & (1<<63 - 1)
+	case 0x9A:
+		return x ^ 1<<63
+	case 0x9B:
+		return uf64(math.Ceil(f64(x)))
+	case 0x9C:
+		return uf64(math.Floor(f64(x)))
+	case 0x9D:
+		return uf64(math.Trunc(f64(x)))
+	case 0x9E:
+		return uf64(math.RoundToEven(f64(x)))
+	case 0x9F:
+		return uf64(math.Sqrt(f64(x)))
+	case 0xA7:
+		return uint64(a)
+	case 0xA8:
+		return uint64(uint32(int32(trunc_checked(float64(f32(x)), -2147483649, 2147483648))))
+	case 0xA9:
+		return uint64(uint32(trunc_checked(float64(f32(x)), -1, 4294967296)))
+	case 0xAA:
+		return uint64(uint32(int32(trunc_checked(f64(x), -2147483649, 2147483648))))
+	case 0xAB:
+		return uint64(uint32(trunc_checked(f64(x), -1, 4294967296)))
+	case 0xAC:
+		return uint64(int64(int32(a)))
+	case 0xAD:
+		return uint64(a)
+	case 0xAE:
+		return uint64(int64(trunc_checked(float64(f32(x)), -9223372036854777856, 9223372036854775808)))
+	case 0xAF:
+		return trunc_u64(trunc_checked(float64(f32(x)), -1, 18446744073709551616))
+	case 0xB0:
+		return uint64(int64(trunc_checked(f64(x), -9223372036854777856, 9223372036854775808)))
+	case 0xB1:
+		return trunc_u64(trunc_checked(f64(x), -1, 18446744073709551616))
+	case 0xB2:
+		return uf32(float32(int32(a)))
+	case 0xB3:
+		return uf32(float32(a))
+	case 0xB4:
+		return uf32(float32(int64(x)))
+	case 0xB5:
+		return uf32(float32(x))
+	case 0xB6:
+		return uf32(float32(f64(x)))
+	case 0xB7:
+		return uf64(float64(int32(a)))
+	case 0xB8:
+		return uf64(float64(a))
+	case 0xB9:
+		return uf64(float64(int64(x)))
+	case 0xBA:
+		return uf64(float64(x))
+	case 0xBB:
+		return uf64(float64(f32(x)))
+	case 0xBC, 0xBD, 0xBE, 0xBF:
+		return x
+	case 0xC0:
+		return uint64(uint32(int32(int8(a))))
+	case 0xC1:
+		return uint64(uint32(int32(int16(a))))
+	case 0xC2:
+		return uint64(int64(int8(x)))
+	case 0xC3:
+		return uint64(int64(int16(x)))
+	case 0xC4:
+		return uint64(int64(int32(x)))
+	case op_fc + 0:
+		return uint64(uint32(int32(trunc_sat(float64(f32(x)), math.MinInt32, math.MaxInt32))))
+	case op_fc + 1:
+		return uint64(uint32(trunc_sat(float64(f32(x)), 0, math.MaxUint32)))
+	case op_fc + 2:
+		return uint64(uint32(int32(trunc_sat(f64(x), math.MinInt32, math.MaxInt32))))
+	case op_fc + 3:
+		return uint64(uint32(trunc_sat(f64(x), 0, math.MaxUint32)))
+	case op_fc + 4:
+		return trunc_sat_i64(float64(f32(x)))
+	case op_fc + 5:
+		return trunc_sat_u64(float64(f32(x)))
+	case op_fc + 6:
+		return trunc_sat_i64(f64(x))
+	case op_fc + 7:
+		return trunc_sat_u64(f64(x))
+	}
+
+	trap("unsupported instruction 0x%x", op)
+
+	return 0
+}
+
+// trunc_checked truncates toward zero, trapping unless the result lies strictly between lo and hi.
+func trunc_checked(f float64, lo float64, hi float64) float64 {
+	if math.IsNaN(f) {
+		trap("invalid conversion to integer")
+	}
+
+	t := math.Trunc(f)
+	if t <= lo || t >= hi {
+		trap("integer overflow")
+	}
+
+	return t
+}
+
+func trunc_u64(t float64) uint64 {
+	if t >= 9223372036854775808 {
+		return uint64(t-9223372036854775808) + 1<<63
+	}
+
+	return uint64(t)
+}
+
+func trunc_sat(f float64, lo float64, hi float64) int64 {
+	switch {
+	case math.IsNaN(f):
+		return 0
+	case f <= lo:
+		return int64(lo)
+	case f >= hi:
+		return int64(hi)
+	}
+
+	return int64(math.Trunc(f))
+}
+
+func trunc_sat_i64(f float64) uint64 {
+	switch {
+	case math.IsNaN(f):
+		return 0
+	case f <= math.MinInt64:
+		return 1 << 63
+	case f >= 9223372036854775808:
+		return math.MaxInt64
+	}
+
+	return uint64(int64(math.Trunc(f)))
+}
+
+func trunc_sat_u64(f float64) uint64 {
+	switch {
+	case math.IsNaN(f) || f <= 0:
+		return 0
+	case f >= 18446744073709551616:
+		return math.MaxUint64
+	}
+
+	return trunc_u64(math.Trunc(f))
+}
+
+func wasm_min(a float64, b float64) float64 {
+	if math.IsNaN(a) || math.IsNaN(b) {
+		return math.NaN()
+	}
+
+	return math.Min(a, b)
+}
+
+func wasm_max(a float64, b float64) float64 {
+	if math.IsNaN(a) || math.IsNaN(b) {
+		return math.NaN()
+	}
+
+	return math.Max(a, b)
+}
@@ -0,0 +1,202 @@
+package main
+
+import (
+	"encoding/binary"
+	"strings"
+	"testing"
+)
+
+// wasm_section appends a section with its id and size.
+func wasm_section(module []byte, id byte, content ...byte) []byte {
+	module = append(module, id)
+	module = binary.AppendUvarint(module, uint64(len(content)))
+
+	return append(module, content...)
+}
+
+// wasm_test_module returns a module exporting a single function "f" of the type given by params
+// and results, with a local of each type in locals and a body ending with its own end. With
+// memory, the module has a page of it.
+func wasm_test_module(params []byte, results []byte, locals []byte, memory bool, body ...byte) []byte {
+	module := []byte(wasm_magic)
+
+	typ := []byte{1, 0x60, byte(len(params))}
+	typ = append(typ, params...)
+	typ = append(typ, byte(len(results)))
+	typ = append(typ, results...)
+	module = wasm_section(module, 1, typ...)
+	module = wasm_section(module, 3, 1, 0)
+	if memory {
+		module = wasm_section(module, 5, 1, 0, 1)
+	}
+	module = wasm_section(module, 7, 1, 1, 'f', 0, 0)
+
+	code := []byte{byte(len(locals))}
+	for _, t := range locals {
+		code = append(code, 1, t)
+	}
+	code = append(code, body...)
+
+	return wasm_section(module, 10, append(binary.AppendUvarint([]byte{1}, uint64(len(code))), code...)...)
+}
+
+var wasm_i32_result = []byte{wasm_i32}
+
+func TestWasmCall(t *testing.T) {
+	tests := []struct {
+		name    string
+		params  []byte
+		results []byte
+		locals  []byte
+		body    []byte
+		args    []uint64
+		want    uint64
+	}{
+		{"add", []byte{wasm_i32, wasm_i32}, wasm_i32_result, nil,
+			[]byte{0x20, 0, 0x20, 1, 0x6A, 0x0B}, []uint64{2, 3}, 5},
+		{"block result", nil, wasm_i32_result, nil,
+			[]byte{0x02, 0x7F, 0x41, 7, 0x0B, 0x0B}, nil, 7},
+		{"if else", wasm_i32_result, wasm_i32_result, nil,
+			[]byte{0x20, 0, 0x04, 0x7F, 0x41, 1, 0x05, 0x41, 2, 0x0B, 0x0B}, []uint64{0}, 2},
+		{"br carries the result", nil, wasm_i32_result, nil,
+			[]byte{0x02, 0x7F, 0x41, 9, 0x0C, 0, 0x0B, 0x0B}, nil, 9},
+		{"unreachable code after br", nil, wasm_i32_result, nil,
+			[]byte{0x02, 0x7F, 0x41, 4, 0x0C, 0, 0x6A, 0x45, 0x0B, 0x0B}, nil, 4},
+		{"loop sums", wasm_i32_result, wasm_i32_result, wasm_i32_result,
+			[]byte{
+				0x03, 0x40,
+				0x20, 1, 0x20, 0, 0x6A, 0x21, 1,
+				0x20, 0, 0x41, 1, 0x6B, 0x22, 0,
+				0x0D, 0,
+				0x0B,
+				0x20, 1, 0x0B,
+			}, []uint64{10}, 55},
+		{"br_table", wasm_i32_result, wasm_i32_result, nil,
+			[]byte{
+				0x02, 0x40, 0x02, 0x40,
+				0x20, 0, 0x0E, 1, 0, 1,
+				0x0B, 0x41, 10, 0x0F,
+				0x0B, 0x41, 20, 0x0B,
+			}, []uint64{5}, 20},
+		{"select", wasm_i32_result, wasm_i32_result, nil,
+			[]byte{0x41, 3, 0x41, 4, 0x20, 0, 0x1B, 0x0B}, []uint64{1}, 3},
+		{"memory", nil, wasm_i32_result, nil,
+			[]byte{0x41, 8, 0x41, 42, 0x36, 2, 0, 0x41, 8, 0x28, 2, 0, 0x0B}, nil, 42},
+		{"i64 to i32", nil, wasm_i32_result, nil,
+			[]byte{0x42, 0x7F, 0xA7, 0x0B}, nil, 0xFFFFFFFF},
+	}
+
+	for _, test := range tests {
+		module, err := Compile_Wasm(wasm_test_module(test.params, test.results, test.locals, test.name == "memory", test.body...))
+		if err != nil {
+			t.Errorf("%s: %v", test.name, err)
+
+			continue
+		}
+
+		inst, err := module.Instantiate()
+		if err != nil {
+			t.Errorf("%s: %v", test.name, err)
+
+			continue
+		}
+
+		results, err := inst.Call("f", test.args...)
+		if err != nil || len(results) != 1 || uint32(results[0]) != uint32(test.want) {
+			t.Errorf("%s: got %v, %v, want %d", test.name, results, err, test.want)
+		}
+	}
+}
+
+func TestWasmTrap(t *testing.T) {
+	tests := []struct {
+		name   string
+		memory bool
+		body   []byte
+		reason string
+	}{
+		{"unreachable", false, []byte{0x00, 0x0B}, "unreachable"},
+		{"division by zero", false, []byte{0x41, 1, 0x41, 0, 0x6D, 0x1A, 0x0B}, "divide by zero"},
+		{"load outside of memory", true, []byte{0x41, 0x80, 0x80, 0x04, 0x28, 2, 0, 0x1A, 0x0B}, "out of bounds"},
+		{"no memory", false, []byte{0x41, 0, 0x28, 2, 0, 0x1A, 0x0B}, "out of bounds"},
+		{"infinite loop", false, []byte{0x03, 0x40, 0x0C, 0, 0x0B, 0x0B}, "out of fuel"},
+		{"infinite recursion", false, []byte{0x10, 0, 0x0B}, "call stack"},
+	}
+
+	for _, test := range tests {
+		module, err := Compile_Wasm(wasm_test_module(nil, nil, nil, test.memory, test.body...))
+		if err != nil {
+			t.Errorf("%s: %v", test.name, err)
+
+			continue
+		}
+
+		inst, err := module.Instantiate()
+		if err != nil {
+			t.Errorf("%s: %v", test.name, err)
+
+			continue
+		}
+
+		for round := 0; round < 2; round++ {
+			_, err = inst.Call("f")
+			if err == nil || !strings.Contains(err.Error(), test.reason) {
+				t.Errorf("%s: got %v, want a trap mentioning %q", test.name, err, test.reason)
+			}
+		}
+	}
+}
+
+func TestWasmMalformed(t *testing.T) {
+	unbalanced := []byte{}
+	for i := 0; i < 70000; i++ {
+		unbalanced = append(unbalanced, 0x02, 0x40, 0x41, 1, 0x0B)
+	}
+
+	tests := []struct {
+		name    string
+		results []byte
+		body    []byte
+	}{
+		{"empty block with a result", nil, []byte{0x02, 0x7F, 0x0B, 0x45, 0x1A, 0x0B}},
+		{"block leaving a value", nil, []byte{0x02, 0x40, 0x41, 1, 0x0B, 0x0B}},
+		{"function leaving a value", nil, []byte{0x41, 1, 0x0B}},
+		{"function missing its result", wasm_i32_result, []byte{0x0B}},
+		{"operand type", wasm_i32_result, []byte{0x42, 1, 0x45, 0x0B}},
+		{"stack underflow", wasm_i32_result, []byte{0x6A, 0x0B}},
+		{"br arity", nil, []byte{0x02, 0x7F, 0x0C, 0, 0x0B, 0x1A, 0x0B}},
+		{"br_if operand", nil, []byte{0x02, 0x40, 0x42, 0, 0x0D, 0, 0x0B, 0x0B}},
+		{"br_table arity", wasm_i32_result, []byte{0x02, 0x7F, 0x02, 0x40, 0x41, 1, 0x41, 0, 0x0E, 1, 1, 0, 0x0B, 0x41, 2, 0x0B, 0x0B}},
+		{"if without else", wasm_i32_result, []byte{0x41, 1, 0x04, 0x7F, 0x41, 1, 0x0B, 0x0B}},
+		{"else branch type", wasm_i32_result, []byte{0x41, 1, 0x04, 0x7F, 0x41, 1, 0x05, 0x42, 1, 0x0B, 0x0B}},
+		{"select types", wasm_i32_result, []byte{0x41, 1, 0x42, 1, 0x41, 1, 0x1B, 0x0B}},
+		{"store value type", nil, []byte{0x41, 0, 0x42, 1, 0x36, 2, 0, 0x0B}},
+		{"return type", wasm_i32_result, []byte{0x42, 1, 0x0F, 0x0B}},
+		{"branch depth", nil, []byte{0x0C, 1, 0x0B}},
+		{"block type", nil, []byte{0x02, 0x70, 0x0B, 0x0B}},
+		{"unknown instruction", nil, []byte{0xFF, 0x0B}},
+		{"missing end", nil, []byte{0x41, 1}},
+		{"code after end", nil, []byte{0x0B, 0x01}},
+		{"unbalanced blocks", nil, append(unbalanced, 0x0B)},
+	}
+
+	for _, test := range tests {
+		if _, err := Compile_Wasm(wasm_test_module(nil, test.results, nil, false, test.body...)); err == nil {
+			t.Errorf("%s: compiled", test.name)
+		}
+	}
+
+	// a plugin that used to crash touchlog with an index out of range
+	crash := []byte("\x00asm\x01\x00\x00\x00\x01\x04\x01\x60\x00\x00\x03\x02\x01\x00\x07\x05\x01\x01f\x00\x00" +
+		"\x0a\x09\x01\x07\x00\x02\x7f\x0b\x45\x1a\x0b")
+	if _, err := Compile_Wasm(crash); err == nil || !strings.Contains(err.Error(), "malformed") {
+		t.Errorf("empty block with a result compiled: %v", err)
+	}
+
+	for _, data := range [][]byte{nil, []byte(wasm_magic + "\x01"), []byte(wasm_magic + "\x01\x05\x01\x60\x01\x00\x00"),
+		[]byte(wasm_magic + "\x08\x01\x05"), []byte(wasm_magic + "\x0a\x01\x01")} {
+		if _, err := Compile_Wasm(data); err == nil {
+			t.Errorf("module %q compiled", data)
+		}
+	}
+}
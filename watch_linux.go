@@ -0,0 +1,67 @@
+package main
+
+import (
+	"os"
+	"syscall"
+	"unsafe"
+)
+
+// Dir_Watcher reports the names of files created, changed, moved or deleted in a directory.
+// On Linux it reads inotify events through the runtime poller, so Close interrupts a pending read.
+type Dir_Watcher struct {
+	Names chan string
+	file  *os.File
+}
+
+// Watch_Dir starts watching a directory.
+func Watch_Dir(dir string) (*Dir_Watcher, error) {
+	fd, err := syscall.InotifyInit1(syscall.IN_CLOEXEC | syscall.IN_NONBLOCK)
+	if err != nil {
+		return nil, os.NewSyscallError("inotify_init1", err)
+	}
+
+	_, err = syscall.InotifyAddWatch(fd, dir, syscall.IN_MODIFY|syscall.IN_CLOSE_WRITE|syscall.IN_CREATE|
+		syscall.IN_MOVED_TO|syscall.IN_MOVED_FROM|syscall.IN_DELETE)
+	if err != nil {
+		syscall.Close(fd)
+
+		return nil, os.NewSyscallError("inotify_add_watch", err)
+	}
+
+	w := &Dir_Watcher{Names: make(chan string, 256), file: os.NewFile(uintptr(fd), "inotify")}
+
+	go w.read()
+
+	return w, nil
+}
+
+func (w *Dir_Watcher) read() {
+	defer close(w.Names)
+
+	buffer := make([]byte, 64*(syscall.SizeofInotifyEvent+syscall.NAME_MAX+1))
+	for {
+		n, err := w.file.Read(buffer)
+		if err != nil {
+			return
+		}
+
+		for offset := 0; offset+syscall.SizeofInotifyEvent <= n; {
+			event := (*syscall.InotifyEvent)(unsafe.Pointer(&buffer[offset]))
+			name := buffer[offset+syscall.SizeofInotifyEvent : offset+syscall.SizeofInotifyEvent+int(event.Len)]
+			offset += syscall.SizeofInotifyEvent + int(event.Len)
+
+			for len(name) > 0 && name[len(name)-1] == 0 {
+				name = name[:len(name)-1]
+			}
+
+			if len(name) > 0 {
+				w.Names <- string(name)
+			}
+		}
+	}
+}
+
+// Close stops the watcher and closes Names.
+func (w *Dir_Watcher) Close() {
+	w.file.Close()
+}
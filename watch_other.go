@@ -0,0 +1,83 @@
+//go:build !linux
+
+package main
+
+import (
+	"os"
+	"time"
+)
+
+const watch_interval time.Duration = 200 * time.Millisecond
+
+// Dir_Watcher reports the names of files created, changed, moved or deleted in a directory.
+// Without inotify it compares the size and modification time of every file on an interval.
+type Dir_Watcher struct {
+	Names chan string
+	done  chan struct{}
+}
+
+// Watch_Dir starts watching a directory.
+func Watch_Dir(dir string) (*Dir_Watcher, error) {
+	seen, err := watch_scan(dir)
+	if err != nil {
+		return nil, err
+	}
+
+	w := &Dir_Watcher{Names: make(chan string, 256), done: make(chan struct{})}
+
+	go func() {
+		defer close(w.Names)
+
+		ticker := time.NewTicker(watch_interval)
+		defer ticker.Stop()
+
+		for {
+			select {
+			case <-w.done:
+				return
+			case <-ticker.C:
+			}
+
+			current, err := watch_scan(dir)
+			if err != nil {
+				continue
+			}
+
+			for name, stamp := range current {
+				if seen[name] != stamp {
+					w.Names <- name
+				}
+			}
+			for name := range seen {
+				if _, ok := current[name]; !ok {
+					w.Names <- name
+				}
+			}
+
+			seen = current
+		}
+	}()
+
+	return w, nil
+}
+
+func watch_scan(dir string) (map[string][2]int64, error) {
+	dirents, err := os.ReadDir(dir)
+	if err != nil {
+		return nil, err
+	}
+
+	stamps := make(map[string][2]int64, len(dirents))
+	for _, dirent := range dirents {
+		if info, err := dirent.Info(); err == nil && info.Mode().IsRegular() {
+			stamps[dirent.Name()] = [2]int64{info.Size(), info.ModTime().UnixNano()}
+		}
+	}
+
+	return stamps, nil
+}
+
+// Close stops the watcher and closes Names.
+func (w *Dir_Watcher) Close() {
+	close(w.done)
+}
@@ -0,0 +1,578 @@
+package main
+
+import (
+	"bufio"
+	"encoding/binary"
+	"errors"
+	"fmt"
+	"io"
+	"os"
+	"path/filepath"
+	"sort"
+	"unicode/utf8"
+)
+
+// The word index lists, for every word of the sections of the logfiles stored as is, where it
+// occurs: the day, the section, how many words of the section come before it and its offset from
+// the line opening the section. Positions let a phrase be matched from the index alone, and
+// offsets let the text around a match be read straight from the logfile, whose section starts
+// the content index records. Offsets are relative to their section, so they stay meaningful to
+// anything holding the section offsets of the same content. Words are folded to lower case the
+// way search ignores case.
+//
+// The index is kept as segments, described with Word_Index. A segment file starts with
+// words_magic, followed by the days it covers, each with the sha256 of the content it was built
+// from, then the dictionary: the words as a Term_FST, which numbers them in sorted order, followed
+// by the number of days holding each word and the size of its postings, by number. The postings of
+// every word come last, in the order of the dictionary, in the blocks described with
+// append_postings. A search reads the days and the dictionary, and then only the postings of the
+// words it looks for.
+const words_name string = "words"
+const words_magic string = "TLWORDS3"
+
+// words_magic_v2 starts segments listing their words one after the other. They are rebuilt.
+const words_magic_v2 string = "TLWORDS2"
+
+var errOutdatedSegment = errors.New("outdated word index segment")
+
+// Word_Posting is one occurrence of a word.
+type Word_Posting struct {
+	Doc      int
+	Section  int
+	Position int
+	Offset   int
+}
+
+// Word_Hit is a match of a phrase: the logfile, the section and the offsets of the start of its
+// first word and of the end of its last word, relative to the line opening the section. For a
+// fuzzy match, End may be past the end of the last word, by as much as the longest word it stands
+// for is longer.
+type Word_Hit struct {
+	Name    string
+	Section int
+	Start   int
+	End     int
+}
+
+type word_doc struct {
+	Name string
+	Hash [32]byte
+}
+
+type word_term struct {
+	docs   int
+	offset int64
+	length int
+}
+
+// word_segment is an open segment of the word index. Docs are the days it covers, in date order,
+// and live tells which of them are still current.
+type word_segment struct {
+	gen   int
+	Docs  []word_doc
+	live  []bool
+	dict  *Term_FST
+	terms []word_term
+	base  int64
+	file  *os.File
+}
+
+// open_word_segment opens a segment file and reads its days and dictionary. Its days are all live.
+func open_word_segment(path string, gen int) (*word_segment, error) {
+	f, err := os.Open(path)
+	if err != nil {
+		return nil, err
+	}
+
+	w := &word_segment{gen: gen, file: f}
+
+	err = w.read_dictionary()
+	if err != nil {
+		f.Close()
+
+		return nil, fmt.Errorf("%s: %w", path, err)
+	}
+
+	w.live = make([]bool, len(w.Docs))
+	for i := range w.live {
+		w.live[i] = true
+	}
+
+	debug.Printf("word segment %d: %d days, %d words\n", gen, len(w.Docs), len(w.terms))
+
+	return w, nil
+}
+
+// days counts the live days of the segment.
+func (w *word_segment) days() int {
+	n := 0
+	for _, live := range w.live {
+		if live {
+			n++
+		}
+	}
+
+	return n
+}
+
+// counting_reader counts the bytes read through it, so the postings can be located once the
+// dictionary before them has been read.
+type counting_reader struct {
+	r *bufio.Reader
+	n int64
+}
+
+func (c *counting_reader) ReadByte() (byte, error) {
+	b, err := c.r.ReadByte()
+	if err == nil {
+		c.n++
+	}
+
+	return b, err
+}
+
+func (c *counting_reader) Read(p []byte) (int, error) {
+	n, err := io.ReadFull(c.r, p)
+	c.n += int64(n)
+
+	return n, err
+}
+
+func (w *word_segment) read_dictionary() error {
+	r := &counting_reader{r: bufio.NewReaderSize(w.file, 64<<10)}
+
+	magic := make([]byte, len(words_magic))
+	if _, err := r.Read(magic); err != nil || string(magic) != words_magic && string(magic) != words_magic_v2 {
+		return errors.New("not a word index segment")
+	}
+
+	if string(magic) == words_magic_v2 {
+		return errOutdatedSegment
+	}
+
+	text := func() (string, error) {
+		n, err := binary.ReadUvarint(r)
+		if err != nil || n > 1<<16 {
+			return "", errors.Join(err, errors.New("damaged word index"))
+		}
+
+		buf := make([]byte, n)
+		_, err = r.Read(buf)
+
+		return string(buf), err
+	}
+
+	count, err := binary.ReadUvarint(r)
+	if err != nil || count > 1<<24 {
+		return errors.Join(err, errors.New("damaged word index"))
+	}
+
+	w.Docs = make([]word_doc, count)
+	for i := range w.Docs {
+		w.Docs[i].Name, err = text()
+		if err != nil {
+			return err
+		}
+
+		if _, err = r.Read(w.Docs[i].Hash[:]); err != nil {
+			return err
+		}
+	}
+
+	count, err = binary.ReadUvarint(r)
+	if err != nil || count > 1<<26 {
+		return errors.Join(err, errors.New("damaged word index"))
+	}
+
+	w.terms = make([]word_term, count)
+
+	root, err1 := binary.ReadUvarint(r)
+	size, err2 := binary.ReadUvarint(r)
+	if err := errors.Join(err1, err2); err != nil || size > 1<<31 || root > size {
+		return errors.Join(err, errors.New("damaged word index"))
+	}
+
+	fst := make([]byte, size)
+	if _, err = r.Read(fst); err != nil {
+		return err
+	}
+
+	w.dict = Open_Term_FST(fst, int(root))
+
+	offset := int64(0)
+	for i := range w.terms {
+		t := &w.terms[i]
+
+		docs, err1 := binary.ReadUvarint(r)
+		length, err2 := binary.ReadUvarint(r)
+		if err := errors.Join(err1, err2); err != nil {
+			return err
+		}
+
+		t.docs, t.length, t.offset = int(docs), int(length), offset
+		offset += int64(length)
+	}
+
+	w.base = r.n
+
+	return nil
+}
+
+// Close closes the segment file.
+func (w *word_segment) Close() {
+	w.file.Close()
+}
+
+// cursor returns a cursor over the occurrences of the word of a number.
+func (w *word_segment) cursor(i int) (*Posting_Cursor, error) {
+	if i >= len(w.terms) {
+		return nil, fmt.Errorf("%s: damaged dictionary", w.file.Name())
+	}
+
+	data := make([]byte, w.terms[i].length)
+
+	_, err := w.file.ReadAt(data, w.base+w.terms[i].offset)
+	if err != nil {
+		return nil, err
+	}
+
+	c, err := New_Posting_Cursor(data)
+	if err != nil {
+		return nil, fmt.Errorf("%s: word %d: %w", w.file.Name(), i, err)
+	}
+
+	return c, nil
+}
+
+// each_postings calls fn with every word of the segment and its occurrences, in dictionary order.
+func (w *word_segment) each_postings(fn func(term string, postings []Word_Posting)) error {
+	if len(w.terms) == 0 {
+		return nil
+	}
+
+	last := w.terms[len(w.terms)-1]
+	blob := make([]byte, last.offset+int64(last.length))
+
+	_, err := w.file.ReadAt(blob, w.base)
+	if err != nil {
+		return err
+	}
+
+	w.dict.Each(func(term []byte, i int) {
+		if err != nil {
+			return
+		}
+
+		if i >= len(w.terms) {
+			err = fmt.Errorf("%s: damaged dictionary", w.file.Name())
+
+			return
+		}
+
+		t := w.terms[i]
+
+		var postings []Word_Posting
+
+		postings, err = decode_postings(blob[t.offset : t.offset+int64(t.length)])
+		if err != nil {
+			err = fmt.Errorf("%s: %s: %w", w.file.Name(), term, err)
+
+			return
+		}
+
+		fn(string(term), postings)
+	})
+
+	return err
+}
+
+// write_word_segment writes a segment file holding docs and the postings of their words.
+//
+// If the segment is successfully written, write_word_segment returns true.
+// Otherwise, the error is logged and write_word_segment returns false.
+func write_word_segment(path string, docs []word_doc, postings map[string][]Word_Posting) bool {
+	terms := make([]string, 0, len(postings))
+	for term := range postings {
+		terms = append(terms, term)
+	}
+
+	sort.Strings(terms)
+
+	out := []byte(words_magic)
+	out = binary.AppendUvarint(out, uint64(len(docs)))
+	for _, doc := range docs {
+		out = binary.AppendUvarint(out, uint64(len(doc.Name)))
+		out = append(out, doc.Name...)
+		out = append(out, doc.Hash[:]...)
+	}
+
+	fst, root := Build_Term_FST(terms).Encoded()
+
+	out = binary.AppendUvarint(out, uint64(len(terms)))
+	out = binary.AppendUvarint(out, uint64(root))
+	out = binary.AppendUvarint(out, uint64(len(fst)))
+	out = append(out, fst...)
+
+	var blob []byte
+
+	for _, term := range terms {
+		p := postings[term]
+
+		days := 0
+		for i := range p {
+			if i == 0 || p[i].Doc != p[i-1].Doc {
+				days++
+			}
+		}
+
+		size := len(blob)
+		blob = append_postings(blob, p)
+
+		out = binary.AppendUvarint(out, uint64(days))
+		out = binary.AppendUvarint(out, uint64(len(blob)-size))
+	}
+
+	out = append(out, blob...)
+
+	debug.Printf("word segment %s: %d days, %d words, %d bytes\n", filepath.Base(path), len(docs), len(terms),
+		len(out))
+
+	return Write_Atomic(path, out)
+}
+
+// Each_Word calls fn with the bounds of every word of data: a run of letters, digits and
+// non-ASCII bytes, as Each_Token hashes them.
+func Each_Word(data []byte, fn func(start int, end int)) {
+	start := -1
+
+	for i, c := range data {
+		if is_token_byte(c) {
+			if start < 0 {
+				start = i
+			}
+
+			continue
+		}
+
+		if start >= 0 {
+			fn(start, i)
+			start = -1
+		}
+	}
+
+	if start >= 0 {
+		fn(start, len(data))
+	}
+}
+
+// Each_Section_Word calls fn with every word of the sections of a day, folded to lower case,
+// along with its section, its position in the section and its offset from the line opening the
+// section. The word is only valid during the call.
+func Each_Section_Word(view *Day_View, fn func(section int, position int, offset int, word []byte)) {
+	var folded []byte
+
+	for i := 0; i < view.Sections(); i++ {
+		name, body := view.Section(i)
+
+		// the body starts on the line after the section line
+		base := len(section_prefix) + len(name) + 1
+		position := 0
+
+		Each_Word(body, func(start int, end int) {
+			folded = folded[:0]
+			for _, c := range body[start:end] {
+				folded = append(folded, lower(c))
+			}
+
+			fn(i, position, base+start, folded)
+			position++
+		})
+	}
+}
+
+// Phrase_Words returns the words of a text, folded to lower case.
+func Phrase_Words(text string) []string {
+	var words []string
+
+	Each_Word([]byte(text), func(start int, end int) {
+		folded := make([]byte, end-start)
+		for i, c := range []byte(text[start:end]) {
+			folded[i] = lower(c)
+		}
+
+		words = append(words, string(folded))
+	})
+
+	return words
+}
+
+// Phrase_Query is a phrase to look for: its words, folded to lower case, and how many edits each
+// of them may be off by.
+type Phrase_Query struct {
+	Words     []string
+	Distances []int
+	automata  []*levenshtein
+	folded    []byte
+}
+
+// New_Phrase_Query returns the query of the words of a text, each of them allowed up to fuzzy
+// edits, but no more than one for every three letters, so short words still match exactly.
+func New_Phrase_Query(text string, fuzzy int) *Phrase_Query {
+	q := &Phrase_Query{Words: Phrase_Words(text)}
+
+	for _, word := range q.Words {
+		distance := min(fuzzy, utf8.RuneCountInString(word)/3)
+
+		q.Distances = append(q.Distances, distance)
+		q.automata = append(q.automata, &levenshtein{query: []rune(word), limit: distance})
+	}
+
+	return q
+}
+
+// Matches tells whether a word of a text, as written, matches the i-th word of the query.
+func (q *Phrase_Query) Matches(i int, word []byte) bool {
+	if q.Distances[i] == 0 {
+		return len(word) == len(q.Words[i]) && contains_fold(word, []byte(q.Words[i]))
+	}
+
+	q.folded = q.folded[:0]
+	for _, c := range word {
+		q.folded = append(q.folded, lower(c))
+	}
+
+	return q.automata[i].matches(q.folded)
+}
+
+// Exact_Words returns the words of the query that may not be off by any edit.
+func (q *Phrase_Query) Exact_Words() []string {
+	var words []string
+
+	for i, word := range q.Words {
+		if q.Distances[i] == 0 {
+			words = append(words, word)
+		}
+	}
+
+	return words
+}
+
+// expand returns the numbers of the words of the segment matching the i-th word of a query, and
+// the length of the longest of them.
+func (w *word_segment) expand(q *Phrase_Query, i int) ([]int, int) {
+	if q.Distances[i] == 0 {
+		n, found := w.dict.Lookup(q.Words[i])
+		if !found {
+			return nil, 0
+		}
+
+		return []int{n}, len(q.Words[i])
+	}
+
+	var terms []int
+	longest := 0
+
+	w.dict.Fuzzy(q.Words[i], q.Distances[i], false, func(term []byte, n int, _ int) {
+		terms = append(terms, n)
+		longest = max(longest, len(term))
+	})
+
+	return terms, longest
+}
+
+// phrase appends the matches of a phrase in the live days of the segment to hits, in the order of
+// days and of their occurrences. A word off by some edits stands for every word of the segment
+// within them, whose occurrences are walked as one. The cursors of the words leapfrog to the days
+// holding all of them, rarest word first, so the blocks of days missing a word are never decoded,
+// and positions are only compared within those days.
+func (w *word_segment) phrase(hits []Word_Hit, q *Phrase_Query) ([]Word_Hit, error) {
+	order := make([]int, len(q.Words))
+	cursors := make([]posting_source, len(q.Words))
+	lengths := make([]int, len(q.Words))
+	days := make([]int, len(q.Words))
+
+	for i := range q.Words {
+		terms, longest := w.expand(q, i)
+		if len(terms) == 0 {
+			return hits, nil
+		}
+
+		union := make([]*Posting_Cursor, len(terms))
+		for j, t := range terms {
+			c, err := w.cursor(t)
+			if err != nil {
+				return hits, err
+			}
+
+			union[j] = c
+			days[i] += w.terms[t].docs
+		}
+
+		order[i], cursors[i], lengths[i] = i, new_posting_source(union), longest
+	}
+
+	sort.SliceStable(order, func(a, b int) bool { return days[order[a]] < days[order[b]] })
+
+	lists := make([][]Word_Posting, len(q.Words))
+
+	for target := 0; ; target++ {
+		for agreed := 0; agreed < len(order); {
+			doc, err := cursors[order[agreed]].Seek(target)
+			if doc < 0 || err != nil {
+				return hits, err
+			}
+
+			if doc > target {
+				target, agreed = doc, 0
+
+				continue
+			}
+
+			agreed++
+		}
+
+		// a day indexed again in a newer segment is left to it
+		if !w.live[target] {
+			continue
+		}
+
+		for i, c := range cursors {
+			var err error
+
+			lists[i], err = c.Take(lists[i][:0])
+			if err != nil {
+				return nil, err
+			}
+		}
+
+		hits = append_phrase_hits(hits, w.Docs[target].Name, lists, lengths)
+	}
+}
+
+// append_phrase_hits appends the matches of a phrase within one day, given the occurrences of each
+// of its words there, in order of section and position, and the length of each word.
+func append_phrase_hits(hits []Word_Hit, name string, lists [][]Word_Posting, lengths []int) []Word_Hit {
+	for _, p := range lists[0] {
+		end := p.Offset + lengths[0]
+
+		matched := true
+		for k := 1; k < len(lists) && matched; k++ {
+			list := lists[k]
+
+			j := sort.Search(len(list), func(j int) bool {
+				return list[j].Section > p.Section || list[j].Section == p.Section && list[j].Position >= p.Position+k
+			})
+
+			matched = j < len(list) && list[j].Section == p.Section && list[j].Position == p.Position+k
+			if matched {
+				end = list[j].Offset + lengths[k]
+			}
+		}
+
+		if matched {
+			hits = append(hits, Word_Hit{Name: name, Section: p.Section, Start: p.Offset, End: end})
+		}
+	}
+
+	return hits
+}
@@ -0,0 +1,1009 @@
+package main
+
+import (
+	"encoding/binary"
+	"errors"
+	"math/bits"
+)
+
+// Zstandard decompression as specified by RFC 8878, which the standard library lacks. A frame is
+// decoded whole into memory, which is all logfiles need; frames using a dictionary are refused.
+const zstd_magic uint32 = 0xFD2FB528
+const zstd_skippable_magic uint32 = 0x184D2A50
+const zstd_max_block int = 128 << 10
+
+const huff_max_bits int = 11
+
+var errZstdCorrupt = errors.New("zstd: corrupt input")
+
+// Literal length and match length codes stand for a base value plus a number of extra bits.
+var ll_base = [36]uint32{0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 18, 20, 22, 24, 28, 32, 40,
+	48, 64, 128, 256, 512, 1024, 2048, 4096, 8192, 16384, 32768, 65536}
+var ll_bits = [36]uint8{0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 3, 3, 4, 6, 7, 8, 9, 10,
+	11, 12, 13, 14, 15, 16}
+var ml_base = [53]uint32{3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26,
+	27, 28, 29, 30, 31, 32, 33, 34, 35, 37, 39, 41, 43, 47, 51, 59, 67, 83, 99, 131, 259, 515, 1027, 2051, 4099,
+	8195, 16387, 32771, 65539}
+var ml_bits = [53]uint8{0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 1, 1, 1, 1, 2, 2, 3, 3, 4, 4, 5, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16}
+
+// The predefined distributions of literal lengths, match lengths and offsets.
+var ll_default = []int16{4, 3, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2, 2, 3, 2, 1, 1, 1,
+	1, 1, -1, -1, -1, -1}
+var ml_default = []int16{1, 4, 3, 2, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, -1, -1, -1, -1, -1, -1, -1}
+var of_default = []int16{1, 1, 1, 1, 1, 1, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, -1, -1, -1, -1, -1}
+
+var ll_predefined, ml_predefined, of_predefined fse_table
+
+func init() {
+	build_fse(&ll_predefined, ll_default, 6)
+	build_fse(&ml_predefined, ml_default, 6)
+	build_fse(&of_predefined, of_default, 5)
+}
+
+// fse_entry is a state of an FSE decoding table: the symbol it stands for and how the next state
+// is found, base plus the value of the next bits.
+type fse_entry struct {
+	symbol uint8
+	bits   uint8
+	base   uint16
+}
+
+type fse_table struct {
+	log     uint8
+	valid   bool
+	entries []fse_entry
+	storage [1 << 9]fse_entry
+}
+
+type huff_entry struct {
+	symbol uint8
+	bits   uint8
+}
+
+// Zstd_Decoder holds the state of a decompression, which is reused from one frame to the next.
+type Zstd_Decoder struct {
+	ll, ml, of fse_table
+	weights    fse_table
+	huff       [1 << huff_max_bits]huff_entry
+	huffLog    uint8
+	hasHuff    bool
+	literals   []byte
+	reps       [3]int
+	out        []byte
+	frame      int
+}
+
+// Decode decompresses every frame of src, skipping skippable frames, and appends the content to dst.
+func (d *Zstd_Decoder) Decode(dst []byte, src []byte) ([]byte, error) {
+	d.out = dst
+
+	defer func() {
+		d.out = nil
+	}()
+
+	for len(src) > 0 {
+		if len(src) < 4 {
+			return nil, errZstdCorrupt
+		}
+
+		magic := binary.LittleEndian.Uint32(src)
+		if magic&0xFFFFFFF0 == zstd_skippable_magic {
+			if len(src) < 8 || uint64(len(src)-8) < uint64(binary.LittleEndian.Uint32(src[4:])) {
+				return nil, errZstdCorrupt
+			}
+
+			src = src[8+binary.LittleEndian.Uint32(src[4:]):]
+
+			continue
+		}
+
+		if magic != zstd_magic {
+			return nil, errors.New("zstd: not a zstd frame")
+		}
+
+		n, err := d.decode_frame(src[4:])
+		if err != nil {
+			return nil, err
+		}
+
+		src = src[4+n:]
+	}
+
+	return d.out, nil
+}
+
+// decode_frame decodes the frame following a magic number and returns its size.
+func (d *Zstd_Decoder) decode_frame(src []byte) (int, error) {
+	if len(src) < 1 {
+		return 0, errZstdCorrupt
+	}
+
+	descriptor := src[0]
+	if descriptor&0x08 != 0 {
+		return 0, errZstdCorrupt
+	}
+
+	p := 1
+	if descriptor&0x20 == 0 {
+		p++ // window descriptor, of no use when decoding into memory
+	}
+
+	dictSize := [4]int{0, 1, 2, 4}[descriptor&3]
+
+	contentSize := [4]int{0, 2, 4, 8}[descriptor>>6]
+	if descriptor>>6 == 0 && descriptor&0x20 != 0 {
+		contentSize = 1
+	}
+
+	if len(src) < p+dictSize+contentSize {
+		return 0, errZstdCorrupt
+	}
+
+	for _, b := range src[p : p+dictSize] {
+		if b != 0 {
+			return 0, errors.New("zstd: frames using a dictionary are not supported")
+		}
+	}
+
+	p += dictSize
+
+	var size uint64
+	for i := contentSize - 1; i >= 0; i-- {
+		size = size<<8 | uint64(src[p+i])
+	}
+
+	if contentSize == 2 {
+		size += 256
+	}
+
+	p += contentSize
+
+	if contentSize > 0 && size < 1<<30 {
+		d.out = grow(d.out, int(size))
+	}
+
+	d.frame = len(d.out)
+	d.reps = [3]int{1, 4, 8}
+	d.hasHuff = false
+	d.ll.valid, d.ml.valid, d.of.valid = false, false, false
+
+	for {
+		if len(src) < p+3 {
+			return 0, errZstdCorrupt
+		}
+
+		header := uint32(src[p]) | uint32(src[p+1])<<8 | uint32(src[p+2])<<16
+		last, kind, blockSize := header&1 != 0, (header>>1)&3, int(header>>3)
+		p += 3
+
+		switch kind {
+		case 0:
+			if len(src) < p+blockSize {
+				return 0, errZstdCorrupt
+			}
+
+			d.out = append(d.out, src[p:p+blockSize]...)
+			p += blockSize
+		case 1:
+			if len(src) < p+1 {
+				return 0, errZstdCorrupt
+			}
+
+			d.out = grow(d.out, blockSize)
+			for i := 0; i < blockSize; i++ {
+				d.out = append(d.out, src[p])
+			}
+
+			p++
+		case 2:
+			if len(src) < p+blockSize || blockSize > zstd_max_block {
+				return 0, errZstdCorrupt
+			}
+
+			err := d.decode_block(src[p : p+blockSize])
+			if err != nil {
+				return 0, err
+			}
+
+			p += blockSize
+		default:
+			return 0, errZstdCorrupt
+		}
+
+		if last {
+			break
+		}
+	}
+
+	if contentSize > 0 && uint64(len(d.out)-d.frame) != size {
+		return 0, errZstdCorrupt
+	}
+
+	if descriptor&0x04 != 0 {
+		if len(src) < p+4 {
+			return 0, errZstdCorrupt
+		}
+
+		if uint32(xxhash64(d.out[d.frame:])) != binary.LittleEndian.Uint32(src[p:]) {
+			return 0, errors.New("zstd: checksum mismatch")
+		}
+
+		p += 4
+	}
+
+	return p, nil
+}
+
+func (d *Zstd_Decoder) decode_block(src []byte) error {
+	literals, n, err := d.decode_literals(src)
+	if err != nil {
+		return err
+	}
+
+	return d.decode_sequences(src[n:], literals)
+}
+
+// decode_literals decodes the literals section of a compressed block and returns the literals and
+// the size of the section.
+func (d *Zstd_Decoder) decode_literals(src []byte) ([]byte, int, error) {
+	if len(src) < 1 {
+		return nil, 0, errZstdCorrupt
+	}
+
+	kind, format := src[0]&3, (src[0]>>2)&3
+
+	if kind < 2 {
+		var size, header int
+
+		switch format {
+		case 0, 2:
+			size, header = int(src[0]>>3), 1
+		case 1:
+			if len(src) < 2 {
+				return nil, 0, errZstdCorrupt
+			}
+
+			size, header = int(src[0]>>4)|int(src[1])<<4, 2
+		case 3:
+			if len(src) < 3 {
+				return nil, 0, errZstdCorrupt
+			}
+
+			size, header = int(src[0]>>4)|int(src[1])<<4|int(src[2])<<12, 3
+		}
+
+		if kind == 0 {
+			if len(src) < header+size {
+				return nil, 0, errZstdCorrupt
+			}
+
+			return src[header : header+size], header + size, nil
+		}
+
+		if len(src) < header+1 || size > zstd_max_block {
+			return nil, 0, errZstdCorrupt
+		}
+
+		d.literals = grow(d.literals[:0], size)[:size]
+		for i := range d.literals {
+			d.literals[i] = src[header]
+		}
+
+		return d.literals, header + 1, nil
+	}
+
+	var header, size, compressed int
+
+	streams := 4
+	switch format {
+	case 0, 1:
+		if len(src) < 3 {
+			return nil, 0, errZstdCorrupt
+		}
+
+		v := int(src[0]) | int(src[1])<<8 | int(src[2])<<16
+		header, size, compressed = 3, (v>>4)&0x3FF, (v>>14)&0x3FF
+		if format == 0 {
+			streams = 1
+		}
+	case 2:
+		if len(src) < 4 {
+			return nil, 0, errZstdCorrupt
+		}
+
+		v := int(binary.LittleEndian.Uint32(src))
+		header, size, compressed = 4, (v>>4)&0x3FFF, (v>>18)&0x3FFF
+	case 3:
+		if len(src) < 5 {
+			return nil, 0, errZstdCorrupt
+		}
+
+		v := int(binary.LittleEndian.Uint32(src)) | int(src[4])<<32
+		header, size, compressed = 5, (v>>4)&0x3FFFF, (v>>22)&0x3FFFF
+	}
+
+	if len(src) < header+compressed || size > zstd_max_block {
+		return nil, 0, errZstdCorrupt
+	}
+
+	data := src[header : header+compressed]
+
+	if kind == 2 {
+		n, err := d.read_huffman(data)
+		if err != nil {
+			return nil, 0, err
+		}
+
+		data = data[n:]
+	} else if !d.hasHuff {
+		return nil, 0, errZstdCorrupt
+	}
+
+	d.literals = grow(d.literals[:0], size)[:size]
+
+	if streams == 1 {
+		err := d.decode_huffman_stream(data, d.literals)
+		if err != nil {
+			return nil, 0, err
+		}
+
+		return d.literals, header + compressed, nil
+	}
+
+	if len(data) < 6 {
+		return nil, 0, errZstdCorrupt
+	}
+
+	var lengths [4]int
+
+	lengths[0] = int(binary.LittleEndian.Uint16(data))
+	lengths[1] = int(binary.LittleEndian.Uint16(data[2:]))
+	lengths[2] = int(binary.LittleEndian.Uint16(data[4:]))
+	lengths[3] = len(data) - 6 - lengths[0] - lengths[1] - lengths[2]
+	if lengths[3] < 0 {
+		return nil, 0, errZstdCorrupt
+	}
+
+	data = data[6:]
+	segment := (size + 3) / 4
+
+	for i, length := range lengths {
+		out := d.literals[min(i*segment, size):min((i+1)*segment, size)]
+
+		err := d.decode_huffman_stream(data[:length], out)
+		if err != nil {
+			return nil, 0, err
+		}
+
+		data = data[length:]
+	}
+
+	return d.literals, header + compressed, nil
+}
+
+// read_huffman reads the description of a Huffman tree, as weights either compressed with FSE or
+// stored four bits each, builds its decoding table and returns the size of the description.
+func (d *Zstd_Decoder) read_huffman(src []byte) (int, error) {
+	if len(src) < 1 {
+		return 0, errZstdCorrupt
+	}
+
+	var weights [256]uint8
+
+	count, size := 0, 0
+
+	if header := int(src[0]); header < 128 {
+		size = 1 + header
+		if len(src) < size {
+			return 0, errZstdCorrupt
+		}
+
+		var probs [256]int16
+
+		n, log, symbols, err := read_fse_description(src[1:size], 255, 6, probs[:])
+		if err != nil {
+			return 0, err
+		}
+
+		if !build_fse(&d.weights, probs[:symbols], log) {
+			return 0, errZstdCorrupt
+		}
+
+		r, ok := new_rev_bits(src[1+n : size])
+		if !ok {
+			return 0, errZstdCorrupt
+		}
+
+		table := d.weights.entries
+		s1, s2 := r.read(uint(log)), r.read(uint(log))
+
+		for {
+			if count > 253 {
+				return 0, errZstdCorrupt
+			}
+
+			e := table[s1]
+			weights[count] = e.symbol
+			count++
+			s1 = uint32(e.base) + r.read(uint(e.bits))
+			if r.pos < 0 {
+				weights[count] = table[s2].symbol
+				count++
+
+				break
+			}
+
+			e = table[s2]
+			weights[count] = e.symbol
+			count++
+			s2 = uint32(e.base) + r.read(uint(e.bits))
+			if r.pos < 0 {
+				weights[count] = table[s1].symbol
+				count++
+
+				break
+			}
+		}
+	} else {
+		count = header - 127
+		size = 1 + (count+1)/2
+		if len(src) < size {
+			return 0, errZstdCorrupt
+		}
+
+		for i := 0; i < count; i++ {
+			b := src[1+i/2]
+			if i%2 == 0 {
+				weights[i] = b >> 4
+			} else {
+				weights[i] = b & 15
+			}
+		}
+	}
+
+	// the weight of the last symbol is what completes the total to a power of two
+	var total uint32
+	for _, w := range weights[:count] {
+		if int(w) > huff_max_bits {
+			return 0, errZstdCorrupt
+		}
+
+		if w > 0 {
+			total += 1 << (w - 1)
+		}
+	}
+
+	if total == 0 || count >= 256 {
+		return 0, errZstdCorrupt
+	}
+
+	maxBits := bits.Len32(total)
+	rest := uint32(1)<<maxBits - total
+	if maxBits > huff_max_bits || rest&(rest-1) != 0 {
+		return 0, errZstdCorrupt
+	}
+
+	weights[count] = uint8(bits.Len32(rest))
+	count++
+
+	var ranks [huff_max_bits + 2]uint32
+	for _, w := range weights[:count] {
+		ranks[w]++
+	}
+
+	next := uint32(0)
+	for w := 1; w <= maxBits; w++ {
+		start := next
+		next += ranks[w] << (w - 1)
+		ranks[w] = start
+	}
+
+	for symbol, w := range weights[:count] {
+		if w == 0 {
+			continue
+		}
+
+		entry := huff_entry{symbol: uint8(symbol), bits: uint8(maxBits + 1 - int(w))}
+		start := ranks[w]
+		for i := start; i < start+1<<(w-1); i++ {
+			d.huff[i] = entry
+		}
+
+		ranks[w] += 1 << (w - 1)
+	}
+
+	d.huffLog = uint8(maxBits)
+	d.hasHuff = true
+
+	return size, nil
+}
+
+func (d *Zstd_Decoder) decode_huffman_stream(src []byte, out []byte) error {
+	r, ok := new_rev_bits(src)
+	if !ok {
+		return errZstdCorrupt
+	}
+
+	log := uint(d.huffLog)
+	for i := range out {
+		e := d.huff[r.peek(log)]
+		out[i] = e.symbol
+		r.pos -= int(e.bits)
+	}
+
+	if r.pos != 0 {
+		return errZstdCorrupt
+	}
+
+	return nil
+}
+
+// decode_sequences decodes the sequences section of a compressed block and executes the
+// sequences, copying literals and matches to the output.
+func (d *Zstd_Decoder) decode_sequences(src []byte, literals []byte) error {
+	if len(src) < 1 {
+		return errZstdCorrupt
+	}
+
+	count, p := int(src[0]), 1
+	switch {
+	case count == 255:
+		if len(src) < 3 {
+			return errZstdCorrupt
+		}
+
+		count, p = int(src[1])|int(src[2])<<8+0x7F00, 3
+	case count >= 128:
+		if len(src) < 2 {
+			return errZstdCorrupt
+		}
+
+		count, p = (count-128)<<8|int(src[1]), 2
+	}
+
+	if count == 0 {
+		d.out = append(d.out, literals...)
+
+		return nil
+	}
+
+	if len(src) < p+1 {
+		return errZstdCorrupt
+	}
+
+	modes := src[p]
+	p++
+
+	if modes&3 != 0 {
+		return errZstdCorrupt
+	}
+
+	for _, t := range []struct {
+		table     *fse_table
+		mode      byte
+		maxSymbol int
+		maxLog    uint8
+		defaults  *fse_table
+	}{
+		{&d.ll, modes >> 6, 35, 9, &ll_predefined},
+		{&d.of, (modes >> 4) & 3, 31, 8, &of_predefined},
+		{&d.ml, (modes >> 2) & 3, 52, 9, &ml_predefined},
+	} {
+		n, err := sequence_table(t.table, t.mode, src[p:], t.maxSymbol, t.maxLog, t.defaults)
+		if err != nil {
+			return err
+		}
+
+		p += n
+	}
+
+	r, ok := new_rev_bits(src[p:])
+	if !ok {
+		return errZstdCorrupt
+	}
+
+	ll, of, ml := d.ll.entries, d.of.entries, d.ml.entries
+	llState, ofState, mlState := r.read(uint(d.ll.log)), r.read(uint(d.of.log)), r.read(uint(d.ml.log))
+
+	used := 0
+
+	for i := 0; i < count; i++ {
+		lle, ofe, mle := ll[llState], of[ofState], ml[mlState]
+		if ofe.symbol > 31 || mle.symbol > 52 || lle.symbol > 35 {
+			return errZstdCorrupt
+		}
+
+		offset := 1<<ofe.symbol + int(r.read(uint(ofe.symbol)))
+		matchLength := int(ml_base[mle.symbol] + r.read(uint(ml_bits[mle.symbol])))
+		literalLength := int(ll_base[lle.symbol] + r.read(uint(ll_bits[lle.symbol])))
+
+		if offset > 3 {
+			offset -= 3
+			d.reps = [3]int{offset, d.reps[0], d.reps[1]}
+		} else {
+			if literalLength == 0 {
+				offset++
+			}
+
+			switch offset {
+			case 1:
+				offset = d.reps[0]
+			case 2:
+				offset = d.reps[1]
+				d.reps = [3]int{offset, d.reps[0], d.reps[2]}
+			case 3:
+				offset = d.reps[2]
+				d.reps = [3]int{offset, d.reps[0], d.reps[1]}
+			case 4:
+				offset = d.reps[0] - 1
+				d.reps = [3]int{offset, d.reps[0], d.reps[1]}
+			}
+		}
+
+		if i < count-1 {
+			llState = uint32(lle.base) + r.read(uint(lle.bits))
+			mlState = uint32(mle.base) + r.read(uint(mle.bits))
+			ofState = uint32(ofe.base) + r.read(uint(ofe.bits))
+		}
+
+		if used+literalLength > len(literals) {
+			return errZstdCorrupt
+		}
+
+		d.out = append(d.out, literals[used:used+literalLength]...)
+		used += literalLength
+
+		start := len(d.out) - offset
+		if offset <= 0 || start < d.frame {
+			return errZstdCorrupt
+		}
+
+		if offset >= matchLength {
+			d.out = append(d.out, d.out[start:start+matchLength]...)
+		} else {
+			d.out = grow(d.out, matchLength)
+			for k := 0; k < matchLength; k++ {
+				d.out = append(d.out, d.out[start+k])
+			}
+		}
+	}
+
+	if r.pos != 0 {
+		return errZstdCorrupt
+	}
+
+	d.out = append(d.out, literals[used:]...)
+
+	return nil
+}
+
+// sequence_table sets up the decoding table of one kind of sequence field for a block according
+// to its mode, and returns the size of the table description read from src.
+func sequence_table(t *fse_table, mode byte, src []byte, maxSymbol int, maxLog uint8, defaults *fse_table) (int, error) {
+	switch mode {
+	case 0:
+		t.log = defaults.log
+		t.entries = t.storage[:len(defaults.entries)]
+		copy(t.entries, defaults.entries)
+		t.valid = true
+
+		return 0, nil
+	case 1:
+		if len(src) < 1 || int(src[0]) > maxSymbol {
+			return 0, errZstdCorrupt
+		}
+
+		t.log = 0
+		t.entries = t.storage[:1]
+		t.entries[0] = fse_entry{symbol: src[0]}
+		t.valid = true
+
+		return 1, nil
+	case 2:
+		var probs [64]int16
+
+		n, log, symbols, err := read_fse_description(src, maxSymbol, maxLog, probs[:])
+		if err != nil {
+			return 0, err
+		}
+
+		if !build_fse(t, probs[:symbols], log) {
+			return 0, errZstdCorrupt
+		}
+
+		return n, nil
+	default:
+		if !t.valid {
+			return 0, errZstdCorrupt
+		}
+
+		return 0, nil
+	}
+}
+
+// read_fse_description reads the normalized probabilities of an FSE table into probs and returns
+// the size of the description, the accuracy log of the table and the number of symbols.
+func read_fse_description(src []byte, maxSymbol int, maxLog uint8, probs []int16) (int, uint8, int, error) {
+	r := fwd_bits{data: src}
+
+	log := uint8(r.read(4)) + 5
+	if log > maxLog {
+		return 0, 0, 0, errZstdCorrupt
+	}
+
+	remaining := int32(1)<<log + 1
+	threshold := int32(1) << log
+	width := uint(log) + 1
+	symbol := 0
+	previous0 := false
+
+	for remaining > 1 && symbol <= maxSymbol {
+		if previous0 {
+			repeat := r.read(2)
+			for repeat == 3 {
+				symbol += 3
+				repeat = r.read(2)
+			}
+
+			symbol += int(repeat)
+			if symbol > maxSymbol {
+				return 0, 0, 0, errZstdCorrupt
+			}
+		}
+
+		limit := 2*threshold - 1 - remaining
+
+		var count int32
+		if low := int32(r.peek(width - 1)); low < limit {
+			count = low
+			r.pos += width - 1
+		} else {
+			count = int32(r.peek(width))
+			if count >= threshold {
+				count -= limit
+			}
+
+			r.pos += width
+		}
+
+		count--
+		if count < 0 {
+			remaining += count
+		} else {
+			remaining -= count
+		}
+
+		probs[symbol] = int16(count)
+		symbol++
+		previous0 = count == 0
+
+		for remaining < threshold {
+			width--
+			threshold >>= 1
+		}
+	}
+
+	if remaining != 1 || r.pos > uint(8*len(src)) {
+		return 0, 0, 0, errZstdCorrupt
+	}
+
+	return int(r.pos+7) / 8, log, symbol, nil
+}
+
+// build_fse builds the decoding table of a distribution, spreading every symbol over as many
+// states as its probability, and reports whether the distribution was valid.
+func build_fse(t *fse_table, probs []int16, log uint8) bool {
+	size := 1 << log
+	t.log = log
+	t.entries = t.storage[:size]
+	t.valid = false
+
+	var next [256]uint16
+
+	high := size - 1
+	for s, p := range probs {
+		if p == -1 {
+			if high < 0 {
+				return false
+			}
+
+			t.entries[high].symbol = uint8(s)
+			high--
+			next[s] = 1
+		} else {
+			next[s] = uint16(p)
+		}
+	}
+
+	step := size>>1 + size>>3 + 3
+	pos := 0
+
+	for s, p := range probs {
+		for i := 0; i < int(p); i++ {
+			t.entries[pos].symbol = uint8(s)
+
+			pos = (pos + step) & (size - 1)
+			for pos > high {
+				pos = (pos + step) & (size - 1)
+			}
+		}
+	}
+
+	if pos != 0 {
+		return false
+	}
+
+	for i := range t.entries {
+		e := &t.entries[i]
+
+		state := next[e.symbol]
+		next[e.symbol]++
+
+		if state == 0 {
+			return false
+		}
+
+		e.bits = log - uint8(bits.Len16(state)-1)
+		e.base = state<<e.bits - uint16(size)
+	}
+
+	t.valid = true
+
+	return true
+}
+
+// fwd_bits reads a little-endian bit stream from its start.
+type fwd_bits struct {
+	data []byte
+	pos  uint
+}
+
+func (r *fwd_bits) peek(n uint) uint32 {
+	var v uint64
+
+	b := int(r.pos >> 3)
+	for i := 0; i < 5 && b+i < len(r.data); i++ {
+		v |= uint64(r.data[b+i]) << (8 * i)
+	}
+
+	return uint32(v>>(r.pos&7)) & (1<<n - 1)
+}
+
+func (r *fwd_bits) read(n uint) uint32 {
+	v := r.peek(n)
+	r.pos += n
+
+	return v
+}
+
+// rev_bits reads a bit stream from its end, where the highest set bit of the last byte marks
+// where the stream starts. pos is the number of bits left; reading past the beginning yields
+// zeros and makes pos negative.
+type rev_bits struct {
+	data []byte
+	pos  int
+}
+
+func new_rev_bits(data []byte) (rev_bits, bool) {
+	if len(data) == 0 || data[len(data)-1] == 0 {
+		return rev_bits{}, false
+	}
+
+	return rev_bits{data: data, pos: 8*(len(data)-1) + bits.Len8(data[len(data)-1]) - 1}, true
+}
+
+// extract returns the n bits starting at bit pos, with bits before the stream read as zeros.
+func (r *rev_bits) extract(pos int, n uint) uint32 {
+	shift := uint(0)
+	if pos < 0 {
+		if pos+int(n) <= 0 {
+			return 0
+		}
+
+		shift = uint(-pos)
+		n -= shift
+		pos = 0
+	}
+
+	var v uint64
+
+	b := pos >> 3
+	for i := 0; i < 5 && b+i < len(r.data); i++ {
+		v |= uint64(r.data[b+i]) << (8 * i)
+	}
+
+	return uint32(v>>(uint(pos)&7)) & (1<<n - 1) << shift
+}
+
+func (r *rev_bits) peek(n uint) uint32 {
+	return r.extract(r.pos-int(n), n)
+}
+
+func (r *rev_bits) read(n uint) uint32 {
+	if n == 0 {
+		return 0
+	}
+
+	r.pos -= int(n)
+
+	return r.extract(r.pos, n)
+}
+
+// grow makes room for n more bytes in buf.
+func grow(buf []byte, n int) []byte {
+	if cap(buf)-len(buf) >= n {
+		return buf
+	}
+
+	grown := make([]byte, len(buf), len(buf)+max(n, len(buf)))
+	copy(grown, buf)
+
+	return grown
+}
+
+const xxh_prime1 uint64 = 11400714785074694791
+const xxh_prime2 uint64 = 14029467366897019727
+const xxh_prime3 uint64 = 1609587929392839161
+const xxh_prime4 uint64 = 9650029242287828579
+const xxh_prime5 uint64 = 2870177450012600261
+
+func xxh_round(acc uint64, lane uint64) uint64 {
+	return bits.RotateLeft64(acc+lane*xxh_prime2, 31) * xxh_prime1
+}
+
+func xxh_merge(acc uint64, v uint64) uint64 {
+	return (acc^xxh_round(0, v))*xxh_prime1 + xxh_prime4
+}
+
+// xxhash64 is XXH64 with a seed of zero, whose low 32 bits are the checksum of a zstd frame.
+func xxhash64(data []byte) uint64 {
+	n := uint64(len(data))
+
+	var h uint64
+
+	if len(data) >= 32 {
+		// the seeds wrap around, which constant arithmetic does not allow
+		prime1, prime2 := xxh_prime1, xxh_prime2
+		v1, v2, v3, v4 := prime1+prime2, prime2, uint64(0), -prime1
+
+		for ; len(data) >= 32; data = data[32:] {
+			v1 = xxh_round(v1, binary.LittleEndian.Uint64(data))
+			v2 = xxh_round(v2, binary.LittleEndian.Uint64(data[8:]))
+			v3 = xxh_round(v3, binary.LittleEndian.Uint64(data[16:]))
+			v4 = xxh_round(v4, binary.LittleEndian.Uint64(data[24:]))
+		}
+
+		h = bits.RotateLeft64(v1, 1) + bits.RotateLeft64(v2, 7) + bits.RotateLeft64(v3, 12) + bits.RotateLeft64(v4, 18)
+		h = xxh_merge(xxh_merge(xxh_merge(xxh_merge(h, v1), v2), v3), v4)
+	} else {
+		h = xxh_prime5
+	}
+
+	h += n
+
+	for ; len(data) >= 8; data = data[8:] {
+		h ^= xxh_round(0, binary.LittleEndian.Uint64(data))
+		h = bits.RotateLeft64(h, 27)*xxh_prime1 + xxh_prime4
+	}
+
+	if len(data) >= 4 {
+		h ^= uint64(binary.LittleEndian.Uint32(data)) * xxh_prime1
+		h = bits.RotateLeft64(h, 23)*xxh_prime2 + xxh_prime3
+		data = data[4:]
+	}
+
+	for _, b := range data {
+		h ^= uint64(b) * xxh_prime5
+		h = bits.RotateLeft64(h, 11) * xxh_prime1
+	}
+
+	h ^= h >> 33
+	h *= xxh_prime2
+	h ^= h >> 29
+	h *= xxh_prime3
+	h ^= h >> 32
+
+	return h
+}
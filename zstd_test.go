@@ -0,0 +1,157 @@
+package main
+
+import (
+	"bytes"
+	"encoding/hex"
+	"fmt"
+	"math/rand"
+	"os"
+	"os/exec"
+	"path/filepath"
+	"strings"
+	"testing"
+)
+
+// zstd_test_days returns a week of logfiles, as the frames below hold them.
+func zstd_test_days() string {
+	var sb strings.Builder
+
+	for d := 1; d < 8; d++ {
+		fmt.Fprintf(&sb, "> month: 04\n> day: %02d\n> year: 1998\n\n|> events\nwalked to the lake and back\n"+
+			"read the paper\n\n|> emotions\ncalm\n\n|> things to remember\ncall mom on sunday\n", d)
+	}
+
+	return sb.String()
+}
+
+func TestZstdFrames(t *testing.T) {
+	days := zstd_test_days()
+
+	// frames written by the reference zstd command line tool
+	tests := []struct {
+		name  string
+		frame string
+		want  string
+	}{
+		{"empty", "28b52ffd240001000099e9d851", ""},
+		{"raw block with checksum", "28b52ffd240f79000068656c6c6f2c206a6f75726e616c0a792912cb", "hello, journal\n"},
+		{"rle block", "28b52ffd64e80245000008610100e42b20042342da2e", strings.Repeat("a", 1000)},
+		{"compressed block with checksum",
+			"28b52ffd64130375040082c81a19706f0e445e7bd088284a5381f8ffb79c88f41afe4a7f7d180179180531086969eb497abff" +
+				"3e33bb80b2f2ffc8b979a7e9cc84e9994fa3df131dc48a3a60b136274796bfd42eabe4efc8b6f0b39ad528abdd49e5d9948" +
+				"920457a0ae75960170c5d276960470c589fdf82c0b202043651c3cc5088a455012415d04c522a604ccb47c2c54089a99e7e" +
+				"835a29bd53376", days},
+		{"compressed block without checksum",
+			"28b52ffd6013038d0400b2081c1d60356e03b0301abbf1b21b79aa4b444992e0a12d5415350638023894c205c2e01004ee4" +
+				"1b588f6e52bebd742e558269a9aecdc6f876596d685cab565a659593ae8284c768d82c9d5e2b3c1f55cfadc57d92c04b8d6" +
+				"9b897c0ab833208871c4309fa7338aa307d5d31dc5d1d2cbfa140a001da41201d44500c522809208a02e021433c6505253d" +
+				"0ace6397acd28", days},
+		{"skippable frame and two frames",
+			"502a4d1803000000abcdef" + "28b52ffd240f79000068656c6c6f2c206a6f75726e616c0a792912cb" +
+				"28b52ffd64e80245000008610100e42b20042342da2e", "hello, journal\n" + strings.Repeat("a", 1000)},
+	}
+
+	var d Zstd_Decoder
+
+	for _, test := range tests {
+		frame, _ := hex.DecodeString(test.frame)
+
+		got, err := d.Decode(nil, frame)
+		if err != nil || string(got) != test.want {
+			t.Errorf("%s: got %d bytes, %v, want %d bytes", test.name, len(got), err, len(test.want))
+		}
+
+		prefix, err := d.Decode([]byte("kept"), frame)
+		if err != nil || string(prefix) != "kept"+test.want {
+			t.Errorf("%s: decoding after a prefix: %v", test.name, err)
+		}
+
+		for cut := 1; cut < len(frame); cut += 1 + len(frame)/16 {
+			if _, err := d.Decode(nil, frame[:cut]); err == nil && test.want != "" {
+				t.Errorf("%s: frame cut after %d bytes decoded", test.name, cut)
+			}
+		}
+	}
+}
+
+func TestZstdCorrupt(t *testing.T) {
+	good, _ := hex.DecodeString("28b52ffd240f79000068656c6c6f2c206a6f75726e616c0a792912cb")
+
+	tests := []struct {
+		name   string
+		mutate func(frame []byte) []byte
+	}{
+		{"checksum", func(f []byte) []byte { f[len(f)-1] ^= 1; return f }},
+		{"content", func(f []byte) []byte { f[10] ^= 1; return f }},
+		{"magic", func(f []byte) []byte { f[0] ^= 1; return f }},
+		{"reserved block type", func(f []byte) []byte { f[6] |= 6; return f }},
+		{"trailing bytes", func(f []byte) []byte { return append(f, 1, 2) }},
+		{"dictionary", func(f []byte) []byte {
+			return append([]byte{0x28, 0xb5, 0x2f, 0xfd, 0x01, 0x00, 0x07}, f[5:]...)
+		}},
+	}
+
+	var d Zstd_Decoder
+
+	for _, test := range tests {
+		frame := test.mutate(append([]byte(nil), good...))
+		if got, err := d.Decode(nil, frame); err == nil {
+			t.Errorf("%s: decoded %q", test.name, got)
+		}
+	}
+}
+
+// TestZstdTool round-trips inputs of several kinds through the zstd command line tool, when it is
+// installed, at the levels that use the different block encodings.
+func TestZstdTool(t *testing.T) {
+	tool, err := exec.LookPath("zstd")
+	if err != nil {
+		t.Skip("zstd is not installed")
+	}
+
+	rng := rand.New(rand.NewSource(1))
+
+	random := make([]byte, 200<<10)
+	rng.Read(random)
+
+	var words strings.Builder
+	vocabulary := strings.Fields("the lake walked read paper calm call mom sunday journal coffee rain work late")
+	for words.Len() < 600<<10 {
+		words.WriteString(vocabulary[rng.Intn(len(vocabulary))])
+		if rng.Intn(8) == 0 {
+			words.WriteByte('\n')
+		} else {
+			words.WriteByte(' ')
+		}
+	}
+
+	inputs := map[string][]byte{
+		"days":     []byte(strings.Repeat(zstd_test_days(), 40)),
+		"random":   random,
+		"words":    []byte(words.String()),
+		"one byte": {'x'},
+	}
+
+	dir := t.TempDir()
+
+	var d Zstd_Decoder
+
+	for name, input := range inputs {
+		for _, level := range []string{"-1", "-3", "-9", "-19", "--fast=5"} {
+			path := filepath.Join(dir, "input")
+			if err := os.WriteFile(path, input, 0644); err != nil {
+				t.Fatal(err)
+			}
+
+			out, err := exec.Command(tool, "-q", "-f", "-c", level, path).Output()
+			if err != nil {
+				t.Fatalf("%s %s: %v", name, level, err)
+			}
+
+			got, err := d.Decode(nil, out)
+			if err != nil || !bytes.Equal(got, input) {
+				t.Errorf("%s at %s: got %d bytes, %v, want %d bytes", name, level, len(got), err, len(input))
+			}
+		}
+	}
+}